@@ -1,9 +1,17 @@
 #pragma once
 
+#if defined(_MSC_VER) || defined(__SSE2__)
+#define PLATFORM_HAS_SSE2
+#endif
+
 #if defined(_MSC_VER) || defined(__SSE3__)
 #define PLATFORM_HAS_SSE3
 #endif
 
+#if defined(__AVX2__)
+#define PLATFORM_HAS_AVX2
+#endif
+
 #if defined(_MSC_VER)
 #include <intrin.h>
 #else
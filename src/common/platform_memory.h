@@ -22,7 +22,8 @@ size_t
 getSystemPageSize();
 
 MapFileHandle
-createMemoryMappedFile(size_t size);
+createMemoryMappedFile(size_t size,
+                       bool hugePages = false);
 
 MapFileHandle
 openMemoryMappedFile(const std::string &path,
@@ -65,4 +66,19 @@ protectMemory(uintptr_t address,
               size_t size,
               ProtectFlags flags);
 
+/**
+ * Returns true if memory mapped files created with hugePages set can be
+ * backed by transparent huge pages.
+ */
+bool
+isHugePageMappingSupported();
+
+/**
+ * Advise the system to back a view of a memory mapped file created with
+ * hugePages set with huge pages, the view stays usable if this fails.
+ */
+bool
+adviseHugePages(uintptr_t address,
+                size_t size);
+
 } // namespace platform
@@ -0,0 +1,160 @@
+#include "log.h"
+#include "qoi_encoder.h"
+
+#include <array>
+#include <fstream>
+
+namespace qoi
+{
+
+static constexpr uint8_t OpIndex = 0x00;
+static constexpr uint8_t OpDiff = 0x40;
+static constexpr uint8_t OpLuma = 0x80;
+static constexpr uint8_t OpRun = 0xc0;
+static constexpr uint8_t OpRgb = 0xfe;
+static constexpr uint8_t OpRgba = 0xff;
+
+static constexpr auto HeaderSize = 14u;
+static constexpr auto MaxRunLength = 62u;
+static constexpr std::array<uint8_t, 8> EndMarker = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+struct Pixel
+{
+   uint8_t r, g, b, a;
+
+   bool operator==(const Pixel &other) const
+   {
+      return r == other.r && g == other.g && b == other.b && a == other.a;
+   }
+};
+
+static inline uint32_t
+pixelHash(const Pixel &px)
+{
+   return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+}
+
+static inline void
+writeU32BE(std::vector<uint8_t> &out,
+           uint32_t value)
+{
+   out.push_back(static_cast<uint8_t>(value >> 24));
+   out.push_back(static_cast<uint8_t>(value >> 16));
+   out.push_back(static_cast<uint8_t>(value >> 8));
+   out.push_back(static_cast<uint8_t>(value));
+}
+
+bool
+encode(uint32_t width,
+       uint32_t height,
+       const uint8_t *rgba,
+       std::vector<uint8_t> &out)
+{
+   if (!width || !height) {
+      return false;
+   }
+
+   auto numPixels = static_cast<size_t>(width) * height;
+   out.clear();
+   out.reserve(HeaderSize + numPixels * 5 + EndMarker.size());
+
+   out.push_back('q');
+   out.push_back('o');
+   out.push_back('i');
+   out.push_back('f');
+   writeU32BE(out, width);
+   writeU32BE(out, height);
+   out.push_back(4); // channels: RGBA
+   out.push_back(0); // colorspace: sRGB with linear alpha
+
+   auto index = std::array<Pixel, 64> { };
+   auto prev = Pixel { 0, 0, 0, 255 };
+   auto run = 0u;
+
+   for (auto i = size_t { 0 }; i < numPixels; ++i) {
+      auto px = Pixel {
+         rgba[i * 4 + 0],
+         rgba[i * 4 + 1],
+         rgba[i * 4 + 2],
+         rgba[i * 4 + 3],
+      };
+
+      if (px == prev) {
+         run++;
+
+         if (run == MaxRunLength || i + 1 == numPixels) {
+            out.push_back(static_cast<uint8_t>(OpRun | (run - 1)));
+            run = 0;
+         }
+
+         continue;
+      }
+
+      if (run) {
+         out.push_back(static_cast<uint8_t>(OpRun | (run - 1)));
+         run = 0;
+      }
+
+      auto hash = pixelHash(px);
+      if (index[hash] == px) {
+         out.push_back(static_cast<uint8_t>(OpIndex | hash));
+      } else {
+         index[hash] = px;
+
+         if (px.a == prev.a) {
+            auto dr = static_cast<int8_t>(px.r - prev.r);
+            auto dg = static_cast<int8_t>(px.g - prev.g);
+            auto db = static_cast<int8_t>(px.b - prev.b);
+            auto dgr = static_cast<int8_t>(dr - dg);
+            auto dgb = static_cast<int8_t>(db - dg);
+
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+               out.push_back(static_cast<uint8_t>(
+                  OpDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+            } else if (dgr >= -8 && dgr <= 7 && dg >= -32 && dg <= 31 && dgb >= -8 && dgb <= 7) {
+               out.push_back(static_cast<uint8_t>(OpLuma | (dg + 32)));
+               out.push_back(static_cast<uint8_t>(((dgr + 8) << 4) | (dgb + 8)));
+            } else {
+               out.push_back(OpRgb);
+               out.push_back(px.r);
+               out.push_back(px.g);
+               out.push_back(px.b);
+            }
+         } else {
+            out.push_back(OpRgba);
+            out.push_back(px.r);
+            out.push_back(px.g);
+            out.push_back(px.b);
+            out.push_back(px.a);
+         }
+      }
+
+      prev = px;
+   }
+
+   out.insert(out.end(), EndMarker.begin(), EndMarker.end());
+   return true;
+}
+
+bool
+writeFile(const std::string &filename,
+          uint32_t width,
+          uint32_t height,
+          const uint8_t *rgba)
+{
+   auto encoded = std::vector<uint8_t> { };
+   if (!encode(width, height, rgba, encoded)) {
+      return false;
+   }
+
+   std::ofstream out { filename, std::ofstream::binary };
+   if (!out.is_open()) {
+      gLog->error("Could not open {} for writing", filename);
+      return false;
+   }
+
+   out.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+   return true;
+}
+
+} // namespace qoi
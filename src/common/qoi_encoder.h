@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace qoi
+{
+
+/**
+ * Encodes a tightly packed 8 bit RGBA image using the "Quite OK Image"
+ * format, which is lossless and a lot cheaper to encode than PNG.
+ */
+bool
+encode(uint32_t width,
+       uint32_t height,
+       const uint8_t *rgba,
+       std::vector<uint8_t> &out);
+
+bool
+writeFile(const std::string &filename,
+          uint32_t width,
+          uint32_t height,
+          const uint8_t *rgba);
+
+} // namespace qoi
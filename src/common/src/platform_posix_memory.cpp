@@ -4,6 +4,7 @@
 
 #ifdef PLATFORM_POSIX
 #include <common/decaf_assert.h>
+#include <cstdio>
 #include <cstdlib>
 #include <errno.h>
 #include <fmt/core.h>
@@ -31,7 +32,7 @@ flagsToProt(ProtectFlags flags)
       return PROT_READ | PROT_WRITE | PROT_EXEC;
    case ProtectFlags::NoAccess:
    default:
-      return PROT_WRITE;
+      return PROT_NONE;
    }
 }
 
@@ -62,8 +63,27 @@ getSystemPageSize()
 
 
 MapFileHandle
-createMemoryMappedFile(size_t size)
+createMemoryMappedFile(size_t size,
+                       bool hugePages)
 {
+#if defined(PLATFORM_LINUX) && defined(MFD_CLOEXEC)
+   // Transparent huge pages only apply to shmem, which a memfd always is,
+   // whereas TMPDIR may well be on a real file system.
+   if (hugePages) {
+      auto fd = memfd_create("decaf", MFD_CLOEXEC);
+      if (fd == -1) {
+         gLog->warn("createMemoryMappedFile({}) memfd_create failed with error: {}",
+                    size, errno);
+      } else if (ftruncate64(fd, size) == -1) {
+         gLog->warn("createMemoryMappedFile({}) ftruncate64 failed with error: {}",
+                    size, errno);
+         close(fd);
+      } else {
+         return static_cast<MapFileHandle>(fd);
+      }
+   }
+#endif
+
    const char *tmpdir = getenv("TMPDIR");
    if (!tmpdir || !*tmpdir) {
       tmpdir = "/tmp";
@@ -160,7 +180,8 @@ mapViewOfFile(MapFileHandle handle,
       return nullptr;
    }
 
-   if (result != dst) {
+   // A null dst lets the system pick the address, like MapViewOfFileEx
+   if (dst && result != dst) {
       gLog->error("mapViewOfFile(offset: 0x{:X}, size: 0x{:X}, dst: {}) mmap returned unexpected address: {}",
                   offset, size, dst, result);
 
@@ -285,6 +306,56 @@ protectMemory(uintptr_t address,
    return true;
 }
 
+
+bool
+isHugePageMappingSupported()
+{
+#if defined(PLATFORM_LINUX) && defined(MADV_HUGEPAGE) && defined(MFD_CLOEXEC)
+   // The active shmem policy is the one in brackets, e.g. "always [advise] never"
+   auto file = fopen("/sys/kernel/mm/transparent_hugepage/shmem_enabled", "r");
+   if (!file) {
+      return false;
+   }
+
+   char buffer[128] = { 0 };
+   auto length = fread(buffer, 1, sizeof(buffer) - 1, file);
+   fclose(file);
+
+   auto text = std::string { buffer, length };
+   auto start = text.find('[');
+   auto end = text.find(']', start);
+   if (start == std::string::npos || end == std::string::npos) {
+      return false;
+   }
+
+   auto policy = text.substr(start + 1, end - start - 1);
+   return policy == "always" || policy == "within_size" ||
+          policy == "advise" || policy == "force";
+#else
+   return false;
+#endif
+}
+
+
+bool
+adviseHugePages(uintptr_t address,
+                size_t size)
+{
+#ifdef MADV_HUGEPAGE
+   auto baseAddress = reinterpret_cast<void *>(address);
+
+   if (madvise(baseAddress, size, MADV_HUGEPAGE) == -1) {
+      gLog->debug("adviseHugePages(address: 0x{:08X}, size: 0x{:X}) madvise failed with error: {}",
+                  address, size, errno);
+      return false;
+   }
+
+   return true;
+#else
+   return false;
+#endif
+}
+
 } // namespace platform
 
 #endif
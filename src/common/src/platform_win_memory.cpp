@@ -67,8 +67,12 @@ getSystemPageSize()
 
 
 MapFileHandle
-createMemoryMappedFile(size_t size)
+createMemoryMappedFile(size_t size,
+                       bool hugePages)
 {
+   // Large pages would need SEC_LARGE_PAGES and SeLockMemoryPrivilege, and
+   // can not be protected at the page granularity write tracking relies on.
+   static_cast<void>(hugePages);
    auto sizeLo = static_cast<DWORD>(size & 0xFFFFFFFFu);
    auto sizeHi = static_cast<DWORD>((size >> 32) & 0xFFFFFFFFu);
    auto handle = CreateFileMappingW(INVALID_HANDLE_VALUE,
@@ -282,6 +286,21 @@ protectMemory(uintptr_t address,
    return true;
 }
 
+
+bool
+isHugePageMappingSupported()
+{
+   return false;
+}
+
+
+bool
+adviseHugePages(uintptr_t address,
+                size_t size)
+{
+   return false;
+}
+
 } // namespace platform
 
 #endif
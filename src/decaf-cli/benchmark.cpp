@@ -0,0 +1,248 @@
+#include "benchmark.h"
+#include "config.h"
+#include "decafcli.h"
+
+#include <algorithm>
+#include <cmath>
+#include <common/platform.h>
+#include <fmt/format.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <libcpu/jit_stats.h>
+#include <libcpu/mmu.h>
+#include <libdecaf/decaf_debug_api.h>
+#include <libgpu/gpu_ringbuffer.h>
+
+#ifdef PLATFORM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+static uint64_t
+getPeakResidentSetSize()
+{
+#ifdef PLATFORM_WINDOWS
+   auto counters = PROCESS_MEMORY_COUNTERS { };
+   if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+      return 0;
+   }
+
+   return counters.PeakWorkingSetSize;
+#else
+   auto usage = rusage { };
+   if (getrusage(RUSAGE_SELF, &usage) != 0) {
+      return 0;
+   }
+
+#ifdef PLATFORM_APPLE
+   // macOS reports bytes, Linux reports kilobytes
+   return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+   return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static std::string
+escapeJson(const std::string &value)
+{
+   auto result = std::string { };
+   result.reserve(value.size());
+
+   for (auto c : value) {
+      switch (c) {
+      case '"':
+         result += "\\\"";
+         break;
+      case '\\':
+         result += "\\\\";
+         break;
+      case '\n':
+         result += "\\n";
+         break;
+      case '\r':
+         result += "\\r";
+         break;
+      case '\t':
+         result += "\\t";
+         break;
+      default:
+         if (static_cast<unsigned char>(c) < 0x20) {
+            result += fmt::format("\\u{:04x}", static_cast<unsigned>(c));
+         } else {
+            result += c;
+         }
+      }
+   }
+
+   return result;
+}
+
+static double
+toMilliseconds(std::chrono::nanoseconds value)
+{
+   return std::chrono::duration<double, std::milli> { value }.count();
+}
+
+/**
+ * Returns the upper bound of the histogram bucket containing the given
+ * percentile, clamped to the longest frame time seen.
+ */
+static std::chrono::nanoseconds
+getFrameTimePercentile(const decaf::debug::FrameStats &stats,
+                       double percentile)
+{
+   auto total = uint64_t { 0 };
+   for (auto count : stats.frameTimeHistogram) {
+      total += count;
+   }
+
+   if (!total) {
+      return std::chrono::nanoseconds { 0 };
+   }
+
+   auto target = static_cast<uint64_t>(std::ceil(percentile * total));
+   auto seen = uint64_t { 0 };
+
+   for (auto i = size_t { 0 }; i < stats.frameTimeHistogram.size(); ++i) {
+      seen += stats.frameTimeHistogram[i];
+
+      if (seen >= target) {
+         return std::min(stats.frameTimeBucketSize * static_cast<int64_t>(i + 1),
+                         stats.maxFrameTime);
+      }
+   }
+
+   return stats.maxFrameTime;
+}
+
+uint64_t
+getBenchmarkFrameCount()
+{
+   auto frameStats = decaf::debug::FrameStats { };
+   decaf::debug::sampleFrameStats(frameStats);
+   return frameStats.numFrames;
+}
+
+std::string
+sampleBenchmarkReport(const std::string &gamePath,
+                      std::chrono::steady_clock::duration elapsed,
+                      bool completed)
+{
+   auto jitStats = cpu::jit::JitStats { };
+   auto jitAvailable = cpu::jit::sampleStats(jitStats);
+
+   auto frameStats = decaf::debug::FrameStats { };
+   decaf::debug::sampleFrameStats(frameStats);
+
+   auto ipcStats = decaf::debug::IosIpcStats { };
+   decaf::debug::sampleIosIpcStats(ipcStats);
+
+   auto ringBufferStats = gpu::ringbuffer::sampleStats();
+
+   auto apertureStats = decaf::debug::TilingApertureStats { };
+   decaf::debug::sampleTilingApertureStats(apertureStats);
+
+   auto seconds = std::chrono::duration<double> { elapsed }.count();
+   auto perSecond = [&](double value) { return seconds > 0.0 ? value / seconds : 0.0; };
+
+   fmt::memory_buffer out;
+   auto inserter = std::back_inserter(out);
+   fmt::format_to(inserter, "{{\n");
+   fmt::format_to(inserter, "  \"game\": \"{}\",\n", escapeJson(gamePath));
+   fmt::format_to(inserter, "  \"gpu_driver\": \"{}\",\n", escapeJson(config::system::gpu_driver));
+   fmt::format_to(inserter, "  \"completed\": {},\n", completed);
+   fmt::format_to(inserter, "  \"duration_ms\": {:.3f},\n", seconds * 1000.0);
+   fmt::format_to(inserter, "  \"peak_rss_bytes\": {},\n", getPeakResidentSetSize());
+   fmt::format_to(inserter, "  \"huge_pages\": {},\n", cpu::isHugePagesEnabled());
+
+   fmt::format_to(inserter, "  \"frames\": {{\n");
+   fmt::format_to(inserter, "    \"presented\": {},\n", frameStats.numFrames);
+   fmt::format_to(inserter, "    \"fps\": {:.3f},\n", perSecond(static_cast<double>(frameStats.numFrames)));
+   fmt::format_to(inserter, "    \"frame_time_ms\": {{\n");
+   fmt::format_to(inserter, "      \"mean\": {:.3f},\n",
+                  frameStats.numFrames > 1 ?
+                     toMilliseconds(frameStats.totalFrameTime) / (frameStats.numFrames - 1) : 0.0);
+   fmt::format_to(inserter, "      \"p50\": {:.3f},\n", toMilliseconds(getFrameTimePercentile(frameStats, 0.50)));
+   fmt::format_to(inserter, "      \"p90\": {:.3f},\n", toMilliseconds(getFrameTimePercentile(frameStats, 0.90)));
+   fmt::format_to(inserter, "      \"p95\": {:.3f},\n", toMilliseconds(getFrameTimePercentile(frameStats, 0.95)));
+   fmt::format_to(inserter, "      \"p99\": {:.3f},\n", toMilliseconds(getFrameTimePercentile(frameStats, 0.99)));
+   fmt::format_to(inserter, "      \"max\": {:.3f}\n", toMilliseconds(frameStats.maxFrameTime));
+   fmt::format_to(inserter, "    }}\n");
+   fmt::format_to(inserter, "  }},\n");
+
+   fmt::format_to(inserter, "  \"jit\": {{\n");
+   fmt::format_to(inserter, "    \"enabled\": {},\n", jitAvailable);
+   fmt::format_to(inserter, "    \"compiled_blocks\": {},\n", jitStats.compiledBlocks.size());
+   fmt::format_to(inserter, "    \"compile_time_ms\": {:.3f},\n", toMilliseconds(jitStats.totalCompileTime));
+   fmt::format_to(inserter, "    \"code_cache_bytes\": {},\n", jitStats.usedCodeCacheSize);
+   fmt::format_to(inserter, "    \"data_cache_bytes\": {}\n", jitStats.usedDataCacheSize);
+   fmt::format_to(inserter, "  }},\n");
+
+   fmt::format_to(inserter, "  \"ring_buffer\": {{\n");
+   fmt::format_to(inserter, "    \"writes\": {},\n", ringBufferStats.numWrites);
+   fmt::format_to(inserter, "    \"reads\": {},\n", ringBufferStats.numReads);
+   fmt::format_to(inserter, "    \"bytes\": {},\n", ringBufferStats.numWordsWritten * 4);
+   fmt::format_to(inserter, "    \"bytes_per_second\": {:.1f}\n",
+                  perSecond(static_cast<double>(ringBufferStats.numWordsWritten * 4)));
+   fmt::format_to(inserter, "  }},\n");
+
+   fmt::format_to(inserter, "  \"tiling_apertures\": {{\n");
+   fmt::format_to(inserter, "    \"apertures\": {},\n", apertureStats.numApertures);
+   fmt::format_to(inserter, "    \"pages_allocated\": {},\n", apertureStats.numPagesAllocated);
+   fmt::format_to(inserter, "    \"pages_touched\": {},\n", apertureStats.numPagesTouched);
+   fmt::format_to(inserter, "    \"pages_dirty\": {}\n", apertureStats.numPagesDirty);
+   fmt::format_to(inserter, "  }},\n");
+
+   fmt::format_to(inserter, "  \"ipc\": {{\n");
+   fmt::format_to(inserter, "    \"requests\": {},\n", ipcStats.numRequests);
+   fmt::format_to(inserter, "    \"request_batches\": {},\n", ipcStats.numRequestBatches);
+   fmt::format_to(inserter, "    \"replies\": {},\n", ipcStats.numReplies);
+   fmt::format_to(inserter, "    \"reply_batches\": {},\n", ipcStats.numReplyBatches);
+   fmt::format_to(inserter, "    \"devices\": [");
+
+   for (auto i = size_t { 0 }; i < ipcStats.devices.size(); ++i) {
+      auto &device = ipcStats.devices[i];
+      auto meanLatency = std::chrono::nanoseconds { 0 };
+      if (device.numRequests) {
+         meanLatency = device.totalLatency / static_cast<int64_t>(device.numRequests);
+      }
+
+      fmt::format_to(inserter,
+                     "{}\n      {{ \"device\": \"{}\", \"requests\": {}, "
+                     "\"mean_latency_ms\": {:.3f}, \"max_latency_ms\": {:.3f} }}",
+                     i ? "," : "",
+                     escapeJson(device.device),
+                     device.numRequests,
+                     toMilliseconds(meanLatency),
+                     toMilliseconds(device.maxLatency));
+   }
+
+   fmt::format_to(inserter, "{}]\n", ipcStats.devices.empty() ? "" : "\n    ");
+   fmt::format_to(inserter, "  }}\n");
+   fmt::format_to(inserter, "}}\n");
+   return fmt::to_string(out);
+}
+
+bool
+writeBenchmarkReport(const std::string &report,
+                     const std::string &path)
+{
+   if (path.empty()) {
+      std::cout << report;
+      return true;
+   }
+
+   std::ofstream out { path, std::ofstream::binary };
+   if (!out.is_open()) {
+      gCliLog->error("Could not open {} to write benchmark report", path);
+      return false;
+   }
+
+   out << report;
+   return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+struct BenchmarkSettings
+{
+   bool enabled = false;
+
+   //! Stop once this many frames have been presented, 0 for no limit.
+   uint32_t frames = 0;
+
+   //! Stop after this many seconds, 0 for no limit.
+   uint32_t seconds = 0;
+
+   //! File to write the JSON report to, stdout when empty.
+   std::string reportPath;
+};
+
+uint64_t
+getBenchmarkFrameCount();
+
+std::string
+sampleBenchmarkReport(const std::string &gamePath,
+                      std::chrono::steady_clock::duration elapsed,
+                      bool completed);
+
+bool
+writeBenchmarkReport(const std::string &report,
+                     const std::string &path);
@@ -7,6 +7,7 @@ namespace system
 {
 
 int timeout_ms = 0;
+std::string gpu_driver = "null";
 
 } // namespace system
 
@@ -14,6 +15,7 @@ bool
 loadFrontendToml(const toml::table &config)
 {
    readValue(config, "system.timeout_ms", system::timeout_ms);
+   readValue(config, "system.gpu_driver", system::gpu_driver);
    return true;
 }
 
@@ -22,6 +24,7 @@ saveFrontendToml(toml::table &config)
 {
    auto system = config.insert("system", toml::table()).first->second.as_table();
    system->insert_or_assign("timeout_ms", system::timeout_ms);
+   system->insert_or_assign("gpu_driver", system::gpu_driver);
    return true;
 }
 
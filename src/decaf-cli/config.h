@@ -11,6 +11,10 @@ namespace system
 
 extern int timeout_ms;
 
+//! Graphics driver to run the game with, "null" or "vulkan".  The Vulkan
+//! driver renders headless so it can be used on machines without a display.
+extern std::string gpu_driver;
+
 } // namespace system
 
 bool
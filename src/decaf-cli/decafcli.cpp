@@ -9,12 +9,32 @@
 #include <thread>
 
 int
-DecafCLI::run(const std::string &gamePath)
+DecafCLI::run(const std::string &gamePath,
+              const BenchmarkSettings &benchmark)
 {
    int result = 0;
 
    // Setup drivers
-   decaf::setGraphicsDriver(gpu::createGraphicsDriver(gpu::GraphicsDriverType::Null));
+   auto graphicsDriver = static_cast<gpu::GraphicsDriver *>(nullptr);
+
+   if (config::system::gpu_driver == "vulkan") {
+      graphicsDriver = gpu::createGraphicsDriver(gpu::GraphicsDriverType::Vulkan);
+
+      if (graphicsDriver) {
+         // A default WindowSystemInfo is headless, scan-out is rendered offscreen
+         graphicsDriver->setWindowSystemInfo(gpu::WindowSystemInfo { });
+      } else {
+         gCliLog->error("Vulkan graphics driver is unavailable, using null driver");
+      }
+   } else if (config::system::gpu_driver != "null") {
+      gCliLog->error("Unknown graphics driver {}, using null driver", config::system::gpu_driver);
+   }
+
+   if (!graphicsDriver) {
+      graphicsDriver = gpu::createGraphicsDriver(gpu::GraphicsDriverType::Null);
+   }
+
+   decaf::setGraphicsDriver(graphicsDriver);
    decaf::setInputDriver(new decaf::NullInputDriver { });
 
    // Initialise emulator
@@ -28,23 +48,46 @@ DecafCLI::run(const std::string &gamePath)
          decaf::getGraphicsDriver()->run();
       } };
 
-   // Setup timeout stuff
-   std::atomic_bool running { true };
-   std::atomic_bool timedOut { false };
+   // The timeout and benchmark threads both want to stop the emulator, the
+   // first to claim the stop owns calling decaf::shutdown. The main thread
+   // claims it too once the emulator exits so the others wake up and leave.
+   enum class StopReason
+   {
+      None,
+      Exited,
+      Timeout,
+      Benchmark,
+   };
+
+   std::mutex stopMutex;
+   std::condition_variable stopCV;
+   auto stopReason = StopReason::None;
+
+   auto claimStop =
+      [&](StopReason reason) {
+         std::unique_lock<std::mutex> lock { stopMutex };
+         if (stopReason != StopReason::None) {
+            return false;
+         }
+
+         stopReason = reason;
+         stopCV.notify_all();
+         return true;
+      };
+
    std::thread timeoutThread;
-   std::condition_variable timeoutCV;
 
    if (config::system::timeout_ms) {
       auto timeout = std::chrono::system_clock::now() + std::chrono::milliseconds(config::system::timeout_ms);
 
       timeoutThread = std::thread {
          [&]() {
-            std::mutex timeoutMutex;
-            std::unique_lock<std::mutex> lock { timeoutMutex };
-            timeoutCV.wait_until(lock, timeout, [&]() { return !running.load(); });
+            {
+               std::unique_lock<std::mutex> lock { stopMutex };
+               stopCV.wait_until(lock, timeout, [&]() { return stopReason != StopReason::None; });
+            }
 
-            if (running) {
-               timedOut.store(true);
+            if (claimStop(StopReason::Timeout)) {
                decaf::shutdown();
             }
          } };
@@ -53,21 +96,75 @@ DecafCLI::run(const std::string &gamePath)
    // Start emulator
    decaf::start();
 
+   // Setup benchmark, once it reaches its frame or time limit we sample the
+   // report while the emulator is still running and then shut it down.
+   auto benchmarkStart = std::chrono::steady_clock::now();
+   auto benchmarkCompleted = false;
+   std::string benchmarkReport;
+   std::thread benchmarkThread;
+
+   if (benchmark.enabled) {
+      benchmarkThread = std::thread {
+         [&]() {
+            while (true) {
+               {
+                  std::unique_lock<std::mutex> lock { stopMutex };
+                  if (stopCV.wait_for(lock, std::chrono::milliseconds { 10 },
+                                      [&]() { return stopReason != StopReason::None; })) {
+                     break;
+                  }
+               }
+
+               auto elapsed = std::chrono::steady_clock::now() - benchmarkStart;
+               auto reachedFrames = benchmark.frames &&
+                  getBenchmarkFrameCount() >= benchmark.frames;
+               auto reachedTime = benchmark.seconds &&
+                  elapsed >= std::chrono::seconds { benchmark.seconds };
+
+               if ((reachedFrames || reachedTime) && claimStop(StopReason::Benchmark)) {
+                  benchmarkReport = sampleBenchmarkReport(gamePath, elapsed, true);
+                  benchmarkCompleted = true;
+                  decaf::shutdown();
+                  break;
+               }
+            }
+         } };
+   }
+
    // Wait until program completes
    result = decaf::waitForExit();
 
-   // If we didn't timeout, wakeup timeout thread
-   if (!timedOut.load()) {
-      running.store(false);
-      timeoutCV.notify_all();
-   } else {
+   // Wake the timeout and benchmark threads if they did not stop us
+   claimStop(StopReason::Exited);
+
+   if (timeoutThread.joinable()) {
+      timeoutThread.join();
+   }
+
+   if (benchmarkThread.joinable()) {
+      benchmarkThread.join();
+   }
+
+   auto timedOut = (stopReason == StopReason::Timeout);
+   if (timedOut) {
       gCliLog->error("Application exceeded maxmimum execution time of {}ms.", config::system::timeout_ms);
       result = -1;
    }
 
-   // Wait for timeout thread to exit
-   if (timeoutThread.joinable()) {
-      timeoutThread.join();
+   if (benchmark.enabled) {
+      if (!benchmarkCompleted) {
+         gCliLog->error("Application exited before the benchmark completed.");
+         benchmarkReport = sampleBenchmarkReport(gamePath,
+                                                 std::chrono::steady_clock::now() - benchmarkStart,
+                                                 false);
+         result = -1;
+      } else {
+         result = 0;
+      }
+
+      if (!writeBenchmarkReport(benchmarkReport, benchmark.reportPath)) {
+         result = -1;
+      }
    }
 
    // Wait for the GPU thread to exit
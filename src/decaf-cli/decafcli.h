@@ -1,4 +1,6 @@
 #pragma once
+#include "benchmark.h"
+
 #include <libdecaf/decaf.h>
 #include <string>
 #include <thread>
@@ -12,7 +14,8 @@ gCliLog;
 class DecafCLI
 {
 public:
-   int run(const std::string &gamePath);
+   int run(const std::string &gamePath,
+           const BenchmarkSettings &benchmark);
 
 private:
 };
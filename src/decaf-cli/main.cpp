@@ -45,7 +45,21 @@ getCommandLineParser()
                   value<std::string> {})
       .add_option("timeout_ms",
                   description { "How long to execute the game for before quitting." },
-                  value<uint32_t> {});
+                  value<uint32_t> {})
+      .add_option("gpu-driver",
+                  description { "Which graphics driver to use, null or vulkan (headless)." },
+                  value<std::string> {})
+      .add_option("benchmark",
+                  description { "Run the game as a benchmark and print a JSON performance report when it stops." })
+      .add_option("benchmark-frames",
+                  description { "Stop the benchmark after this many frames have been presented." },
+                  value<uint32_t> {})
+      .add_option("benchmark-seconds",
+                  description { "Stop the benchmark after this many seconds, defaults to 60 if no frame count is given." },
+                  value<uint32_t> {})
+      .add_option("benchmark-report",
+                  description { "Write the benchmark report to this file instead of stdout." },
+                  value<std::string> {});
 
    auto config_options = config::getExcmdGroups(parser);
 
@@ -148,6 +162,29 @@ start(excmd::parser &parser,
       config::system::timeout_ms = options.get<uint32_t>("timeout_ms");
    }
 
+   if (options.has("gpu-driver")) {
+      config::system::gpu_driver = options.get<std::string>("gpu-driver");
+   }
+
+   auto benchmark = BenchmarkSettings { };
+   benchmark.enabled = options.has("benchmark");
+
+   if (options.has("benchmark-frames")) {
+      benchmark.frames = options.get<uint32_t>("benchmark-frames");
+   }
+
+   if (options.has("benchmark-seconds")) {
+      benchmark.seconds = options.get<uint32_t>("benchmark-seconds");
+   }
+
+   if (options.has("benchmark-report")) {
+      benchmark.reportPath = options.get<std::string>("benchmark-report");
+   }
+
+   if (benchmark.enabled && !benchmark.frames && !benchmark.seconds) {
+      benchmark.seconds = 60;
+   }
+
    // Initialise libdecaf logger
    auto logFile = getPathBasename(gamePath);
    decaf::initialiseLogging(logFile);
@@ -171,7 +208,7 @@ start(excmd::parser &parser,
    }
 
    DecafCLI cli;
-   return cli.run(gamePath);
+   return cli.run(gamePath, benchmark);
 }
 
 int main(int argc, char **argv)
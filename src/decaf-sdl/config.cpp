@@ -38,6 +38,9 @@ bool dump_tv_frames = false;
 //! What directory to place dumped frames in.
 std::string dump_frames_dir = "frames";
 
+//! File format for dumped frames, tga or qoi.
+std::string dump_frames_format = "tga";
+
 } // namespace test
 
 void
@@ -219,6 +222,7 @@ loadFrontendToml(const toml::table &config)
    readValue(config, "test.dump_drc_frames", config::test::dump_drc_frames);
    readValue(config, "test.dump_tv_frames", config::test::dump_tv_frames);
    readValue(config, "test.dump_frames_dir", config::test::dump_frames_dir);
+   readValue(config, "test.dump_frames_format", config::test::dump_frames_format);
    return true;
 }
 
@@ -302,6 +306,7 @@ saveFrontendToml(toml::table &config)
    test->insert_or_assign("dump_drc_frames", config::test::dump_drc_frames);
    test->insert_or_assign("dump_tv_frames", config::test::dump_tv_frames);
    test->insert_or_assign("dump_frames_dir", config::test::dump_frames_dir);
+   test->insert_or_assign("dump_frames_format", config::test::dump_frames_format);
    return true;
 }
 
@@ -112,6 +112,9 @@ extern bool dump_tv_frames;
 //! What directory to place dumped frames in.
 extern std::string dump_frames_dir;
 
+//! File format for dumped frames, tga or qoi.
+extern std::string dump_frames_format;
+
 } // namespace test
 
 void
@@ -7,6 +7,7 @@
 #include <libgpu/gpu_graphicsdriver.h>
 #include <SDL_syswm.h>
 
+#include <filesystem>
 #include <iterator>
 #include <thread>
 
@@ -198,6 +199,23 @@ DecafSDL::run(const std::string &gamePath)
    // Start emulator
    decaf::start();
 
+   if (config::test::dump_tv_frames || config::test::dump_drc_frames) {
+      auto format = gpu::FrameCaptureFormat::Tga;
+      if (config::test::dump_frames_format == "qoi") {
+         format = gpu::FrameCaptureFormat::Qoi;
+      }
+
+      auto error = std::error_code { };
+      std::filesystem::create_directories(config::test::dump_frames_dir, error);
+
+      auto prefix = (std::filesystem::path { config::test::dump_frames_dir } / "frame_").string();
+      if (!mGraphicsDriver->startFrameCapture(prefix, format,
+                                              config::test::dump_tv_frames,
+                                              config::test::dump_drc_frames)) {
+         gCliLog->warn("Frame capture is not supported by this graphics driver");
+      }
+   }
+
    auto event = SDL_Event { };
    while (!shouldQuit && !decaf::stopping() && SDL_WaitEvent(&event)) {
       switch (event.type) {
@@ -254,6 +272,12 @@ DecafSDL::run(const std::string &gamePath)
    // Shut down decaf
    decaf::shutdown();
 
+   // Finish writing any captured frames while the graphics driver is running
+   if (config::test::dump_tv_frames || config::test::dump_drc_frames) {
+      auto numFrames = mGraphicsDriver->stopFrameCapture();
+      gCliLog->info("Dumped {} frames to {}", numFrames, config::test::dump_frames_dir);
+   }
+
    // Shut down graphics
    mGraphicsDriver->stop();
    mGraphicsThread.join();
@@ -82,7 +82,13 @@ getCommandLineParser()
                   description { "Dump rendered TV frames to file." })
       .add_option("dump-frames-dir",
                   description { "Folder to place dumped frames in" },
-                  make_default_value(config::test::dump_frames_dir));
+                  make_default_value(config::test::dump_frames_dir))
+      .add_option("dump-frames-format",
+                  description { "File format for dumped frames." },
+                  allowed<std::string> { {
+                     "tga", "qoi"
+                  } },
+                  make_default_value(config::test::dump_frames_format));
 
    auto config_options = config::getExcmdGroups(parser);
 
@@ -208,6 +214,10 @@ start(excmd::parser &parser,
       config::test::dump_frames_dir = options.get<std::string>("dump-frames-dir");
    }
 
+   if (options.has("dump-frames-format")) {
+      config::test::dump_frames_format = options.get<std::string>("dump-frames-format");
+   }
+
    // Initialise libdecaf logger
    auto logFile = getPathBasename(target);
    decaf::initialiseLogging(logFile);
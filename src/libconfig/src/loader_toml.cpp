@@ -104,6 +104,7 @@ loadFromTOML(const toml::table &config,
              cpu::Settings &cpuSettings)
 {
    readValue(config, "mem.writetrack", cpuSettings.memory.writeTrackEnabled);
+   readValue(config, "mem.huge_pages", cpuSettings.memory.hugePagesEnabled);
 
    readValue(config, "jit.enabled", cpuSettings.jit.enabled);
    readValue(config, "jit.verify", cpuSettings.jit.verify);
@@ -161,6 +162,7 @@ loadFromTOML(const toml::table &config,
    readValue(config, "system.time_scale", decafSettings.system.time_scale);
    readArray(config, "system.lle_modules", decafSettings.system.lle_modules);
    readValue(config, "system.dump_hle_rpl", decafSettings.system.dump_hle_rpl);
+   readValue(config, "system.rpl_cache_path", decafSettings.system.rpl_cache_path);
    readArray(config, "system.title_directories", decafSettings.system.title_directories);
    return true;
 }
@@ -172,6 +174,10 @@ loadFromTOML(const toml::table &config,
    readValue(config, "gpu.debug", gpuSettings.debug.debug_enabled);
    readValue(config, "gpu.dump_shaders", gpuSettings.debug.dump_shaders);
    readValue(config, "gpu.dump_shader_binaries_only", gpuSettings.debug.dump_shader_binaries_only);
+   readValue(config, "gpu.optimize_shaders", gpuSettings.debug.optimize_shaders);
+   readValue(config, "gpu.validate_optimized_shaders", gpuSettings.debug.validate_optimized_shaders);
+   readValue(config, "gpu.cache_display_lists", gpuSettings.debug.cache_display_lists);
+   readValue(config, "gpu.pm4_decode_thread", gpuSettings.debug.pm4_decode_thread);
 
    auto display = config.get_as<toml::table>("display");
    if (display) {
@@ -218,6 +224,10 @@ bool
 saveToTOML(toml::table &config,
            const cpu::Settings &cpuSettings)
 {
+   auto mem = config.insert("mem", toml::table()).first->second.as_table();
+   mem->insert_or_assign("writetrack", cpuSettings.memory.writeTrackEnabled);
+   mem->insert_or_assign("huge_pages", cpuSettings.memory.hugePagesEnabled);
+
    auto jit = config.insert("jit", toml::table()).first->second.as_table();
    jit->insert_or_assign("enabled", cpuSettings.jit.enabled);
    jit->insert_or_assign("verify", cpuSettings.jit.verify);
@@ -291,6 +301,7 @@ saveToTOML(toml::table &config,
    system->insert_or_assign("slc_path", decafSettings.system.slc_path);
    system->insert_or_assign("content_path", decafSettings.system.content_path);
    system->insert_or_assign("time_scale", decafSettings.system.time_scale);
+   system->insert_or_assign("rpl_cache_path", decafSettings.system.rpl_cache_path);
 
    auto lle_modules = toml::array();
    for (auto &name : decafSettings.system.lle_modules) {
@@ -315,6 +326,10 @@ saveToTOML(toml::table &config,
    gpu->insert_or_assign("debug", gpuSettings.debug.debug_enabled);
    gpu->insert_or_assign("dump_shaders", gpuSettings.debug.dump_shaders);
    gpu->insert_or_assign("dump_shader_binaries_only", gpuSettings.debug.dump_shader_binaries_only);
+   gpu->insert_or_assign("optimize_shaders", gpuSettings.debug.optimize_shaders);
+   gpu->insert_or_assign("validate_optimized_shaders", gpuSettings.debug.validate_optimized_shaders);
+   gpu->insert_or_assign("cache_display_lists", gpuSettings.debug.cache_display_lists);
+   gpu->insert_or_assign("pm4_decode_thread", gpuSettings.debug.pm4_decode_thread);
 
    // display
    auto display = config.insert("display", toml::table()).first->second.as_table();
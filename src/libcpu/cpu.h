@@ -27,6 +27,7 @@ static const uint32_t CALLBACK_ADDR = 0xFBADCDE0;
 using EntrypointHandler = std::function<void(Core *core)>;
 using InterruptHandler = void (*)(Core *core, uint32_t interrupt_flags);
 using SegfaultHandler = void(*)(Core *core, uint32_t address, platform::StackTrace *hostStackTrace);
+using AccessFaultHandler = bool(*)(uint32_t address);
 using BranchTraceHandler = void(*)(Core *core, uint32_t target);
 using SystemCallHandler = Core * (*)(Core *core, uint32_t id);
 
@@ -42,6 +43,14 @@ setInterruptHandler(InterruptHandler handler);
 void
 setSegfaultHandler(SegfaultHandler handler);
 
+/**
+ * Called on any host thread for an access violation inside guest virtual
+ * memory before it is raised as a segfault, return true when the fault has
+ * been resolved and the access should be retried.
+ */
+void
+setAccessFaultHandler(AccessFaultHandler handler);
+
 void
 setBranchTraceHandler(BranchTraceHandler handler);
 
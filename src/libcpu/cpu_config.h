@@ -47,6 +47,9 @@ struct MemorySettings
 {
    //! Whether page guards for write tracking is enabled or not.
    bool writeTrackEnabled = false;
+
+   //! Back MEM1 and MEM2 with transparent huge pages where available.
+   bool hugePagesEnabled = false;
 };
 
 struct Settings
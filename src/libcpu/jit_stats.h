@@ -1,6 +1,7 @@
 #pragma once
 #include <array>
 #include <atomic>
+#include <chrono>
 #include <common/platform.h>
 #include <cstdint>
 #include <gsl/gsl-lite.hpp>
@@ -65,6 +66,10 @@ struct JitStats
    uint64_t totalTimeInCodeBlocks = 0;
    uint64_t usedCodeCacheSize = 0;
    uint64_t usedDataCacheSize = 0;
+
+   //! Host time spent translating code blocks, including failed attempts.
+   std::chrono::nanoseconds totalCompileTime { 0 };
+
    gsl::span<CodeBlock> compiledBlocks;
 };
 
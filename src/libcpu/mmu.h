@@ -98,6 +98,10 @@ bool
 virtualToPhysicalAddress(VirtualAddress virtualAddress,
                          PhysicalAddress &out);
 
+//! Returns true if MEM1 and MEM2 ended up backed by transparent huge pages.
+bool
+isHugePagesEnabled();
+
 template<typename Type>
 inline VirtualAddress
 translate(Type *pointer)
@@ -156,6 +156,12 @@ setSegfaultHandler(SegfaultHandler handler)
    internal::setUserSegfaultHandler(handler);
 }
 
+void
+setAccessFaultHandler(AccessFaultHandler handler)
+{
+   internal::setAccessFaultHandler(handler);
+}
+
 void
 setBranchTraceHandler(BranchTraceHandler handler)
 {
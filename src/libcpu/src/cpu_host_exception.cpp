@@ -1,5 +1,6 @@
 #include "cpu.h"
 
+#include <atomic>
 #include <common/decaf_assert.h>
 #include <common/platform_exception.h>
 #include <common/platform_stacktrace.h>
@@ -12,6 +13,7 @@ namespace cpu::internal
 static thread_local uint32_t sSegfaultAddr = 0;
 static thread_local platform::StackTrace *sSegfaultStackTrace = nullptr;
 static SegfaultHandler sUserSegfaultHandler = nullptr;
+static std::atomic<AccessFaultHandler> sAccessFaultHandler { nullptr };
 
 static void
 coreSegfaultEntry()
@@ -59,11 +61,6 @@ hostExceptionHandler(platform::Exception *exception)
       return platform::UnhandledException;
    }
 
-   // Only handle exceptions from the CPU cores
-   if (this_core::id() >= 0xFF) {
-      return platform::UnhandledException;
-   }
-
    // Retreive the exception information
    auto info = reinterpret_cast<platform::AccessViolationException *>(exception);
    auto address = info->address;
@@ -74,6 +71,19 @@ hostExceptionHandler(platform::Exception *exception)
       return platform::UnhandledException;
    }
 
+   // Give the access fault handler a chance to resolve faults on memory it
+   // protects itself, this may happen on any thread which touches guest memory
+   auto accessFaultHandler = sAccessFaultHandler.load();
+   if (address != 0 && accessFaultHandler &&
+       accessFaultHandler(static_cast<uint32_t>(address - memBase))) {
+      return platform::HandledException;
+   }
+
+   // Only handle exceptions from the CPU cores
+   if (this_core::id() >= 0xFF) {
+      return platform::UnhandledException;
+   }
+
    sSegfaultAddr = static_cast<uint32_t>(address - memBase);
    sSegfaultStackTrace = platform::captureStackTrace();
    return coreSegfaultEntry;
@@ -94,4 +104,10 @@ setUserSegfaultHandler(SegfaultHandler userHandler)
    sUserSegfaultHandler = userHandler;
 }
 
+void
+setAccessFaultHandler(AccessFaultHandler handler)
+{
+   sAccessFaultHandler = handler;
+}
+
 } // namespace cpu::internal
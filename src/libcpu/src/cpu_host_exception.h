@@ -10,4 +10,7 @@ installHostExceptionHandler();
 void
 setUserSegfaultHandler(SegfaultHandler userHandler);
 
+void
+setAccessFaultHandler(AccessFaultHandler handler);
+
 } // namespace cpu::internal
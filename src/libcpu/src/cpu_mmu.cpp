@@ -100,4 +100,10 @@ virtualToPhysicalAddress(VirtualAddress virtualAddress,
    return sMemoryMap.virtualToPhysicalAddress(virtualAddress, out);
 }
 
+bool
+isHugePagesEnabled()
+{
+   return sMemoryMap.isHugePagesEnabled();
+}
+
 } // namespace cpu
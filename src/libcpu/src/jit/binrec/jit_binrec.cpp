@@ -263,6 +263,7 @@ BinrecBackend::getCodeBlock(BinrecCore *core, uint32_t address)
    auto limit = 4096u;
    auto size = long { 0 };
    void *buffer = nullptr;
+   auto compileStart = std::chrono::steady_clock::now();
 
    while (!handle->translate(core, address, address + limit - 1, &buffer, &size)) {
       limit /= 2;
@@ -270,10 +271,17 @@ BinrecBackend::getCodeBlock(BinrecCore *core, uint32_t address)
       if (limit < 256) {
          gLog->warn("Failed to translate code at 0x{:X}", address);
          indexPtr->store(CodeBlockIndexError);
+         mTotalCompileTimeNs += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - compileStart).count());
          return nullptr;
       }
    }
 
+   mTotalCompileTimeNs += static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now() - compileStart).count());
+
 #ifdef PLATFORM_WINDOWS
    // First 8 bytes of buffer is offset to start of code
    auto codeOffset = *reinterpret_cast<uint64_t *>(buffer);
@@ -418,6 +426,7 @@ BinrecBackend::sampleStats(JitStats &stats)
    stats.compiledBlocks = mCodeCache.getCompiledCodeBlocks();
    stats.usedCodeCacheSize = mCodeCache.getCodeCacheSize();
    stats.usedDataCacheSize = mCodeCache.getDataCacheSize();
+   stats.totalCompileTime = std::chrono::nanoseconds { mTotalCompileTimeNs.load() };
    return true;
 }
 
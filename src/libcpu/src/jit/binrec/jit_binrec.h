@@ -136,6 +136,7 @@ private:
    BinrecOptimisationFlags mOptFlags;
    std::vector<std::pair<ppcaddr_t, uint32_t>> mReadOnlyRanges;
    std::atomic<uint64_t> mTotalProfileTime { 0 };
+   std::atomic<uint64_t> mTotalCompileTimeNs { 0 };
    uint32_t mProfilingMask = 0;
    bool mVerifyEnabled = false;
    uint32_t mVerifyAddress = 0;
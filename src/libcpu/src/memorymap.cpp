@@ -1,3 +1,4 @@
+#include "cpu_config.h"
 #include "memorymap.h"
 
 #include <algorithm>
@@ -98,8 +99,19 @@ MemoryMap::reserve()
       return false;
    }
 
+   // MEM1 and MEM2 are accessed randomly by both the JIT and HLE code, so
+   // back them with huge pages to reduce TLB misses when requested.
+   mHugePages = false;
+   if (config()->memory.hugePagesEnabled) {
+      mHugePages = platform::isHugePageMappingSupported();
+
+      if (!mHugePages) {
+         gLog->warn("Huge pages were requested but transparent huge pages are not available for shared memory");
+      }
+   }
+
    // Commit MEM1
-   mMem1 = platform::createMemoryMappedFile(MEM1Size);
+   mMem1 = platform::createMemoryMappedFile(MEM1Size, mHugePages);
    if (mMem1 == platform::InvalidMapFileHandle) {
       gLog->error("Unable to create MEM1 mapping");
       free();
@@ -107,7 +119,7 @@ MemoryMap::reserve()
    }
 
    // Commit MEM2
-   mMem2 = platform::createMemoryMappedFile(MEM2Size);
+   mMem2 = platform::createMemoryMappedFile(MEM2Size, mHugePages);
    if (mMem2 == platform::InvalidMapFileHandle) {
       gLog->error("Unable to create MEM2 mapping");
       free();
@@ -226,6 +238,20 @@ MemoryMap::reserve()
       return false;
    }
 
+   if (mHugePages) {
+      // If the advice is rejected we keep going with normal pages
+      mHugePages =
+         platform::adviseHugePages(reinterpret_cast<uintptr_t>(ptrMem1), MEM1Size) &&
+         platform::adviseHugePages(reinterpret_cast<uintptr_t>(ptrMem2), MEM2Size);
+   }
+
+   if (mHugePages) {
+      gLog->info("MEM1 and MEM2 are backed by transparent huge pages");
+   } else {
+      gLog->info("MEM1 and MEM2 are backed by {} KiB pages",
+                 platform::getSystemPageSize() / 1024);
+   }
+
    return true;
 }
 
@@ -369,6 +395,13 @@ MemoryMap::queryPhysicalAddress(PhysicalAddress physicalAddress)
 }
 
 
+bool
+MemoryMap::isHugePagesEnabled() const
+{
+   return mHugePages;
+}
+
+
 bool
 MemoryMap::virtualToPhysicalAddress(VirtualAddress virtualAddress,
                                     PhysicalAddress &out)
@@ -644,6 +677,13 @@ MemoryMap::mapMemory(VirtualAddress virtualAddress,
       return false;
    }
 
+   if (mHugePages && (physicalMemoryType == PhysicalMemoryType::MEM1 ||
+                      physicalMemoryType == PhysicalMemoryType::MEM2)) {
+      // Only the 2 MiB aligned parts of the view can actually use huge pages,
+      // the virtual and physical addresses are congruent for the usual maps.
+      platform::adviseHugePages(reinterpret_cast<uintptr_t>(virtualPtr), size);
+   }
+
    return true;
 }
 
@@ -79,6 +79,9 @@ public:
    VirtualMemoryType
    queryVirtualAddress(VirtualAddress virtualAddress);
 
+   bool
+   isHugePagesEnabled() const;
+
 private:
    uintptr_t reserveBaseAddress();
 
@@ -105,6 +108,9 @@ private:
    platform::MapFileHandle mLockedCache = platform::InvalidMapFileHandle;
    platform::MapFileHandle mTilingAperture = platform::InvalidMapFileHandle;
 
+   //! Whether MEM1 and MEM2 are backed by transparent huge pages.
+   bool mHugePages = false;
+
    uintptr_t mVirtualBase = 0;
    uintptr_t mPhysicalBase = 0;
    std::vector<VirtualMemoryMap> mMappedMemory;
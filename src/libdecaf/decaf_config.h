@@ -81,6 +81,9 @@ struct SystemSettings
    double time_scale = 1.0;
    std::vector<std::string> lle_modules;
    bool dump_hle_rpl = false; // TODO: Move this to a debug api command?
+
+   //! Directory to cache relocated RPL images in, empty disables the cache.
+   std::string rpl_cache_path = "";
 };
 
 struct Settings
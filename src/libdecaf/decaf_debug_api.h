@@ -302,6 +302,107 @@ struct CafeVoice
    bool loopingEnabled;
 };
 
+struct IosWorkerStats
+{
+   //! Number of host threads servicing IOS worker tasks.
+   uint32_t numThreads = 0;
+
+   //! Number of tasks submitted but not yet completed.
+   uint32_t queueDepth = 0;
+
+   //! Highest queueDepth seen since IOS started.
+   uint32_t peakQueueDepth = 0;
+
+   //! Total number of tasks submitted.
+   uint64_t tasksSubmitted = 0;
+
+   //! Total number of tasks completed.
+   uint64_t tasksCompleted = 0;
+
+   //! Sum of submit to completion latency of all completed tasks.
+   std::chrono::nanoseconds totalLatency { 0 };
+
+   //! Highest submit to completion latency of a single task.
+   std::chrono::nanoseconds maxLatency { 0 };
+};
+
+struct IosIpcDeviceStats
+{
+   //! Name of the IOS device, e.g. /dev/fsa
+   std::string device;
+
+   //! Number of requests to this device which have been replied to, sample
+   //! twice to derive a request rate.
+   uint64_t numRequests = 0;
+
+   //! Sum of PPC submit to reply delivery latency of all requests.
+   std::chrono::nanoseconds totalLatency { 0 };
+
+   //! Highest PPC submit to reply delivery latency of a single request.
+   std::chrono::nanoseconds maxLatency { 0 };
+};
+
+struct IosIpcStats
+{
+   //! Total number of requests submitted from PPC to IOS.
+   uint64_t numRequests = 0;
+
+   //! Number of times the IOS IPC thread woke up to process requests.
+   uint64_t numRequestBatches = 0;
+
+   //! Highest number of requests processed in a single wakeup.
+   uint32_t maxRequestBatchSize = 0;
+
+   //! Total number of replies delivered from IOS to PPC.
+   uint64_t numReplies = 0;
+
+   //! Number of PPC IPC interrupts which delivered replies.
+   uint64_t numReplyBatches = 0;
+
+   //! Highest number of replies delivered by a single interrupt.
+   uint32_t maxReplyBatchSize = 0;
+
+   std::vector<IosIpcDeviceStats> devices;
+};
+
+struct FrameStats
+{
+   //! Number of frames presented by the game with GX2SwapScanBuffers.
+   uint64_t numFrames = 0;
+
+   //! Sum of the host time between consecutive frames.
+   std::chrono::nanoseconds totalFrameTime { 0 };
+
+   //! Longest host time between two consecutive frames.
+   std::chrono::nanoseconds maxFrameTime { 0 };
+
+   //! Width of each frameTimeHistogram bucket.
+   std::chrono::nanoseconds frameTimeBucketSize { 0 };
+
+   //! Number of frames which took each bucket's worth of host time, the last
+   //! bucket also counts every frame longer than it.
+   std::vector<uint64_t> frameTimeHistogram;
+};
+
+struct TilingApertureStats
+{
+   //! Number of tiled apertures allocated with GX2AllocateTilingApertureEx.
+   uint64_t numApertures = 0;
+
+   //! Host pages of tiled apertures which were left to be untiled on access.
+   uint64_t numPagesAllocated = 0;
+
+   //! Host pages which were accessed and so had to be untiled.
+   uint64_t numPagesTouched = 0;
+
+   //! Host pages which were written to and so were retiled on free.
+   uint64_t numPagesDirty = 0;
+
+   //! Rows of macro tiles which were untiled and retiled.
+   uint64_t numRowsUntiled = 0;
+   uint64_t numRowsRetiled = 0;
+};
+
 enum class Pm4CaptureState
 {
    Disabled,
@@ -335,6 +436,14 @@ bool sampleCafeRunningThread(int coreId, CafeThread &info);
 bool sampleCafeThreads(std::vector<CafeThread> &threads);
 bool sampleCafeVoices(std::vector<CafeVoice> &voiceInfos);
 
+// IOS
+bool sampleIosWorkerStats(IosWorkerStats &stats);
+bool sampleIosIpcStats(IosIpcStats &stats);
+
+// GX2
+bool sampleFrameStats(FrameStats &stats);
+bool sampleTilingApertureStats(TilingApertureStats &stats);
+
 // pm4 capture
 Pm4CaptureState pm4CaptureState();
 bool pm4CaptureNextFrame();
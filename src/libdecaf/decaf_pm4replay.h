@@ -1,7 +1,11 @@
 #pragma once
 #include <array>
 #include <cstdint>
+#include <common/platform_memory.h>
 #include <libcpu/be2_struct.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace decaf::pm4
 {
@@ -13,6 +17,29 @@ static const std::array<char, 4> CaptureMagic =
    'D', 'P', 'M', '4'
 };
 
+/*
+Version 2 captures start with CaptureMagicV2 and a CaptureFileHeader. The
+contents of command buffers and memory loads are stored once per unique
+content as MemoryBlock packets, the CommandBuffer and MemoryLoad packets
+then refer to them with a CaptureBlockRef. A MemoryBlock always appears
+in the file before the first packet referring to it.
+
+A Frame packet is written at the start of every captured frame. When the
+capture is stopped an index of all frames and blocks is appended to the
+file, a capture which was not stopped cleanly has an indexOffset of 0 and
+the index is rebuilt by scanning the packets.
+*/
+static const std::array<char, 4> CaptureMagicV2 =
+{
+   'D', 'P', 'M', '2'
+};
+
+struct CaptureFileHeader
+{
+   //! Offset of the CaptureIndexHeader, 0 if there is no index.
+   uint64_t indexOffset;
+};
+
 struct CapturePacket
 {
    enum Type : uint32_t
@@ -22,6 +49,8 @@ struct CapturePacket
       MemoryLoad,
       RegisterSnapshot,
       SetBuffer,
+      MemoryBlock,
+      Frame,
    };
 
    Type type;
@@ -29,6 +58,47 @@ struct CapturePacket
    uint64_t timestamp;
 };
 
+//! Followed by the block data, stored as described by compression.
+struct CaptureMemoryBlock
+{
+   enum Compression : uint32_t
+   {
+      None,
+      Zlib,
+   };
+
+   uint64_t hash;
+   uint32_t size;
+   Compression compression;
+};
+
+struct CaptureBlockRef
+{
+   uint64_t hash;
+   uint32_t size;
+};
+
+//! Followed by numFrames CaptureFrameIndexEntry then numBlocks CaptureBlockIndexEntry.
+struct CaptureIndexHeader
+{
+   uint32_t numFrames;
+   uint32_t numBlocks;
+};
+
+struct CaptureFrameIndexEntry
+{
+   //! Offset of the Frame packet.
+   uint64_t offset;
+   uint64_t timestamp;
+};
+
+struct CaptureBlockIndexEntry
+{
+   uint64_t hash;
+   //! Offset of the MemoryBlock packet.
+   uint64_t offset;
+};
+
 struct CaptureMemoryLoad
 {
    enum MemoryType : uint32_t
@@ -73,4 +143,102 @@ struct CaptureSetBuffer
 
 #pragma pack(pop)
 
+/**
+ * Reads packets from a memory mapped capture file of either version.
+ *
+ * Packet data points either directly into the mapped file or into blocks
+ * decompressed on first use, which are kept until the reader is closed.
+ */
+class CaptureReader
+{
+public:
+   struct Packet
+   {
+      CapturePacket::Type type;
+      uint64_t timestamp;
+
+      //! Offset of the packet in the file, can be passed to seek.
+      size_t offset;
+
+      //! The load header for MemoryLoad packets, zeroed otherwise.
+      CaptureMemoryLoad memoryLoad;
+
+      //! The packet contents, for MemoryLoad the memory being loaded.
+      const uint8_t *data;
+      uint32_t size;
+   };
+
+   struct Frame
+   {
+      size_t offset;
+      uint64_t timestamp;
+   };
+
+   CaptureReader() = default;
+   CaptureReader(const CaptureReader &) = delete;
+   CaptureReader &operator=(const CaptureReader &) = delete;
+   ~CaptureReader();
+
+   bool
+   open(const std::string &path);
+
+   void
+   close();
+
+   unsigned
+   version() const
+   {
+      return mVersion;
+   }
+
+   //! Frame start offsets, only version 2 captures record these.
+   const std::vector<Frame> &
+   frames() const
+   {
+      return mFrames;
+   }
+
+   //! Read the next packet, MemoryBlock packets are skipped over.
+   bool
+   next(Packet &packet);
+
+   void
+   seek(size_t offset);
+
+   void
+   rewind();
+
+private:
+   template<typename Type>
+   bool
+   readStruct(size_t offset,
+              size_t end,
+              Type &out) const;
+
+   bool
+   readIndex(uint64_t offset);
+
+   void
+   scanIndex();
+
+   const uint8_t *
+   getBlock(const CaptureBlockRef &ref);
+
+private:
+   platform::MapFileHandle mHandle = platform::InvalidMapFileHandle;
+   const uint8_t *mView = nullptr;
+   size_t mSize = 0;
+   size_t mDataStart = 0;
+   size_t mDataEnd = 0;
+   size_t mPosition = 0;
+   unsigned mVersion = 0;
+   std::vector<Frame> mFrames;
+
+   //! Offset of the MemoryBlock packet for each block hash.
+   std::unordered_map<uint64_t, size_t> mBlocks;
+
+   //! Decompressed contents of compressed blocks.
+   std::unordered_map<uint64_t, std::vector<uint8_t>> mBlockCache;
+};
+
 } // namespace decaf::pm4
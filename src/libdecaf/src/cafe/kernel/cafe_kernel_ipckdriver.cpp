@@ -193,6 +193,9 @@ ipckDriverLoaderPollCompletion()
 
 /**
  * Submit an IPC reply from IOS.
+ *
+ * Replies are batched per core, only the first reply after the interrupt
+ * handler has taken the previous batch raises a new interrupt.
  */
 void
 ipckDriverIosSubmitReply(phys_ptr<ios::IpcRequest> reply)
@@ -200,10 +203,13 @@ ipckDriverIosSubmitReply(phys_ptr<ios::IpcRequest> reply)
    auto coreId = reply->cpuId - ios::CpuId::PPC0;
 
    sIpcMutex.lock();
+   auto wasEmpty = sPendingResponses[coreId].empty();
    sPendingResponses[coreId].push_back(reply);
    sIpcMutex.unlock();
 
-   cpu::interrupt(coreId, cpu::IPC_INTERRUPT);
+   if (wasEmpty) {
+      cpu::interrupt(coreId, cpu::IPC_INTERRUPT);
+   }
 }
 
 
@@ -593,8 +599,12 @@ ipckDriverHandleInterrupt(InterruptType type,
    sIpcMutex.unlock();
 
    // Process replies into process queue
-   for (auto response : responses) {
-      processReply(driver, response);
+   if (!responses.empty()) {
+      for (auto response : responses) {
+         processReply(driver, response);
+      }
+
+      ios::kernel::internal::completeIpcReplies(responses);
    }
 
    // Dispatch any pending user replies for the current process
@@ -1,6 +1,7 @@
 #include "cafe_kernel_loader.h"
 #include "cafe_kernel_mmu.h"
 #include "cafe_kernel_process.h"
+#include "cafe_kernel_symbolindex.h"
 
 #include "cafe/loader/cafe_loader_entry.h"
 #include "cafe/loader/cafe_loader_globals.h"
@@ -273,84 +274,10 @@ findClosestSymbol(virt_addr addr,
       moduleNameBuffer[0] = char { 0 };
    }
 
-   // Find the module and section containing the given address
-   auto containingModule = virt_ptr<loader::LOADED_RPL> { nullptr };
-   auto containingSectionIndex = 0u;
-
-   for (auto rpl = partitionData->loadedModuleList; rpl; rpl = rpl->nextLoadedRpl) {
-      for (auto i = 0u; i < rpl->elfHeader.shnum; ++i) {
-         auto sectionAddress = rpl->sectionAddressBuffer[i];
-         if (!sectionAddress) {
-            continue;
-         }
-
-         auto sectionHeader =
-            virt_cast<loader::rpl::SectionHeader *>(
-               virt_cast<virt_addr>(rpl->sectionHeaderBuffer) +
-               rpl->elfHeader.shentsize * i);
-
-         if (addr >= sectionAddress &&
-             addr < sectionAddress + sectionHeader->size) {
-            containingModule = rpl;
-            containingSectionIndex = i;
-            break;
-         }
-      }
-   }
-
-   // Search the module's symbol table for the nearest symbol
-   auto nearestSymbolName = virt_ptr<const char> { nullptr };
-   auto nearestSymbolValue = virt_addr { 0 };
-
-   if (containingModule) {
-      auto nearestSymbolDistance = uint32_t { 0xFFFFFFFFu };
-      for (auto i = 0u; i < containingModule->elfHeader.shnum; ++i) {
-         auto sectionAddress = containingModule->sectionAddressBuffer[i];
-         auto sectionHeader =
-            virt_cast<loader::rpl::SectionHeader *>(
-               virt_cast<virt_addr>(containingModule->sectionHeaderBuffer) +
-               containingModule->elfHeader.shentsize * i);
-
-         if (sectionHeader->type == loader::rpl::SHT_SYMTAB) {
-            auto strTab = containingModule->sectionAddressBuffer[sectionHeader->link];
-            auto symTabEntSize =
-               sectionHeader->entsize ?
-               static_cast<uint32_t>(sectionHeader->entsize) :
-               sizeof(loader::rpl::Symbol);
-            auto numSymbols = sectionHeader->size / symTabEntSize;
-
-            for (auto j = 0u; j < numSymbols; ++j) {
-               auto symbol =
-                  virt_cast<loader::rpl::Symbol *>(sectionAddress + j * symTabEntSize);
-               auto symbolAddr = virt_addr { static_cast<uint32_t>(symbol->value) };
-               if (symbol->shndx != containingSectionIndex ||
-                   symbolAddr > addr) {
-                  continue;
-               }
-
-               // Ignore symbols beginning with $ or .
-               auto symbolName = virt_cast<const char *>(strTab + symbol->name);
-               if (symbolName[0] == '$' || symbolName[0] == '.') {
-                  continue;
-               }
-
-               if (addr - symbolAddr < nearestSymbolDistance) {
-                  nearestSymbolName = symbolName;
-                  nearestSymbolDistance = static_cast<uint32_t>(addr - symbolAddr);
-                  nearestSymbolValue = symbolAddr;
-
-                  if (nearestSymbolDistance == 0) {
-                     break;
-                  }
-               }
-            }
-
-            if (nearestSymbolDistance == 0) {
-               break;
-            }
-         }
-      }
-   }
+   auto symbol = lookupSymbolIndex(partitionData->ramPartitionId, addr);
+   auto containingModule = symbol.module;
+   auto nearestSymbolName = symbol.name;
+   auto nearestSymbolValue = symbol.address;
 
    // Set the output
    if (moduleNameBuffer) {
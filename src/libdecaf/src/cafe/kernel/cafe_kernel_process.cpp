@@ -3,6 +3,7 @@
 #include "cafe_kernel_mmu.h"
 #include "cafe_kernel_mcp.h"
 #include "cafe_kernel_process.h"
+#include "cafe_kernel_symbolindex.h"
 
 #include "ios/mcp/ios_mcp_mcp_types.h"
 #include "cafe/cafe_ppc_interface_invoke_guest.h"
@@ -397,6 +398,7 @@ initialiseProcessData()
       data.coreKernelProcessId[0] = KernelProcessId::Invalid;
       data.coreKernelProcessId[1] = KernelProcessId::Invalid;
       data.coreKernelProcessId[2] = KernelProcessId::Invalid;
+      resetSymbolIndex(data.ramPartitionId);
    }
 }
 
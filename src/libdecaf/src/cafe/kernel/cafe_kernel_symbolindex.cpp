@@ -0,0 +1,233 @@
+#include "cafe_kernel_symbolindex.h"
+#include "cafe/loader/cafe_loader_rpl.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace cafe::kernel::internal
+{
+
+/*
+Symbol lookups used to walk every section of every loaded module and then
+every symbol of the containing module. Instead each module is indexed once
+by the loader when it is linked: its loaded sections go into an address
+ordered map of all sections in its ram partition, and its symbols into a
+vector sorted by section and address, so a lookup is two binary searches.
+Modules are removed from the index when they are purged, and a partition's
+index is reset when a new process is loaded into it.
+*/
+
+struct ModuleSymbol
+{
+   uint32_t section;
+   virt_addr address;
+   virt_ptr<const char> name;
+};
+
+struct ModuleIndex
+{
+   //! Sorted by section then address, equal symbols stay in symtab order.
+   std::vector<ModuleSymbol> symbols;
+};
+
+struct SectionRange
+{
+   virt_addr end;
+   virt_ptr<loader::LOADED_RPL> module;
+   uint32_t section;
+};
+
+struct PartitionIndex
+{
+   std::unordered_map<uint32_t, ModuleIndex> modules;
+
+   //! Loaded sections of every indexed module keyed by start address.
+   std::map<virt_addr, SectionRange> sections;
+};
+
+static std::mutex
+sSymbolIndexMutex;
+
+static std::array<PartitionIndex, NumRamPartitions>
+sPartitionIndex;
+
+static PartitionIndex *
+getPartitionIndex(RamPartitionId rampid)
+{
+   auto id = static_cast<int32_t>(rampid);
+   if (id < 0 || id >= NumRamPartitions) {
+      return nullptr;
+   }
+
+   return &sPartitionIndex[id];
+}
+
+static virt_ptr<loader::rpl::SectionHeader>
+getSectionHeader(virt_ptr<loader::LOADED_RPL> rpl,
+                 uint32_t index)
+{
+   return virt_cast<loader::rpl::SectionHeader *>(
+      virt_cast<virt_addr>(rpl->sectionHeaderBuffer) +
+      rpl->elfHeader.shentsize * index);
+}
+
+static void
+indexModule(PartitionIndex &partition,
+            virt_ptr<loader::LOADED_RPL> rpl)
+{
+   auto key = static_cast<uint32_t>(virt_cast<virt_addr>(rpl));
+   if (partition.modules.count(key) ||
+       !rpl->sectionHeaderBuffer || !rpl->sectionAddressBuffer) {
+      return;
+   }
+
+   auto &index = partition.modules[key];
+
+   for (auto i = 0u; i < rpl->elfHeader.shnum; ++i) {
+      auto sectionAddress = rpl->sectionAddressBuffer[i];
+      if (!sectionAddress) {
+         continue;
+      }
+
+      auto sectionHeader = getSectionHeader(rpl, i);
+      if (sectionHeader->size) {
+         partition.sections[sectionAddress] =
+            SectionRange { sectionAddress + sectionHeader->size, rpl, i };
+      }
+
+      if (sectionHeader->type != loader::rpl::SHT_SYMTAB) {
+         continue;
+      }
+
+      auto strTab = rpl->sectionAddressBuffer[sectionHeader->link];
+      auto symTabEntSize =
+         sectionHeader->entsize ?
+         static_cast<uint32_t>(sectionHeader->entsize) :
+         sizeof(loader::rpl::Symbol);
+      auto numSymbols = sectionHeader->size / symTabEntSize;
+
+      for (auto j = 0u; j < numSymbols; ++j) {
+         auto symbol =
+            virt_cast<loader::rpl::Symbol *>(sectionAddress + j * symTabEntSize);
+
+         // Ignore symbols beginning with $ or .
+         auto symbolName = virt_cast<const char *>(strTab + symbol->name);
+         if (symbolName[0] == '$' || symbolName[0] == '.') {
+            continue;
+         }
+
+         index.symbols.push_back({
+            symbol->shndx,
+            virt_addr { static_cast<uint32_t>(symbol->value) },
+            symbolName
+         });
+      }
+   }
+
+   std::stable_sort(index.symbols.begin(), index.symbols.end(),
+                    [](const ModuleSymbol &lhs, const ModuleSymbol &rhs) {
+                       return std::tie(lhs.section, lhs.address) <
+                              std::tie(rhs.section, rhs.address);
+                    });
+}
+
+void
+resetSymbolIndex(RamPartitionId rampid)
+{
+   auto lock = std::unique_lock { sSymbolIndexMutex };
+   if (auto partition = getPartitionIndex(rampid)) {
+      partition->modules.clear();
+      partition->sections.clear();
+   }
+}
+
+void
+addModuleSymbolIndex(RamPartitionId rampid,
+                     virt_ptr<loader::LOADED_RPL> rpl)
+{
+   auto lock = std::unique_lock { sSymbolIndexMutex };
+   if (auto partition = getPartitionIndex(rampid)) {
+      indexModule(*partition, rpl);
+   }
+}
+
+void
+removeModuleSymbolIndex(RamPartitionId rampid,
+                        virt_ptr<loader::LOADED_RPL> rpl)
+{
+   auto lock = std::unique_lock { sSymbolIndexMutex };
+   auto partition = getPartitionIndex(rampid);
+   if (!partition ||
+       !partition->modules.erase(static_cast<uint32_t>(virt_cast<virt_addr>(rpl)))) {
+      return;
+   }
+
+   for (auto itr = partition->sections.begin(); itr != partition->sections.end(); ) {
+      if (itr->second.module == rpl) {
+         itr = partition->sections.erase(itr);
+      } else {
+         ++itr;
+      }
+   }
+}
+
+IndexedSymbol
+lookupSymbolIndex(RamPartitionId rampid,
+                  virt_addr addr)
+{
+   auto lock = std::unique_lock { sSymbolIndexMutex };
+   auto result = IndexedSymbol { nullptr, nullptr, virt_addr { 0 } };
+   auto partition = getPartitionIndex(rampid);
+   if (!partition) {
+      return result;
+   }
+
+   auto sectionItr = partition->sections.upper_bound(addr);
+   if (sectionItr == partition->sections.begin()) {
+      return result;
+   }
+
+   --sectionItr;
+   if (addr >= sectionItr->second.end) {
+      return result;
+   }
+
+   auto &section = sectionItr->second;
+   auto &symbols =
+      partition->modules[static_cast<uint32_t>(virt_cast<virt_addr>(section.module))].symbols;
+   result.module = section.module;
+
+   // Find the last symbol in the section at or below addr, then the first
+   // symbol in symtab order with that same address.
+   auto itr = std::upper_bound(symbols.begin(), symbols.end(),
+                               std::make_pair(section.section, addr),
+                               [](const std::pair<uint32_t, virt_addr> &value,
+                                  const ModuleSymbol &symbol) {
+                                  return std::tie(value.first, value.second) <
+                                         std::tie(symbol.section, symbol.address);
+                               });
+   if (itr == symbols.begin() || std::prev(itr)->section != section.section) {
+      return result;
+   }
+
+   auto nearest = std::prev(itr);
+   nearest = std::lower_bound(symbols.begin(), itr,
+                              std::make_pair(section.section, nearest->address),
+                              [](const ModuleSymbol &symbol,
+                                 const std::pair<uint32_t, virt_addr> &value) {
+                                 return std::tie(symbol.section, symbol.address) <
+                                        std::tie(value.first, value.second);
+                              });
+
+   result.name = nearest->name;
+   result.address = nearest->address;
+   return result;
+}
+
+} // namespace cafe::kernel::internal
@@ -0,0 +1,35 @@
+#pragma once
+#include "cafe_kernel_processid.h"
+#include "cafe/loader/cafe_loader_loaded_rpl.h"
+
+#include <libcpu/be2_struct.h>
+
+namespace cafe::kernel::internal
+{
+
+struct IndexedSymbol
+{
+   //! Module containing the address, nullptr if no module contains it.
+   virt_ptr<loader::LOADED_RPL> module;
+
+   //! Nearest symbol at or below the address, nullptr if there is none.
+   virt_ptr<const char> name;
+   virt_addr address;
+};
+
+void
+resetSymbolIndex(RamPartitionId rampid);
+
+void
+addModuleSymbolIndex(RamPartitionId rampid,
+                     virt_ptr<loader::LOADED_RPL> rpl);
+
+void
+removeModuleSymbolIndex(RamPartitionId rampid,
+                        virt_ptr<loader::LOADED_RPL> rpl);
+
+IndexedSymbol
+lookupSymbolIndex(RamPartitionId rampid,
+                  virt_addr addr);
+
+} // namespace cafe::kernel::internal
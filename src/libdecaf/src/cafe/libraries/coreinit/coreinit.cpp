@@ -13,6 +13,7 @@
 #include "coreinit_lockedcache.h"
 #include "coreinit_mcp.h"
 #include "coreinit_memallocator.h"
+#include "coreinit_memexpheap.h"
 #include "coreinit_memory.h"
 #include "coreinit_memheap.h"
 #include "coreinit_scheduler.h"
@@ -42,10 +43,12 @@ coreinit_entry(/* no args for coreinit entry point */)
    internal::initialiseExceptionHandlers();
    internal::initialiseScheduler();
    internal::initialiseThreads();
+   internal::resetAlarmTimers();
    internal::initialiseAlarmThread();
    internal::initialiseLockedCache(coreId);
    internal::initialiseMemory();
    internal::initialiseMemHeap();
+   internal::resetExpHeapFreeIndices();
    internal::initialiseAllocatorStaticData();
    IPCDriverInit();
    IPCDriverOpen();
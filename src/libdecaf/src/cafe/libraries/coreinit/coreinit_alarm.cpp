@@ -14,9 +14,15 @@
 #include "cafe/cafe_ppc_interface_invoke_guest.h"
 
 #include <libcpu/cpu_control.h>
+#include <algorithm>
 #include <array>
 #include <common/decaf_assert.h>
 #include <fmt/core.h>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace cafe::coreinit
 {
@@ -46,6 +52,55 @@ sAlarmData = nullptr;
 static OSThreadEntryPointFn
 sAlarmCallbackThreadEntry;
 
+/*
+The guest alarm queues are unordered linked lists, so finding the next
+deadline or the expired alarms means walking a whole queue. Alongside each
+core's alarm queue we keep a host side timer index ordered by deadline, and
+an index of queued alarms by group for OSCancelAlarms. Both only ever hold
+alarms which are in one of the per core alarm queues and are protected by
+sAlarmData->lock, the guest queues themselves are unchanged.
+
+Alarms are only ever appended to the alarm queues, so the order alarms were
+added to the timer index in is also their order in the guest queue. The index
+is only used to find which alarms have expired, they are still fired in
+queue order.
+*/
+
+struct AlarmTimer
+{
+   OSTime nextFire;
+
+   //! Position of the alarm in its core's alarm queue.
+   uint64_t sequence;
+
+   uint32_t alarm;
+
+   bool operator <(const AlarmTimer &other) const
+   {
+      return std::tie(nextFire, sequence, alarm) <
+             std::tie(other.nextFire, other.sequence, other.alarm);
+   }
+};
+
+struct AlarmTimerEntry
+{
+   uint32_t coreId;
+   uint32_t group;
+   std::set<AlarmTimer>::iterator timer;
+};
+
+static std::array<std::set<AlarmTimer>, OSGetCoreCount()>
+sAlarmTimers;
+
+static std::unordered_map<uint32_t, AlarmTimerEntry>
+sAlarmTimerEntries;
+
+static std::unordered_map<uint32_t, std::unordered_set<uint32_t>>
+sAlarmGroups;
+
+static uint64_t
+sAlarmTimerSequence = 0;
+
 namespace internal
 {
 
@@ -54,6 +109,55 @@ void updateCpuAlarmNoALock();
 
 } // namespace internal
 
+static uint32_t
+alarmKey(virt_ptr<OSAlarm> alarm)
+{
+   return static_cast<uint32_t>(virt_cast<virt_addr>(alarm));
+}
+
+/**
+ * Add an alarm which has just been appended to a core's alarm queue to the
+ * timer index.
+ */
+static void
+addAlarmTimer(uint32_t coreId,
+              virt_ptr<OSAlarm> alarm)
+{
+   auto key = alarmKey(alarm);
+   decaf_check(!sAlarmTimerEntries.count(key));
+
+   auto timer = AlarmTimer { alarm->nextFire, sAlarmTimerSequence++, key };
+   auto &entry = sAlarmTimerEntries[key];
+   entry.coreId = coreId;
+   entry.group = alarm->group;
+   entry.timer = sAlarmTimers[coreId].insert(timer).first;
+   sAlarmGroups[entry.group].insert(key);
+}
+
+/**
+ * Remove an alarm from the timer index, does nothing if the alarm is not in
+ * a core's alarm queue.
+ */
+static void
+removeAlarmTimer(virt_ptr<OSAlarm> alarm)
+{
+   auto itr = sAlarmTimerEntries.find(alarmKey(alarm));
+   if (itr == sAlarmTimerEntries.end()) {
+      return;
+   }
+
+   auto &entry = itr->second;
+   sAlarmTimers[entry.coreId].erase(entry.timer);
+
+   auto groupItr = sAlarmGroups.find(entry.group);
+   groupItr->second.erase(itr->first);
+   if (groupItr->second.empty()) {
+      sAlarmGroups.erase(groupItr);
+   }
+
+   sAlarmTimerEntries.erase(itr);
+}
+
 /**
  * Internal alarm cancel.
  *
@@ -77,6 +181,7 @@ cancelAlarmNoAlarmLock(virt_ptr<OSAlarm> alarm)
    if (alarm->alarmQueue) {
       internal::AlarmQueue::erase(alarm->alarmQueue, alarm);
       alarm->alarmQueue = nullptr;
+      removeAlarmTimer(alarm);
    }
 
    return TRUE;
@@ -121,21 +226,22 @@ OSCancelAlarms(uint32_t group)
    internal::lockScheduler();
    internal::acquireIdLock(sAlarmData->lock, static_cast<uint32_t>(-2));
 
-   for (auto &perCoreData : sAlarmData->perCoreData) {
-      for (auto alarm = perCoreData.alarmQueue.head; alarm; ) {
-         auto next = alarm->link.next;
+   auto groupItr = sAlarmGroups.find(group);
+   if (groupItr != sAlarmGroups.end()) {
+      // Cancelling removes the alarm from the group so take a copy first
+      auto alarms = std::vector<uint32_t> { groupItr->second.begin(),
+                                            groupItr->second.end() };
 
-         if (alarm->group == group) {
-            if (cancelAlarmNoAlarmLock(alarm)) {
-               for (auto thread = alarm->threadQueue.head; thread; thread = thread->link.next) {
-                  thread->alarmCancelled = TRUE;
-               }
+      for (auto key : alarms) {
+         auto alarm = virt_cast<OSAlarm *>(virt_addr { key });
 
-               internal::wakeupThreadNoLock(virt_addrof(alarm->threadQueue));
+         if (cancelAlarmNoAlarmLock(alarm)) {
+            for (auto thread = alarm->threadQueue.head; thread; thread = thread->link.next) {
+               thread->alarmCancelled = TRUE;
             }
-         }
 
-         alarm = next;
+            internal::wakeupThreadNoLock(virt_addrof(alarm->threadQueue));
+         }
       }
    }
 
@@ -261,16 +367,17 @@ OSSetPeriodicAlarm(virt_ptr<OSAlarm> alarm,
    if (alarm->alarmQueue) {
       internal::AlarmQueue::erase(alarm->alarmQueue, alarm);
       alarm->alarmQueue = nullptr;
+      removeAlarmTimer(alarm);
    }
 
    // Add to this core's alarm queue
-   auto queue = virt_addrof(sAlarmData->perCoreData[OSGetCoreId()].alarmQueue);
+   auto coreId = OSGetCoreId();
+   auto queue = virt_addrof(sAlarmData->perCoreData[coreId].alarmQueue);
    alarm->alarmQueue = queue;
    internal::AlarmQueue::append(queue, alarm);
+   addAlarmTimer(coreId, alarm);
 
    // Set the interrupt timer in processor
-   // TODO: Store the last set CPU alarm time, and simply check this
-   // alarm against that time to make finding the soonest alarm cheaper.
    internal::updateCpuAlarmNoALock();
 
    internal::releaseIdLock(sAlarmData->lock, alarm);
@@ -287,6 +394,20 @@ OSSetAlarmTag(virt_ptr<OSAlarm> alarm,
 {
    internal::acquireIdLock(sAlarmData->lock, alarm);
    alarm->group = group;
+
+   // Keep the group index in sync if the alarm is already queued
+   auto itr = sAlarmTimerEntries.find(alarmKey(alarm));
+   if (itr != sAlarmTimerEntries.end() && itr->second.group != group) {
+      auto oldGroupItr = sAlarmGroups.find(itr->second.group);
+      oldGroupItr->second.erase(itr->first);
+      if (oldGroupItr->second.empty()) {
+         sAlarmGroups.erase(oldGroupItr);
+      }
+
+      itr->second.group = group;
+      sAlarmGroups[group].insert(itr->first);
+   }
+
    internal::releaseIdLock(sAlarmData->lock, alarm);
 }
 
@@ -417,6 +538,7 @@ alarmCallbackThreadEntry(uint32_t coreId,
          alarm->state = OSAlarmState::Set;
          internal::AlarmQueue::append(queue, alarm);
          alarm->alarmQueue = queue;
+         addAlarmTimer(coreId, alarm);
          internal::updateCpuAlarmNoALock();
       }
 
@@ -456,22 +578,11 @@ cancelAlarm(virt_ptr<OSAlarm> alarm)
 void
 updateCpuAlarmNoALock()
 {
-   auto &queue = sAlarmData->perCoreData[cpu::this_core::id()].alarmQueue;
+   auto &timers = sAlarmTimers[cpu::this_core::id()];
    auto next = std::chrono::steady_clock::time_point::max();
 
-   for (virt_ptr<OSAlarm> alarm = queue.head; alarm; ) {
-      auto nextAlarm = alarm->link.next;
-
-      // Update next if its not past yet
-      if (alarm->state == OSAlarmState::Set && alarm->nextFire) {
-         auto nextFire = cpu::tbToTimePoint(alarm->nextFire - internal::getBaseTime());
-
-         if (nextFire < next) {
-            next = nextFire;
-         }
-      }
-
-      alarm = nextAlarm;
+   if (!timers.empty()) {
+      next = cpu::tbToTimePoint(timers.begin()->nextFire - internal::getBaseTime());
    }
 
    cpu::this_core::setNextAlarm(next);
@@ -480,7 +591,9 @@ updateCpuAlarmNoALock()
 void
 handleAlarmInterrupt(virt_ptr<OSContext> context)
 {
-   auto &coreAlarmData = sAlarmData->perCoreData[cpu::this_core::id()];
+   auto coreId = cpu::this_core::id();
+   auto &coreAlarmData = sAlarmData->perCoreData[coreId];
+   auto &timers = sAlarmTimers[coreId];
    auto queue = virt_addrof(coreAlarmData.alarmQueue);
    auto cbQueue = virt_addrof(coreAlarmData.callbackAlarmQueue);
    auto cbThreadQueue = virt_addrof(coreAlarmData.callbackThreadQueue);
@@ -489,15 +602,32 @@ handleAlarmInterrupt(virt_ptr<OSContext> context)
    internal::lockScheduler();
    acquireIdLockWithCoreId(sAlarmData->lock);
 
-   for (virt_ptr<OSAlarm> alarm = queue->head; alarm; ) {
-      auto nextAlarm = alarm->link.next;
+   while (!timers.empty() && timers.begin()->nextFire <= now) {
+      // Collect the expired alarms and put them back into queue order
+      auto expired = std::vector<AlarmTimer> { };
+      for (auto itr = timers.begin(); itr != timers.end() && itr->nextFire <= now; ++itr) {
+         expired.push_back(*itr);
+      }
+
+      std::sort(expired.begin(), expired.end(),
+                [](const AlarmTimer &lhs, const AlarmTimer &rhs) {
+                   return lhs.sequence < rhs.sequence;
+                });
+
+      for (auto &timer : expired) {
+         // A system alarm callback may have cancelled or reset this alarm
+         auto entryItr = sAlarmTimerEntries.find(timer.alarm);
+         if (entryItr == sAlarmTimerEntries.end() ||
+             entryItr->second.timer->sequence != timer.sequence) {
+            continue;
+         }
 
-      // Expire it if its past its nextFire time
-      if (alarm->nextFire <= now) {
+         auto alarm = virt_cast<OSAlarm *>(virt_addr { timer.alarm });
          decaf_check(alarm->state == OSAlarmState::Set);
 
          internal::AlarmQueue::erase(queue, alarm);
          alarm->alarmQueue = nullptr;
+         removeAlarmTimer(alarm);
 
          alarm->state = OSAlarmState::Expired;
          alarm->context = context;
@@ -521,8 +651,6 @@ handleAlarmInterrupt(virt_ptr<OSContext> context)
             wakeupThreadNoLock(cbThreadQueue);
          }
       }
-
-      alarm = nextAlarm;
    }
 
    internal::updateCpuAlarmNoALock();
@@ -531,6 +659,22 @@ handleAlarmInterrupt(virt_ptr<OSContext> context)
    internal::unlockScheduler();
 }
 
+/**
+ * Drop the alarm timer and group indices, must be called before the alarm
+ * queues are initialised for a new process.
+ */
+void
+resetAlarmTimers()
+{
+   for (auto &timers : sAlarmTimers) {
+      timers.clear();
+   }
+
+   sAlarmTimerEntries.clear();
+   sAlarmGroups.clear();
+   sAlarmTimerSequence = 0;
+}
+
 void
 initialiseAlarmThread()
 {
@@ -185,6 +185,9 @@ cancelAlarm(virt_ptr<OSAlarm> alarm);
 void
 handleAlarmInterrupt(virt_ptr<OSContext> context);
 
+void
+resetAlarmTimers();
+
 void
 initialiseAlarmThread();
 
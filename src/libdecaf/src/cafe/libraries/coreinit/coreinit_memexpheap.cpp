@@ -2,8 +2,13 @@
 #include "coreinit_memexpheap.h"
 #include "coreinit_memory.h"
 
+#include <array>
 #include <common/log.h>
 #include <libcpu/cpu_formatters.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
 
 namespace cafe::coreinit
 {
@@ -45,13 +50,164 @@ static bool
 listContainsBlock(virt_ptr<MEMExpHeapBlockList> list,
                   virt_ptr<MEMExpHeapBlock> block)
 {
-   for (auto i = list->head; i; i = i->next) {
-      if (i == block) {
-         return true;
+   // Rather than walking the whole list we check that the neighbouring
+   // links agree that block is a member of list.
+   if (block->prev ? block->prev->next != block : list->head != block) {
+      return false;
+   }
+
+   if (block->next ? block->next->prev != block : list->tail != block) {
+      return false;
+   }
+
+   return true;
+}
+
+/**
+ * Host side shadow of an expanded heap's free list.
+ *
+ * The guest free list is kept sorted by address, blocks is an exact mirror
+ * of it which lets us find neighbours in O(log n). Blocks are also bucketed
+ * by the log2 of their size so allocations only look at blocks which are
+ * large enough, each bucket is ordered by address so first-fit still picks
+ * the same block as walking the guest list would.
+ */
+struct ExpHeapFreeIndex
+{
+   static constexpr auto NumBuckets = 32u;
+
+   static uint32_t
+   getBucket(uint32_t size)
+   {
+      auto bucket = 0u;
+      while (size >>= 1) {
+         ++bucket;
+      }
+
+      return bucket;
+   }
+
+   void
+   insert(uint32_t addr,
+          uint32_t size)
+   {
+      blocks.emplace(addr, size);
+      buckets[getBucket(size)].insert(addr);
+      totalFreeSize += size;
+   }
+
+   void
+   erase(uint32_t addr)
+   {
+      auto itr = blocks.find(addr);
+      decaf_check(itr != blocks.end());
+      buckets[getBucket(itr->second)].erase(addr);
+      totalFreeSize -= itr->second;
+      blocks.erase(itr);
+   }
+
+   void
+   resize(uint32_t addr,
+          uint32_t size)
+   {
+      auto itr = blocks.find(addr);
+      decaf_check(itr != blocks.end());
+      buckets[getBucket(itr->second)].erase(addr);
+      buckets[getBucket(size)].insert(addr);
+      totalFreeSize = totalFreeSize - itr->second + size;
+      itr->second = size;
+   }
+
+   //! Free block address -> blockSize, ordered by address.
+   std::map<uint32_t, uint32_t> blocks;
+
+   //! Free block addresses bucketed by log2(blockSize).
+   std::array<std::set<uint32_t>, NumBuckets> buckets;
+
+   uint32_t totalFreeSize = 0;
+};
+
+static std::mutex
+sFreeIndexMutex;
+
+static std::unordered_map<uint32_t, ExpHeapFreeIndex>
+sFreeIndices;
+
+static uint32_t
+getAddress(virt_ptr<void> ptr)
+{
+   return static_cast<uint32_t>(virt_cast<virt_addr>(ptr));
+}
+
+static virt_ptr<MEMExpHeapBlock>
+getBlock(uint32_t addr)
+{
+   return virt_cast<MEMExpHeapBlock *>(virt_addr { addr });
+}
+
+static ExpHeapFreeIndex &
+resetFreeIndex(virt_ptr<MEMExpHeap> heap)
+{
+   std::unique_lock lock { sFreeIndexMutex };
+   auto &index = sFreeIndices[getAddress(heap)];
+   index = { };
+   return index;
+}
+
+static void
+destroyFreeIndex(virt_ptr<MEMExpHeap> heap)
+{
+   std::unique_lock lock { sFreeIndexMutex };
+   sFreeIndices.erase(getAddress(heap));
+}
+
+/**
+ * Check whether a free index still mirrors the guest free list.
+ *
+ * The guest heap can change underneath us without going through
+ * MEMCreateExpHeapEx, e.g. a heap is recreated by guest code we do not
+ * intercept or guest memory is restored from a snapshot. Comparing both
+ * ends of the list catches these cases without walking it.
+ */
+static bool
+isFreeIndexValid(virt_ptr<MEMExpHeap> heap,
+                 const ExpHeapFreeIndex &index)
+{
+   auto head = heap->freeList.head;
+   auto tail = heap->freeList.tail;
+
+   if (index.blocks.empty() || !head || !tail) {
+      return index.blocks.empty() && !head && !tail;
+   }
+
+   auto first = index.blocks.begin();
+   auto last = std::prev(index.blocks.end());
+   return first->first == getAddress(head)
+       && first->second == head->blockSize
+       && last->first == getAddress(tail)
+       && last->second == tail->blockSize;
+}
+
+/**
+ * Get the free index for a heap, must be called with the heap lock held.
+ */
+static ExpHeapFreeIndex &
+getFreeIndex(virt_ptr<MEMExpHeap> heap)
+{
+   std::unique_lock lock { sFreeIndexMutex };
+   auto &index = sFreeIndices[getAddress(heap)];
+
+   if (!isFreeIndexValid(heap, index)) {
+      // Rebuild from the guest list for heaps we have not seen created or
+      // whose free list has been changed behind our back.
+      index = { };
+
+      for (auto block = heap->freeList.head; block; block = block->next) {
+         index.insert(getAddress(block), block->blockSize);
       }
    }
 
-   return false;
+   return index;
 }
 
 static void
@@ -103,6 +259,44 @@ removeBlock(virt_ptr<MEMExpHeapBlockList> list,
    block->next = nullptr;
 }
 
+/**
+ * Insert a block into the free list, keeping the list sorted by address.
+ */
+static void
+insertFreeBlock(virt_ptr<MEMExpHeap> heap,
+                ExpHeapFreeIndex &index,
+                virt_ptr<MEMExpHeapBlock> block)
+{
+   auto addr = getAddress(block);
+   auto prevBlock = virt_ptr<MEMExpHeapBlock> { nullptr };
+   auto itr = index.blocks.lower_bound(addr);
+
+   if (itr != index.blocks.begin()) {
+      prevBlock = getBlock(std::prev(itr)->first);
+   }
+
+   insertBlock(virt_addrof(heap->freeList), prevBlock, block);
+   index.insert(addr, block->blockSize);
+}
+
+static void
+removeFreeBlock(virt_ptr<MEMExpHeap> heap,
+                ExpHeapFreeIndex &index,
+                virt_ptr<MEMExpHeapBlock> block)
+{
+   index.erase(getAddress(block));
+   removeBlock(virt_addrof(heap->freeList), block);
+}
+
+static void
+setFreeBlockSize(ExpHeapFreeIndex &index,
+                 virt_ptr<MEMExpHeapBlock> block,
+                 uint32_t size)
+{
+   index.resize(getAddress(block), size);
+   block->blockSize = size;
+}
+
 static uint32_t
 getAlignedBlockSize(virt_ptr<MEMExpHeapBlock> block,
                     uint32_t alignment,
@@ -133,6 +327,98 @@ getAlignedBlockSize(virt_ptr<MEMExpHeapBlock> block,
    }
 }
 
+/**
+ * Find the free block an allocation should be made from.
+ *
+ * FirstFree picks the lowest addressed block which fits, NearestSize picks
+ * the block with the smallest aligned size which fits, preferring the lowest
+ * address on a tie, exactly as a walk of the sorted guest list would.
+ */
+static virt_ptr<MEMExpHeapBlock>
+findFreeBlock(ExpHeapFreeIndex &index,
+              MEMExpHeapMode mode,
+              uint32_t size,
+              uint32_t alignment,
+              MEMExpHeapDirection dir)
+{
+   auto foundAddr = 0u;
+   auto found = false;
+   auto bestAlignedSize = 0xFFFFFFFFu;
+
+   for (auto bucket = ExpHeapFreeIndex::getBucket(size);
+        bucket < ExpHeapFreeIndex::NumBuckets; ++bucket) {
+      if (mode == MEMExpHeapMode::NearestSize && found) {
+         // Alignment can only waste up to alignment bytes, once the smallest
+         // possible aligned size of this bucket is larger than our best fit
+         // no larger bucket can hold a better one.
+         auto bucketMinSize = 1u << bucket;
+         auto bucketMinAlignedSize =
+            bucketMinSize > alignment ? bucketMinSize - alignment : 0u;
+
+         if (bucketMinAlignedSize > bestAlignedSize) {
+            break;
+         }
+      }
+
+      for (auto addr : index.buckets[bucket]) {
+         if (mode == MEMExpHeapMode::FirstFree && found && addr > foundAddr) {
+            // Already have a lower addressed block which fits
+            break;
+         }
+
+         auto alignedSize = getAlignedBlockSize(getBlock(addr), alignment, dir);
+         if (alignedSize < size) {
+            continue;
+         }
+
+         if (mode == MEMExpHeapMode::FirstFree) {
+            foundAddr = addr;
+            found = true;
+            break;
+         }
+
+         if (alignedSize < bestAlignedSize ||
+             (alignedSize == bestAlignedSize && addr < foundAddr)) {
+            foundAddr = addr;
+            found = true;
+            bestAlignedSize = alignedSize;
+         }
+      }
+   }
+
+   if (!found) {
+      return nullptr;
+   }
+
+   return getBlock(foundAddr);
+}
+
+static uint32_t
+getLargestAlignedSize(ExpHeapFreeIndex &index,
+                      uint32_t alignment,
+                      MEMExpHeapDirection dir)
+{
+   auto largestFree = 0u;
+
+   for (auto bucket = ExpHeapFreeIndex::NumBuckets; bucket-- > 0; ) {
+      // Every block in this bucket and below is smaller than 2^(bucket + 1)
+      auto bucketMaxSize = static_cast<uint32_t>((uint64_t { 1 } << (bucket + 1)) - 1);
+      if (bucketMaxSize <= largestFree) {
+         break;
+      }
+
+      for (auto addr : index.buckets[bucket]) {
+         auto alignedSize = getAlignedBlockSize(getBlock(addr), alignment, dir);
+
+         if (alignedSize > largestFree) {
+            largestFree = alignedSize;
+         }
+      }
+   }
+
+   return largestFree;
+}
+
 static virt_ptr<MEMExpHeapBlock>
 createUsedBlockFromFreeBlock(virt_ptr<MEMExpHeap> heap,
                              virt_ptr<MEMExpHeapBlock> freeBlock,
@@ -140,16 +426,16 @@ createUsedBlockFromFreeBlock(virt_ptr<MEMExpHeap> heap,
                              uint32_t alignment,
                              MEMExpHeapDirection dir)
 {
+   auto &index = getFreeIndex(heap);
    auto expHeapAttribs = heap->attribs.value();
    auto freeBlockAttribs = freeBlock->attribs.value();
 
-   auto freeBlockPrev = freeBlock->prev;
    auto freeMemStart = getBlockMemStart(freeBlock);
    auto freeMemEnd = getBlockMemEnd(freeBlock);
 
    // Free blocks should never have alignment...
    decaf_check(!freeBlockAttribs.alignment());
-   removeBlock(virt_addrof(heap->freeList), freeBlock);
+   removeFreeBlock(heap, index, freeBlock);
 
    // Find where we are going to start
    auto alignedDataStart = virt_ptr<uint8_t> { };
@@ -183,7 +469,7 @@ createUsedBlockFromFreeBlock(virt_ptr<MEMExpHeap> heap,
          freeBlock->prev = nullptr;
          freeBlock->tag = FreeTag;
 
-         insertBlock(virt_addrof(heap->freeList), freeBlockPrev, freeBlock);
+         insertFreeBlock(heap, index, freeBlock);
          topSpaceRemain = 0;
       }
    }
@@ -200,7 +486,7 @@ createUsedBlockFromFreeBlock(virt_ptr<MEMExpHeap> heap,
          freeBlock->prev = nullptr;
          freeBlock->tag = FreeTag;
 
-         insertBlock(virt_addrof(heap->freeList), freeBlockPrev, freeBlock);
+         insertFreeBlock(heap, index, freeBlock);
          bottomSpaceRemain = 0;
       }
    }
@@ -239,17 +525,19 @@ releaseMemory(virt_ptr<MEMExpHeap> heap,
       std::memset(memStart.get(), fillVal, memEnd - memStart);
    }
 
-   // Find the preceeding block to the memory we are releasing
+   // Find the free blocks either side of the memory we are releasing, free
+   // blocks have no alignment so their mem start is the block itself.
+   auto &index = getFreeIndex(heap);
    virt_ptr<MEMExpHeapBlock> prevBlock = nullptr;
-   virt_ptr<MEMExpHeapBlock> nextBlock = heap->freeList.head;
+   virt_ptr<MEMExpHeapBlock> nextBlock = nullptr;
 
-   for (auto block = heap->freeList.head; block; block = block->next) {
-      if (getBlockMemStart(block) < memStart) {
-         prevBlock = block;
-         nextBlock = block->next;
-      } else if (block >= prevBlock) {
-         break;
-      }
+   auto itr = index.blocks.lower_bound(getAddress(memStart));
+   if (itr != index.blocks.end()) {
+      nextBlock = getBlock(itr->first);
+   }
+
+   if (itr != index.blocks.begin()) {
+      prevBlock = getBlock(std::prev(itr)->first);
    }
 
    virt_ptr<MEMExpHeapBlock> freeBlock = nullptr;
@@ -260,7 +548,8 @@ releaseMemory(virt_ptr<MEMExpHeap> heap,
 
       if (memStart == prevMemEnd) {
          // Previous block absorbs the new memory
-         prevBlock->blockSize += static_cast<uint32_t>(memEnd - memStart);
+         setFreeBlockSize(index, prevBlock,
+                          prevBlock->blockSize + static_cast<uint32_t>(memEnd - memStart));
 
          // Our free block becomes the previous one
          freeBlock = prevBlock;
@@ -277,7 +566,7 @@ releaseMemory(virt_ptr<MEMExpHeap> heap,
       freeBlock->prev = nullptr;
       freeBlock->tag = FreeTag;
 
-      insertBlock(virt_addrof(heap->freeList), prevBlock, freeBlock);
+      insertFreeBlock(heap, index, freeBlock);
    }
 
    if (nextBlock) {
@@ -289,9 +578,9 @@ releaseMemory(virt_ptr<MEMExpHeap> heap,
          // The next block needs to be merged into the freeBlock, as they
          //  are directly adjacent to each other in memory.
          auto nextBlockEnd = getBlockMemEnd(nextBlock);
-         freeBlock->blockSize += static_cast<uint32_t>(nextBlockEnd - nextBlockStart);
-
-         removeBlock(virt_addrof(heap->freeList), nextBlock);
+         removeFreeBlock(heap, index, nextBlock);
+         setFreeBlockSize(index, freeBlock,
+                          freeBlock->blockSize + static_cast<uint32_t>(nextBlockEnd - nextBlockStart));
       }
    }
 }
@@ -337,6 +626,9 @@ MEMCreateExpHeapEx(virt_ptr<void> base,
    heap->usedList.head = nullptr;
    heap->usedList.tail = nullptr;
 
+   auto &index = resetFreeIndex(heap);
+   index.insert(getAddress(firstBlock), firstBlock->blockSize);
+
    heap->groupId = uint16_t { 0 };
    heap->attribs = MEMExpHeapAttribs::get(0);
 
@@ -350,6 +642,7 @@ MEMDestroyExpHeap(MEMHeapHandle handle)
    decaf_check(heap);
    decaf_check(heap->header.tag == MEMHeapTag::ExpandedHeap);
    internal::unregisterHeap(virt_addrof(heap->header));
+   destroyFreeIndex(heap);
    return heap;
 }
 
@@ -373,70 +666,29 @@ MEMAllocFromExpHeapEx(MEMHeapHandle handle,
 
    size = align_up(size, 4);
 
-   if (alignment > 0) {
-      auto foundBlock = virt_ptr<MEMExpHeapBlock> { nullptr };
-      auto bestAlignedSize = 0xFFFFFFFFu;
+   auto &index = getFreeIndex(heap);
+   auto direction = MEMExpHeapDirection::FromStart;
 
+   if (alignment > 0) {
       alignment = std::max(4, alignment);
-      decaf_check((alignment & 0x3) == 0);
-
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block,
-                                                alignment,
-                                                MEMExpHeapDirection::FromStart);
-
-         if (alignedSize >= size) {
-            if (expHeapFlags.allocMode() == MEMExpHeapMode::FirstFree) {
-               foundBlock = block;
-               break;
-            } else {
-               if (alignedSize < bestAlignedSize) {
-                  foundBlock = block;
-                  bestAlignedSize = alignedSize;
-               }
-            }
-         }
-      }
-
-      if (foundBlock) {
-         newBlock = createUsedBlockFromFreeBlock(heap,
-                                                 foundBlock,
-                                                 size,
-                                                 alignment,
-                                                 MEMExpHeapDirection::FromStart);
-      }
    } else {
       alignment = std::max(4, -alignment);
-      decaf_check((alignment & 0x3) == 0);
-
-      auto foundBlock = virt_ptr<MEMExpHeapBlock> { nullptr };
-      auto bestAlignedSize = 0xFFFFFFFFu;
-
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block,
-                                                alignment,
-                                                MEMExpHeapDirection::FromEnd);
-
-         if (alignedSize >= size) {
-            if (expHeapFlags.allocMode() == MEMExpHeapMode::FirstFree) {
-               foundBlock = block;
-               break;
-            } else {
-               if (alignedSize < bestAlignedSize) {
-                  foundBlock = block;
-                  bestAlignedSize = alignedSize;
-               }
-            }
-         }
-      }
+      direction = MEMExpHeapDirection::FromEnd;
+   }
 
-      if (foundBlock) {
-         newBlock = createUsedBlockFromFreeBlock(heap,
-                                                 foundBlock,
-                                                 size,
-                                                 alignment,
-                                                 MEMExpHeapDirection::FromEnd);
-      }
+   decaf_check((alignment & 0x3) == 0);
+
+   auto foundBlock = findFreeBlock(index,
+                                   expHeapFlags.allocMode(),
+                                   size,
+                                   static_cast<uint32_t>(alignment),
+                                   direction);
+   if (foundBlock) {
+      newBlock = createUsedBlockFromFreeBlock(heap,
+                                              foundBlock,
+                                              size,
+                                              alignment,
+                                              direction);
    }
 
    if (!newBlock) {
@@ -517,13 +769,11 @@ MEMAdjustExpHeap(MEMHeapHandle handle)
 
    // Remove the block from the free list
    decaf_check(!lastFreeBlock->next);
-
-   if (lastFreeBlock->prev) {
-      lastFreeBlock->prev->next = nullptr;
-   }
+   auto lastFreeBlockMemStart = getBlockMemStart(lastFreeBlock);
+   removeFreeBlock(heap, getFreeIndex(heap), lastFreeBlock);
 
    // Move the heaps end pointer to the true start point of this block
-   heap->header.dataEnd = getBlockMemStart(lastFreeBlock);
+   heap->header.dataEnd = lastFreeBlockMemStart;
 
    auto heapMemStart = virt_cast<uint8_t *>(heap);
    auto heapMemEnd = virt_cast<uint8_t *>(heap->header.dataEnd);
@@ -552,34 +802,25 @@ MEMResizeForMBlockExpHeap(MEMHeapHandle handle,
          releaseMemory(heap, releasedMemStart, releasedMemEnd);
       }
    } else if (size > block->blockSize) {
+      auto &index = getFreeIndex(heap);
       auto blockMemEnd = getBlockMemEnd(block);
-      auto freeBlock = virt_ptr<MEMExpHeapBlock> { nullptr };
 
-      for (auto i = heap->freeList.head; i; i = i->next) {
-         auto freeBlockMemStart = getBlockMemStart(i);
-
-         if (freeBlockMemStart == blockMemEnd) {
-            freeBlock = i;
-            break;
-         }
-
-         // Free list is sorted, so we only need to search a little bit
-         if (freeBlockMemStart > blockMemEnd) {
-            break;
-         }
-      }
-
-      if (!freeBlock) {
+      // Free blocks have no alignment, so a free block directly after us
+      // starts exactly at our mem end.
+      auto itr = index.blocks.find(getAddress(blockMemEnd));
+      if (itr == index.blocks.end()) {
          return 0;
       }
 
+      auto freeBlock = getBlock(itr->first);
+
       // Grab the data we need from the free block
       auto freeBlockMemStart = getBlockMemStart(freeBlock);
       auto freeBlockMemEnd = getBlockMemEnd(freeBlock);
       auto freeMemSize = static_cast<uint32_t>(freeBlockMemEnd - freeBlockMemStart);
 
       // Drop the free block from the list of free regions
-      removeBlock(virt_addrof(heap->freeList), freeBlock);
+      removeFreeBlock(heap, index, freeBlock);
 
       // Adjust the sizing of the free area and the block
       auto newAllocSize = (size - block->blockSize);
@@ -610,14 +851,8 @@ uint32_t
 MEMGetTotalFreeSizeForExpHeap(MEMHeapHandle handle)
 {
    auto heap = virt_cast<MEMExpHeap *>(handle);
-   auto freeSize = 0u;
    internal::HeapLock lock { virt_addrof(heap->header) };
-
-   for (auto block = heap->freeList.head; block; block = block->next) {
-      freeSize += block->blockSize;
-   }
-
-   return freeSize;
+   return getFreeIndex(heap).totalFreeSize;
 }
 
 uint32_t
@@ -625,34 +860,21 @@ MEMGetAllocatableSizeForExpHeapEx(MEMHeapHandle handle,
                                   int32_t alignment)
 {
    auto heap = virt_cast<MEMExpHeap *>(handle);
-   auto largestFree = 0u;
    internal::HeapLock lock { virt_addrof(heap->header) };
+   auto &index = getFreeIndex(heap);
 
    if (alignment > 0) {
       decaf_check((alignment & 0x3) == 0);
-
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block, alignment, MEMExpHeapDirection::FromStart);
-
-         if (alignedSize > largestFree) {
-            largestFree = alignedSize;
-         }
-      }
+      return getLargestAlignedSize(index,
+                                   static_cast<uint32_t>(alignment),
+                                   MEMExpHeapDirection::FromStart);
    } else {
       alignment = -alignment;
-
       decaf_check((alignment & 0x3) == 0);
-
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block, alignment, MEMExpHeapDirection::FromEnd);
-
-         if (alignedSize > largestFree) {
-            largestFree = alignedSize;
-         }
-      }
+      return getLargestAlignedSize(index,
+                                   static_cast<uint32_t>(alignment),
+                                   MEMExpHeapDirection::FromEnd);
    }
-
-   return largestFree;
 }
 
 uint16_t
@@ -728,6 +950,17 @@ dumpExpandedHeap(virt_ptr<MEMExpHeap> heap)
    }
 }
 
+/**
+ * Drop every host free index, they will be rebuilt from the guest free lists
+ * on next use. Must be called whenever guest memory is replaced wholesale.
+ */
+void
+resetExpHeapFreeIndices()
+{
+   std::unique_lock lock { sFreeIndexMutex };
+   sFreeIndices.clear();
+}
+
 } // namespace internal
 
 void
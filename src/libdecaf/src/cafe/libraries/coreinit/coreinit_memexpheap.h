@@ -130,6 +130,9 @@ namespace internal
 void
 dumpExpandedHeap(virt_ptr<MEMExpHeap> handle);
 
+void
+resetExpHeapFreeIndices();
+
 } // namespace internal
 
 /** @} */
@@ -1,4 +1,5 @@
 #include "gx2.h"
+#include "gx2_aperture.h"
 #include "gx2_debug.h"
 #include "gx2r_resource.h"
 
@@ -9,6 +10,7 @@ static int32_t
 rpl_entry(coreinit::OSDynLoad_ModuleHandle moduleHandle,
           coreinit::OSDynLoad_EntryReason reason)
 {
+   internal::initialiseApertures();
    internal::initialiseDebug();
    internal::initialiseGx2rAllocator();
    return 0;
@@ -7,8 +7,17 @@
 #include "cafe/libraries/coreinit/coreinit_memory.h"
 #include "cafe/libraries/tcl/tcl_aperture.h"
 
+#include <algorithm>
+#include <array>
+#include <common/align.h>
+#include <common/log.h>
+#include <common/platform_memory.h>
+#include <libcpu/cpu.h>
+#include <libcpu/cpu_formatters.h>
 #include <libgpu/gpu7_tiling.h>
 #include <libgpu/gpu7_tiling_cpu.h>
+#include <mutex>
+#include <vector>
 
 namespace cafe::gx2
 {
@@ -16,6 +25,55 @@ namespace cafe::gx2
 using namespace cafe::coreinit;
 using namespace cafe::tcl;
 
+/*
+Tiled apertures are emulated lazily. Rather than untiling the whole surface
+when the aperture is allocated, the host pages of the aperture are protected
+and a page is only untiled on its first access. Untiling works on whole rows
+of macro tiles, a row is untiled the first time any page overlapping it is
+touched. Pages are first unprotected as read only so that a write causes a
+second fault which marks the page as dirty, when the aperture is freed only
+the rows behind dirty pages are retiled into the surface.
+
+The untiled data is always written and read through the physical view of the
+aperture, which is never protected.
+*/
+
+enum class AperturePageState : uint8_t
+{
+   //! Not accessed yet, the host page is not accessible.
+   Protected,
+
+   //! Untiled and read only.
+   Clean,
+
+   //! Written to, must be retiled when the aperture is freed.
+   Dirty,
+};
+
+struct LazyAperture
+{
+   bool active = false;
+   gpu7::tiling::RetileInfo retileInfo;
+   uint8_t *tiled = nullptr;
+   uint8_t *untiled = nullptr;
+   uint32_t slice = 0;
+
+   //! A row of macro tiles, the granularity at which we retile.
+   uint32_t rowBytes = 0;
+   uint32_t rowTiles = 0;
+   uint32_t numRows = 0;
+   uint32_t untiledBytes = 0;
+   std::vector<bool> rowUntiled;
+
+   //! Only host pages which lie entirely within the aperture are protected,
+   //! the rows overlapping the partial pages at either end are untiled
+   //! eagerly and always retiled.
+   uint32_t firstPageOffset = 0;
+   uint32_t lastPageOffset = 0;
+   virt_addr firstPage;
+   std::vector<AperturePageState> pages;
+};
+
 struct ApertureInfo
 {
    gpu7::tiling::RetileInfo retileInfo;
@@ -35,6 +93,173 @@ struct StaticApertureData
 static virt_ptr<StaticApertureData>
 sApertureData = nullptr;
 
+static std::mutex
+sLazyApertureMutex;
+
+static std::array<LazyAperture, 32>
+sLazyApertures;
+
+static internal::ApertureStats
+sApertureStats;
+
+static size_t
+sHostPageSize = 0;
+
+static void
+untileApertureRows(LazyAperture &aperture,
+                   uint32_t begin,
+                   uint32_t end)
+{
+   if (begin >= end) {
+      return;
+   }
+
+   auto firstRow = begin / aperture.rowBytes;
+   auto lastRow = std::min((end - 1) / aperture.rowBytes, aperture.numRows - 1);
+
+   for (auto row = firstRow; row <= lastRow; ++row) {
+      if (aperture.rowUntiled[row]) {
+         continue;
+      }
+
+      auto firstTile = row * aperture.rowTiles;
+      auto numTiles = std::min(aperture.rowTiles,
+                               aperture.retileInfo.numTilesPerSlice - firstTile);
+      gpu7::tiling::cpu::untileRange(aperture.retileInfo,
+                                     aperture.untiled,
+                                     aperture.tiled,
+                                     aperture.slice,
+                                     firstTile,
+                                     numTiles);
+      aperture.rowUntiled[row] = true;
+      sApertureStats.numRowsUntiled++;
+   }
+}
+
+static void
+markApertureRows(const LazyAperture &aperture,
+                 std::vector<bool> &rows,
+                 uint32_t begin,
+                 uint32_t end)
+{
+   if (begin >= end) {
+      return;
+   }
+
+   auto firstRow = begin / aperture.rowBytes;
+   auto lastRow = std::min((end - 1) / aperture.rowBytes, aperture.numRows - 1);
+
+   for (auto row = firstRow; row <= lastRow; ++row) {
+      rows[row] = true;
+   }
+}
+
+static bool
+protectAperturePage(const LazyAperture &aperture,
+                    uint32_t page,
+                    platform::ProtectFlags flags)
+{
+   auto address = aperture.firstPage + static_cast<uint32_t>(page * sHostPageSize);
+   if (!platform::protectMemory(cpu::getBaseVirtualAddress() + static_cast<uint32_t>(address),
+                                sHostPageSize,
+                                flags)) {
+      gLog->error("Failed to change protection of tiling aperture page at {}", address);
+      return false;
+   }
+
+   return true;
+}
+
+static void
+allocateLazyAperture(LazyAperture &aperture,
+                     virt_addr untiledAddress)
+{
+   const auto &info = aperture.retileInfo;
+   const auto thinMicroTileBytes = info.thickMicroTileBytes / info.microTileThickness;
+   aperture.rowTiles = info.numTilesPerRow * info.macroTileHeight;
+   aperture.rowBytes = aperture.rowTiles * thinMicroTileBytes;
+   aperture.numRows = (info.numTilesPerSlice + aperture.rowTiles - 1) / aperture.rowTiles;
+   aperture.untiledBytes = info.numTilesPerSlice * thinMicroTileBytes;
+   aperture.rowUntiled.assign(aperture.numRows, false);
+
+   auto begin = static_cast<uint32_t>(untiledAddress);
+   auto end = begin + aperture.untiledBytes;
+   auto firstPage = align_up(begin, sHostPageSize);
+   auto lastPage = align_down(end, sHostPageSize);
+
+   if (firstPage >= lastPage) {
+      // Too small to cover a whole host page
+      aperture.firstPageOffset = aperture.untiledBytes;
+      aperture.lastPageOffset = aperture.untiledBytes;
+      aperture.pages.clear();
+      untileApertureRows(aperture, 0, aperture.untiledBytes);
+      return;
+   }
+
+   aperture.firstPageOffset = firstPage - begin;
+   aperture.lastPageOffset = lastPage - begin;
+   aperture.firstPage = virt_addr { firstPage };
+   aperture.pages.assign((lastPage - firstPage) / sHostPageSize,
+                         AperturePageState::Protected);
+
+   untileApertureRows(aperture, 0, aperture.firstPageOffset);
+   untileApertureRows(aperture, aperture.lastPageOffset, aperture.untiledBytes);
+
+   for (auto i = 0u; i < aperture.pages.size(); ++i) {
+      if (!protectAperturePage(aperture, i, platform::ProtectFlags::NoAccess)) {
+         // We will never see a fault for this page, so untile it now and
+         // treat it as written so it is retiled on free.
+         auto pageOffset = aperture.firstPageOffset + static_cast<uint32_t>(i * sHostPageSize);
+         untileApertureRows(aperture, pageOffset,
+                            pageOffset + static_cast<uint32_t>(sHostPageSize));
+         aperture.pages[i] = AperturePageState::Dirty;
+      }
+   }
+
+   sApertureStats.numPagesAllocated += aperture.pages.size();
+}
+
+static void
+freeLazyAperture(LazyAperture &aperture)
+{
+   // The partial pages at either end are never protected so we can not tell
+   // whether they were written to.
+   auto retileRows = std::vector<bool>(aperture.numRows, false);
+   markApertureRows(aperture, retileRows, 0, aperture.firstPageOffset);
+   markApertureRows(aperture, retileRows, aperture.lastPageOffset, aperture.untiledBytes);
+
+   for (auto i = 0u; i < aperture.pages.size(); ++i) {
+      if (aperture.pages[i] == AperturePageState::Dirty) {
+         auto pageOffset = aperture.firstPageOffset + static_cast<uint32_t>(i * sHostPageSize);
+         markApertureRows(aperture, retileRows, pageOffset,
+                          pageOffset + static_cast<uint32_t>(sHostPageSize));
+      } else {
+         protectAperturePage(aperture, i, platform::ProtectFlags::ReadWrite);
+      }
+   }
+
+   for (auto row = 0u; row < aperture.numRows; ++row) {
+      if (!retileRows[row]) {
+         continue;
+      }
+
+      auto firstTile = row * aperture.rowTiles;
+      auto numTiles = std::min(aperture.rowTiles,
+                               aperture.retileInfo.numTilesPerSlice - firstTile);
+      gpu7::tiling::cpu::tileRange(aperture.retileInfo,
+                                   aperture.untiled,
+                                   aperture.tiled,
+                                   aperture.slice,
+                                   firstTile,
+                                   numTiles);
+      sApertureStats.numRowsRetiled++;
+   }
+
+   aperture.active = false;
+   aperture.pages.clear();
+   aperture.rowUntiled.clear();
+}
+
 void
 GX2AllocateTilingApertureEx(virt_ptr<GX2Surface> surface,
                             uint32_t level,
@@ -94,11 +319,24 @@ GX2AllocateTilingApertureEx(virt_ptr<GX2Surface> surface,
       info.slice = depth;
       info.numSlices = 1u;
 
-      gpu7::tiling::cpu::untile(info.retileInfo,
-                                virt_cast<uint8_t *>(info.untiledAddress).get(),
-                                virt_cast<uint8_t *>(info.tiledAddress).get(),
-                                info.slice,
-                                info.numSlices);
+      if (!info.retileInfo.isTiled) {
+         gpu7::tiling::cpu::untile(info.retileInfo,
+                                   virt_cast<uint8_t *>(info.untiledAddress).get(),
+                                   virt_cast<uint8_t *>(info.tiledAddress).get(),
+                                   info.slice,
+                                   info.numSlices);
+         return;
+      }
+
+      auto lock = std::unique_lock { sLazyApertureMutex };
+      auto &aperture = sLazyApertures[*outHandle];
+      aperture.retileInfo = info.retileInfo;
+      aperture.tiled = virt_cast<uint8_t *>(info.tiledAddress).get();
+      aperture.untiled = phys_cast<uint8_t *>(OSEffectiveToPhysical(info.untiledAddress)).get();
+      aperture.slice = info.slice;
+      allocateLazyAperture(aperture, info.untiledAddress);
+      aperture.active = true;
+      sApertureStats.numApertures++;
    }
 }
 
@@ -106,7 +344,12 @@ void
 GX2FreeTilingAperture(GX2ApertureHandle handle)
 {
    auto &info = sApertureData->apertureInfo[handle];
-   if (info.tiledAddress && info.untiledAddress) {
+   auto lock = std::unique_lock { sLazyApertureMutex };
+   auto &aperture = sLazyApertures[handle];
+
+   if (aperture.active) {
+      freeLazyAperture(aperture);
+   } else if (info.tiledAddress && info.untiledAddress) {
       gpu7::tiling::cpu::tile(info.retileInfo,
                               virt_cast<uint8_t *>(info.untiledAddress).get(),
                               virt_cast<uint8_t *>(info.tiledAddress).get(),
@@ -114,6 +357,8 @@ GX2FreeTilingAperture(GX2ApertureHandle handle)
                               info.numSlices);
    }
 
+   lock.unlock();
+
    TCLFreeTilingAperture(handle);
    info.tiledAddress = virt_addr { 0u };
    info.tiledSize = 0u;
@@ -124,6 +369,77 @@ GX2FreeTilingAperture(GX2ApertureHandle handle)
 namespace internal
 {
 
+void
+initialiseApertures()
+{
+   auto lock = std::unique_lock { sLazyApertureMutex };
+   sHostPageSize = platform::getSystemPageSize();
+   sApertureStats = { };
+
+   for (auto &aperture : sLazyApertures) {
+      aperture = { };
+   }
+
+   cpu::setAccessFaultHandler(&handleApertureAccessFault);
+}
+
+bool
+handleApertureAccessFault(uint32_t address)
+{
+   auto lock = std::unique_lock { sLazyApertureMutex };
+
+   for (auto &aperture : sLazyApertures) {
+      if (!aperture.active || aperture.pages.empty()) {
+         continue;
+      }
+
+      auto firstPage = static_cast<uint32_t>(aperture.firstPage);
+      if (address < firstPage ||
+          address - firstPage >= aperture.pages.size() * sHostPageSize) {
+         continue;
+      }
+
+      auto page = static_cast<uint32_t>((address - firstPage) / sHostPageSize);
+      auto &state = aperture.pages[page];
+
+      if (state == AperturePageState::Protected) {
+         auto pageOffset = aperture.firstPageOffset + static_cast<uint32_t>(page * sHostPageSize);
+         untileApertureRows(aperture, pageOffset,
+                            pageOffset + static_cast<uint32_t>(sHostPageSize));
+
+         // If we cannot lift the protection the access would fault again
+         // forever, so let it be reported as a real fault instead.
+         if (!protectAperturePage(aperture, page, platform::ProtectFlags::ReadOnly)) {
+            return false;
+         }
+
+         state = AperturePageState::Clean;
+         sApertureStats.numPagesTouched++;
+      } else if (state == AperturePageState::Clean) {
+         // A fault on a read only page must be a write
+         if (!protectAperturePage(aperture, page, platform::ProtectFlags::ReadWrite)) {
+            return false;
+         }
+
+         state = AperturePageState::Dirty;
+         sApertureStats.numPagesDirty++;
+      } else {
+         return false;
+      }
+
+      return true;
+   }
+
+   return false;
+}
+
+ApertureStats
+getApertureStats()
+{
+   auto lock = std::unique_lock { sLazyApertureMutex };
+   return sApertureStats;
+}
+
 bool
 translateAperture(virt_addr &address,
                   uint32_t &size)
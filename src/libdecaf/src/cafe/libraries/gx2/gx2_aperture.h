@@ -30,6 +30,34 @@ GX2FreeTilingAperture(GX2ApertureHandle handle);
 namespace internal
 {
 
+struct ApertureStats
+{
+   //! Number of tiled apertures allocated.
+   uint64_t numApertures = 0;
+
+   //! Host pages of tiled apertures which were protected for lazy untiling.
+   uint64_t numPagesAllocated = 0;
+
+   //! Host pages which were accessed and untiled.
+   uint64_t numPagesTouched = 0;
+
+   //! Host pages which were written to and retiled on free.
+   uint64_t numPagesDirty = 0;
+
+   //! Rows of macro tiles untiled and retiled.
+   uint64_t numRowsUntiled = 0;
+   uint64_t numRowsRetiled = 0;
+};
+
+void
+initialiseApertures();
+
+bool
+handleApertureAccessFault(uint32_t address);
+
+ApertureStats
+getApertureStats();
+
 bool
 translateAperture(virt_addr &address,
                   uint32_t &size);
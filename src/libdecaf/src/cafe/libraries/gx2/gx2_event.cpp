@@ -15,9 +15,11 @@
 #include "cafe/libraries/coreinit/coreinit_time.h"
 #include "cafe/libraries/tcl/tcl_interrupthandler.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <common/log.h>
+#include <mutex>
 
 namespace cafe::gx2
 {
@@ -54,6 +56,10 @@ static OSThreadEntryPointFn sAppIoThreadEntry = nullptr;
 static AlarmCallbackFn sVsyncAlarmHandler = nullptr;
 static TCLInterruptHandlerFn sTclEventCallback = nullptr;
 
+static std::mutex sSwapStatsMutex;
+static internal::SwapStats sSwapStats;
+static std::chrono::steady_clock::time_point sLastSwapTime;
+
 /**
  * Sleep the current thread until the last submitted command buffer
  * has been processed by the driver.
@@ -211,6 +217,11 @@ initEvents(virt_ptr<void> appIoThreadStackBuffer,
    OSInitThreadQueue(virt_addrof(sEventData->flipThreadQueue));
    OSInitThreadQueue(virt_addrof(sEventData->vsyncThreadQueue));
 
+   {
+      auto lock = std::unique_lock { sSwapStatsMutex };
+      sSwapStats = { };
+   }
+
    // Setup 60hz alarm to perform vsync
    auto ticks = static_cast<OSTime>(OSGetSystemInfo()->busSpeed / 4) / 60;
    OSCreateAlarm(virt_addrof(sEventData->vsyncAlarm));
@@ -371,6 +382,33 @@ void
 onSwap()
 {
    sEventData->swapCount.fetch_add(1, std::memory_order_release);
+
+   auto now = std::chrono::steady_clock::now();
+   auto lock = std::unique_lock { sSwapStatsMutex };
+
+   if (sSwapStats.numSwaps) {
+      auto interval = static_cast<uint64_t>(
+         std::chrono::duration_cast<std::chrono::nanoseconds>(now - sLastSwapTime).count());
+      auto bucket = std::min<uint64_t>(interval / SwapIntervalBucketNs,
+                                       NumSwapIntervalBuckets - 1);
+      sSwapStats.swapIntervalHistogram[bucket]++;
+      sSwapStats.totalSwapIntervalNs += interval;
+      sSwapStats.maxSwapIntervalNs = std::max(sSwapStats.maxSwapIntervalNs, interval);
+   }
+
+   sSwapStats.numSwaps++;
+   sLastSwapTime = now;
+}
+
+
+/**
+ * Get the host timing of swaps since GX2 was initialised.
+ */
+SwapStats
+getSwapStats()
+{
+   auto lock = std::unique_lock { sSwapStatsMutex };
+   return sSwapStats;
 }
 
 
@@ -3,6 +3,7 @@
 #include "cafe/libraries/coreinit/coreinit_time.h"
 #include "gx2_enum.h"
 
+#include <array>
 #include <libcpu/be2_struct.h>
 #include <utility>
 
@@ -63,6 +64,21 @@ GX2GetSwapStatus(virt_ptr<uint32_t> outSwapCount,
 namespace internal
 {
 
+//! Width of a bucket in the swap interval histogram.
+constexpr auto SwapIntervalBucketNs = uint64_t { 100000 };
+
+//! Number of histogram buckets, the last one also counts any longer interval.
+constexpr auto NumSwapIntervalBuckets = 2000u;
+
+//! Host side timing of GX2SwapScanBuffers, used for benchmarking.
+struct SwapStats
+{
+   uint64_t numSwaps = 0;
+   uint64_t totalSwapIntervalNs = 0;
+   uint64_t maxSwapIntervalNs = 0;
+   std::array<uint64_t, NumSwapIntervalBuckets> swapIntervalHistogram = { };
+};
+
 void
 initEvents(virt_ptr<void> appIoThreadStackBuffer,
            uint32_t appIoThreadStackSize);
@@ -78,6 +94,9 @@ displayListOverrun(virt_ptr<void> list,
 void
 onSwap();
 
+SwapStats
+getSwapStats();
+
 void
 onFlip();
 
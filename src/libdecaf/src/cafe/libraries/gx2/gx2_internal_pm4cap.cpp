@@ -11,7 +11,12 @@
 #include <common/byte_swap.h>
 #include <common/log.h>
 #include <common/platform_dir.h>
+#include <common/platform_thread.h>
 #include <common/murmur3.h>
+#include <common/xxhash.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <fmt/core.h>
 #include <fstream>
 #include <gsl/gsl-lite.hpp>
@@ -23,9 +28,18 @@
 #include <libgpu/latte/latte_pm4_commands.h>
 #include <libgpu/latte/latte_pm4_reader.h>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
-
-using decaf::pm4::CaptureMagic;
+#include <zlib.h>
+
+using decaf::pm4::CaptureBlockIndexEntry;
+using decaf::pm4::CaptureBlockRef;
+using decaf::pm4::CaptureFileHeader;
+using decaf::pm4::CaptureFrameIndexEntry;
+using decaf::pm4::CaptureIndexHeader;
+using decaf::pm4::CaptureMagicV2;
+using decaf::pm4::CaptureMemoryBlock;
 using decaf::pm4::CapturePacket;
 using decaf::pm4::CaptureMemoryLoad;
 using decaf::pm4::CaptureSetBuffer;
@@ -39,6 +53,10 @@ HashAllMemory = true;
 static const auto
 HashShadowState = true;
 
+//! Submission blocks once this much data is waiting for the writer thread.
+static constexpr auto
+MaxQueuedWriteBytes = size_t { 256 * 1024 * 1024 };
+
 namespace cafe::gx2::internal
 {
 
@@ -51,12 +69,42 @@ class Recorder
       uint64_t hash[2];
    };
 
+   /*
+   Packets are copied into a WriteRecord on the submission path and written
+   out by mWriterThread, which does the block hashing, deduplication and
+   compression so none of it slows down the game.
+   */
+   struct WriteRecord
+   {
+      CapturePacket packet;
+
+      //! Written directly after the packet.
+      std::vector<uint8_t> header;
+
+      //! Written as a MemoryBlock referred to after the header.
+      std::vector<uint8_t> block;
+      bool hasBlock = false;
+   };
+
 public:
    Recorder()
    {
       mRegisters.fill(0);
    }
 
+   ~Recorder()
+   {
+      if (mWriterThread.joinable()) {
+         {
+            std::unique_lock<std::mutex> lock { mWriterMutex };
+            mWriterStop = true;
+         }
+
+         mWriterCondition.notify_all();
+         mWriterThread.join();
+      }
+   }
+
    bool
    requestStart(const std::string &path)
    {
@@ -68,11 +116,19 @@ public:
          return false;
       }
 
-      // Write magic header
-      mOut.write(CaptureMagic.data(), CaptureMagic.size());
+      // Write magic header, the index offset is filled in by stop
+      auto fileHeader = CaptureFileHeader { };
+      fileHeader.indexOffset = 0;
+      mOut.write(CaptureMagicV2.data(), CaptureMagicV2.size());
+      mOut.write(reinterpret_cast<const char *>(&fileHeader), sizeof(CaptureFileHeader));
 
       // Set intial state
       mRecordedMemory.clear();
+      mBlockOffsets.clear();
+      mFrameIndex.clear();
+      mWriterStop = false;
+      mWriterThread = std::thread { [this]() { writerThreadEntry(); } };
+      platform::setThreadName(&mWriterThread, "PM4 Capture Writer");
       mState = CaptureState::WaitStartNextFrame;
 
       return true;
@@ -109,6 +165,8 @@ public:
       } else if (mState == CaptureState::WaitEndNextFrame) {
          stop();
          mCaptureNumFrames = 0;
+      } else if (mState == CaptureState::Enabled) {
+         writeFrame();
       }
 
       ++mCapturedFrames;
@@ -129,11 +187,12 @@ public:
          phys_cast<uint32_t *>(OSEffectiveToPhysical(virt_cast<virt_addr>(buffer))),
          numWords);
 
-      CapturePacket packet;
-      packet.type = CapturePacket::CommandBuffer;
-      packet.size = numWords * 4;
-      writePacket(packet);
-      writeData(buffer.get(), packet.size);
+      auto record = WriteRecord { };
+      record.packet.type = CapturePacket::CommandBuffer;
+      record.hasBlock = true;
+      record.block.resize(numWords * 4);
+      std::memcpy(record.block.data(), buffer.get(), record.block.size());
+      queueRecord(std::move(record));
    }
 
    void
@@ -161,6 +220,7 @@ private:
    {
       decaf_check(mState == CaptureState::Disabled || mState == CaptureState::WaitStartNextFrame);
       mState = CaptureState::Enabled;
+      writeFrame();
       writeRegisterSnapshot();
       writeDisplayInfo();
    }
@@ -169,18 +229,36 @@ private:
    stop()
    {
       decaf_check(mState == CaptureState::Enabled || mState == CaptureState::WaitEndNextFrame);
+
+      {
+         std::unique_lock<std::mutex> lock { mWriterMutex };
+         mWriterStop = true;
+      }
+
+      mWriterCondition.notify_all();
+      mWriterThread.join();
+
+      writeIndex();
       mOut.close();
       mState = CaptureState::Disabled;
    }
 
+   void
+   writeFrame()
+   {
+      auto record = WriteRecord { };
+      record.packet.type = CapturePacket::Frame;
+      queueRecord(std::move(record));
+   }
+
    void
    writeRegisterSnapshot()
    {
-      CapturePacket packet;
-      packet.type = CapturePacket::RegisterSnapshot;
-      packet.size = static_cast<uint32_t>(mRegisters.size() * sizeof(uint32_t));
-      writePacket(packet);
-      writeData(mRegisters.data(), packet.size);
+      auto record = WriteRecord { };
+      record.packet.type = CapturePacket::RegisterSnapshot;
+      record.header.resize(mRegisters.size() * sizeof(uint32_t));
+      std::memcpy(record.header.data(), mRegisters.data(), record.header.size());
+      queueRecord(std::move(record));
    }
 
    void
@@ -188,11 +266,6 @@ private:
    {
       auto tvScanBuffer = getTvScanBuffer();
       if (tvScanBuffer->image) {
-         CapturePacket packet;
-         packet.type = CapturePacket::SetBuffer;
-         packet.size = sizeof(CaptureSetBuffer);
-         writePacket(packet);
-
          CaptureSetBuffer setBuffer;
          setBuffer.type = CaptureSetBuffer::TvBuffer;
          setBuffer.address = OSEffectiveToPhysical(virt_cast<virt_addr>(tvScanBuffer->image));
@@ -202,16 +275,11 @@ private:
          setBuffer.bufferingMode = GX2BufferingMode::Double;
          setBuffer.width = tvScanBuffer->width;
          setBuffer.height = tvScanBuffer->height;
-         writeData(&setBuffer, packet.size);
+         writeSetBuffer(setBuffer);
       }
 
       auto drcScanBuffer = getDrcScanBuffer();
       if (drcScanBuffer->image) {
-         CapturePacket packet;
-         packet.type = CapturePacket::SetBuffer;
-         packet.size = sizeof(CaptureSetBuffer);
-         writePacket(packet);
-
          CaptureSetBuffer setBuffer;
          setBuffer.type = CaptureSetBuffer::DrcBuffer;
          setBuffer.address = OSEffectiveToPhysical(virt_cast<virt_addr>(drcScanBuffer->image));
@@ -221,21 +289,18 @@ private:
          setBuffer.bufferingMode = GX2BufferingMode::Double;
          setBuffer.width = drcScanBuffer->width;
          setBuffer.height = drcScanBuffer->height;
-         writeData(&setBuffer, packet.size);
+         writeSetBuffer(setBuffer);
       }
    }
 
    void
-   writePacket(CapturePacket &packet)
-   {
-      packet.timestamp = mPacketTimestamp++;
-      mOut.write(reinterpret_cast<const char *>(&packet), sizeof(CapturePacket));
-   }
-
-   void
-   writeData(void *data, uint32_t size)
+   writeSetBuffer(const CaptureSetBuffer &setBuffer)
    {
-      mOut.write(reinterpret_cast<const char *>(data), size);
+      auto record = WriteRecord { };
+      record.packet.type = CapturePacket::SetBuffer;
+      record.header.resize(sizeof(CaptureSetBuffer));
+      std::memcpy(record.header.data(), &setBuffer, sizeof(CaptureSetBuffer));
+      queueRecord(std::move(record));
    }
 
    void
@@ -247,12 +312,150 @@ private:
       load.type = type;
       load.address = address;
 
-      CapturePacket packet;
-      packet.type = CapturePacket::MemoryLoad;
-      packet.size = size + sizeof(CaptureMemoryLoad);
-      writePacket(packet);
-      writeData(&load, sizeof(CaptureMemoryLoad));
-      writeData(phys_cast<void *>(address).get(), size);
+      auto record = WriteRecord { };
+      record.packet.type = CapturePacket::MemoryLoad;
+      record.header.resize(sizeof(CaptureMemoryLoad));
+      std::memcpy(record.header.data(), &load, sizeof(CaptureMemoryLoad));
+      record.hasBlock = true;
+      record.block.resize(size);
+      std::memcpy(record.block.data(), phys_cast<void *>(address).get(), size);
+      queueRecord(std::move(record));
+   }
+
+   void
+   queueRecord(WriteRecord &&record)
+   {
+      auto size = record.header.size() + record.block.size();
+      record.packet.timestamp = mPacketTimestamp++;
+
+      {
+         std::unique_lock<std::mutex> lock { mWriterMutex };
+         mWriterCondition.wait(lock, [&]() {
+            return mWriterQueue.empty() || mWriterQueueBytes < MaxQueuedWriteBytes;
+         });
+
+         mWriterQueueBytes += size;
+         mWriterQueue.emplace_back(std::move(record));
+      }
+
+      mWriterCondition.notify_all();
+   }
+
+   void
+   writerThreadEntry()
+   {
+      while (true) {
+         std::unique_lock<std::mutex> lock { mWriterMutex };
+         mWriterCondition.wait(lock, [&]() {
+            return mWriterStop || !mWriterQueue.empty();
+         });
+
+         if (mWriterQueue.empty()) {
+            break;
+         }
+
+         auto record = std::move(mWriterQueue.front());
+         mWriterQueue.pop_front();
+         lock.unlock();
+
+         writeRecord(record);
+
+         lock.lock();
+         mWriterQueueBytes -= record.header.size() + record.block.size();
+         lock.unlock();
+         mWriterCondition.notify_all();
+      }
+   }
+
+   void
+   writeRecord(WriteRecord &record)
+   {
+      auto offset = static_cast<uint64_t>(mOut.tellp());
+      auto ref = CaptureBlockRef { };
+
+      if (record.packet.type == CapturePacket::Frame) {
+         mFrameIndex.push_back({ offset, record.packet.timestamp });
+      }
+
+      if (record.hasBlock) {
+         ref.hash = XXH64(record.block.data(), record.block.size(), 0);
+         ref.size = static_cast<uint32_t>(record.block.size());
+
+         if (mBlockOffsets.emplace(ref.hash, offset).second) {
+            writeMemoryBlock(ref, record.block, record.packet.timestamp);
+         }
+      }
+
+      record.packet.size = static_cast<uint32_t>(record.header.size());
+      if (record.hasBlock) {
+         record.packet.size += sizeof(CaptureBlockRef);
+      }
+
+      mOut.write(reinterpret_cast<const char *>(&record.packet), sizeof(CapturePacket));
+      mOut.write(reinterpret_cast<const char *>(record.header.data()), record.header.size());
+
+      if (record.hasBlock) {
+         mOut.write(reinterpret_cast<const char *>(&ref), sizeof(CaptureBlockRef));
+      }
+   }
+
+   void
+   writeMemoryBlock(const CaptureBlockRef &ref,
+                    const std::vector<uint8_t> &data,
+                    uint64_t timestamp)
+   {
+      auto block = CaptureMemoryBlock { };
+      block.hash = ref.hash;
+      block.size = ref.size;
+      block.compression = CaptureMemoryBlock::None;
+
+      auto stored = data.data();
+      auto storedSize = static_cast<uLongf>(data.size());
+
+      // Only keep the compressed data if it actually saved something
+      auto compressedSize = compressBound(static_cast<uLong>(data.size()));
+      mCompressBuffer.resize(compressedSize);
+
+      if (compress2(mCompressBuffer.data(), &compressedSize,
+                    data.data(), static_cast<uLong>(data.size()),
+                    Z_BEST_SPEED) == Z_OK &&
+          compressedSize < data.size()) {
+         block.compression = CaptureMemoryBlock::Zlib;
+         stored = mCompressBuffer.data();
+         storedSize = compressedSize;
+      }
+
+      auto packet = CapturePacket { };
+      packet.type = CapturePacket::MemoryBlock;
+      packet.size = static_cast<uint32_t>(sizeof(CaptureMemoryBlock) + storedSize);
+      packet.timestamp = timestamp;
+      mOut.write(reinterpret_cast<const char *>(&packet), sizeof(CapturePacket));
+      mOut.write(reinterpret_cast<const char *>(&block), sizeof(CaptureMemoryBlock));
+      mOut.write(reinterpret_cast<const char *>(stored), storedSize);
+   }
+
+   void
+   writeIndex()
+   {
+      auto fileHeader = CaptureFileHeader { };
+      fileHeader.indexOffset = static_cast<uint64_t>(mOut.tellp());
+
+      auto header = CaptureIndexHeader { };
+      header.numFrames = static_cast<uint32_t>(mFrameIndex.size());
+      header.numBlocks = static_cast<uint32_t>(mBlockOffsets.size());
+      mOut.write(reinterpret_cast<const char *>(&header), sizeof(CaptureIndexHeader));
+      mOut.write(reinterpret_cast<const char *>(mFrameIndex.data()),
+                 mFrameIndex.size() * sizeof(CaptureFrameIndexEntry));
+
+      for (auto &[hash, offset] : mBlockOffsets) {
+         auto entry = CaptureBlockIndexEntry { };
+         entry.hash = hash;
+         entry.offset = offset;
+         mOut.write(reinterpret_cast<const char *>(&entry), sizeof(CaptureBlockIndexEntry));
+      }
+
+      mOut.seekp(CaptureMagicV2.size());
+      mOut.write(reinterpret_cast<const char *>(&fileHeader), sizeof(CaptureFileHeader));
    }
 
    void
@@ -886,12 +1089,24 @@ private:
 private:
    CaptureState mState = CaptureState::Disabled;
    std::mutex mMutex;
-   std::ofstream mOut;
    std::vector<RecordedMemory> mRecordedMemory;
    std::array<uint32_t, 0x10000> mRegisters;
    size_t mCapturedFrames = 0;
    size_t mCaptureNumFrames = 0;
    uint64_t mPacketTimestamp = 0ull;
+
+   std::thread mWriterThread;
+   std::mutex mWriterMutex;
+   std::condition_variable mWriterCondition;
+   std::deque<WriteRecord> mWriterQueue;
+   size_t mWriterQueueBytes = 0;
+   bool mWriterStop = false;
+
+   //! Only accessed by the writer thread while it is running.
+   std::ofstream mOut;
+   std::unordered_map<uint64_t, uint64_t> mBlockOffsets;
+   std::vector<CaptureFrameIndexEntry> mFrameIndex;
+   std::vector<uint8_t> mCompressBuffer;
 };
 
 static Recorder
@@ -7,11 +7,17 @@
 #include "cafe/cafe_stackobject.h"
 #include "cafe/libraries/cafe_hle_stub.h"
 
+#include <algorithm>
+#include <array>
 #include <common/align.h>
 #include <common/decaf_assert.h>
 #include <common/log.h>
+#include <common/platform.h>
+#include <common/platform_intrin.h>
+#include <cstring>
 #include <fmt/core.h>
 #include <libcpu/cpu_formatters.h>
+#include <thread>
 
 // ffmpeg unfortunately does not validate with high warning levels
 #ifdef _MSC_VER
@@ -30,6 +36,17 @@ extern "C" {
 namespace cafe::h264
 {
 
+/*
+Every frame submitted to ffmpeg waits for output in one of these slots. A
+stream may declare a reorder delay of up to 16 frames and frame threading
+holds up to one more frame per thread, so the slots comfortably outnumber
+the frames which can be in flight at once.
+*/
+static constexpr auto MaxPendingFrames = 32u;
+static constexpr auto MaxReorderFrames = 16u;
+static constexpr int MaxFrameThreads = 3;
+static_assert(MaxReorderFrames + MaxFrameThreads + 1 <= MaxPendingFrames);
+
 // This is decaf specific stuff - does not match structure in h264.rpl
 struct H264CodecMemory
 {
@@ -37,10 +54,14 @@ struct H264CodecMemory
    AVFrame *frame;
    AVCodecParserContext *parser;
    SwsContext *sws;
-   int swsWidth;
-   int swsHeight;
-   int inputFrameIndex;
-   int outputFrameIndex;
+
+   //! The packet pts of the next frame, frames are matched back to their
+   //! slot in pendingFrames by pts as they are output in display order.
+   int64_t nextPts;
+
+   //! The pts of the frame waiting in each slot, or -1 for a free slot.
+   std::array<int64_t, MaxPendingFrames> pendingPts;
+   std::array<H264DecodedFrameInfo, MaxPendingFrames> pendingFrames;
 
    //! HACK: This is just a copy of the most recently seen vui_parameters in
    //! the stream, technically it should probably be the ones that are in the
@@ -49,11 +70,121 @@ struct H264CodecMemory
    H264DecodedVuiParameters vui_parameters;
 };
 
+// Must fit before l1Memory in the work memory
+static_assert(sizeof(H264CodecMemory) <= 0x445F00 - 0x442300);
+
 } // namespace cafe::h264
 
 namespace cafe::h264::ffmpeg
 {
 
+static void
+copyPlane(uint8_t *dst,
+          int dstStride,
+          const uint8_t *src,
+          int srcStride,
+          int width,
+          int height)
+{
+   if (dstStride == srcStride) {
+      std::memcpy(dst, src, static_cast<size_t>(dstStride) * (height - 1) + width);
+      return;
+   }
+
+   for (auto y = 0; y < height; ++y) {
+      std::memcpy(dst + y * dstStride, src + y * srcStride, width);
+   }
+}
+
+static void
+interleaveChroma(uint8_t *dst,
+                 const uint8_t *u,
+                 const uint8_t *v,
+                 int width)
+{
+   auto x = 0;
+
+#ifdef PLATFORM_HAS_SSE2
+   for (; x + 16 <= width; x += 16) {
+      auto uu = _mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x));
+      auto vv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + x));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * x),
+                       _mm_unpacklo_epi8(uu, vv));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * x + 16),
+                       _mm_unpackhi_epi8(uu, vv));
+   }
+#endif
+
+   for (; x < width; ++x) {
+      dst[2 * x + 0] = u[x];
+      dst[2 * x + 1] = v[x];
+   }
+}
+
+/**
+ * Write a decoded frame to the guest frame buffer as NV12.
+ *
+ * NV12 and YUV420P frames are copied directly as they only differ in how
+ * the chroma is laid out, anything else is converted with swscale.
+ */
+static bool
+writeFrameNV12(H264CodecMemory *codecMemory,
+               AVFrame *frame,
+               uint8_t *dstLuma,
+               uint8_t *dstChroma,
+               int pitch)
+{
+   auto chromaWidth = (frame->width + 1) / 2;
+   auto chromaHeight = (frame->height + 1) / 2;
+
+   switch (frame->format) {
+   case AV_PIX_FMT_NV12:
+      copyPlane(dstLuma, pitch, frame->data[0], frame->linesize[0],
+                frame->width, frame->height);
+      copyPlane(dstChroma, pitch, frame->data[1], frame->linesize[1],
+                chromaWidth * 2, chromaHeight);
+      return true;
+   case AV_PIX_FMT_YUV420P:
+      copyPlane(dstLuma, pitch, frame->data[0], frame->linesize[0],
+                frame->width, frame->height);
+
+      for (auto y = 0; y < chromaHeight; ++y) {
+         interleaveChroma(dstChroma + y * pitch,
+                          frame->data[1] + y * frame->linesize[1],
+                          frame->data[2] + y * frame->linesize[2],
+                          chromaWidth);
+      }
+      return true;
+   default:
+      break;
+   }
+
+   // Reuses the previous context when the frame size and format still match
+   codecMemory->sws =
+      sws_getCachedContext(codecMemory->sws,
+                           frame->width, frame->height,
+                           static_cast<AVPixelFormat>(frame->format),
+                           frame->width, frame->height, AV_PIX_FMT_NV12,
+                           0, nullptr, nullptr, nullptr);
+   if (!codecMemory->sws) {
+      return false;
+   }
+
+   uint8_t *dstBuffers[] = {
+      dstLuma,
+      dstChroma,
+   };
+   int dstStride[] = {
+      pitch, pitch
+   };
+
+   sws_scale(codecMemory->sws,
+             frame->data, frame->linesize,
+             0, frame->height,
+             dstBuffers, dstStride);
+   return true;
+}
+
 static int
 receiveFrames(virt_ptr<H264WorkMemory> workMemory)
 {
@@ -68,11 +199,17 @@ receiveFrames(virt_ptr<H264WorkMemory> workMemory)
          break;
       }
 
-      // Get the decoded frame info
-      auto &decodedFrameInfo = streamMemory->decodedFrameInfos[codecMemory->outputFrameIndex];
-      codecMemory->outputFrameIndex =
-         (codecMemory->outputFrameIndex + 1) % streamMemory->decodedFrameInfos.size();
+      // Get the decoded frame info the frame was submitted with
+      auto pts = frame->pts;
+      auto slot = static_cast<size_t>(pts % MaxPendingFrames);
+      if (pts < 0 || codecMemory->pendingPts[slot] != pts) {
+         gLog->error("Decoded H264 frame has unexpected pts {}", pts);
+         av_frame_unref(frame);
+         continue;
+      }
 
+      codecMemory->pendingPts[slot] = -1;
+      auto &decodedFrameInfo = codecMemory->pendingFrames[slot];
 
       auto decodeResult = StackObject<H264DecodeResult> { };
       decodeResult->status = 100;
@@ -80,38 +217,13 @@ receiveFrames(virt_ptr<H264WorkMemory> workMemory)
 
       const auto pitch = align_up(frame->width, 256);
 
-      // Destroy previously created SWS if there is different width/height
-      if (codecMemory->sws &&
-         (codecMemory->swsWidth != frame->width ||
-          codecMemory->swsHeight != frame->height)) {
-         sws_freeContext(codecMemory->sws);
-         codecMemory->sws = nullptr;
-      }
-
-      // Create SWS context if needed
-      if (!codecMemory->sws) {
-         codecMemory->sws =
-            sws_getContext(frame->width, frame->height,
-                           static_cast<AVPixelFormat>(frame->format),
-                           frame->width, frame->height, AV_PIX_FMT_NV12,
-                           0, nullptr, nullptr, nullptr);
-      }
-
-      // Use SWS to convert frame output to NV12 format
-      decaf_check(codecMemory->sws);
+      // Write frame output to the guest frame buffer in NV12 format
       auto frameBuffer = virt_cast<uint8_t *>(decodedFrameInfo.buffer);
-      uint8_t *dstBuffers[] = {
-         frameBuffer.get(),
-         frameBuffer.get() + frame->height * pitch,
-      };
-      int dstStride[] = {
-         pitch, pitch
-      };
-
-      sws_scale(codecMemory->sws,
-                frame->data, frame->linesize,
-                0, frame->height,
-                dstBuffers, dstStride);
+      auto converted = writeFrameNV12(codecMemory.get(), frame,
+                                      frameBuffer.get(),
+                                      frameBuffer.get() + frame->height * pitch,
+                                      pitch);
+      decaf_check(converted);
 
       decodeResult->framebuffer = frameBuffer;
       decodeResult->width = frame->width;
@@ -170,6 +282,7 @@ receiveFrames(virt_ptr<H264WorkMemory> workMemory)
       cafe::invoke(cpu::this_core::state(),
                    streamMemory->paramFramePointerOutput,
                    output);
+      av_frame_unref(frame);
    }
 
    if (result == AVERROR_EOF || result == AVERROR(EAGAIN)) {
@@ -210,8 +323,11 @@ H264DECOpen(virt_ptr<void> memory)
       return H264Error::GenericError;
    }
 
-   context->flags |= AV_CODEC_FLAG_LOW_DELAY;
-   context->thread_type = FF_THREAD_SLICE;
+   // AV_CODEC_FLAG_LOW_DELAY would disable frame threading
+   context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+   context->thread_count =
+      std::clamp(static_cast<int>(std::thread::hardware_concurrency()),
+                 1, MaxFrameThreads);
    context->pix_fmt = AV_PIX_FMT_NV12;
 
    if (avcodec_open2(context, codec, NULL) < 0) {
@@ -246,8 +362,8 @@ H264DECBegin(virt_ptr<void> memory)
    // Open a new parser, because there is no reset function for it and I don't
    // know if it has internal state which is important :).
    workMemory->codecMemory->parser = av_parser_init(AV_CODEC_ID_H264);
-   workMemory->codecMemory->inputFrameIndex = 0;
-   workMemory->codecMemory->outputFrameIndex = 0;
+   workMemory->codecMemory->nextPts = 0;
+   workMemory->codecMemory->pendingPts.fill(-1);
 
    return H264Error::OK;
 }
@@ -297,7 +413,6 @@ H264DECExecute(virt_ptr<void> memory,
 
    auto bitStream = workMemory->bitStream;
    auto codecMemory = workMemory->codecMemory;
-   auto streamMemory = workMemory->streamMemory;
 
    if (!bitStream->buffer_length) {
       return H264Error::GenericError;
@@ -347,11 +462,22 @@ H264DECExecute(virt_ptr<void> memory,
       }
    }
 
-   // Update the decoded frame info for this frame
-   auto &decodedFrameInfo = streamMemory->decodedFrameInfos[codecMemory->inputFrameIndex];
-   codecMemory->inputFrameIndex =
-      (codecMemory->inputFrameIndex + 1) % streamMemory->decodedFrameInfos.size();
+   // Take the next slot for this frame's info, the slots outnumber the frames
+   // ffmpeg can hold so this only finds a frame still waiting if its output
+   // was lost. Receive anything which is ready before giving up on it.
+   auto pts = codecMemory->nextPts++;
+   auto slot = static_cast<size_t>(pts % MaxPendingFrames);
+   if (codecMemory->pendingPts[slot] >= 0) {
+      receiveFrames(workMemory);
+
+      if (codecMemory->pendingPts[slot] >= 0) {
+         gLog->warn("H264 frame {} was never output, reusing its slot",
+                    codecMemory->pendingPts[slot]);
+      }
+   }
 
+   auto &decodedFrameInfo = codecMemory->pendingFrames[slot];
+   codecMemory->pendingPts[slot] = pts;
    decodedFrameInfo.buffer = frameBuffer;
    decodedFrameInfo.timestamp = bitStream->timestamp;
 
@@ -369,6 +495,8 @@ H264DECExecute(virt_ptr<void> memory,
    auto* packet = av_packet_alloc();
    packet->data = bitStream->buffer.get();
    packet->size = bitStream->buffer_length;
+   packet->pts = pts;
+   packet->dts = AV_NOPTS_VALUE;
 
    auto result = avcodec_send_packet(codecMemory->context, packet);
    if (result != 0) {
@@ -409,11 +537,20 @@ H264DECFlush(virt_ptr<void> memory)
       return H264Error::InvalidParameter;
    }
 
-   // Discard internal state and buffered frames
-   if (workMemory->codecMemory->context) {
-      avcodec_flush_buffers(workMemory->codecMemory->context);
+   auto context = workMemory->codecMemory->context;
+   if (!context) {
+      return H264Error::OK;
    }
 
+   // Drain the frames still held for reordering or by the frame threads,
+   // then reset the decoder so it accepts packets again.
+   if (avcodec_send_packet(context, nullptr) == 0) {
+      receiveFrames(workMemory);
+   }
+
+   avcodec_flush_buffers(context);
+   workMemory->codecMemory->pendingPts.fill(-1);
+
    return H264Error::OK;
 }
 
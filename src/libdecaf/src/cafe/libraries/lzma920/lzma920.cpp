@@ -14,6 +14,11 @@ void
 Library::registerSymbols()
 {
    RegisterEntryPoint(rpl_entry);
+
+   registerLzmaDecSymbols();
+   registerLzma2DecSymbols();
+   registerLzmaEncSymbols();
+   registerLzma2EncSymbols();
 }
 
 } // namespace cafe::lzma920
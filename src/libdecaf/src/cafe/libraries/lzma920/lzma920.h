@@ -16,6 +16,10 @@ protected:
    virtual void registerSymbols() override;
 
 private:
+   void registerLzmaDecSymbols();
+   void registerLzma2DecSymbols();
+   void registerLzmaEncSymbols();
+   void registerLzma2EncSymbols();
 };
 
 } // namespace cafe::lzma920
@@ -0,0 +1,832 @@
+#include "lzma920_lzfind.h"
+#include "lzma920_lzmaenc.h"
+#include "cafe/cafe_ppc_interface_invoke_guest.h"
+#include "cafe/cafe_stackobject.h"
+
+#include <algorithm>
+#include <cstring>
+#include <libcpu/mmu.h>
+
+namespace cafe::lzma920::internal
+{
+
+constexpr uint32_t EmptyHashValue = 0;
+constexpr uint32_t MaxValForNormalize = 0xFFFFFFFFu;
+constexpr uint32_t NormalizeStepMin = 1u << 10;
+constexpr uint32_t NormalizeMask = ~(NormalizeStepMin - 1);
+constexpr uint32_t MaxHistorySize = 3u << 30;
+
+constexpr uint32_t Hash2Size = 1u << 10;
+constexpr uint32_t Hash3Size = 1u << 16;
+constexpr uint32_t Hash4Size = 1u << 20;
+
+constexpr uint32_t Fix3HashSize = Hash2Size;
+constexpr uint32_t Fix4HashSize = Hash2Size + Hash3Size;
+
+constexpr uint32_t CrcPoly = 0xEDB88320u;
+
+static void
+freeGuestMemory(virt_ptr<ISzAlloc> alloc,
+                void *address)
+{
+   internal::freeMemory(alloc, virt_cast<void *>(cpu::translate(address)));
+}
+
+static void
+freeWindow(MatchFinder &p,
+           virt_ptr<ISzAlloc> alloc)
+{
+   if (!p.directInput) {
+      freeGuestMemory(alloc, p.bufferBase);
+      p.bufferBase = nullptr;
+   }
+}
+
+static bool
+createWindow(MatchFinder &p,
+             uint32_t keepSizeReserv,
+             virt_ptr<ISzAlloc> alloc)
+{
+   auto blockSize = p.keepSizeBefore + p.keepSizeAfter + keepSizeReserv;
+   if (p.directInput) {
+      p.blockSize = blockSize;
+      return true;
+   }
+
+   if (!p.bufferBase || p.blockSize != blockSize) {
+      freeWindow(p, alloc);
+      p.blockSize = blockSize;
+      p.bufferBase = virt_cast<uint8_t *>(internal::allocMemory(alloc, blockSize)).get();
+   }
+
+   return p.bufferBase != nullptr;
+}
+
+static void
+reduceOffsets(MatchFinder &p,
+              uint32_t subValue)
+{
+   p.posLimit -= subValue;
+   p.pos -= subValue;
+   p.streamPos -= subValue;
+}
+
+/**
+ * Reads from the guest stream until keepSizeAfter bytes are available past
+ * pos or the window is full.
+ */
+static void
+readBlock(MatchFinder &p)
+{
+   if (p.streamEndWasReached || p.result != SZ_OK) {
+      return;
+   }
+
+   if (p.directInput) {
+      auto curSize = 0xFFFFFFFFu - p.streamPos;
+      if (curSize > p.directInputRem) {
+         curSize = p.directInputRem;
+      }
+
+      p.directInputRem -= curSize;
+      p.streamPos += curSize;
+      if (p.directInputRem == 0) {
+         p.streamEndWasReached = true;
+      }
+
+      return;
+   }
+
+   auto size = StackObject<uint32_t> { };
+
+   while (true) {
+      auto dest = p.buffer + (p.streamPos - p.pos);
+      *size = static_cast<uint32_t>(p.bufferBase + p.blockSize - dest);
+      if (*size == 0) {
+         return;
+      }
+
+      p.result = cafe::invoke(cpu::this_core::state(),
+                               p.stream->Read,
+                               p.stream,
+                               virt_cast<void *>(cpu::translate(dest)),
+                               size);
+      if (p.result != SZ_OK) {
+         return;
+      }
+
+      if (*size == 0) {
+         p.streamEndWasReached = true;
+         return;
+      }
+
+      p.streamPos += *size;
+      if (p.streamPos - p.pos > p.keepSizeAfter) {
+         return;
+      }
+   }
+}
+
+static void
+moveBlock(MatchFinder &p)
+{
+   std::memmove(p.bufferBase,
+                p.buffer - p.keepSizeBefore,
+                p.streamPos - p.pos + p.keepSizeBefore);
+   p.buffer = p.bufferBase + p.keepSizeBefore;
+}
+
+static bool
+needMove(MatchFinder &p)
+{
+   if (p.directInput) {
+      return false;
+   }
+
+   return static_cast<uint32_t>(p.bufferBase + p.blockSize - p.buffer) <= p.keepSizeAfter;
+}
+
+static void
+checkAndMoveAndRead(MatchFinder &p)
+{
+   if (needMove(p)) {
+      moveBlock(p);
+   }
+
+   readBlock(p);
+}
+
+static void
+freeHash(MatchFinder &p,
+         virt_ptr<ISzAlloc> alloc)
+{
+   freeGuestMemory(alloc, p.hash);
+   p.hash = nullptr;
+}
+
+static void
+setLimits(MatchFinder &p)
+{
+   auto limit = MaxValForNormalize - p.pos;
+   auto limit2 = p.cyclicBufferSize - p.cyclicBufferPos;
+   if (limit2 < limit) {
+      limit = limit2;
+   }
+
+   limit2 = p.streamPos - p.pos;
+   if (limit2 <= p.keepSizeAfter) {
+      if (limit2 > 0) {
+         limit2 = 1;
+      }
+   } else {
+      limit2 -= p.keepSizeAfter;
+   }
+
+   if (limit2 < limit) {
+      limit = limit2;
+   }
+
+   auto lenLimit = p.streamPos - p.pos;
+   if (lenLimit > p.matchMaxLen) {
+      lenLimit = p.matchMaxLen;
+   }
+
+   p.lenLimit = lenLimit;
+   p.posLimit = p.pos + limit;
+}
+
+static void
+normalize(MatchFinder &p)
+{
+   auto subValue = (p.pos - p.historySize - 1) & NormalizeMask;
+   auto items = p.hash;
+   auto numItems = p.hashSizeSum + p.numSons;
+
+   for (auto i = 0u; i < numItems; ++i) {
+      auto value = items[i];
+      if (value <= subValue) {
+         value = EmptyHashValue;
+      } else {
+         value -= subValue;
+      }
+
+      items[i] = value;
+   }
+
+   reduceOffsets(p, subValue);
+}
+
+static void
+checkLimits(MatchFinder &p)
+{
+   if (p.pos == MaxValForNormalize) {
+      normalize(p);
+   }
+
+   if (!p.streamEndWasReached && p.keepSizeAfter == p.streamPos - p.pos) {
+      checkAndMoveAndRead(p);
+   }
+
+   if (p.cyclicBufferPos == p.cyclicBufferSize) {
+      p.cyclicBufferPos = 0;
+   }
+
+   setLimits(p);
+}
+
+static inline void
+movePos(MatchFinder &p)
+{
+   ++p.cyclicBufferPos;
+   p.buffer++;
+
+   if (++p.pos == p.posLimit) {
+      checkLimits(p);
+   }
+}
+
+static uint32_t *
+hcGetMatchesSpec(uint32_t lenLimit,
+                 uint32_t curMatch,
+                 uint32_t pos,
+                 const uint8_t *cur,
+                 LzRef *son,
+                 uint32_t cyclicBufferPos,
+                 uint32_t cyclicBufferSize,
+                 uint32_t cutValue,
+                 uint32_t *distances,
+                 uint32_t maxLen)
+{
+   son[cyclicBufferPos] = curMatch;
+
+   while (true) {
+      auto delta = pos - curMatch;
+      if (cutValue-- == 0 || delta >= cyclicBufferSize) {
+         return distances;
+      }
+
+      auto pb = cur - delta;
+      curMatch = son[cyclicBufferPos - delta + ((delta > cyclicBufferPos) ? cyclicBufferSize : 0)];
+
+      if (pb[maxLen] == cur[maxLen] && *pb == *cur) {
+         auto len = 0u;
+         while (++len != lenLimit) {
+            if (pb[len] != cur[len]) {
+               break;
+            }
+         }
+
+         if (maxLen < len) {
+            *distances++ = maxLen = len;
+            *distances++ = delta - 1;
+            if (len == lenLimit) {
+               return distances;
+            }
+         }
+      }
+   }
+}
+
+static uint32_t *
+btGetMatchesSpec(uint32_t lenLimit,
+                 uint32_t curMatch,
+                 uint32_t pos,
+                 const uint8_t *cur,
+                 LzRef *son,
+                 uint32_t cyclicBufferPos,
+                 uint32_t cyclicBufferSize,
+                 uint32_t cutValue,
+                 uint32_t *distances,
+                 uint32_t maxLen)
+{
+   auto ptr0 = son + (cyclicBufferPos << 1) + 1;
+   auto ptr1 = son + (cyclicBufferPos << 1);
+   auto len0 = 0u;
+   auto len1 = 0u;
+
+   while (true) {
+      auto delta = pos - curMatch;
+      if (cutValue-- == 0 || delta >= cyclicBufferSize) {
+         *ptr0 = *ptr1 = EmptyHashValue;
+         return distances;
+      }
+
+      auto pair = son + ((cyclicBufferPos - delta + ((delta > cyclicBufferPos) ? cyclicBufferSize : 0)) << 1);
+      auto pb = cur - delta;
+      auto len = (len0 < len1) ? len0 : len1;
+
+      if (pb[len] == cur[len]) {
+         if (++len != lenLimit && pb[len] == cur[len]) {
+            while (++len != lenLimit) {
+               if (pb[len] != cur[len]) {
+                  break;
+               }
+            }
+         }
+
+         if (maxLen < len) {
+            *distances++ = maxLen = len;
+            *distances++ = delta - 1;
+            if (len == lenLimit) {
+               *ptr1 = pair[0];
+               *ptr0 = pair[1];
+               return distances;
+            }
+         }
+      }
+
+      if (pb[len] < cur[len]) {
+         *ptr1 = curMatch;
+         ptr1 = pair + 1;
+         curMatch = *ptr1;
+         len1 = len;
+      } else {
+         *ptr0 = curMatch;
+         ptr0 = pair;
+         curMatch = *ptr0;
+         len0 = len;
+      }
+   }
+}
+
+static void
+btSkipMatchesSpec(uint32_t lenLimit,
+                  uint32_t curMatch,
+                  uint32_t pos,
+                  const uint8_t *cur,
+                  LzRef *son,
+                  uint32_t cyclicBufferPos,
+                  uint32_t cyclicBufferSize,
+                  uint32_t cutValue)
+{
+   auto ptr0 = son + (cyclicBufferPos << 1) + 1;
+   auto ptr1 = son + (cyclicBufferPos << 1);
+   auto len0 = 0u;
+   auto len1 = 0u;
+
+   while (true) {
+      auto delta = pos - curMatch;
+      if (cutValue-- == 0 || delta >= cyclicBufferSize) {
+         *ptr0 = *ptr1 = EmptyHashValue;
+         return;
+      }
+
+      auto pair = son + ((cyclicBufferPos - delta + ((delta > cyclicBufferPos) ? cyclicBufferSize : 0)) << 1);
+      auto pb = cur - delta;
+      auto len = (len0 < len1) ? len0 : len1;
+
+      if (pb[len] == cur[len]) {
+         while (++len != lenLimit) {
+            if (pb[len] != cur[len]) {
+               break;
+            }
+         }
+
+         if (len == lenLimit) {
+            *ptr1 = pair[0];
+            *ptr0 = pair[1];
+            return;
+         }
+      }
+
+      if (pb[len] < cur[len]) {
+         *ptr1 = curMatch;
+         ptr1 = pair + 1;
+         curMatch = *ptr1;
+         len1 = len;
+      } else {
+         *ptr0 = curMatch;
+         ptr0 = pair;
+         curMatch = *ptr0;
+         len0 = len;
+      }
+   }
+}
+
+static inline uint32_t *
+btGetMatches(MatchFinder &p,
+             uint32_t lenLimit,
+             uint32_t curMatch,
+             uint32_t *distances,
+             uint32_t maxLen)
+{
+   return btGetMatchesSpec(lenLimit, curMatch, p.pos, p.buffer, p.son,
+                           p.cyclicBufferPos, p.cyclicBufferSize,
+                           p.cutValue, distances, maxLen);
+}
+
+static inline void
+btSkipMatches(MatchFinder &p,
+              uint32_t lenLimit,
+              uint32_t curMatch)
+{
+   btSkipMatchesSpec(lenLimit, curMatch, p.pos, p.buffer, p.son,
+                     p.cyclicBufferPos, p.cyclicBufferSize, p.cutValue);
+}
+
+/**
+ * Finds the matches at the current position which are longer than the
+ * previous one, storing (length, distance - 1) pairs into distances and
+ * returning the number of values stored.
+ */
+static uint32_t
+bt2GetMatches(MatchFinder &p,
+              uint32_t *distances)
+{
+   auto lenLimit = p.lenLimit;
+   if (lenLimit < 2) {
+      movePos(p);
+      return 0;
+   }
+
+   auto cur = p.buffer;
+   auto hashValue = cur[0] | (static_cast<uint32_t>(cur[1]) << 8);
+   auto curMatch = p.hash[hashValue];
+   p.hash[hashValue] = p.pos;
+
+   auto offset = static_cast<uint32_t>(btGetMatches(p, lenLimit, curMatch, distances, 1) - distances);
+   movePos(p);
+   return offset;
+}
+
+static uint32_t
+bt3GetMatches(MatchFinder &p,
+              uint32_t *distances)
+{
+   auto lenLimit = p.lenLimit;
+   if (lenLimit < 3) {
+      movePos(p);
+      return 0;
+   }
+
+   auto cur = p.buffer;
+   auto temp = p.crc[cur[0]] ^ cur[1];
+   auto hash2Value = temp & (Hash2Size - 1);
+   auto hashValue = (temp ^ (static_cast<uint32_t>(cur[2]) << 8)) & p.hashMask;
+
+   auto delta2 = p.pos - p.hash[hash2Value];
+   auto curMatch = p.hash[Fix3HashSize + hashValue];
+   p.hash[hash2Value] = p.pos;
+   p.hash[Fix3HashSize + hashValue] = p.pos;
+
+   auto maxLen = 2u;
+   auto offset = 0u;
+
+   if (delta2 < p.cyclicBufferSize && *(cur - delta2) == *cur) {
+      for (; maxLen != lenLimit; maxLen++) {
+         if ((cur - delta2)[maxLen] != cur[maxLen]) {
+            break;
+         }
+      }
+
+      distances[0] = maxLen;
+      distances[1] = delta2 - 1;
+      offset = 2;
+
+      if (maxLen == lenLimit) {
+         btSkipMatches(p, lenLimit, curMatch);
+         movePos(p);
+         return offset;
+      }
+   }
+
+   offset = static_cast<uint32_t>(btGetMatches(p, lenLimit, curMatch, distances + offset, maxLen) - distances);
+   movePos(p);
+   return offset;
+}
+
+/**
+ * The 2 and 3 byte hashes find the closest short matches, which bt4 and hc4
+ * then extend before searching the 4 byte hash chain or tree.
+ */
+template<bool BinaryTree>
+static uint32_t
+hash4GetMatches(MatchFinder &p,
+                uint32_t *distances)
+{
+   auto lenLimit = p.lenLimit;
+   if (lenLimit < 4) {
+      movePos(p);
+      return 0;
+   }
+
+   auto cur = p.buffer;
+   auto temp = p.crc[cur[0]] ^ cur[1];
+   auto hash2Value = temp & (Hash2Size - 1);
+   auto hash3Value = (temp ^ (static_cast<uint32_t>(cur[2]) << 8)) & (Hash3Size - 1);
+   auto hashValue = (temp ^ (static_cast<uint32_t>(cur[2]) << 8) ^ (p.crc[cur[3]] << 5)) & p.hashMask;
+
+   auto delta2 = p.pos - p.hash[hash2Value];
+   auto delta3 = p.pos - p.hash[Fix3HashSize + hash3Value];
+   auto curMatch = p.hash[Fix4HashSize + hashValue];
+   p.hash[hash2Value] = p.pos;
+   p.hash[Fix3HashSize + hash3Value] = p.pos;
+   p.hash[Fix4HashSize + hashValue] = p.pos;
+
+   auto maxLen = 1u;
+   auto offset = 0u;
+
+   if (delta2 < p.cyclicBufferSize && *(cur - delta2) == *cur) {
+      distances[0] = maxLen = 2;
+      distances[1] = delta2 - 1;
+      offset = 2;
+   }
+
+   if (delta2 != delta3 && delta3 < p.cyclicBufferSize && *(cur - delta3) == *cur) {
+      maxLen = 3;
+      distances[offset + 1] = delta3 - 1;
+      offset += 2;
+      delta2 = delta3;
+   }
+
+   if (offset != 0) {
+      for (; maxLen != lenLimit; maxLen++) {
+         if ((cur - delta2)[maxLen] != cur[maxLen]) {
+            break;
+         }
+      }
+
+      distances[offset - 2] = maxLen;
+
+      if (maxLen == lenLimit) {
+         if constexpr (BinaryTree) {
+            btSkipMatches(p, lenLimit, curMatch);
+         } else {
+            p.son[p.cyclicBufferPos] = curMatch;
+         }
+
+         movePos(p);
+         return offset;
+      }
+   }
+
+   if (maxLen < 3) {
+      maxLen = 3;
+   }
+
+   if constexpr (BinaryTree) {
+      offset = static_cast<uint32_t>(btGetMatches(p, lenLimit, curMatch, distances + offset, maxLen) - distances);
+   } else {
+      offset = static_cast<uint32_t>(
+         hcGetMatchesSpec(lenLimit, curMatch, p.pos, p.buffer, p.son,
+                          p.cyclicBufferPos, p.cyclicBufferSize,
+                          p.cutValue, distances + offset, maxLen) - distances);
+   }
+
+   movePos(p);
+   return offset;
+}
+
+static void
+bt2Skip(MatchFinder &p,
+        uint32_t num)
+{
+   do {
+      auto lenLimit = p.lenLimit;
+      if (lenLimit < 2) {
+         movePos(p);
+         continue;
+      }
+
+      auto cur = p.buffer;
+      auto hashValue = cur[0] | (static_cast<uint32_t>(cur[1]) << 8);
+      auto curMatch = p.hash[hashValue];
+      p.hash[hashValue] = p.pos;
+      btSkipMatches(p, lenLimit, curMatch);
+      movePos(p);
+   } while (--num != 0);
+}
+
+static void
+bt3Skip(MatchFinder &p,
+        uint32_t num)
+{
+   do {
+      auto lenLimit = p.lenLimit;
+      if (lenLimit < 3) {
+         movePos(p);
+         continue;
+      }
+
+      auto cur = p.buffer;
+      auto temp = p.crc[cur[0]] ^ cur[1];
+      auto hash2Value = temp & (Hash2Size - 1);
+      auto hashValue = (temp ^ (static_cast<uint32_t>(cur[2]) << 8)) & p.hashMask;
+      auto curMatch = p.hash[Fix3HashSize + hashValue];
+      p.hash[hash2Value] = p.pos;
+      p.hash[Fix3HashSize + hashValue] = p.pos;
+      btSkipMatches(p, lenLimit, curMatch);
+      movePos(p);
+   } while (--num != 0);
+}
+
+template<bool BinaryTree>
+static void
+hash4Skip(MatchFinder &p,
+          uint32_t num)
+{
+   do {
+      auto lenLimit = p.lenLimit;
+      if (lenLimit < 4) {
+         movePos(p);
+         continue;
+      }
+
+      auto cur = p.buffer;
+      auto temp = p.crc[cur[0]] ^ cur[1];
+      auto hash2Value = temp & (Hash2Size - 1);
+      auto hash3Value = (temp ^ (static_cast<uint32_t>(cur[2]) << 8)) & (Hash3Size - 1);
+      auto hashValue = (temp ^ (static_cast<uint32_t>(cur[2]) << 8) ^ (p.crc[cur[3]] << 5)) & p.hashMask;
+      auto curMatch = p.hash[Fix4HashSize + hashValue];
+      p.hash[hash2Value] = p.pos;
+      p.hash[Fix3HashSize + hash3Value] = p.pos;
+      p.hash[Fix4HashSize + hashValue] = p.pos;
+
+      if constexpr (BinaryTree) {
+         btSkipMatches(p, lenLimit, curMatch);
+      } else {
+         p.son[p.cyclicBufferPos] = curMatch;
+      }
+
+      movePos(p);
+   } while (--num != 0);
+}
+
+void
+matchFinderConstruct(MatchFinder &p)
+{
+   p.bufferBase = nullptr;
+   p.directInput = false;
+   p.hash = nullptr;
+   p.hashSizeSum = 0;
+   p.numSons = 0;
+   p.cutValue = 32;
+   p.btMode = true;
+   p.numHashBytes = 4;
+   p.bigHash = false;
+
+   for (auto i = 0u; i < 256; ++i) {
+      auto r = i;
+      for (auto j = 0; j < 8; ++j) {
+         r = (r >> 1) ^ (CrcPoly & ~((r & 1) - 1));
+      }
+
+      p.crc[i] = r;
+   }
+}
+
+bool
+matchFinderCreate(MatchFinder &p,
+                  uint32_t historySize,
+                  uint32_t keepAddBufferBefore,
+                  uint32_t matchMaxLen,
+                  uint32_t keepAddBufferAfter,
+                  virt_ptr<ISzAlloc> alloc)
+{
+   if (historySize > MaxHistorySize) {
+      matchFinderFree(p, alloc);
+      return false;
+   }
+
+   auto sizeReserv = historySize >> 1;
+   if (historySize > (2u << 30)) {
+      sizeReserv = historySize >> 2;
+   }
+
+   sizeReserv += (keepAddBufferBefore + matchMaxLen + keepAddBufferAfter) / 2 + (1 << 19);
+
+   // One extra byte is kept as moveBlock runs after pos++
+   p.keepSizeBefore = historySize + keepAddBufferBefore + 1;
+   p.keepSizeAfter = matchMaxLen + keepAddBufferAfter;
+
+   if (createWindow(p, sizeReserv, alloc)) {
+      auto newCyclicBufferSize = historySize + 1;
+      auto hs = uint32_t { 0 };
+      p.matchMaxLen = matchMaxLen;
+      p.fixedHashSize = 0;
+
+      if (p.numHashBytes == 2) {
+         hs = (1 << 16) - 1;
+      } else {
+         hs = historySize - 1;
+         hs |= (hs >> 1);
+         hs |= (hs >> 2);
+         hs |= (hs >> 4);
+         hs |= (hs >> 8);
+         hs >>= 1;
+         hs |= 0xFFFF;
+
+         if (hs > (1 << 24)) {
+            if (p.numHashBytes == 3) {
+               hs = (1 << 24) - 1;
+            } else {
+               hs >>= 1;
+            }
+         }
+      }
+
+      p.hashMask = hs;
+      hs++;
+
+      if (p.numHashBytes > 2) {
+         p.fixedHashSize += Hash2Size;
+      }
+
+      if (p.numHashBytes > 3) {
+         p.fixedHashSize += Hash3Size;
+      }
+
+      if (p.numHashBytes > 4) {
+         p.fixedHashSize += Hash4Size;
+      }
+
+      hs += p.fixedHashSize;
+
+      auto prevSize = p.hashSizeSum + p.numSons;
+      p.historySize = historySize;
+      p.hashSizeSum = hs;
+      p.cyclicBufferSize = newCyclicBufferSize;
+      p.numSons = p.btMode ? newCyclicBufferSize * 2 : newCyclicBufferSize;
+
+      auto newSize = p.hashSizeSum + p.numSons;
+      if (p.hash && prevSize == newSize) {
+         return true;
+      }
+
+      freeHash(p, alloc);
+
+      if (static_cast<uint64_t>(newSize) * sizeof(LzRef) <= 0xFFFFFFFFu) {
+         p.hash = static_cast<LzRef *>(internal::allocMemory(alloc, newSize * sizeof(LzRef)).get());
+      }
+
+      if (p.hash) {
+         p.son = p.hash + p.hashSizeSum;
+         return true;
+      }
+   }
+
+   matchFinderFree(p, alloc);
+   return false;
+}
+
+void
+matchFinderFree(MatchFinder &p,
+                virt_ptr<ISzAlloc> alloc)
+{
+   freeHash(p, alloc);
+   freeWindow(p, alloc);
+}
+
+void
+matchFinderSetStream(MatchFinder &p,
+                     virt_ptr<ISeqInStream> stream)
+{
+   if (p.directInput) {
+      // The window was the caller's buffer, a new one is allocated on create
+      p.bufferBase = nullptr;
+      p.directInput = false;
+   }
+
+   p.stream = stream;
+}
+
+void
+matchFinderSetInputBuffer(MatchFinder &p,
+                          const uint8_t *src,
+                          uint32_t srcLen,
+                          virt_ptr<ISzAlloc> alloc)
+{
+   freeWindow(p, alloc);
+   p.directInput = true;
+   p.bufferBase = const_cast<uint8_t *>(src);
+   p.directInputRem = srcLen;
+}
+
+void
+matchFinderInit(MatchFinder &p)
+{
+   std::fill_n(p.hash, p.hashSizeSum, EmptyHashValue);
+   p.cyclicBufferPos = 0;
+   p.buffer = p.bufferBase;
+   p.pos = p.streamPos = p.cyclicBufferSize;
+   p.result = SZ_OK;
+   p.streamEndWasReached = false;
+   readBlock(p);
+   setLimits(p);
+
+   if (!p.btMode) {
+      p.getMatches = &hash4GetMatches<false>;
+      p.skip = &hash4Skip<false>;
+   } else if (p.numHashBytes == 2) {
+      p.getMatches = &bt2GetMatches;
+      p.skip = &bt2Skip;
+   } else if (p.numHashBytes == 3) {
+      p.getMatches = &bt3GetMatches;
+      p.skip = &bt3Skip;
+   } else {
+      p.getMatches = &hash4GetMatches<true>;
+      p.skip = &hash4Skip<true>;
+   }
+}
+
+} // namespace cafe::lzma920::internal
@@ -0,0 +1,112 @@
+#pragma once
+#include "lzma920_lzmadec.h"
+
+#include <cstdint>
+#include <libcpu/be2_struct.h>
+
+namespace cafe::lzma920
+{
+
+struct ISeqInStream;
+
+namespace internal
+{
+
+/*
+Host port of the single threaded LzFind.c match finder from the LZMA SDK
+9.20. The window buffer and hash tables are allocated from guest memory with
+the title's allocator, the match finder itself is decaf specific and lives
+inside the encoder object.
+*/
+
+using LzRef = uint32_t;
+
+struct MatchFinder;
+
+using MatchFinderGetMatchesFn = uint32_t (*)(MatchFinder &p, uint32_t *distances);
+using MatchFinderSkipFn = void (*)(MatchFinder &p, uint32_t num);
+
+struct MatchFinder
+{
+   uint8_t *buffer;
+   uint32_t pos;
+   uint32_t posLimit;
+   uint32_t streamPos;
+   uint32_t lenLimit;
+
+   uint32_t cyclicBufferPos;
+   uint32_t cyclicBufferSize;
+
+   uint32_t matchMaxLen;
+   LzRef *hash;
+   LzRef *son;
+   uint32_t hashMask;
+   uint32_t cutValue;
+
+   uint8_t *bufferBase;
+   virt_ptr<ISeqInStream> stream;
+   bool streamEndWasReached;
+
+   uint32_t blockSize;
+   uint32_t keepSizeBefore;
+   uint32_t keepSizeAfter;
+
+   uint32_t numHashBytes;
+   bool directInput;
+   uint32_t directInputRem;
+   bool btMode;
+   bool bigHash;
+   uint32_t historySize;
+   uint32_t fixedHashSize;
+   uint32_t hashSizeSum;
+   uint32_t numSons;
+   int32_t result;
+   uint32_t crc[256];
+
+   MatchFinderGetMatchesFn getMatches;
+   MatchFinderSkipFn skip;
+};
+
+void
+matchFinderConstruct(MatchFinder &p);
+
+bool
+matchFinderCreate(MatchFinder &p,
+                  uint32_t historySize,
+                  uint32_t keepAddBufferBefore,
+                  uint32_t matchMaxLen,
+                  uint32_t keepAddBufferAfter,
+                  virt_ptr<ISzAlloc> alloc);
+
+void
+matchFinderFree(MatchFinder &p,
+                virt_ptr<ISzAlloc> alloc);
+
+void
+matchFinderSetStream(MatchFinder &p,
+                     virt_ptr<ISeqInStream> stream);
+
+void
+matchFinderSetInputBuffer(MatchFinder &p,
+                          const uint8_t *src,
+                          uint32_t srcLen,
+                          virt_ptr<ISzAlloc> alloc);
+
+void
+matchFinderInit(MatchFinder &p);
+
+inline uint32_t
+matchFinderGetNumAvailableBytes(const MatchFinder &p)
+{
+   return p.streamPos - p.pos;
+}
+
+inline const uint8_t *
+matchFinderGetPointerToCurrentPos(const MatchFinder &p)
+{
+   return p.buffer;
+}
+
+} // namespace internal
+
+} // namespace cafe::lzma920
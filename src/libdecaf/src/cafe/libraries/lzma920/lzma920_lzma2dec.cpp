@@ -0,0 +1,451 @@
+#include "lzma920.h"
+#include "lzma920_lzma2dec.h"
+#include "cafe/cafe_stackobject.h"
+
+#include <array>
+#include <cstring>
+
+namespace cafe::lzma920
+{
+
+constexpr uint8_t Lzma2ControlLzma = 1 << 7;
+constexpr uint8_t Lzma2ControlCopyResetDic = 1;
+
+constexpr uint32_t Lzma2LcLpMax = 4;
+
+enum Lzma2State : int32_t
+{
+   Control,
+   Unpack0,
+   Unpack1,
+   Pack0,
+   Pack1,
+   Prop,
+   Data,
+   DataCont,
+   Finished,
+   Error,
+};
+
+static bool
+isUncompressedChunk(virt_ptr<CLzma2Dec> p)
+{
+   return (p->control & Lzma2ControlLzma) == 0;
+}
+
+static uint32_t
+getLzmaMode(virt_ptr<CLzma2Dec> p)
+{
+   return (p->control >> 5) & 3;
+}
+
+static int32_t
+getOldProps(uint8_t prop,
+            std::array<uint8_t, LZMA_PROPS_SIZE> &props)
+{
+   if (prop > 40) {
+      return SZ_ERROR_UNSUPPORTED;
+   }
+
+   auto dicSize = (prop == 40) ? 0xFFFFFFFFu :
+      ((2u | (prop & 1)) << (prop / 2 + 11));
+
+   props[0] = static_cast<uint8_t>(Lzma2LcLpMax);
+   props[1] = static_cast<uint8_t>(dicSize);
+   props[2] = static_cast<uint8_t>(dicSize >> 8);
+   props[3] = static_cast<uint8_t>(dicSize >> 16);
+   props[4] = static_cast<uint8_t>(dicSize >> 24);
+   return SZ_OK;
+}
+
+static Lzma2State
+updateState(virt_ptr<CLzma2Dec> p,
+            uint8_t b)
+{
+   switch (p->state) {
+   case Lzma2State::Control:
+      p->control = b;
+
+      if (b == 0) {
+         return Lzma2State::Finished;
+      }
+
+      if (isUncompressedChunk(p)) {
+         if ((b & 0x7F) > 2) {
+            return Lzma2State::Error;
+         }
+
+         p->unpackSize = 0u;
+      } else {
+         p->unpackSize = static_cast<uint32_t>(b & 0x1F) << 16;
+      }
+
+      return Lzma2State::Unpack0;
+   case Lzma2State::Unpack0:
+      p->unpackSize |= static_cast<uint32_t>(b) << 8;
+      return Lzma2State::Unpack1;
+   case Lzma2State::Unpack1:
+      p->unpackSize |= static_cast<uint32_t>(b);
+      p->unpackSize += 1u;
+      return isUncompressedChunk(p) ? Lzma2State::Data : Lzma2State::Pack0;
+   case Lzma2State::Pack0:
+      p->packSize = static_cast<uint32_t>(b) << 8;
+      return Lzma2State::Pack1;
+   case Lzma2State::Pack1:
+      p->packSize |= static_cast<uint32_t>(b);
+      p->packSize += 1u;
+
+      if (getLzmaMode(p) >= 2) {
+         return Lzma2State::Prop;
+      }
+
+      return p->needInitProp ? Lzma2State::Error : Lzma2State::Data;
+   case Lzma2State::Prop:
+   {
+      if (b >= (9 * 5 * 5)) {
+         return Lzma2State::Error;
+      }
+
+      auto lc = b % 9u;
+      b /= 9;
+      auto pb = b / 5u;
+      auto lp = b % 5u;
+
+      if (lc + lp > Lzma2LcLpMax) {
+         return Lzma2State::Error;
+      }
+
+      p->decoder.prop.lc = lc;
+      p->decoder.prop.lp = lp;
+      p->decoder.prop.pb = pb;
+      p->needInitProp = 0;
+      return Lzma2State::Data;
+   }
+   default:
+      return Lzma2State::Error;
+   }
+}
+
+static void
+updateWithUncompressed(virt_ptr<CLzmaDec> p,
+                       const uint8_t *src,
+                       uint32_t size)
+{
+   std::memcpy(p->dic.get() + p->dicPos, src, size);
+   p->dicPos += size;
+
+   if (p->checkDicSize == 0 && p->prop.dicSize - p->processedPos <= size) {
+      p->checkDicSize = p->prop.dicSize;
+   }
+
+   p->processedPos += size;
+}
+
+static int32_t
+decodeToDic(virt_ptr<CLzma2Dec> p,
+            uint32_t dicLimit,
+            const uint8_t *src,
+            uint32_t *srcLen,
+            int32_t finishMode,
+            int32_t *status)
+{
+   auto inSize = *srcLen;
+   *srcLen = 0;
+   *status = LZMA_STATUS_NOT_SPECIFIED;
+
+   while (p->state != Lzma2State::Finished) {
+      auto dicPos = static_cast<uint32_t>(p->decoder.dicPos);
+
+      if (p->state == Lzma2State::Error) {
+         return SZ_ERROR_DATA;
+      }
+
+      if (dicPos == dicLimit && finishMode == LZMA_FINISH_ANY) {
+         *status = LZMA_STATUS_NOT_FINISHED;
+         return SZ_OK;
+      }
+
+      if (p->state != Lzma2State::Data && p->state != Lzma2State::DataCont) {
+         if (*srcLen == inSize) {
+            *status = LZMA_STATUS_NEEDS_MORE_INPUT;
+            return SZ_OK;
+         }
+
+         (*srcLen)++;
+         p->state = updateState(p, *src++);
+         continue;
+      }
+
+      auto destSizeCur = dicLimit - dicPos;
+      auto srcSizeCur = inSize - *srcLen;
+      auto curFinishMode = LZMA_FINISH_ANY;
+
+      if (p->unpackSize <= destSizeCur) {
+         destSizeCur = p->unpackSize;
+         curFinishMode = LZMA_FINISH_END;
+      }
+
+      if (isUncompressedChunk(p)) {
+         if (*srcLen == inSize) {
+            *status = LZMA_STATUS_NEEDS_MORE_INPUT;
+            return SZ_OK;
+         }
+
+         if (p->state == Lzma2State::Data) {
+            auto initDic = (p->control == Lzma2ControlCopyResetDic);
+
+            if (initDic) {
+               p->needInitProp = 1;
+               p->needInitState = 1;
+            } else if (p->needInitDic) {
+               return SZ_ERROR_DATA;
+            }
+
+            p->needInitDic = 0;
+            LzmaDec_InitDicAndState(virt_addrof(p->decoder), initDic ? 1 : 0, 0);
+         }
+
+         if (srcSizeCur > destSizeCur) {
+            srcSizeCur = destSizeCur;
+         }
+
+         if (srcSizeCur == 0) {
+            return SZ_ERROR_DATA;
+         }
+
+         updateWithUncompressed(virt_addrof(p->decoder), src, srcSizeCur);
+         src += srcSizeCur;
+         *srcLen += srcSizeCur;
+         p->unpackSize -= srcSizeCur;
+         p->state = (p->unpackSize == 0) ? Lzma2State::Control : Lzma2State::DataCont;
+      } else {
+         if (p->state == Lzma2State::Data) {
+            auto mode = getLzmaMode(p);
+            auto initDic = (mode == 3);
+            auto initState = (mode > 0);
+
+            if ((!initDic && p->needInitDic) || (!initState && p->needInitState)) {
+               return SZ_ERROR_DATA;
+            }
+
+            LzmaDec_InitDicAndState(virt_addrof(p->decoder),
+                                    initDic ? 1 : 0,
+                                    initState ? 1 : 0);
+            p->needInitDic = 0;
+            p->needInitState = 0;
+            p->state = Lzma2State::DataCont;
+         }
+
+         if (srcSizeCur > p->packSize) {
+            srcSizeCur = p->packSize;
+         }
+
+         auto res = internal::decodeToDic(virt_addrof(p->decoder),
+                                          dicPos + destSizeCur, src,
+                                          &srcSizeCur, curFinishMode, status);
+         src += srcSizeCur;
+         *srcLen += srcSizeCur;
+         p->packSize -= srcSizeCur;
+
+         auto outSizeProcessed = static_cast<uint32_t>(p->decoder.dicPos) - dicPos;
+         p->unpackSize -= outSizeProcessed;
+
+         if (res != SZ_OK) {
+            return res;
+         }
+
+         if (*status == LZMA_STATUS_NEEDS_MORE_INPUT) {
+            return res;
+         }
+
+         if (srcSizeCur == 0 && outSizeProcessed == 0) {
+            if (*status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK ||
+                p->unpackSize != 0 || p->packSize != 0) {
+               return SZ_ERROR_DATA;
+            }
+
+            p->state = Lzma2State::Control;
+         }
+
+         if (*status == LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK) {
+            *status = LZMA_STATUS_NOT_FINISHED;
+         }
+      }
+   }
+
+   *status = LZMA_STATUS_FINISHED_WITH_MARK;
+   return SZ_OK;
+}
+
+int32_t
+Lzma2Dec_AllocateProbs(virt_ptr<CLzma2Dec> p,
+                       uint8_t prop,
+                       virt_ptr<ISzAlloc> alloc)
+{
+   auto props = std::array<uint8_t, LZMA_PROPS_SIZE> { };
+
+   if (auto res = getOldProps(prop, props); res != SZ_OK) {
+      return res;
+   }
+
+   return internal::allocateProbs(virt_addrof(p->decoder), props.data(),
+                                  LZMA_PROPS_SIZE, alloc);
+}
+
+int32_t
+Lzma2Dec_Allocate(virt_ptr<CLzma2Dec> p,
+                  uint8_t prop,
+                  virt_ptr<ISzAlloc> alloc)
+{
+   auto props = std::array<uint8_t, LZMA_PROPS_SIZE> { };
+
+   if (auto res = getOldProps(prop, props); res != SZ_OK) {
+      return res;
+   }
+
+   return internal::allocate(virt_addrof(p->decoder), props.data(),
+                             LZMA_PROPS_SIZE, alloc);
+}
+
+void
+Lzma2Dec_Init(virt_ptr<CLzma2Dec> p)
+{
+   p->state = Lzma2State::Control;
+   p->needInitDic = 1;
+   p->needInitState = 1;
+   p->needInitProp = 1;
+   LzmaDec_Init(virt_addrof(p->decoder));
+}
+
+int32_t
+Lzma2Dec_DecodeToDic(virt_ptr<CLzma2Dec> p,
+                     uint32_t dicLimit,
+                     virt_ptr<const uint8_t> src,
+                     virt_ptr<uint32_t> srcLen,
+                     int32_t finishMode,
+                     virt_ptr<int32_t> status)
+{
+   auto hostSrcLen = static_cast<uint32_t>(*srcLen);
+   auto hostStatus = int32_t { LZMA_STATUS_NOT_SPECIFIED };
+   auto result = decodeToDic(p, dicLimit, src.get(), &hostSrcLen,
+                             finishMode, &hostStatus);
+   *srcLen = hostSrcLen;
+   *status = hostStatus;
+   return result;
+}
+
+int32_t
+Lzma2Dec_DecodeToBuf(virt_ptr<CLzma2Dec> p,
+                     virt_ptr<uint8_t> dest,
+                     virt_ptr<uint32_t> destLen,
+                     virt_ptr<const uint8_t> src,
+                     virt_ptr<uint32_t> srcLen,
+                     int32_t finishMode,
+                     virt_ptr<int32_t> status)
+{
+   auto outSize = static_cast<uint32_t>(*destLen);
+   auto inSize = static_cast<uint32_t>(*srcLen);
+   auto hostDest = dest.get();
+   auto hostSrc = src.get();
+   auto hostStatus = int32_t { LZMA_STATUS_NOT_SPECIFIED };
+   auto totalIn = 0u;
+   auto totalOut = 0u;
+   auto result = SZ_OK;
+
+   while (true) {
+      auto dicBufSize = static_cast<uint32_t>(p->decoder.dicBufSize);
+
+      if (p->decoder.dicPos == dicBufSize) {
+         p->decoder.dicPos = 0u;
+      }
+
+      auto dicPos = static_cast<uint32_t>(p->decoder.dicPos);
+      auto inSizeCur = inSize;
+      auto outSizeCur = 0u;
+      auto curFinishMode = finishMode;
+
+      if (outSize > dicBufSize - dicPos) {
+         outSizeCur = dicBufSize;
+         curFinishMode = LZMA_FINISH_ANY;
+      } else {
+         outSizeCur = dicPos + outSize;
+      }
+
+      result = decodeToDic(p, outSizeCur, hostSrc, &inSizeCur,
+                           curFinishMode, &hostStatus);
+      hostSrc += inSizeCur;
+      inSize -= inSizeCur;
+      totalIn += inSizeCur;
+
+      outSizeCur = static_cast<uint32_t>(p->decoder.dicPos) - dicPos;
+      std::memcpy(hostDest, p->decoder.dic.get() + dicPos, outSizeCur);
+      hostDest += outSizeCur;
+      outSize -= outSizeCur;
+      totalOut += outSizeCur;
+
+      if (result != SZ_OK || outSizeCur == 0 || outSize == 0) {
+         break;
+      }
+   }
+
+   *srcLen = totalIn;
+   *destLen = totalOut;
+   *status = hostStatus;
+   return result;
+}
+
+int32_t
+Lzma2Decode(virt_ptr<uint8_t> dest,
+            virt_ptr<uint32_t> destLen,
+            virt_ptr<const uint8_t> src,
+            virt_ptr<uint32_t> srcLen,
+            uint8_t prop,
+            int32_t finishMode,
+            virt_ptr<int32_t> status,
+            virt_ptr<ISzAlloc> alloc)
+{
+   auto outSize = static_cast<uint32_t>(*destLen);
+   auto inSize = static_cast<uint32_t>(*srcLen);
+   *destLen = 0u;
+   *srcLen = 0u;
+   *status = LZMA_STATUS_NOT_SPECIFIED;
+
+   auto p = StackObject<CLzma2Dec> { };
+   p->decoder.dic = dest;
+   p->decoder.dicBufSize = outSize;
+   p->decoder.probs = nullptr;
+
+   if (auto res = Lzma2Dec_AllocateProbs(p, prop, alloc); res != SZ_OK) {
+      return res;
+   }
+
+   Lzma2Dec_Init(p);
+
+   auto hostSrcLen = inSize;
+   auto hostStatus = int32_t { LZMA_STATUS_NOT_SPECIFIED };
+   auto res = decodeToDic(p, outSize, src.get(), &hostSrcLen,
+                          finishMode, &hostStatus);
+   *srcLen = hostSrcLen;
+   *destLen = static_cast<uint32_t>(p->decoder.dicPos);
+   *status = hostStatus;
+
+   if (res == SZ_OK && hostStatus == LZMA_STATUS_NEEDS_MORE_INPUT) {
+      res = SZ_ERROR_INPUT_EOF;
+   }
+
+   LzmaDec_FreeProbs(virt_addrof(p->decoder), alloc);
+   return res;
+}
+
+void
+Library::registerLzma2DecSymbols()
+{
+   RegisterFunctionExport(Lzma2Dec_AllocateProbs);
+   RegisterFunctionExport(Lzma2Dec_Allocate);
+   RegisterFunctionExport(Lzma2Dec_Init);
+   RegisterFunctionExport(Lzma2Dec_DecodeToDic);
+   RegisterFunctionExport(Lzma2Dec_DecodeToBuf);
+   RegisterFunctionExport(Lzma2Decode);
+}
+
+} // namespace cafe::lzma920
@@ -0,0 +1,81 @@
+#pragma once
+#include "lzma920_lzmadec.h"
+
+#include <cstdint>
+#include <libcpu/be2_struct.h>
+
+namespace cafe::lzma920
+{
+
+/*
+Host implementation of the Lzma2Dec API from the LZMA SDK 9.20, built on top
+of the LzmaDec implementation.
+*/
+
+#pragma pack(push, 1)
+
+struct CLzma2Dec
+{
+   be2_struct<CLzmaDec> decoder;
+   be2_val<uint32_t> packSize;
+   be2_val<uint32_t> unpackSize;
+   be2_val<int32_t> state;
+   be2_val<uint8_t> control;
+   PADDING(3);
+   be2_val<int32_t> needInitDic;
+   be2_val<int32_t> needInitState;
+   be2_val<int32_t> needInitProp;
+};
+CHECK_OFFSET(CLzma2Dec, 0x00, decoder);
+CHECK_OFFSET(CLzma2Dec, 0x70, packSize);
+CHECK_OFFSET(CLzma2Dec, 0x74, unpackSize);
+CHECK_OFFSET(CLzma2Dec, 0x78, state);
+CHECK_OFFSET(CLzma2Dec, 0x7C, control);
+CHECK_OFFSET(CLzma2Dec, 0x80, needInitDic);
+CHECK_OFFSET(CLzma2Dec, 0x84, needInitState);
+CHECK_OFFSET(CLzma2Dec, 0x88, needInitProp);
+CHECK_SIZE(CLzma2Dec, 0x8C);
+
+#pragma pack(pop)
+
+int32_t
+Lzma2Dec_AllocateProbs(virt_ptr<CLzma2Dec> p,
+                       uint8_t prop,
+                       virt_ptr<ISzAlloc> alloc);
+
+int32_t
+Lzma2Dec_Allocate(virt_ptr<CLzma2Dec> p,
+                  uint8_t prop,
+                  virt_ptr<ISzAlloc> alloc);
+
+void
+Lzma2Dec_Init(virt_ptr<CLzma2Dec> p);
+
+int32_t
+Lzma2Dec_DecodeToDic(virt_ptr<CLzma2Dec> p,
+                     uint32_t dicLimit,
+                     virt_ptr<const uint8_t> src,
+                     virt_ptr<uint32_t> srcLen,
+                     int32_t finishMode,
+                     virt_ptr<int32_t> status);
+
+int32_t
+Lzma2Dec_DecodeToBuf(virt_ptr<CLzma2Dec> p,
+                     virt_ptr<uint8_t> dest,
+                     virt_ptr<uint32_t> destLen,
+                     virt_ptr<const uint8_t> src,
+                     virt_ptr<uint32_t> srcLen,
+                     int32_t finishMode,
+                     virt_ptr<int32_t> status);
+
+int32_t
+Lzma2Decode(virt_ptr<uint8_t> dest,
+            virt_ptr<uint32_t> destLen,
+            virt_ptr<const uint8_t> src,
+            virt_ptr<uint32_t> srcLen,
+            uint8_t prop,
+            int32_t finishMode,
+            virt_ptr<int32_t> status,
+            virt_ptr<ISzAlloc> alloc);
+
+} // namespace cafe::lzma920
@@ -0,0 +1,660 @@
+#include "lzma920.h"
+#include "lzma920_lzma2enc.h"
+#include "cafe/cafe_ppc_interface_invoke_guest.h"
+#include "cafe/cafe_stackobject.h"
+
+#include <algorithm>
+#include <common/align.h>
+#include <cstring>
+#include <libcpu/mmu.h>
+
+namespace cafe::lzma920
+{
+
+/*
+This is a port of Lzma2Enc.c from the LZMA SDK 9.20. The guest library can
+split the input into blocks and encode them on several threads, here the
+blocks are encoded one after the other on the calling core which gives the
+same output as the threaded encoder.
+*/
+
+constexpr uint8_t Lzma2ControlLzma = 1 << 7;
+constexpr uint8_t Lzma2ControlCopyNoReset = 2;
+constexpr uint8_t Lzma2ControlCopyResetDic = 1;
+constexpr uint8_t Lzma2ControlEof = 0;
+
+constexpr uint32_t Lzma2LcLpMax = 4;
+
+constexpr uint32_t Lzma2PackSizeMax = 1u << 16;
+constexpr uint32_t Lzma2CopyChunkSize = Lzma2PackSizeMax;
+constexpr uint32_t Lzma2UnpackSizeMax = 1u << 21;
+constexpr uint32_t Lzma2KeepWindowSize = Lzma2UnpackSizeMax;
+constexpr uint32_t Lzma2ChunkSizeCompressedMax = (1u << 16) + 16;
+
+constexpr int32_t NumMtCoderThreadsMax = 32;
+
+struct Lzma2EncoderProps
+{
+   internal::EncoderProps lzmaProps;
+   uint32_t blockSize;
+   int32_t numBlockThreads;
+   int32_t numTotalThreads;
+};
+
+struct Lzma2Coder
+{
+   CLzmaEncHandle enc;
+   uint64_t srcPos;
+   uint8_t props;
+   bool needInitState;
+   bool needInitProp;
+};
+
+// This is decaf specific stuff - does not match the CLzma2Enc in lzma920.rpl
+struct Lzma2Encoder
+{
+   Lzma2EncoderProps props;
+   uint8_t *outBuf;
+   virt_ptr<ISzAlloc> alloc;
+   virt_ptr<ISzAlloc> allocBig;
+   Lzma2Coder coders[NumMtCoderThreadsMax];
+};
+
+static Lzma2Encoder &
+getEncoder(CLzma2EncHandle handle)
+{
+   return *reinterpret_cast<Lzma2Encoder *>(align_up(virt_cast<uint8_t *>(handle).get(), 8));
+}
+
+static virt_ptr<const void>
+toGuest(const uint8_t *ptr)
+{
+   return virt_cast<const void *>(cpu::translate(ptr));
+}
+
+static bool
+writeStream(virt_ptr<ISeqOutStream> outStream,
+            const uint8_t *buf,
+            uint32_t size)
+{
+   return cafe::invoke(cpu::this_core::state(),
+                       outStream->Write,
+                       outStream,
+                       toGuest(buf),
+                       size) == size;
+}
+
+static int32_t
+reportProgress(virt_ptr<ICompressProgress> progress,
+               uint64_t inSize,
+               uint64_t outSize)
+{
+   if (!progress) {
+      return SZ_OK;
+   }
+
+   if (cafe::invoke(cpu::this_core::state(),
+                    progress->Progress,
+                    progress,
+                    inSize,
+                    outSize) != SZ_OK) {
+      return SZ_ERROR_PROGRESS;
+   }
+
+   return SZ_OK;
+}
+
+static Lzma2EncoderProps
+loadProps(virt_ptr<const CLzma2EncProps> props)
+{
+   auto result = Lzma2EncoderProps { };
+   result.lzmaProps = internal::loadEncoderProps(virt_addrof(props->lzmaProps));
+   result.blockSize = props->blockSize;
+   result.numBlockThreads = props->numBlockThreads;
+   result.numTotalThreads = props->numTotalThreads;
+   return result;
+}
+
+static void
+storeProps(const Lzma2EncoderProps &props,
+           virt_ptr<CLzma2EncProps> out)
+{
+   internal::storeEncoderProps(props.lzmaProps, virt_addrof(out->lzmaProps));
+   out->blockSize = props.blockSize;
+   out->numBlockThreads = props.numBlockThreads;
+   out->numTotalThreads = props.numTotalThreads;
+}
+
+static void
+initProps(Lzma2EncoderProps &p)
+{
+   internal::initEncoderProps(p.lzmaProps);
+   p.numTotalThreads = -1;
+   p.numBlockThreads = -1;
+   p.blockSize = 0;
+}
+
+static void
+normalizeProps(Lzma2EncoderProps &p)
+{
+   auto lzmaProps = p.lzmaProps;
+   internal::normalizeEncoderProps(lzmaProps);
+
+   auto t1n = lzmaProps.numThreads;
+   auto t1 = p.lzmaProps.numThreads;
+   auto t2 = p.numBlockThreads;
+   auto t3 = p.numTotalThreads;
+
+   if (t2 > NumMtCoderThreadsMax) {
+      t2 = NumMtCoderThreadsMax;
+   }
+
+   if (t3 <= 0) {
+      if (t2 <= 0) {
+         t2 = 1;
+      }
+
+      t3 = t1n * t2;
+   } else if (t2 <= 0) {
+      t2 = t3 / t1n;
+
+      if (t2 == 0) {
+         t1 = 1;
+         t2 = t3;
+      }
+
+      if (t2 > NumMtCoderThreadsMax) {
+         t2 = NumMtCoderThreadsMax;
+      }
+   } else if (t1 <= 0) {
+      t1 = t3 / t2;
+
+      if (t1 == 0) {
+         t1 = 1;
+      }
+   } else {
+      t3 = t1n * t2;
+   }
+
+   p.lzmaProps.numThreads = t1;
+   p.numBlockThreads = t2;
+   p.numTotalThreads = t3;
+   internal::normalizeEncoderProps(p.lzmaProps);
+
+   if (p.blockSize == 0) {
+      constexpr uint64_t MinSize = 1u << 20;
+      constexpr uint64_t MaxSize = 1u << 28;
+      auto dictSize = p.lzmaProps.dictSize;
+      auto blockSize = std::clamp(static_cast<uint64_t>(dictSize) << 2, MinSize, MaxSize);
+      p.blockSize = static_cast<uint32_t>(std::max<uint64_t>(blockSize, dictSize));
+   }
+}
+
+static int32_t
+initCoder(Lzma2Coder &p,
+          const Lzma2EncoderProps &props)
+{
+   if (auto res = internal::lzmaEncSetProps(p.enc, props.lzmaProps); res != SZ_OK) {
+      return res;
+   }
+
+   uint8_t propsEncoded[LZMA_PROPS_SIZE];
+   auto propsSize = LZMA_PROPS_SIZE;
+
+   if (auto res = internal::lzmaEncWriteProperties(p.enc, propsEncoded, &propsSize); res != SZ_OK) {
+      return res;
+   }
+
+   p.srcPos = 0;
+   p.props = propsEncoded[0];
+   p.needInitState = true;
+   p.needInitProp = true;
+   return SZ_OK;
+}
+
+/**
+ * Encode the next chunk into outBuf, as an LZMA chunk or as uncompressed
+ * chunks when it does not compress. With an outStream every chunk is
+ * written out as soon as it is made. packSizeRes is the size of outBuf on
+ * entry and the number of bytes produced on return, 0 at the end of input.
+ */
+static int32_t
+encodeSubblock(Lzma2Coder &p,
+               uint8_t *outBuf,
+               uint32_t *packSizeRes,
+               virt_ptr<ISeqOutStream> outStream)
+{
+   auto packSizeLimit = *packSizeRes;
+   auto packSize = packSizeLimit;
+   auto unpackSize = Lzma2UnpackSizeMax;
+   auto lzHeaderSize = 5u + (p.needInitProp ? 1u : 0u);
+   auto useCopyBlock = false;
+
+   *packSizeRes = 0;
+   if (packSize < lzHeaderSize) {
+      return SZ_ERROR_OUTPUT_EOF;
+   }
+
+   packSize -= lzHeaderSize;
+
+   internal::lzmaEncSaveState(p.enc);
+   auto res = internal::lzmaEncCodeOneMemBlock(p.enc, p.needInitState,
+                                               outBuf + lzHeaderSize, &packSize,
+                                               Lzma2PackSizeMax, &unpackSize);
+
+   if (unpackSize == 0) {
+      return res;
+   }
+
+   if (res == SZ_OK) {
+      useCopyBlock = (packSize + 2 >= unpackSize || packSize > (1u << 16));
+   } else {
+      if (res != SZ_ERROR_OUTPUT_EOF) {
+         return res;
+      }
+
+      res = SZ_OK;
+      useCopyBlock = true;
+   }
+
+   if (useCopyBlock) {
+      auto destPos = 0u;
+
+      while (unpackSize > 0) {
+         auto u = std::min(unpackSize, Lzma2CopyChunkSize);
+         if (packSizeLimit - destPos < u + 3) {
+            return SZ_ERROR_OUTPUT_EOF;
+         }
+
+         outBuf[destPos++] = (p.srcPos == 0) ? Lzma2ControlCopyResetDic : Lzma2ControlCopyNoReset;
+         outBuf[destPos++] = static_cast<uint8_t>((u - 1) >> 8);
+         outBuf[destPos++] = static_cast<uint8_t>(u - 1);
+         std::memcpy(outBuf + destPos, internal::lzmaEncGetCurBuf(p.enc) - unpackSize, u);
+         unpackSize -= u;
+         destPos += u;
+         p.srcPos += u;
+
+         if (outStream) {
+            *packSizeRes += destPos;
+            if (!writeStream(outStream, outBuf, destPos)) {
+               return SZ_ERROR_WRITE;
+            }
+
+            destPos = 0;
+         } else {
+            *packSizeRes = destPos;
+         }
+      }
+
+      internal::lzmaEncRestoreState(p.enc);
+      return SZ_OK;
+   }
+
+   auto destPos = 0u;
+   auto u = unpackSize - 1;
+   auto pm = packSize - 1;
+   auto mode = (p.srcPos == 0) ? 3u : (p.needInitState ? (p.needInitProp ? 2u : 1u) : 0u);
+
+   outBuf[destPos++] = static_cast<uint8_t>(Lzma2ControlLzma | (mode << 5) | ((u >> 16) & 0x1F));
+   outBuf[destPos++] = static_cast<uint8_t>(u >> 8);
+   outBuf[destPos++] = static_cast<uint8_t>(u);
+   outBuf[destPos++] = static_cast<uint8_t>(pm >> 8);
+   outBuf[destPos++] = static_cast<uint8_t>(pm);
+
+   if (p.needInitProp) {
+      outBuf[destPos++] = p.props;
+   }
+
+   p.needInitProp = false;
+   p.needInitState = false;
+   destPos += packSize;
+   p.srcPos += unpackSize;
+
+   if (outStream) {
+      if (!writeStream(outStream, outBuf, destPos)) {
+         return SZ_ERROR_WRITE;
+      }
+   }
+
+   *packSizeRes = destPos;
+   return SZ_OK;
+}
+
+//! Encode the whole input stream through one encoder.
+static int32_t
+encodeStream(Lzma2Encoder &encoder,
+             virt_ptr<ISeqOutStream> outStream,
+             virt_ptr<ISeqInStream> inStream,
+             virt_ptr<ICompressProgress> progress)
+{
+   auto &p = encoder.coders[0];
+   auto packTotal = uint64_t { 0 };
+   auto res = SZ_OK;
+
+   if (!encoder.outBuf) {
+      encoder.outBuf = virt_cast<uint8_t *>(
+         internal::allocMemory(encoder.alloc, Lzma2ChunkSizeCompressedMax)).get();
+      if (!encoder.outBuf) {
+         return SZ_ERROR_MEM;
+      }
+   }
+
+   res = initCoder(p, encoder.props);
+   if (res != SZ_OK) {
+      return res;
+   }
+
+   res = internal::lzmaEncPrepareForLzma2(p.enc, inStream, Lzma2KeepWindowSize,
+                                          encoder.alloc, encoder.allocBig);
+   if (res != SZ_OK) {
+      return res;
+   }
+
+   while (true) {
+      auto packSize = Lzma2ChunkSizeCompressedMax;
+      res = encodeSubblock(p, encoder.outBuf, &packSize, outStream);
+      if (res != SZ_OK) {
+         break;
+      }
+
+      packTotal += packSize;
+      res = reportProgress(progress, p.srcPos, packTotal);
+      if (res != SZ_OK || packSize == 0) {
+         break;
+      }
+   }
+
+   if (res == SZ_OK) {
+      // The guest Write has to see guest memory so the marker goes via outBuf
+      encoder.outBuf[0] = Lzma2ControlEof;
+      if (!writeStream(outStream, encoder.outBuf, 1)) {
+         return SZ_ERROR_WRITE;
+      }
+   }
+
+   return res;
+}
+
+//! Read until size bytes have been read or the stream ends.
+static int32_t
+readFull(virt_ptr<ISeqInStream> inStream,
+         virt_ptr<uint8_t> buf,
+         uint32_t *size)
+{
+   auto readSize = StackObject<uint32_t> { };
+   auto rem = *size;
+   *size = 0;
+
+   while (rem != 0) {
+      *readSize = rem;
+
+      auto res = cafe::invoke(cpu::this_core::state(),
+                              inStream->Read,
+                              inStream,
+                              virt_cast<void *>(buf + *size),
+                              virt_ptr<uint32_t> { readSize });
+      if (res != SZ_OK) {
+         return res;
+      }
+
+      if (*readSize == 0) {
+         break;
+      }
+
+      *size += *readSize;
+      rem -= *readSize;
+   }
+
+   return SZ_OK;
+}
+
+/**
+ * Encode one block independently of the others, it starts by resetting the
+ * dictionary and the last block also gets the end of stream marker.
+ */
+static int32_t
+encodeBlock(Lzma2Encoder &encoder,
+            uint8_t *dest,
+            uint32_t *destSize,
+            const uint8_t *src,
+            uint32_t srcSize,
+            bool finished)
+{
+   auto &p = encoder.coders[0];
+   auto destLim = *destSize;
+   auto res = SZ_OK;
+   *destSize = 0;
+
+   if (srcSize != 0) {
+      res = initCoder(p, encoder.props);
+      if (res != SZ_OK) {
+         return res;
+      }
+
+      res = internal::lzmaEncMemPrepare(p.enc, src, srcSize, Lzma2KeepWindowSize,
+                                        encoder.alloc, encoder.allocBig);
+      if (res != SZ_OK) {
+         return res;
+      }
+
+      while (p.srcPos < srcSize) {
+         auto packSize = destLim - *destSize;
+         res = encodeSubblock(p, dest + *destSize, &packSize, nullptr);
+         if (res != SZ_OK) {
+            return res;
+         }
+
+         *destSize += packSize;
+
+         if (packSize == 0) {
+            return SZ_ERROR_FAIL;
+         }
+      }
+   }
+
+   if (finished) {
+      if (*destSize == destLim) {
+         return SZ_ERROR_OUTPUT_EOF;
+      }
+
+      dest[(*destSize)++] = Lzma2ControlEof;
+   }
+
+   return SZ_OK;
+}
+
+/**
+ * The guest library hands each block to a coder thread when
+ * numBlockThreads > 1, blocks do not depend on each other so encoding them
+ * in order on this core writes the same stream.
+ */
+static int32_t
+encodeBlocks(Lzma2Encoder &encoder,
+             virt_ptr<ISeqOutStream> outStream,
+             virt_ptr<ISeqInStream> inStream,
+             virt_ptr<ICompressProgress> progress)
+{
+   auto blockSize = encoder.props.blockSize;
+   auto destBlockSize = blockSize + (blockSize >> 10) + 16;
+   auto inBuf = virt_cast<uint8_t *>(internal::allocMemory(encoder.alloc, blockSize));
+   auto outBuf = virt_cast<uint8_t *>(internal::allocMemory(encoder.alloc, destBlockSize));
+   auto inTotal = uint64_t { 0 };
+   auto outTotal = uint64_t { 0 };
+   auto res = SZ_OK;
+
+   if (!inBuf || !outBuf) {
+      res = SZ_ERROR_MEM;
+   }
+
+   while (res == SZ_OK) {
+      auto size = blockSize;
+      res = readFull(inStream, inBuf, &size);
+      if (res != SZ_OK) {
+         res = SZ_ERROR_READ;
+         break;
+      }
+
+      auto finished = (size != blockSize);
+      auto destSize = destBlockSize;
+      res = encodeBlock(encoder, outBuf.get(), &destSize, inBuf.get(), size, finished);
+      if (res != SZ_OK) {
+         break;
+      }
+
+      if (!writeStream(outStream, outBuf.get(), destSize)) {
+         res = SZ_ERROR_WRITE;
+         break;
+      }
+
+      inTotal += size;
+      outTotal += destSize;
+
+      if (finished) {
+         break;
+      }
+
+      res = reportProgress(progress, inTotal, outTotal);
+   }
+
+   if (inBuf) {
+      internal::freeMemory(encoder.alloc, inBuf);
+   }
+
+   if (outBuf) {
+      internal::freeMemory(encoder.alloc, outBuf);
+   }
+
+   return res;
+}
+
+void
+Lzma2EncProps_Init(virt_ptr<CLzma2EncProps> p)
+{
+   auto props = Lzma2EncoderProps { };
+   initProps(props);
+   storeProps(props, p);
+}
+
+void
+Lzma2EncProps_Normalize(virt_ptr<CLzma2EncProps> p)
+{
+   auto props = loadProps(p);
+   normalizeProps(props);
+   storeProps(props, p);
+}
+
+CLzma2EncHandle
+Lzma2Enc_Create(virt_ptr<ISzAlloc> alloc,
+                virt_ptr<ISzAlloc> allocBig)
+{
+   auto handle = internal::allocMemory(alloc, sizeof(Lzma2Encoder) + 4);
+   if (!handle) {
+      return nullptr;
+   }
+
+   auto &p = getEncoder(handle);
+   initProps(p.props);
+   normalizeProps(p.props);
+   p.outBuf = nullptr;
+   p.alloc = alloc;
+   p.allocBig = allocBig;
+
+   for (auto &coder : p.coders) {
+      coder.enc = nullptr;
+   }
+
+   return handle;
+}
+
+void
+Lzma2Enc_Destroy(CLzma2EncHandle handle)
+{
+   auto &p = getEncoder(handle);
+
+   for (auto &coder : p.coders) {
+      if (coder.enc) {
+         LzmaEnc_Destroy(coder.enc, p.alloc, p.allocBig);
+         coder.enc = nullptr;
+      }
+   }
+
+   if (p.outBuf) {
+      internal::freeMemory(p.alloc, virt_cast<void *>(cpu::translate(p.outBuf)));
+   }
+
+   internal::freeMemory(p.alloc, handle);
+}
+
+int32_t
+Lzma2Enc_SetProps(CLzma2EncHandle handle,
+                  virt_ptr<const CLzma2EncProps> props)
+{
+   auto &p = getEncoder(handle);
+   auto newProps = loadProps(props);
+   auto lzmaProps = newProps.lzmaProps;
+   internal::normalizeEncoderProps(lzmaProps);
+
+   if (lzmaProps.lc + lzmaProps.lp > static_cast<int32_t>(Lzma2LcLpMax)) {
+      return SZ_ERROR_PARAM;
+   }
+
+   p.props = newProps;
+   normalizeProps(p.props);
+   return SZ_OK;
+}
+
+uint8_t
+Lzma2Enc_WriteProperties(CLzma2EncHandle handle)
+{
+   auto &p = getEncoder(handle);
+   auto lzmaProps = p.props.lzmaProps;
+   internal::normalizeEncoderProps(lzmaProps);
+
+   auto i = 0u;
+   for (; i < 40; ++i) {
+      if (lzmaProps.dictSize <= ((2u | (i & 1)) << (i / 2 + 11))) {
+         break;
+      }
+   }
+
+   return static_cast<uint8_t>(i);
+}
+
+int32_t
+Lzma2Enc_Encode(CLzma2EncHandle handle,
+                virt_ptr<ISeqOutStream> outStream,
+                virt_ptr<ISeqInStream> inStream,
+                virt_ptr<ICompressProgress> progress)
+{
+   auto &p = getEncoder(handle);
+
+   for (auto i = 0; i < p.props.numBlockThreads; ++i) {
+      auto &coder = p.coders[i];
+      if (!coder.enc) {
+         coder.enc = LzmaEnc_Create(p.alloc);
+         if (!coder.enc) {
+            return SZ_ERROR_MEM;
+         }
+      }
+   }
+
+   if (p.props.numBlockThreads <= 1) {
+      return encodeStream(p, outStream, inStream, progress);
+   }
+
+   return encodeBlocks(p, outStream, inStream, progress);
+}
+
+void
+Library::registerLzma2EncSymbols()
+{
+   RegisterFunctionExport(Lzma2EncProps_Init);
+   RegisterFunctionExport(Lzma2EncProps_Normalize);
+   RegisterFunctionExport(Lzma2Enc_Create);
+   RegisterFunctionExport(Lzma2Enc_Destroy);
+   RegisterFunctionExport(Lzma2Enc_SetProps);
+   RegisterFunctionExport(Lzma2Enc_WriteProperties);
+   RegisterFunctionExport(Lzma2Enc_Encode);
+}
+
+} // namespace cafe::lzma920
@@ -0,0 +1,60 @@
+#pragma once
+#include "lzma920_lzmaenc.h"
+
+#include <cstdint>
+#include <libcpu/be2_struct.h>
+
+namespace cafe::lzma920
+{
+
+/*
+Host implementation of the Lzma2Enc API from the LZMA SDK 9.20, built on top
+of the LzmaEnc implementation.
+*/
+
+#pragma pack(push, 1)
+
+struct CLzma2EncProps
+{
+   be2_struct<CLzmaEncProps> lzmaProps;
+   be2_val<uint32_t> blockSize;
+   be2_val<int32_t> numBlockThreads;
+   be2_val<int32_t> numTotalThreads;
+};
+CHECK_OFFSET(CLzma2EncProps, 0x00, lzmaProps);
+CHECK_OFFSET(CLzma2EncProps, 0x30, blockSize);
+CHECK_OFFSET(CLzma2EncProps, 0x34, numBlockThreads);
+CHECK_OFFSET(CLzma2EncProps, 0x38, numTotalThreads);
+CHECK_SIZE(CLzma2EncProps, 0x3C);
+
+#pragma pack(pop)
+
+using CLzma2EncHandle = virt_ptr<void>;
+
+void
+Lzma2EncProps_Init(virt_ptr<CLzma2EncProps> p);
+
+void
+Lzma2EncProps_Normalize(virt_ptr<CLzma2EncProps> p);
+
+CLzma2EncHandle
+Lzma2Enc_Create(virt_ptr<ISzAlloc> alloc,
+                virt_ptr<ISzAlloc> allocBig);
+
+void
+Lzma2Enc_Destroy(CLzma2EncHandle p);
+
+int32_t
+Lzma2Enc_SetProps(CLzma2EncHandle p,
+                  virt_ptr<const CLzma2EncProps> props);
+
+uint8_t
+Lzma2Enc_WriteProperties(CLzma2EncHandle p);
+
+int32_t
+Lzma2Enc_Encode(CLzma2EncHandle p,
+                virt_ptr<ISeqOutStream> outStream,
+                virt_ptr<ISeqInStream> inStream,
+                virt_ptr<ICompressProgress> progress);
+
+} // namespace cafe::lzma920
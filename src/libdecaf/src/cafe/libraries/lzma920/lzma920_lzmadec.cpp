@@ -0,0 +1,1428 @@
+#include "lzma920.h"
+#include "lzma920_lzmadec.h"
+#include "cafe/cafe_ppc_interface_invoke_guest.h"
+#include "cafe/cafe_stackobject.h"
+#include "cafe/libraries/coreinit/coreinit_memdefaultheap.h"
+
+#include <array>
+#include <cstring>
+#include <libcpu/mmu.h>
+
+namespace cafe::lzma920
+{
+
+/*
+This is a port of LzmaDec.c from the LZMA SDK 9.20 which decodes with host
+code directly from and to guest memory. Each call copies the CLzmaDec into
+a LzmaDecoder, runs the decoder and copies the state back, so a stream can
+be decoded across many calls exactly as with the guest library. The
+probabilities stay big endian in the guest allocated probs buffer.
+*/
+
+using Prob = be2_val<uint16_t>;
+
+constexpr uint32_t TopValue = 1u << 24;
+constexpr uint32_t NumBitModelTotalBits = 11;
+constexpr uint32_t BitModelTotal = 1u << NumBitModelTotalBits;
+constexpr uint32_t NumMoveBits = 5;
+
+constexpr uint32_t RcInitSize = 5;
+
+constexpr uint32_t NumPosBitsMax = 4;
+constexpr uint32_t NumPosStatesMax = 1u << NumPosBitsMax;
+
+constexpr uint32_t LenNumLowBits = 3;
+constexpr uint32_t LenNumLowSymbols = 1u << LenNumLowBits;
+constexpr uint32_t LenNumMidBits = 3;
+constexpr uint32_t LenNumMidSymbols = 1u << LenNumMidBits;
+constexpr uint32_t LenNumHighBits = 8;
+constexpr uint32_t LenNumHighSymbols = 1u << LenNumHighBits;
+
+constexpr uint32_t LenChoice = 0;
+constexpr uint32_t LenChoice2 = LenChoice + 1;
+constexpr uint32_t LenLow = LenChoice2 + 1;
+constexpr uint32_t LenMid = LenLow + (NumPosStatesMax << LenNumLowBits);
+constexpr uint32_t LenHigh = LenMid + (NumPosStatesMax << LenNumMidBits);
+constexpr uint32_t NumLenProbs = LenHigh + LenNumHighSymbols;
+
+constexpr uint32_t NumStates = 12;
+constexpr uint32_t NumLitStates = 7;
+
+constexpr uint32_t StartPosModelIndex = 4;
+constexpr uint32_t EndPosModelIndex = 14;
+constexpr uint32_t NumFullDistances = 1u << (EndPosModelIndex >> 1);
+
+constexpr uint32_t NumPosSlotBits = 6;
+constexpr uint32_t NumLenToPosStates = 4;
+
+constexpr uint32_t NumAlignBits = 4;
+constexpr uint32_t AlignTableSize = 1u << NumAlignBits;
+
+constexpr uint32_t MatchMinLen = 2;
+constexpr uint32_t MatchSpecLenStart = MatchMinLen + LenNumLowSymbols + LenNumMidSymbols + LenNumHighSymbols;
+
+constexpr uint32_t IsMatch = 0;
+constexpr uint32_t IsRep = IsMatch + (NumStates << NumPosBitsMax);
+constexpr uint32_t IsRepG0 = IsRep + NumStates;
+constexpr uint32_t IsRepG1 = IsRepG0 + NumStates;
+constexpr uint32_t IsRepG2 = IsRepG1 + NumStates;
+constexpr uint32_t IsRep0Long = IsRepG2 + NumStates;
+constexpr uint32_t PosSlot = IsRep0Long + (NumStates << NumPosBitsMax);
+constexpr uint32_t SpecPos = PosSlot + (NumLenToPosStates << NumPosSlotBits);
+constexpr uint32_t Align = SpecPos + NumFullDistances - EndPosModelIndex;
+constexpr uint32_t LenCoder = Align + AlignTableSize;
+constexpr uint32_t RepLenCoder = LenCoder + NumLenProbs;
+constexpr uint32_t Literal = RepLenCoder + NumLenProbs;
+
+constexpr uint32_t LzmaBaseSize = 1846;
+constexpr uint32_t LzmaLitSize = 768;
+constexpr uint32_t LzmaDicMin = 1u << 12;
+
+static_assert(Literal == LzmaBaseSize);
+
+struct LzmaDecoder
+{
+   uint32_t lc;
+   uint32_t lp;
+   uint32_t pb;
+   uint32_t dicSize;
+   Prob *probs;
+   uint8_t *dic;
+   const uint8_t *buf;
+   uint32_t range;
+   uint32_t code;
+   uint32_t dicPos;
+   uint32_t dicBufSize;
+   uint32_t processedPos;
+   uint32_t checkDicSize;
+   uint32_t state;
+   uint32_t reps[4];
+   uint32_t remainLen;
+   bool needFlush;
+   bool needInitState;
+   uint32_t numProbs;
+   uint32_t tempBufSize;
+   std::array<uint8_t, LZMA_REQUIRED_INPUT_MAX> tempBuf;
+};
+
+enum class DummyResult
+{
+   Error,
+   Literal,
+   Match,
+   Rep,
+};
+
+struct RangeDecoder
+{
+   uint32_t range;
+   uint32_t code;
+   const uint8_t *buf;
+
+   inline void
+   normalize()
+   {
+      if (range < TopValue) {
+         range <<= 8;
+         code = (code << 8) | *buf++;
+      }
+   }
+
+   inline uint32_t
+   decodeBit(Prob *prob)
+   {
+      uint32_t ttt = *prob;
+      normalize();
+
+      auto bound = (range >> NumBitModelTotalBits) * ttt;
+      if (code < bound) {
+         range = bound;
+         *prob = static_cast<uint16_t>(ttt + ((BitModelTotal - ttt) >> NumMoveBits));
+         return 0;
+      }
+
+      range -= bound;
+      code -= bound;
+      *prob = static_cast<uint16_t>(ttt - (ttt >> NumMoveBits));
+      return 1;
+   }
+
+   inline uint32_t
+   decodeTree(Prob *probs,
+              uint32_t limit)
+   {
+      auto i = 1u;
+
+      do {
+         i = (i + i) + decodeBit(probs + i);
+      } while (i < limit);
+
+      return i - limit;
+   }
+
+   inline uint32_t
+   decodeDirectBit()
+   {
+      normalize();
+      range >>= 1;
+      code -= range;
+
+      auto t = 0u - (code >> 31);
+      code += range & t;
+      return t + 1;
+   }
+};
+
+/**
+ * The same decoding as RangeDecoder but without updating any probabilities
+ * and failing instead of reading past the end of the input.
+ */
+struct RangeDecoderCheck
+{
+   uint32_t range;
+   uint32_t code;
+   const uint8_t *buf;
+   const uint8_t *bufLimit;
+
+   inline bool
+   normalize()
+   {
+      if (range < TopValue) {
+         if (buf >= bufLimit) {
+            return false;
+         }
+
+         range <<= 8;
+         code = (code << 8) | *buf++;
+      }
+
+      return true;
+   }
+
+   inline bool
+   decodeBit(const Prob *prob,
+             uint32_t &bit)
+   {
+      uint32_t ttt = *prob;
+      if (!normalize()) {
+         return false;
+      }
+
+      auto bound = (range >> NumBitModelTotalBits) * ttt;
+      if (code < bound) {
+         range = bound;
+         bit = 0;
+      } else {
+         range -= bound;
+         code -= bound;
+         bit = 1;
+      }
+
+      return true;
+   }
+
+   inline bool
+   decodeTree(const Prob *probs,
+              uint32_t limit,
+              uint32_t &result)
+   {
+      auto i = 1u;
+
+      do {
+         auto bit = 0u;
+         if (!decodeBit(probs + i, bit)) {
+            return false;
+         }
+
+         i = (i + i) + bit;
+      } while (i < limit);
+
+      result = i - limit;
+      return true;
+   }
+};
+
+static void
+loadDecoder(virt_ptr<CLzmaDec> guest,
+            LzmaDecoder &decoder)
+{
+   decoder.lc = guest->prop.lc;
+   decoder.lp = guest->prop.lp;
+   decoder.pb = guest->prop.pb;
+   decoder.dicSize = guest->prop.dicSize;
+   decoder.probs = reinterpret_cast<Prob *>(guest->probs.getRawPointer());
+   decoder.dic = guest->dic.getRawPointer();
+   decoder.buf = nullptr;
+   decoder.range = guest->range;
+   decoder.code = guest->code;
+   decoder.dicPos = guest->dicPos;
+   decoder.dicBufSize = guest->dicBufSize;
+   decoder.processedPos = guest->processedPos;
+   decoder.checkDicSize = guest->checkDicSize;
+   decoder.state = guest->state;
+
+   for (auto i = 0u; i < 4; ++i) {
+      decoder.reps[i] = guest->reps[i];
+   }
+
+   decoder.remainLen = guest->remainLen;
+   decoder.needFlush = !!guest->needFlush;
+   decoder.needInitState = !!guest->needInitState;
+   decoder.numProbs = guest->numProbs;
+   decoder.tempBufSize = guest->tempBufSize;
+
+   for (auto i = 0u; i < decoder.tempBuf.size(); ++i) {
+      decoder.tempBuf[i] = guest->tempBuf[i];
+   }
+}
+
+static void
+storeDecoder(const LzmaDecoder &decoder,
+             virt_ptr<CLzmaDec> guest)
+{
+   auto tempBufStart = decoder.tempBuf.data();
+   auto tempBufEnd = tempBufStart + decoder.tempBuf.size();
+
+   if (decoder.buf >= tempBufStart && decoder.buf <= tempBufEnd) {
+      guest->buf = virt_addrof(guest->tempBuf) + (decoder.buf - tempBufStart);
+   } else if (decoder.buf) {
+      guest->buf = virt_cast<const uint8_t *>(cpu::translate(decoder.buf));
+   }
+
+   guest->range = decoder.range;
+   guest->code = decoder.code;
+   guest->dicPos = decoder.dicPos;
+   guest->processedPos = decoder.processedPos;
+   guest->checkDicSize = decoder.checkDicSize;
+   guest->state = decoder.state;
+
+   for (auto i = 0u; i < 4; ++i) {
+      guest->reps[i] = decoder.reps[i];
+   }
+
+   guest->remainLen = decoder.remainLen;
+   guest->needFlush = decoder.needFlush ? 1 : 0;
+   guest->needInitState = decoder.needInitState ? 1 : 0;
+   guest->tempBufSize = decoder.tempBufSize;
+
+   for (auto i = 0u; i < decoder.tempBuf.size(); ++i) {
+      guest->tempBuf[i] = decoder.tempBuf[i];
+   }
+}
+
+/**
+ * Decode symbols until dicPos reaches limit or buf reaches bufLimit, the
+ * first symbol is always decoded.
+ *
+ * On return remainLen is the length of a match still to be copied, or
+ * MatchSpecLenStart once the end marker has been decoded.
+ */
+static int32_t
+decodeReal(LzmaDecoder &p,
+           uint32_t limit,
+           const uint8_t *bufLimit)
+{
+   auto probs = p.probs;
+   auto state = p.state;
+   auto rep0 = p.reps[0];
+   auto rep1 = p.reps[1];
+   auto rep2 = p.reps[2];
+   auto rep3 = p.reps[3];
+   auto pbMask = (1u << p.pb) - 1;
+   auto lpMask = (1u << p.lp) - 1;
+   auto lc = p.lc;
+
+   auto dic = p.dic;
+   auto dicBufSize = p.dicBufSize;
+   auto dicPos = p.dicPos;
+
+   auto processedPos = p.processedPos;
+   auto checkDicSize = p.checkDicSize;
+   auto len = 0u;
+
+   auto rc = RangeDecoder { p.range, p.code, p.buf };
+
+   do {
+      auto posState = processedPos & pbMask;
+      auto prob = probs + IsMatch + (state << NumPosBitsMax) + posState;
+
+      if (!rc.decodeBit(prob)) {
+         auto symbol = 1u;
+         prob = probs + Literal;
+
+         if (checkDicSize != 0 || processedPos != 0) {
+            prob += LzmaLitSize * (((processedPos & lpMask) << lc) +
+                                   (dic[(dicPos == 0 ? dicBufSize : dicPos) - 1] >> (8 - lc)));
+         }
+
+         if (state < NumLitStates) {
+            state -= (state < 4) ? state : 3;
+
+            do {
+               symbol = (symbol + symbol) + rc.decodeBit(prob + symbol);
+            } while (symbol < 0x100);
+         } else {
+            uint32_t matchByte = dic[(dicPos - rep0) + ((dicPos < rep0) ? dicBufSize : 0)];
+            auto offs = 0x100u;
+            state -= (state < 10) ? 3 : 6;
+
+            do {
+               matchByte <<= 1;
+               auto bit = matchByte & offs;
+
+               if (rc.decodeBit(prob + offs + bit + symbol)) {
+                  symbol = (symbol + symbol) + 1;
+                  offs &= bit;
+               } else {
+                  symbol = symbol + symbol;
+                  offs &= ~bit;
+               }
+            } while (symbol < 0x100);
+         }
+
+         dic[dicPos++] = static_cast<uint8_t>(symbol);
+         processedPos++;
+         continue;
+      }
+
+      prob = probs + IsRep + state;
+
+      if (!rc.decodeBit(prob)) {
+         state += NumStates;
+         prob = probs + LenCoder;
+      } else {
+         if (checkDicSize == 0 && processedPos == 0) {
+            return SZ_ERROR_DATA;
+         }
+
+         prob = probs + IsRepG0 + state;
+
+         if (!rc.decodeBit(prob)) {
+            prob = probs + IsRep0Long + (state << NumPosBitsMax) + posState;
+
+            if (!rc.decodeBit(prob)) {
+               dic[dicPos] = dic[(dicPos - rep0) + ((dicPos < rep0) ? dicBufSize : 0)];
+               dicPos++;
+               processedPos++;
+               state = state < NumLitStates ? 9 : 11;
+               continue;
+            }
+         } else {
+            auto distance = 0u;
+            prob = probs + IsRepG1 + state;
+
+            if (!rc.decodeBit(prob)) {
+               distance = rep1;
+            } else {
+               prob = probs + IsRepG2 + state;
+
+               if (!rc.decodeBit(prob)) {
+                  distance = rep2;
+               } else {
+                  distance = rep3;
+                  rep3 = rep2;
+               }
+
+               rep2 = rep1;
+            }
+
+            rep1 = rep0;
+            rep0 = distance;
+         }
+
+         state = state < NumLitStates ? 8 : 11;
+         prob = probs + RepLenCoder;
+      }
+
+      {
+         auto limitLen = 0u;
+         auto offset = 0u;
+         auto probLen = prob + LenChoice;
+
+         if (!rc.decodeBit(probLen)) {
+            probLen = prob + LenLow + (posState << LenNumLowBits);
+            offset = 0;
+            limitLen = 1u << LenNumLowBits;
+         } else {
+            probLen = prob + LenChoice2;
+
+            if (!rc.decodeBit(probLen)) {
+               probLen = prob + LenMid + (posState << LenNumMidBits);
+               offset = LenNumLowSymbols;
+               limitLen = 1u << LenNumMidBits;
+            } else {
+               probLen = prob + LenHigh;
+               offset = LenNumLowSymbols + LenNumMidSymbols;
+               limitLen = 1u << LenNumHighBits;
+            }
+         }
+
+         len = rc.decodeTree(probLen, limitLen) + offset;
+      }
+
+      if (state >= NumStates) {
+         prob = probs + PosSlot +
+            ((len < NumLenToPosStates ? len : NumLenToPosStates - 1) << NumPosSlotBits);
+         auto distance = rc.decodeTree(prob, 1u << 6);
+
+         if (distance >= StartPosModelIndex) {
+            auto posSlot = distance;
+            auto numDirectBits = (distance >> 1) - 1;
+            distance = 2 | (distance & 1);
+
+            if (posSlot < EndPosModelIndex) {
+               distance <<= numDirectBits;
+               prob = probs + SpecPos + distance - posSlot - 1;
+
+               auto mask = 1u;
+               auto i = 1u;
+
+               do {
+                  if (rc.decodeBit(prob + i)) {
+                     i = (i + i) + 1;
+                     distance |= mask;
+                  } else {
+                     i = i + i;
+                  }
+
+                  mask <<= 1;
+               } while (--numDirectBits != 0);
+            } else {
+               numDirectBits -= NumAlignBits;
+
+               do {
+                  distance = (distance << 1) + rc.decodeDirectBit();
+               } while (--numDirectBits != 0);
+
+               prob = probs + Align;
+               distance <<= NumAlignBits;
+
+               auto i = 1u;
+               for (auto mask = 1u; mask < (1u << NumAlignBits); mask <<= 1) {
+                  if (rc.decodeBit(prob + i)) {
+                     i = (i + i) + 1;
+                     distance |= mask;
+                  } else {
+                     i = i + i;
+                  }
+               }
+
+               if (distance == 0xFFFFFFFFu) {
+                  len += MatchSpecLenStart;
+                  state -= NumStates;
+                  break;
+               }
+            }
+         }
+
+         rep3 = rep2;
+         rep2 = rep1;
+         rep1 = rep0;
+         rep0 = distance + 1;
+
+         if (checkDicSize == 0) {
+            if (distance >= processedPos) {
+               return SZ_ERROR_DATA;
+            }
+         } else if (distance >= checkDicSize) {
+            return SZ_ERROR_DATA;
+         }
+
+         state = (state < NumStates + NumLitStates) ? NumLitStates : NumLitStates + 3;
+      }
+
+      len += MatchMinLen;
+
+      if (limit == dicPos) {
+         return SZ_ERROR_DATA;
+      }
+
+      {
+         auto rem = limit - dicPos;
+         auto curLen = (rem < len) ? rem : len;
+         auto pos = (dicPos - rep0) + ((dicPos < rep0) ? dicBufSize : 0);
+
+         processedPos += curLen;
+         len -= curLen;
+
+         if (pos + curLen <= dicBufSize) {
+            // Copy forwards a byte at a time, the ranges may overlap
+            auto dest = dic + dicPos;
+            auto src = dic + pos;
+            dicPos += curLen;
+
+            for (auto i = 0u; i < curLen; ++i) {
+               dest[i] = src[i];
+            }
+         } else {
+            do {
+               dic[dicPos++] = dic[pos];
+
+               if (++pos == dicBufSize) {
+                  pos = 0;
+               }
+            } while (--curLen != 0);
+         }
+      }
+   } while (dicPos < limit && rc.buf < bufLimit);
+
+   rc.normalize();
+   p.buf = rc.buf;
+   p.range = rc.range;
+   p.code = rc.code;
+   p.remainLen = len;
+   p.dicPos = dicPos;
+   p.processedPos = processedPos;
+   p.reps[0] = rep0;
+   p.reps[1] = rep1;
+   p.reps[2] = rep2;
+   p.reps[3] = rep3;
+   p.state = state;
+   return SZ_OK;
+}
+
+static void
+writeRem(LzmaDecoder &p,
+         uint32_t limit)
+{
+   if (p.remainLen == 0 || p.remainLen >= MatchSpecLenStart) {
+      return;
+   }
+
+   auto dic = p.dic;
+   auto dicPos = p.dicPos;
+   auto dicBufSize = p.dicBufSize;
+   auto len = p.remainLen;
+   auto rep0 = p.reps[0];
+
+   if (limit - dicPos < len) {
+      len = limit - dicPos;
+   }
+
+   if (p.checkDicSize == 0 && p.dicSize - p.processedPos <= len) {
+      p.checkDicSize = p.dicSize;
+   }
+
+   p.processedPos += len;
+   p.remainLen -= len;
+
+   while (len != 0) {
+      len--;
+      dic[dicPos] = dic[(dicPos - rep0) + ((dicPos < rep0) ? dicBufSize : 0)];
+      dicPos++;
+   }
+
+   p.dicPos = dicPos;
+}
+
+static int32_t
+decodeReal2(LzmaDecoder &p,
+            uint32_t limit,
+            const uint8_t *bufLimit)
+{
+   do {
+      auto limit2 = limit;
+
+      if (p.checkDicSize == 0) {
+         auto rem = p.dicSize - p.processedPos;
+         if (limit - p.dicPos > rem) {
+            limit2 = p.dicPos + rem;
+         }
+      }
+
+      if (auto res = decodeReal(p, limit2, bufLimit); res != SZ_OK) {
+         return res;
+      }
+
+      if (p.processedPos >= p.dicSize) {
+         p.checkDicSize = p.dicSize;
+      }
+
+      writeRem(p, limit);
+   } while (p.dicPos < limit && p.buf < bufLimit && p.remainLen < MatchSpecLenStart);
+
+   if (p.remainLen > MatchSpecLenStart) {
+      p.remainLen = MatchSpecLenStart;
+   }
+
+   return SZ_OK;
+}
+
+/**
+ * Check whether the next symbol can be decoded from the inSize bytes at
+ * buf without changing any decoder state.
+ */
+static DummyResult
+tryDummy(const LzmaDecoder &p,
+         const uint8_t *buf,
+         uint32_t inSize)
+{
+   auto rc = RangeDecoderCheck { p.range, p.code, buf, buf + inSize };
+   auto probs = p.probs;
+   auto state = p.state;
+   auto result = DummyResult::Error;
+   auto bit = 0u;
+
+   auto posState = p.processedPos & ((1u << p.pb) - 1);
+   auto prob = probs + IsMatch + (state << NumPosBitsMax) + posState;
+
+   if (!rc.decodeBit(prob, bit)) {
+      return DummyResult::Error;
+   }
+
+   if (!bit) {
+      prob = probs + Literal;
+
+      if (p.checkDicSize != 0 || p.processedPos != 0) {
+         prob += LzmaLitSize *
+            (((p.processedPos & ((1u << p.lp) - 1)) << p.lc) +
+             (p.dic[(p.dicPos == 0 ? p.dicBufSize : p.dicPos) - 1] >> (8 - p.lc)));
+      }
+
+      auto symbol = 1u;
+
+      if (state < NumLitStates) {
+         do {
+            if (!rc.decodeBit(prob + symbol, bit)) {
+               return DummyResult::Error;
+            }
+
+            symbol = (symbol + symbol) + bit;
+         } while (symbol < 0x100);
+      } else {
+         uint32_t matchByte = p.dic[p.dicPos - p.reps[0] +
+                                    ((p.dicPos < p.reps[0]) ? p.dicBufSize : 0)];
+         auto offs = 0x100u;
+
+         do {
+            matchByte <<= 1;
+            auto matchBit = matchByte & offs;
+
+            if (!rc.decodeBit(prob + offs + matchBit + symbol, bit)) {
+               return DummyResult::Error;
+            }
+
+            symbol = (symbol + symbol) + bit;
+            offs &= bit ? matchBit : ~matchBit;
+         } while (symbol < 0x100);
+      }
+
+      result = DummyResult::Literal;
+   } else {
+      auto len = 0u;
+      prob = probs + IsRep + state;
+
+      if (!rc.decodeBit(prob, bit)) {
+         return DummyResult::Error;
+      }
+
+      if (!bit) {
+         state = 0;
+         prob = probs + LenCoder;
+         result = DummyResult::Match;
+      } else {
+         result = DummyResult::Rep;
+         prob = probs + IsRepG0 + state;
+
+         if (!rc.decodeBit(prob, bit)) {
+            return DummyResult::Error;
+         }
+
+         if (!bit) {
+            prob = probs + IsRep0Long + (state << NumPosBitsMax) + posState;
+
+            if (!rc.decodeBit(prob, bit)) {
+               return DummyResult::Error;
+            }
+
+            if (!bit) {
+               return rc.normalize() ? DummyResult::Rep : DummyResult::Error;
+            }
+         } else {
+            prob = probs + IsRepG1 + state;
+
+            if (!rc.decodeBit(prob, bit)) {
+               return DummyResult::Error;
+            }
+
+            if (bit) {
+               prob = probs + IsRepG2 + state;
+
+               if (!rc.decodeBit(prob, bit)) {
+                  return DummyResult::Error;
+               }
+            }
+         }
+
+         state = NumStates;
+         prob = probs + RepLenCoder;
+      }
+
+      {
+         auto limitLen = 0u;
+         auto offset = 0u;
+         auto probLen = prob + LenChoice;
+
+         if (!rc.decodeBit(probLen, bit)) {
+            return DummyResult::Error;
+         }
+
+         if (!bit) {
+            probLen = prob + LenLow + (posState << LenNumLowBits);
+            offset = 0;
+            limitLen = 1u << LenNumLowBits;
+         } else {
+            probLen = prob + LenChoice2;
+
+            if (!rc.decodeBit(probLen, bit)) {
+               return DummyResult::Error;
+            }
+
+            if (!bit) {
+               probLen = prob + LenMid + (posState << LenNumMidBits);
+               offset = LenNumLowSymbols;
+               limitLen = 1u << LenNumMidBits;
+            } else {
+               probLen = prob + LenHigh;
+               offset = LenNumLowSymbols + LenNumMidSymbols;
+               limitLen = 1u << LenNumHighBits;
+            }
+         }
+
+         if (!rc.decodeTree(probLen, limitLen, len)) {
+            return DummyResult::Error;
+         }
+
+         len += offset;
+      }
+
+      if (state < 4) {
+         auto posSlot = 0u;
+         prob = probs + PosSlot +
+            ((len < NumLenToPosStates ? len : NumLenToPosStates - 1) << NumPosSlotBits);
+
+         if (!rc.decodeTree(prob, 1u << NumPosSlotBits, posSlot)) {
+            return DummyResult::Error;
+         }
+
+         if (posSlot >= StartPosModelIndex) {
+            auto numDirectBits = (posSlot >> 1) - 1;
+
+            if (posSlot < EndPosModelIndex) {
+               prob = probs + SpecPos + ((2 | (posSlot & 1)) << numDirectBits) - posSlot - 1;
+            } else {
+               numDirectBits -= NumAlignBits;
+
+               do {
+                  if (!rc.normalize()) {
+                     return DummyResult::Error;
+                  }
+
+                  rc.range >>= 1;
+                  rc.code -= rc.range & (((rc.code - rc.range) >> 31) - 1);
+               } while (--numDirectBits != 0);
+
+               prob = probs + Align;
+               numDirectBits = NumAlignBits;
+            }
+
+            auto i = 1u;
+
+            do {
+               if (!rc.decodeBit(prob + i, bit)) {
+                  return DummyResult::Error;
+               }
+
+               i = (i + i) + bit;
+            } while (--numDirectBits != 0);
+         }
+      }
+   }
+
+   return rc.normalize() ? result : DummyResult::Error;
+}
+
+static void
+initRc(LzmaDecoder &p,
+       const uint8_t *data)
+{
+   p.code = (static_cast<uint32_t>(data[1]) << 24) |
+            (static_cast<uint32_t>(data[2]) << 16) |
+            (static_cast<uint32_t>(data[3]) << 8) |
+             static_cast<uint32_t>(data[4]);
+   p.range = 0xFFFFFFFFu;
+   p.needFlush = false;
+}
+
+static void
+initStateReal(LzmaDecoder &p)
+{
+   auto numProbs = Literal + (LzmaLitSize << (p.lc + p.lp));
+
+   for (auto i = 0u; i < numProbs; ++i) {
+      p.probs[i] = static_cast<uint16_t>(BitModelTotal >> 1);
+   }
+
+   p.reps[0] = p.reps[1] = p.reps[2] = p.reps[3] = 1;
+   p.state = 0;
+   p.needInitState = false;
+}
+
+static int32_t
+decodeToDic(LzmaDecoder &p,
+            uint32_t dicLimit,
+            const uint8_t *src,
+            uint32_t *srcLen,
+            int32_t finishMode,
+            int32_t *status)
+{
+   auto inSize = *srcLen;
+   *srcLen = 0;
+   writeRem(p, dicLimit);
+
+   *status = LZMA_STATUS_NOT_SPECIFIED;
+
+   while (p.remainLen != MatchSpecLenStart) {
+      auto checkEndMarkNow = false;
+
+      if (p.needFlush) {
+         for (; inSize > 0 && p.tempBufSize < RcInitSize; (*srcLen)++, inSize--) {
+            p.tempBuf[p.tempBufSize++] = *src++;
+         }
+
+         if (p.tempBufSize < RcInitSize) {
+            *status = LZMA_STATUS_NEEDS_MORE_INPUT;
+            return SZ_OK;
+         }
+
+         if (p.tempBuf[0] != 0) {
+            return SZ_ERROR_DATA;
+         }
+
+         initRc(p, p.tempBuf.data());
+         p.tempBufSize = 0;
+      }
+
+      if (p.dicPos >= dicLimit) {
+         if (p.remainLen == 0 && p.code == 0) {
+            *status = LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK;
+            return SZ_OK;
+         }
+
+         if (finishMode == LZMA_FINISH_ANY) {
+            *status = LZMA_STATUS_NOT_FINISHED;
+            return SZ_OK;
+         }
+
+         if (p.remainLen != 0) {
+            *status = LZMA_STATUS_NOT_FINISHED;
+            return SZ_ERROR_DATA;
+         }
+
+         checkEndMarkNow = true;
+      }
+
+      if (p.needInitState) {
+         initStateReal(p);
+      }
+
+      if (p.tempBufSize == 0) {
+         auto bufLimit = src;
+
+         if (inSize < LZMA_REQUIRED_INPUT_MAX || checkEndMarkNow) {
+            auto dummyRes = tryDummy(p, src, inSize);
+
+            if (dummyRes == DummyResult::Error) {
+               std::memcpy(p.tempBuf.data(), src, inSize);
+               p.tempBufSize = inSize;
+               *srcLen += inSize;
+               *status = LZMA_STATUS_NEEDS_MORE_INPUT;
+               return SZ_OK;
+            }
+
+            if (checkEndMarkNow && dummyRes != DummyResult::Match) {
+               *status = LZMA_STATUS_NOT_FINISHED;
+               return SZ_ERROR_DATA;
+            }
+
+            bufLimit = src;
+         } else {
+            bufLimit = src + inSize - LZMA_REQUIRED_INPUT_MAX;
+         }
+
+         p.buf = src;
+
+         if (decodeReal2(p, dicLimit, bufLimit) != SZ_OK) {
+            return SZ_ERROR_DATA;
+         }
+
+         auto processed = static_cast<uint32_t>(p.buf - src);
+         *srcLen += processed;
+         src += processed;
+         inSize -= processed;
+      } else {
+         auto rem = p.tempBufSize;
+         auto lookAhead = 0u;
+
+         while (rem < LZMA_REQUIRED_INPUT_MAX && lookAhead < inSize) {
+            p.tempBuf[rem++] = src[lookAhead++];
+         }
+
+         p.tempBufSize = rem;
+
+         if (rem < LZMA_REQUIRED_INPUT_MAX || checkEndMarkNow) {
+            auto dummyRes = tryDummy(p, p.tempBuf.data(), rem);
+
+            if (dummyRes == DummyResult::Error) {
+               *srcLen += lookAhead;
+               *status = LZMA_STATUS_NEEDS_MORE_INPUT;
+               return SZ_OK;
+            }
+
+            if (checkEndMarkNow && dummyRes != DummyResult::Match) {
+               *status = LZMA_STATUS_NOT_FINISHED;
+               return SZ_ERROR_DATA;
+            }
+         }
+
+         p.buf = p.tempBuf.data();
+
+         if (decodeReal2(p, dicLimit, p.buf) != SZ_OK) {
+            return SZ_ERROR_DATA;
+         }
+
+         lookAhead -= rem - static_cast<uint32_t>(p.buf - p.tempBuf.data());
+         *srcLen += lookAhead;
+         src += lookAhead;
+         inSize -= lookAhead;
+         p.tempBufSize = 0;
+      }
+   }
+
+   if (p.code == 0) {
+      *status = LZMA_STATUS_FINISHED_WITH_MARK;
+   }
+
+   return (p.code == 0) ? SZ_OK : SZ_ERROR_DATA;
+}
+
+static int32_t
+decodeProps(const uint8_t *data,
+            uint32_t size,
+            uint32_t &lc,
+            uint32_t &lp,
+            uint32_t &pb,
+            uint32_t &dicSize)
+{
+   if (size < LZMA_PROPS_SIZE) {
+      return SZ_ERROR_UNSUPPORTED;
+   }
+
+   dicSize = data[1] |
+             (static_cast<uint32_t>(data[2]) << 8) |
+             (static_cast<uint32_t>(data[3]) << 16) |
+             (static_cast<uint32_t>(data[4]) << 24);
+
+   if (dicSize < LzmaDicMin) {
+      dicSize = LzmaDicMin;
+   }
+
+   auto d = static_cast<uint32_t>(data[0]);
+   if (d >= (9 * 5 * 5)) {
+      return SZ_ERROR_UNSUPPORTED;
+   }
+
+   lc = d % 9;
+   d /= 9;
+   pb = d / 5;
+   lp = d % 5;
+   return SZ_OK;
+}
+
+static void
+freeDict(virt_ptr<CLzmaDec> p,
+         virt_ptr<ISzAlloc> alloc)
+{
+   internal::freeMemory(alloc, p->dic);
+   p->dic = nullptr;
+}
+
+static int32_t
+allocateProbs2(virt_ptr<CLzmaDec> p,
+               uint32_t lc,
+               uint32_t lp,
+               virt_ptr<ISzAlloc> alloc)
+{
+   auto numProbs = LzmaBaseSize + (LzmaLitSize << (lc + lp));
+
+   if (!p->probs || numProbs != p->numProbs) {
+      LzmaDec_FreeProbs(p, alloc);
+      p->probs = virt_cast<uint16_t *>(internal::allocMemory(alloc, numProbs * sizeof(uint16_t)));
+      p->numProbs = numProbs;
+
+      if (!p->probs) {
+         return SZ_ERROR_MEM;
+      }
+   }
+
+   return SZ_OK;
+}
+
+int32_t
+LzmaProps_Decode(virt_ptr<CLzmaProps> p,
+                 virt_ptr<const uint8_t> data,
+                 uint32_t size)
+{
+   uint32_t lc, lp, pb, dicSize;
+   auto res = decodeProps(data.get(), size, lc, lp, pb, dicSize);
+
+   // The guest version writes dicSize before checking the first byte
+   if (size >= LZMA_PROPS_SIZE) {
+      p->dicSize = dicSize;
+   }
+
+   if (res == SZ_OK) {
+      p->lc = lc;
+      p->lp = lp;
+      p->pb = pb;
+   }
+
+   return res;
+}
+
+void
+LzmaDec_InitDicAndState(virt_ptr<CLzmaDec> p,
+                        int32_t initDic,
+                        int32_t initState)
+{
+   p->needFlush = 1;
+   p->remainLen = 0u;
+   p->tempBufSize = 0u;
+
+   if (initDic) {
+      p->processedPos = 0u;
+      p->checkDicSize = 0u;
+      p->needInitState = 1;
+   }
+
+   if (initState) {
+      p->needInitState = 1;
+   }
+}
+
+void
+LzmaDec_Init(virt_ptr<CLzmaDec> p)
+{
+   p->dicPos = 0u;
+   LzmaDec_InitDicAndState(p, 1, 1);
+}
+
+int32_t
+LzmaDec_AllocateProbs(virt_ptr<CLzmaDec> p,
+                      virt_ptr<const uint8_t> props,
+                      uint32_t propsSize,
+                      virt_ptr<ISzAlloc> alloc)
+{
+   return internal::allocateProbs(p, props.get(), propsSize, alloc);
+}
+
+void
+LzmaDec_FreeProbs(virt_ptr<CLzmaDec> p,
+                  virt_ptr<ISzAlloc> alloc)
+{
+   internal::freeMemory(alloc, p->probs);
+   p->probs = nullptr;
+}
+
+int32_t
+LzmaDec_Allocate(virt_ptr<CLzmaDec> p,
+                 virt_ptr<const uint8_t> props,
+                 uint32_t propsSize,
+                 virt_ptr<ISzAlloc> alloc)
+{
+   return internal::allocate(p, props.get(), propsSize, alloc);
+}
+
+void
+LzmaDec_Free(virt_ptr<CLzmaDec> p,
+             virt_ptr<ISzAlloc> alloc)
+{
+   LzmaDec_FreeProbs(p, alloc);
+   freeDict(p, alloc);
+}
+
+int32_t
+LzmaDec_DecodeToDic(virt_ptr<CLzmaDec> p,
+                    uint32_t dicLimit,
+                    virt_ptr<const uint8_t> src,
+                    virt_ptr<uint32_t> srcLen,
+                    int32_t finishMode,
+                    virt_ptr<int32_t> status)
+{
+   auto hostSrcLen = static_cast<uint32_t>(*srcLen);
+   auto hostStatus = int32_t { LZMA_STATUS_NOT_SPECIFIED };
+   auto result = internal::decodeToDic(p, dicLimit, src.get(), &hostSrcLen,
+                                       finishMode, &hostStatus);
+   *srcLen = hostSrcLen;
+   *status = hostStatus;
+   return result;
+}
+
+int32_t
+LzmaDec_DecodeToBuf(virt_ptr<CLzmaDec> p,
+                    virt_ptr<uint8_t> dest,
+                    virt_ptr<uint32_t> destLen,
+                    virt_ptr<const uint8_t> src,
+                    virt_ptr<uint32_t> srcLen,
+                    int32_t finishMode,
+                    virt_ptr<int32_t> status)
+{
+   auto outSize = static_cast<uint32_t>(*destLen);
+   auto inSize = static_cast<uint32_t>(*srcLen);
+   auto hostDest = dest.get();
+   auto hostSrc = src.get();
+   auto hostStatus = int32_t { LZMA_STATUS_NOT_SPECIFIED };
+   auto totalIn = 0u;
+   auto totalOut = 0u;
+   auto result = SZ_OK;
+
+   auto decoder = LzmaDecoder { };
+   loadDecoder(p, decoder);
+
+   while (true) {
+      if (decoder.dicPos == decoder.dicBufSize) {
+         decoder.dicPos = 0;
+      }
+
+      auto dicPos = decoder.dicPos;
+      auto inSizeCur = inSize;
+      auto outSizeCur = 0u;
+      auto curFinishMode = finishMode;
+
+      if (outSize > decoder.dicBufSize - dicPos) {
+         outSizeCur = decoder.dicBufSize;
+         curFinishMode = LZMA_FINISH_ANY;
+      } else {
+         outSizeCur = dicPos + outSize;
+      }
+
+      result = decodeToDic(decoder, outSizeCur, hostSrc, &inSizeCur,
+                           curFinishMode, &hostStatus);
+      hostSrc += inSizeCur;
+      inSize -= inSizeCur;
+      totalIn += inSizeCur;
+
+      outSizeCur = decoder.dicPos - dicPos;
+      std::memcpy(hostDest, decoder.dic + dicPos, outSizeCur);
+      hostDest += outSizeCur;
+      outSize -= outSizeCur;
+      totalOut += outSizeCur;
+
+      if (result != SZ_OK || outSizeCur == 0 || outSize == 0) {
+         break;
+      }
+   }
+
+   storeDecoder(decoder, p);
+   *srcLen = totalIn;
+   *destLen = totalOut;
+   *status = hostStatus;
+   return result;
+}
+
+int32_t
+LzmaDecode(virt_ptr<uint8_t> dest,
+           virt_ptr<uint32_t> destLen,
+           virt_ptr<const uint8_t> src,
+           virt_ptr<uint32_t> srcLen,
+           virt_ptr<const uint8_t> propData,
+           uint32_t propSize,
+           int32_t finishMode,
+           virt_ptr<int32_t> status,
+           virt_ptr<ISzAlloc> alloc)
+{
+   auto outSize = static_cast<uint32_t>(*destLen);
+   auto inSize = static_cast<uint32_t>(*srcLen);
+   *destLen = 0u;
+   *srcLen = 0u;
+   *status = LZMA_STATUS_NOT_SPECIFIED;
+
+   if (inSize < RcInitSize) {
+      return SZ_ERROR_INPUT_EOF;
+   }
+
+   auto p = StackObject<CLzmaDec> { };
+   p->dic = nullptr;
+   p->probs = nullptr;
+
+   if (auto res = internal::allocateProbs(p, propData.get(), propSize, alloc); res != SZ_OK) {
+      return res;
+   }
+
+   p->dic = dest;
+   p->dicBufSize = outSize;
+   LzmaDec_Init(p);
+
+   auto hostSrcLen = inSize;
+   auto hostStatus = int32_t { LZMA_STATUS_NOT_SPECIFIED };
+   auto res = internal::decodeToDic(p, outSize, src.get(), &hostSrcLen,
+                                    finishMode, &hostStatus);
+   *srcLen = hostSrcLen;
+   *destLen = static_cast<uint32_t>(p->dicPos);
+   *status = hostStatus;
+
+   if (res == SZ_OK && hostStatus == LZMA_STATUS_NEEDS_MORE_INPUT) {
+      res = SZ_ERROR_INPUT_EOF;
+   }
+
+   LzmaDec_FreeProbs(p, alloc);
+   return res;
+}
+
+/**
+ * From LzmaLib, which allocates from the default heap and does not require
+ * an end marker.
+ */
+int32_t
+LzmaUncompress(virt_ptr<uint8_t> dest,
+               virt_ptr<uint32_t> destLen,
+               virt_ptr<const uint8_t> src,
+               virt_ptr<uint32_t> srcLen,
+               virt_ptr<const uint8_t> props,
+               uint32_t propsSize)
+{
+   auto status = StackObject<int32_t> { };
+   return LzmaDecode(dest, destLen, src, srcLen, props, propsSize,
+                     LZMA_FINISH_ANY, status, nullptr);
+}
+
+namespace internal
+{
+
+virt_ptr<void>
+allocMemory(virt_ptr<ISzAlloc> alloc,
+            uint32_t size)
+{
+   if (!alloc) {
+      return coreinit::MEMAllocFromDefaultHeap(size);
+   }
+
+   return cafe::invoke(cpu::this_core::state(),
+                       alloc->Alloc,
+                       alloc,
+                       size);
+}
+
+void
+freeMemory(virt_ptr<ISzAlloc> alloc,
+           virt_ptr<void> address)
+{
+   if (!alloc) {
+      if (address) {
+         coreinit::MEMFreeToDefaultHeap(address);
+      }
+
+      return;
+   }
+
+   cafe::invoke(cpu::this_core::state(),
+                alloc->Free,
+                alloc,
+                address);
+}
+
+int32_t
+decodeToDic(virt_ptr<CLzmaDec> p,
+            uint32_t dicLimit,
+            const uint8_t *src,
+            uint32_t *srcLen,
+            int32_t finishMode,
+            int32_t *status)
+{
+   auto decoder = LzmaDecoder { };
+   loadDecoder(p, decoder);
+
+   auto result = lzma920::decodeToDic(decoder, dicLimit, src, srcLen,
+                                      finishMode, status);
+   storeDecoder(decoder, p);
+   return result;
+}
+
+int32_t
+allocateProbs(virt_ptr<CLzmaDec> p,
+              const uint8_t *props,
+              uint32_t propsSize,
+              virt_ptr<ISzAlloc> alloc)
+{
+   uint32_t lc, lp, pb, dicSize;
+
+   if (auto res = decodeProps(props, propsSize, lc, lp, pb, dicSize); res != SZ_OK) {
+      return res;
+   }
+
+   if (auto res = allocateProbs2(p, lc, lp, alloc); res != SZ_OK) {
+      return res;
+   }
+
+   p->prop.lc = lc;
+   p->prop.lp = lp;
+   p->prop.pb = pb;
+   p->prop.dicSize = dicSize;
+   return SZ_OK;
+}
+
+int32_t
+allocate(virt_ptr<CLzmaDec> p,
+         const uint8_t *props,
+         uint32_t propsSize,
+         virt_ptr<ISzAlloc> alloc)
+{
+   uint32_t lc, lp, pb, dicSize;
+
+   if (auto res = decodeProps(props, propsSize, lc, lp, pb, dicSize); res != SZ_OK) {
+      return res;
+   }
+
+   if (auto res = allocateProbs2(p, lc, lp, alloc); res != SZ_OK) {
+      return res;
+   }
+
+   auto dicBufSize = dicSize;
+
+   if (!p->dic || dicBufSize != p->dicBufSize) {
+      freeDict(p, alloc);
+      p->dic = virt_cast<uint8_t *>(internal::allocMemory(alloc, dicBufSize));
+
+      if (!p->dic) {
+         LzmaDec_FreeProbs(p, alloc);
+         return SZ_ERROR_MEM;
+      }
+   }
+
+   p->dicBufSize = dicBufSize;
+   p->prop.lc = lc;
+   p->prop.lp = lp;
+   p->prop.pb = pb;
+   p->prop.dicSize = dicSize;
+   return SZ_OK;
+}
+
+} // namespace internal
+
+void
+Library::registerLzmaDecSymbols()
+{
+   RegisterFunctionExport(LzmaProps_Decode);
+   RegisterFunctionExport(LzmaDec_InitDicAndState);
+   RegisterFunctionExport(LzmaDec_Init);
+   RegisterFunctionExport(LzmaDec_AllocateProbs);
+   RegisterFunctionExport(LzmaDec_FreeProbs);
+   RegisterFunctionExport(LzmaDec_Allocate);
+   RegisterFunctionExport(LzmaDec_Free);
+   RegisterFunctionExport(LzmaDec_DecodeToDic);
+   RegisterFunctionExport(LzmaDec_DecodeToBuf);
+   RegisterFunctionExport(LzmaDecode);
+   RegisterFunctionExport(LzmaUncompress);
+}
+
+} // namespace cafe::lzma920
@@ -0,0 +1,216 @@
+#pragma once
+#include <cstdint>
+#include <libcpu/be2_struct.h>
+
+namespace cafe::lzma920
+{
+
+/*
+Host implementation of the LzmaDec API from the LZMA SDK 9.20, the state
+structs keep the layout of the 32 bit big endian build titles link against
+and all decoder state lives in them between calls.
+*/
+
+constexpr int32_t SZ_OK = 0;
+constexpr int32_t SZ_ERROR_DATA = 1;
+constexpr int32_t SZ_ERROR_MEM = 2;
+constexpr int32_t SZ_ERROR_UNSUPPORTED = 4;
+constexpr int32_t SZ_ERROR_PARAM = 5;
+constexpr int32_t SZ_ERROR_INPUT_EOF = 6;
+constexpr int32_t SZ_ERROR_OUTPUT_EOF = 7;
+constexpr int32_t SZ_ERROR_READ = 8;
+constexpr int32_t SZ_ERROR_WRITE = 9;
+constexpr int32_t SZ_ERROR_PROGRESS = 10;
+constexpr int32_t SZ_ERROR_FAIL = 11;
+
+constexpr int32_t LZMA_FINISH_ANY = 0;
+constexpr int32_t LZMA_FINISH_END = 1;
+
+constexpr int32_t LZMA_STATUS_NOT_SPECIFIED = 0;
+constexpr int32_t LZMA_STATUS_FINISHED_WITH_MARK = 1;
+constexpr int32_t LZMA_STATUS_NOT_FINISHED = 2;
+constexpr int32_t LZMA_STATUS_NEEDS_MORE_INPUT = 3;
+constexpr int32_t LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK = 4;
+
+constexpr uint32_t LZMA_PROPS_SIZE = 5;
+constexpr uint32_t LZMA_REQUIRED_INPUT_MAX = 20;
+
+#pragma pack(push, 1)
+
+struct ISzAlloc;
+
+using ISzAllocAllocFn = virt_func_ptr<
+   virt_ptr<void>(virt_ptr<ISzAlloc> p, uint32_t size)>;
+
+using ISzAllocFreeFn = virt_func_ptr<
+   void(virt_ptr<ISzAlloc> p, virt_ptr<void> address)>;
+
+struct ISzAlloc
+{
+   be2_val<ISzAllocAllocFn> Alloc;
+   be2_val<ISzAllocFreeFn> Free;
+};
+CHECK_OFFSET(ISzAlloc, 0x00, Alloc);
+CHECK_OFFSET(ISzAlloc, 0x04, Free);
+CHECK_SIZE(ISzAlloc, 0x08);
+
+struct CLzmaProps
+{
+   be2_val<uint32_t> lc;
+   be2_val<uint32_t> lp;
+   be2_val<uint32_t> pb;
+   be2_val<uint32_t> dicSize;
+};
+CHECK_OFFSET(CLzmaProps, 0x00, lc);
+CHECK_OFFSET(CLzmaProps, 0x04, lp);
+CHECK_OFFSET(CLzmaProps, 0x08, pb);
+CHECK_OFFSET(CLzmaProps, 0x0C, dicSize);
+CHECK_SIZE(CLzmaProps, 0x10);
+
+struct CLzmaDec
+{
+   be2_struct<CLzmaProps> prop;
+   be2_virt_ptr<uint16_t> probs;
+   be2_virt_ptr<uint8_t> dic;
+   be2_virt_ptr<const uint8_t> buf;
+   be2_val<uint32_t> range;
+   be2_val<uint32_t> code;
+   be2_val<uint32_t> dicPos;
+   be2_val<uint32_t> dicBufSize;
+   be2_val<uint32_t> processedPos;
+   be2_val<uint32_t> checkDicSize;
+   be2_val<uint32_t> state;
+   be2_array<uint32_t, 4> reps;
+   be2_val<uint32_t> remainLen;
+   be2_val<int32_t> needFlush;
+   be2_val<int32_t> needInitState;
+   be2_val<uint32_t> numProbs;
+   be2_val<uint32_t> tempBufSize;
+   be2_array<uint8_t, LZMA_REQUIRED_INPUT_MAX> tempBuf;
+};
+CHECK_OFFSET(CLzmaDec, 0x00, prop);
+CHECK_OFFSET(CLzmaDec, 0x10, probs);
+CHECK_OFFSET(CLzmaDec, 0x14, dic);
+CHECK_OFFSET(CLzmaDec, 0x18, buf);
+CHECK_OFFSET(CLzmaDec, 0x1C, range);
+CHECK_OFFSET(CLzmaDec, 0x20, code);
+CHECK_OFFSET(CLzmaDec, 0x24, dicPos);
+CHECK_OFFSET(CLzmaDec, 0x28, dicBufSize);
+CHECK_OFFSET(CLzmaDec, 0x2C, processedPos);
+CHECK_OFFSET(CLzmaDec, 0x30, checkDicSize);
+CHECK_OFFSET(CLzmaDec, 0x34, state);
+CHECK_OFFSET(CLzmaDec, 0x38, reps);
+CHECK_OFFSET(CLzmaDec, 0x48, remainLen);
+CHECK_OFFSET(CLzmaDec, 0x4C, needFlush);
+CHECK_OFFSET(CLzmaDec, 0x50, needInitState);
+CHECK_OFFSET(CLzmaDec, 0x54, numProbs);
+CHECK_OFFSET(CLzmaDec, 0x58, tempBufSize);
+CHECK_OFFSET(CLzmaDec, 0x5C, tempBuf);
+CHECK_SIZE(CLzmaDec, 0x70);
+
+#pragma pack(pop)
+
+int32_t
+LzmaProps_Decode(virt_ptr<CLzmaProps> p,
+                 virt_ptr<const uint8_t> data,
+                 uint32_t size);
+
+void
+LzmaDec_InitDicAndState(virt_ptr<CLzmaDec> p,
+                        int32_t initDic,
+                        int32_t initState);
+
+void
+LzmaDec_Init(virt_ptr<CLzmaDec> p);
+
+int32_t
+LzmaDec_AllocateProbs(virt_ptr<CLzmaDec> p,
+                      virt_ptr<const uint8_t> props,
+                      uint32_t propsSize,
+                      virt_ptr<ISzAlloc> alloc);
+
+void
+LzmaDec_FreeProbs(virt_ptr<CLzmaDec> p,
+                  virt_ptr<ISzAlloc> alloc);
+
+int32_t
+LzmaDec_Allocate(virt_ptr<CLzmaDec> p,
+                 virt_ptr<const uint8_t> props,
+                 uint32_t propsSize,
+                 virt_ptr<ISzAlloc> alloc);
+
+void
+LzmaDec_Free(virt_ptr<CLzmaDec> p,
+             virt_ptr<ISzAlloc> alloc);
+
+int32_t
+LzmaDec_DecodeToDic(virt_ptr<CLzmaDec> p,
+                    uint32_t dicLimit,
+                    virt_ptr<const uint8_t> src,
+                    virt_ptr<uint32_t> srcLen,
+                    int32_t finishMode,
+                    virt_ptr<int32_t> status);
+
+int32_t
+LzmaDec_DecodeToBuf(virt_ptr<CLzmaDec> p,
+                    virt_ptr<uint8_t> dest,
+                    virt_ptr<uint32_t> destLen,
+                    virt_ptr<const uint8_t> src,
+                    virt_ptr<uint32_t> srcLen,
+                    int32_t finishMode,
+                    virt_ptr<int32_t> status);
+
+int32_t
+LzmaDecode(virt_ptr<uint8_t> dest,
+           virt_ptr<uint32_t> destLen,
+           virt_ptr<const uint8_t> src,
+           virt_ptr<uint32_t> srcLen,
+           virt_ptr<const uint8_t> propData,
+           uint32_t propSize,
+           int32_t finishMode,
+           virt_ptr<int32_t> status,
+           virt_ptr<ISzAlloc> alloc);
+
+int32_t
+LzmaUncompress(virt_ptr<uint8_t> dest,
+               virt_ptr<uint32_t> destLen,
+               virt_ptr<const uint8_t> src,
+               virt_ptr<uint32_t> srcLen,
+               virt_ptr<const uint8_t> props,
+               uint32_t propsSize);
+
+namespace internal
+{
+
+//! Allocate through alloc, or from the default heap if alloc is null.
+virt_ptr<void>
+allocMemory(virt_ptr<ISzAlloc> alloc,
+            uint32_t size);
+
+void
+freeMemory(virt_ptr<ISzAlloc> alloc,
+           virt_ptr<void> address);
+
+int32_t
+decodeToDic(virt_ptr<CLzmaDec> p,
+            uint32_t dicLimit,
+            const uint8_t *src,
+            uint32_t *srcLen,
+            int32_t finishMode,
+            int32_t *status);
+
+int32_t
+allocateProbs(virt_ptr<CLzmaDec> p,
+              const uint8_t *props,
+              uint32_t propsSize,
+              virt_ptr<ISzAlloc> alloc);
+
+int32_t
+allocate(virt_ptr<CLzmaDec> p,
+         const uint8_t *props,
+         uint32_t propsSize,
+         virt_ptr<ISzAlloc> alloc);
+
+} // namespace internal
+
+} // namespace cafe::lzma920
@@ -0,0 +1,2433 @@
+#include "lzma920.h"
+#include "lzma920_lzfind.h"
+#include "lzma920_lzmaenc.h"
+#include "cafe/cafe_ppc_interface_invoke_guest.h"
+#include "cafe/cafe_stackobject.h"
+
+#include <algorithm>
+#include <common/align.h>
+#include <cstring>
+#include <libcpu/mmu.h>
+
+namespace cafe::lzma920
+{
+
+/*
+This is a port of LzmaEnc.c from the LZMA SDK 9.20 built without the
+multithreaded match finder, so numThreads is accepted but every encode runs
+on the calling core. For the same props the output is byte for byte what the
+guest library's single threaded encoder produces.
+
+LzmaEnc_Create allocates room for a LzmaEncoder from the title's allocator
+and the handle points at that allocation, the encoder lives at the first
+8 byte aligned address inside it. The probabilities, window and hash tables
+are only ever touched by host code so they are kept in host byte order.
+*/
+
+using Prob = uint16_t;
+
+constexpr uint32_t NumTopBits = 24;
+constexpr uint32_t TopValue = 1u << NumTopBits;
+
+constexpr uint32_t NumBitModelTotalBits = 11;
+constexpr uint32_t BitModelTotal = 1u << NumBitModelTotalBits;
+constexpr uint32_t NumMoveBits = 5;
+constexpr uint32_t ProbInitValue = BitModelTotal >> 1;
+
+constexpr uint32_t NumMoveReducingBits = 4;
+constexpr uint32_t NumBitPriceShiftBits = 4;
+
+constexpr uint32_t NumReps = 4;
+constexpr uint32_t NumOpts = 1u << 12;
+
+constexpr uint32_t NumLenToPosStates = 4;
+constexpr uint32_t NumPosSlotBits = 6;
+constexpr uint32_t DicLogSizeMax = 32;
+constexpr uint32_t DistTableSizeMax = DicLogSizeMax * 2;
+
+constexpr uint32_t NumAlignBits = 4;
+constexpr uint32_t AlignTableSize = 1u << NumAlignBits;
+constexpr uint32_t AlignMask = AlignTableSize - 1;
+
+constexpr uint32_t StartPosModelIndex = 4;
+constexpr uint32_t EndPosModelIndex = 14;
+constexpr uint32_t NumFullDistances = 1u << (EndPosModelIndex >> 1);
+
+constexpr uint32_t LzmaPbMax = 4;
+constexpr uint32_t LzmaLcMax = 8;
+constexpr uint32_t LzmaLpMax = 4;
+constexpr uint32_t NumPbStatesMax = 1u << LzmaPbMax;
+
+constexpr uint32_t LenNumLowBits = 3;
+constexpr uint32_t LenNumLowSymbols = 1u << LenNumLowBits;
+constexpr uint32_t LenNumMidBits = 3;
+constexpr uint32_t LenNumMidSymbols = 1u << LenNumMidBits;
+constexpr uint32_t LenNumHighBits = 8;
+constexpr uint32_t LenNumHighSymbols = 1u << LenNumHighBits;
+constexpr uint32_t LenNumSymbolsTotal = LenNumLowSymbols + LenNumMidSymbols + LenNumHighSymbols;
+
+static_assert(LZMA_MATCH_LEN_MAX == LZMA_MATCH_LEN_MIN + LenNumSymbolsTotal - 1);
+
+constexpr uint32_t NumStates = 12;
+
+//! The guest library is a 32 bit build, which sizes the fast position table
+//! for dictionaries of up to 1 << 27 bytes.
+constexpr uint32_t NumLogBits = 11;
+constexpr uint32_t DicLogSizeMaxCompress = (NumLogBits - 1) * 2 + 7;
+
+constexpr uint32_t InfinityPrice = 1u << 30;
+constexpr uint32_t RcBufSize = 1u << 16;
+constexpr uint32_t BigHashDicLimit = 1u << 24;
+
+constexpr uint32_t LiteralNextStates[NumStates] = { 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 4, 5 };
+constexpr uint32_t MatchNextStates[NumStates] = { 7, 7, 7, 7, 7, 7, 7, 10, 10, 10, 10, 10 };
+constexpr uint32_t RepNextStates[NumStates] = { 8, 8, 8, 8, 8, 8, 8, 11, 11, 11, 11, 11 };
+constexpr uint32_t ShortRepNextStates[NumStates] = { 9, 9, 9, 9, 9, 9, 9, 11, 11, 11, 11, 11 };
+
+struct Optimal
+{
+   uint32_t price;
+   uint32_t state;
+   bool prev1IsChar;
+   bool prev2;
+   uint32_t posPrev2;
+   uint32_t backPrev2;
+   uint32_t posPrev;
+   uint32_t backPrev;
+   uint32_t backs[NumReps];
+};
+
+struct LengthEncoder
+{
+   Prob choice;
+   Prob choice2;
+   Prob low[NumPbStatesMax << LenNumLowBits];
+   Prob mid[NumPbStatesMax << LenNumMidBits];
+   Prob high[LenNumHighSymbols];
+};
+
+struct LengthPriceEncoder
+{
+   LengthEncoder p;
+   uint32_t prices[NumPbStatesMax][LenNumSymbolsTotal];
+   uint32_t tableSize;
+   uint32_t counters[NumPbStatesMax];
+};
+
+//! Where the range coder output goes when encoding to memory.
+struct OutputBuffer
+{
+   uint8_t *data;
+   uint32_t rem;
+   bool overflow;
+};
+
+struct RangeEncoder
+{
+   uint32_t range;
+   uint8_t cache;
+   uint64_t low;
+   uint64_t cacheSize;
+   uint8_t *buf;
+   uint8_t *bufLim;
+   uint8_t *bufBase;
+   virt_ptr<ISeqOutStream> outStream;
+   OutputBuffer *outBuffer;
+   uint64_t processed;
+   int32_t res;
+
+   void
+   init()
+   {
+      low = 0;
+      range = 0xFFFFFFFFu;
+      cacheSize = 1;
+      cache = 0;
+      buf = bufBase;
+      processed = 0;
+      res = SZ_OK;
+   }
+
+   uint64_t
+   getProcessed() const
+   {
+      return processed + (buf - bufBase) + cacheSize;
+   }
+
+   void
+   flushStream()
+   {
+      if (res != SZ_OK) {
+         return;
+      }
+
+      auto num = static_cast<uint32_t>(buf - bufBase);
+      auto written = 0u;
+
+      if (outBuffer) {
+         written = num;
+         if (outBuffer->rem < written) {
+            written = outBuffer->rem;
+            outBuffer->overflow = true;
+         }
+
+         std::memcpy(outBuffer->data, bufBase, written);
+         outBuffer->rem -= written;
+         outBuffer->data += written;
+      } else {
+         written = cafe::invoke(cpu::this_core::state(),
+                                outStream->Write,
+                                outStream,
+                                virt_cast<const void *>(cpu::translate(bufBase)),
+                                num);
+      }
+
+      if (written != num) {
+         res = SZ_ERROR_WRITE;
+      }
+
+      processed += num;
+      buf = bufBase;
+   }
+
+   void
+   shiftLow()
+   {
+      if (static_cast<uint32_t>(low) < 0xFF000000u || static_cast<uint32_t>(low >> 32) != 0) {
+         auto temp = cache;
+
+         do {
+            *buf++ = static_cast<uint8_t>(temp + static_cast<uint8_t>(low >> 32));
+            if (buf == bufLim) {
+               flushStream();
+            }
+
+            temp = 0xFF;
+         } while (--cacheSize != 0);
+
+         cache = static_cast<uint8_t>(static_cast<uint32_t>(low) >> 24);
+      }
+
+      cacheSize++;
+      low = static_cast<uint32_t>(low) << 8;
+   }
+
+   void
+   flushData()
+   {
+      for (auto i = 0; i < 5; ++i) {
+         shiftLow();
+      }
+   }
+
+   void
+   encodeDirectBits(uint32_t value,
+                    uint32_t numBits)
+   {
+      do {
+         range >>= 1;
+         low += range & (0 - ((value >> --numBits) & 1));
+
+         if (range < TopValue) {
+            range <<= 8;
+            shiftLow();
+         }
+      } while (numBits != 0);
+   }
+
+   inline void
+   encodeBit(Prob *prob,
+             uint32_t symbol)
+   {
+      uint32_t ttt = *prob;
+      auto newBound = (range >> NumBitModelTotalBits) * ttt;
+
+      if (symbol == 0) {
+         range = newBound;
+         ttt += (BitModelTotal - ttt) >> NumMoveBits;
+      } else {
+         low += newBound;
+         range -= newBound;
+         ttt -= ttt >> NumMoveBits;
+      }
+
+      *prob = static_cast<Prob>(ttt);
+
+      if (range < TopValue) {
+         range <<= 8;
+         shiftLow();
+      }
+   }
+
+   void
+   encodeLiteral(Prob *probs,
+                 uint32_t symbol)
+   {
+      symbol |= 0x100;
+
+      do {
+         encodeBit(probs + (symbol >> 8), (symbol >> 7) & 1);
+         symbol <<= 1;
+      } while (symbol < 0x10000);
+   }
+
+   void
+   encodeLiteralMatched(Prob *probs,
+                        uint32_t symbol,
+                        uint32_t matchByte)
+   {
+      auto offs = 0x100u;
+      symbol |= 0x100;
+
+      do {
+         matchByte <<= 1;
+         encodeBit(probs + (offs + (matchByte & offs) + (symbol >> 8)), (symbol >> 7) & 1);
+         symbol <<= 1;
+         offs &= ~(matchByte ^ symbol);
+      } while (symbol < 0x10000);
+   }
+
+   void
+   encodeTree(Prob *probs,
+              uint32_t numBitLevels,
+              uint32_t symbol)
+   {
+      auto m = 1u;
+
+      for (auto i = numBitLevels; i != 0; ) {
+         i--;
+         auto bit = (symbol >> i) & 1;
+         encodeBit(probs + m, bit);
+         m = (m << 1) | bit;
+      }
+   }
+
+   void
+   encodeTreeReverse(Prob *probs,
+                     uint32_t numBitLevels,
+                     uint32_t symbol)
+   {
+      auto m = 1u;
+
+      for (auto i = 0u; i < numBitLevels; ++i) {
+         auto bit = symbol & 1;
+         encodeBit(probs + m, bit);
+         m = (m << 1) | bit;
+         symbol >>= 1;
+      }
+   }
+};
+
+//! Everything LzmaEnc_SaveState copies except the literal probabilities.
+struct EncoderState
+{
+   Prob isMatch[NumStates][NumPbStatesMax];
+   Prob isRep[NumStates];
+   Prob isRepG0[NumStates];
+   Prob isRepG1[NumStates];
+   Prob isRepG2[NumStates];
+   Prob isRep0Long[NumStates][NumPbStatesMax];
+
+   Prob posSlotEncoder[NumLenToPosStates][1 << NumPosSlotBits];
+   Prob posEncoders[NumFullDistances - EndPosModelIndex];
+   Prob posAlignEncoder[1 << NumAlignBits];
+
+   LengthPriceEncoder lenEnc;
+   LengthPriceEncoder repLenEnc;
+
+   uint32_t reps[NumReps];
+   uint32_t state;
+};
+
+// This is decaf specific stuff - does not match the CLzmaEnc in lzma920.rpl
+struct LzmaEncoder : EncoderState
+{
+   internal::MatchFinder matchFinder;
+
+   uint32_t optimumEndIndex;
+   uint32_t optimumCurrentIndex;
+
+   uint32_t longestMatchLength;
+   uint32_t numPairs;
+   uint32_t numAvail;
+   Optimal opt[NumOpts];
+
+   uint8_t fastPos[1 << NumLogBits];
+
+   uint32_t probPrices[BitModelTotal >> NumMoveReducingBits];
+   uint32_t matches[LZMA_MATCH_LEN_MAX * 2 + 2 + 1];
+   uint32_t numFastBytes;
+   uint32_t additionalOffset;
+
+   uint32_t posSlotPrices[NumLenToPosStates][DistTableSizeMax];
+   uint32_t distancesPrices[NumLenToPosStates][NumFullDistances];
+   uint32_t alignPrices[AlignTableSize];
+   uint32_t alignPriceCount;
+
+   uint32_t distTableSize;
+
+   uint32_t lc;
+   uint32_t lp;
+   uint32_t pb;
+   uint32_t lpMask;
+   uint32_t pbMask;
+
+   Prob *litProbs;
+   uint32_t lclp;
+
+   bool fastMode;
+
+   RangeEncoder rc;
+
+   bool writeEndMark;
+   uint64_t nowPos64;
+   uint32_t matchPriceCount;
+   bool finished;
+
+   int32_t result;
+   uint32_t dictSize;
+
+   bool needInit;
+
+   EncoderState saveState;
+   Prob *saveLitProbs;
+};
+
+static LzmaEncoder &
+getEncoder(CLzmaEncHandle handle)
+{
+   return *reinterpret_cast<LzmaEncoder *>(align_up(virt_cast<uint8_t *>(handle).get(), 8));
+}
+
+static void
+freeGuestMemory(virt_ptr<ISzAlloc> alloc,
+                void *address)
+{
+   internal::freeMemory(alloc, virt_cast<void *>(cpu::translate(address)));
+}
+
+namespace internal
+{
+
+EncoderProps
+loadEncoderProps(virt_ptr<const CLzmaEncProps> props)
+{
+   auto result = EncoderProps { };
+   result.level = props->level;
+   result.dictSize = props->dictSize;
+   result.lc = props->lc;
+   result.lp = props->lp;
+   result.pb = props->pb;
+   result.algo = props->algo;
+   result.fb = props->fb;
+   result.btMode = props->btMode;
+   result.numHashBytes = props->numHashBytes;
+   result.mc = props->mc;
+   result.writeEndMark = props->writeEndMark;
+   result.numThreads = props->numThreads;
+   return result;
+}
+
+void
+storeEncoderProps(const EncoderProps &props,
+                  virt_ptr<CLzmaEncProps> out)
+{
+   out->level = props.level;
+   out->dictSize = props.dictSize;
+   out->lc = props.lc;
+   out->lp = props.lp;
+   out->pb = props.pb;
+   out->algo = props.algo;
+   out->fb = props.fb;
+   out->btMode = props.btMode;
+   out->numHashBytes = props.numHashBytes;
+   out->mc = props.mc;
+   out->writeEndMark = props.writeEndMark;
+   out->numThreads = props.numThreads;
+}
+
+void
+initEncoderProps(EncoderProps &p)
+{
+   p.level = 5;
+   p.dictSize = 0;
+   p.mc = 0;
+   p.lc = p.lp = p.pb = p.algo = p.fb = p.btMode = p.numHashBytes = p.numThreads = -1;
+   p.writeEndMark = 0;
+}
+
+void
+normalizeEncoderProps(EncoderProps &p)
+{
+   auto level = p.level;
+   if (level < 0) {
+      level = 5;
+   }
+
+   p.level = level;
+
+   if (p.dictSize == 0) {
+      p.dictSize = (level <= 5) ? (1u << (level * 2 + 14)) : ((level == 6) ? (1u << 25) : (1u << 26));
+   }
+
+   if (p.lc < 0) {
+      p.lc = 3;
+   }
+
+   if (p.lp < 0) {
+      p.lp = 0;
+   }
+
+   if (p.pb < 0) {
+      p.pb = 2;
+   }
+
+   if (p.algo < 0) {
+      p.algo = (level < 5) ? 0 : 1;
+   }
+
+   if (p.fb < 0) {
+      p.fb = (level < 7) ? 32 : 64;
+   }
+
+   if (p.btMode < 0) {
+      p.btMode = (p.algo == 0) ? 0 : 1;
+   }
+
+   if (p.numHashBytes < 0) {
+      p.numHashBytes = 4;
+   }
+
+   if (p.mc == 0) {
+      p.mc = (16 + (p.fb >> 1)) >> (p.btMode ? 0 : 1);
+   }
+
+   if (p.numThreads < 0) {
+      p.numThreads = (p.btMode && p.algo) ? 2 : 1;
+   }
+}
+
+} // namespace internal
+
+static int32_t
+setProps(LzmaEncoder &p,
+         internal::EncoderProps props)
+{
+   internal::normalizeEncoderProps(props);
+
+   if (props.lc > static_cast<int32_t>(LzmaLcMax) ||
+       props.lp > static_cast<int32_t>(LzmaLpMax) ||
+       props.pb > static_cast<int32_t>(LzmaPbMax) ||
+       props.dictSize > (1u << DicLogSizeMaxCompress) ||
+       props.dictSize > (1u << 30)) {
+      return SZ_ERROR_PARAM;
+   }
+
+   p.dictSize = props.dictSize;
+   p.numFastBytes = std::clamp<uint32_t>(props.fb, 5, LZMA_MATCH_LEN_MAX);
+   p.lc = props.lc;
+   p.lp = props.lp;
+   p.pb = props.pb;
+   p.fastMode = (props.algo == 0);
+   p.matchFinder.btMode = props.btMode != 0;
+
+   auto numHashBytes = 4u;
+   if (props.btMode) {
+      if (props.numHashBytes < 2) {
+         numHashBytes = 2;
+      } else if (props.numHashBytes < 4) {
+         numHashBytes = props.numHashBytes;
+      }
+   }
+
+   p.matchFinder.numHashBytes = numHashBytes;
+   p.matchFinder.cutValue = props.mc;
+   p.writeEndMark = props.writeEndMark != 0;
+   return SZ_OK;
+}
+
+static void
+initFastPos(uint8_t *fastPos)
+{
+   auto c = 2u;
+   fastPos[0] = 0;
+   fastPos[1] = 1;
+
+   for (auto slotFast = 2u; slotFast < NumLogBits * 2; ++slotFast) {
+      auto k = 1u << ((slotFast >> 1) - 1);
+      for (auto j = 0u; j < k; ++j, ++c) {
+         fastPos[c] = static_cast<uint8_t>(slotFast);
+      }
+   }
+}
+
+static inline uint32_t
+getPosSlot1(const LzmaEncoder &p,
+            uint32_t pos)
+{
+   return p.fastPos[pos];
+}
+
+static inline uint32_t
+getPosSlot2(const LzmaEncoder &p,
+            uint32_t pos)
+{
+   auto i = (pos < (1u << (NumLogBits + 6))) ? 6u : 6u + NumLogBits - 1;
+   return p.fastPos[pos >> i] + (i * 2);
+}
+
+static inline uint32_t
+getPosSlot(const LzmaEncoder &p,
+           uint32_t pos)
+{
+   return (pos < NumFullDistances) ? getPosSlot1(p, pos) : getPosSlot2(p, pos);
+}
+
+static inline uint32_t
+getLenToPosState(uint32_t len)
+{
+   return (len < NumLenToPosStates + 1) ? len - 2 : NumLenToPosStates - 1;
+}
+
+static inline bool
+isCharState(uint32_t state)
+{
+   return state < 7;
+}
+
+static void
+initPriceTables(uint32_t *probPrices)
+{
+   for (auto i = (1u << NumMoveReducingBits) / 2; i < BitModelTotal; i += (1u << NumMoveReducingBits)) {
+      constexpr auto CyclesBits = NumBitPriceShiftBits;
+      auto w = i;
+      auto bitCount = 0u;
+
+      for (auto j = 0u; j < CyclesBits; ++j) {
+         w = w * w;
+         bitCount <<= 1;
+
+         while (w >= (1u << 16)) {
+            w >>= 1;
+            bitCount++;
+         }
+      }
+
+      probPrices[i >> NumMoveReducingBits] = (NumBitModelTotalBits << CyclesBits) - 15 - bitCount;
+   }
+}
+
+static inline uint32_t
+getPrice(const uint32_t *probPrices,
+         uint32_t prob,
+         uint32_t symbol)
+{
+   return probPrices[(prob ^ ((0u - symbol) & (BitModelTotal - 1))) >> NumMoveReducingBits];
+}
+
+static inline uint32_t
+getPrice0(const uint32_t *probPrices,
+          uint32_t prob)
+{
+   return probPrices[prob >> NumMoveReducingBits];
+}
+
+static inline uint32_t
+getPrice1(const uint32_t *probPrices,
+          uint32_t prob)
+{
+   return probPrices[(prob ^ (BitModelTotal - 1)) >> NumMoveReducingBits];
+}
+
+static uint32_t
+getLiteralPrice(const Prob *probs,
+                uint32_t symbol,
+                const uint32_t *probPrices)
+{
+   auto price = 0u;
+   symbol |= 0x100;
+
+   do {
+      price += getPrice(probPrices, probs[symbol >> 8], (symbol >> 7) & 1);
+      symbol <<= 1;
+   } while (symbol < 0x10000);
+
+   return price;
+}
+
+static uint32_t
+getLiteralPriceMatched(const Prob *probs,
+                       uint32_t symbol,
+                       uint32_t matchByte,
+                       const uint32_t *probPrices)
+{
+   auto price = 0u;
+   auto offs = 0x100u;
+   symbol |= 0x100;
+
+   do {
+      matchByte <<= 1;
+      price += getPrice(probPrices, probs[offs + (matchByte & offs) + (symbol >> 8)], (symbol >> 7) & 1);
+      symbol <<= 1;
+      offs &= ~(matchByte ^ symbol);
+   } while (symbol < 0x10000);
+
+   return price;
+}
+
+static uint32_t
+getTreePrice(const Prob *probs,
+             uint32_t numBitLevels,
+             uint32_t symbol,
+             const uint32_t *probPrices)
+{
+   auto price = 0u;
+   symbol |= (1u << numBitLevels);
+
+   while (symbol != 1) {
+      price += getPrice(probPrices, probs[symbol >> 1], symbol & 1);
+      symbol >>= 1;
+   }
+
+   return price;
+}
+
+static uint32_t
+getTreeReversePrice(const Prob *probs,
+                    uint32_t numBitLevels,
+                    uint32_t symbol,
+                    const uint32_t *probPrices)
+{
+   auto price = 0u;
+   auto m = 1u;
+
+   for (auto i = numBitLevels; i != 0; --i) {
+      auto bit = symbol & 1;
+      symbol >>= 1;
+      price += getPrice(probPrices, probs[m], bit);
+      m = (m << 1) | bit;
+   }
+
+   return price;
+}
+
+static void
+initLengthEncoder(LengthEncoder &p)
+{
+   p.choice = p.choice2 = ProbInitValue;
+   std::fill(std::begin(p.low), std::end(p.low), ProbInitValue);
+   std::fill(std::begin(p.mid), std::end(p.mid), ProbInitValue);
+   std::fill(std::begin(p.high), std::end(p.high), ProbInitValue);
+}
+
+static void
+encodeLength(LengthEncoder &p,
+             RangeEncoder &rc,
+             uint32_t symbol,
+             uint32_t posState)
+{
+   if (symbol < LenNumLowSymbols) {
+      rc.encodeBit(&p.choice, 0);
+      rc.encodeTree(p.low + (posState << LenNumLowBits), LenNumLowBits, symbol);
+   } else {
+      rc.encodeBit(&p.choice, 1);
+
+      if (symbol < LenNumLowSymbols + LenNumMidSymbols) {
+         rc.encodeBit(&p.choice2, 0);
+         rc.encodeTree(p.mid + (posState << LenNumMidBits), LenNumMidBits,
+                       symbol - LenNumLowSymbols);
+      } else {
+         rc.encodeBit(&p.choice2, 1);
+         rc.encodeTree(p.high, LenNumHighBits,
+                       symbol - LenNumLowSymbols - LenNumMidSymbols);
+      }
+   }
+}
+
+static void
+setLengthPrices(const LengthEncoder &p,
+                uint32_t posState,
+                uint32_t numSymbols,
+                uint32_t *prices,
+                const uint32_t *probPrices)
+{
+   auto a0 = getPrice0(probPrices, p.choice);
+   auto a1 = getPrice1(probPrices, p.choice);
+   auto b0 = a1 + getPrice0(probPrices, p.choice2);
+   auto b1 = a1 + getPrice1(probPrices, p.choice2);
+   auto i = 0u;
+
+   for (i = 0; i < LenNumLowSymbols; ++i) {
+      if (i >= numSymbols) {
+         return;
+      }
+
+      prices[i] = a0 + getTreePrice(p.low + (posState << LenNumLowBits),
+                                    LenNumLowBits, i, probPrices);
+   }
+
+   for (; i < LenNumLowSymbols + LenNumMidSymbols; ++i) {
+      if (i >= numSymbols) {
+         return;
+      }
+
+      prices[i] = b0 + getTreePrice(p.mid + (posState << LenNumMidBits),
+                                    LenNumMidBits, i - LenNumLowSymbols, probPrices);
+   }
+
+   for (; i < numSymbols; ++i) {
+      prices[i] = b1 + getTreePrice(p.high, LenNumHighBits,
+                                    i - LenNumLowSymbols - LenNumMidSymbols, probPrices);
+   }
+}
+
+static void
+updateLengthPriceTable(LengthPriceEncoder &p,
+                       uint32_t posState,
+                       const uint32_t *probPrices)
+{
+   setLengthPrices(p.p, posState, p.tableSize, p.prices[posState], probPrices);
+   p.counters[posState] = p.tableSize;
+}
+
+static void
+updateLengthPriceTables(LengthPriceEncoder &p,
+                        uint32_t numPosStates,
+                        const uint32_t *probPrices)
+{
+   for (auto posState = 0u; posState < numPosStates; ++posState) {
+      updateLengthPriceTable(p, posState, probPrices);
+   }
+}
+
+static void
+encodeLengthAndUpdatePrices(LengthPriceEncoder &p,
+                            RangeEncoder &rc,
+                            uint32_t symbol,
+                            uint32_t posState,
+                            bool updatePrice,
+                            const uint32_t *probPrices)
+{
+   encodeLength(p.p, rc, symbol, posState);
+
+   if (updatePrice) {
+      if (--p.counters[posState] == 0) {
+         updateLengthPriceTable(p, posState, probPrices);
+      }
+   }
+}
+
+static void
+movePos(LzmaEncoder &p,
+        uint32_t num)
+{
+   if (num != 0) {
+      p.additionalOffset += num;
+      p.matchFinder.skip(p.matchFinder, num);
+   }
+}
+
+static uint32_t
+readMatchDistances(LzmaEncoder &p,
+                   uint32_t *numDistancePairsRes)
+{
+   auto lenRes = 0u;
+   p.numAvail = internal::matchFinderGetNumAvailableBytes(p.matchFinder);
+   auto numPairs = p.matchFinder.getMatches(p.matchFinder, p.matches);
+
+   if (numPairs > 0) {
+      lenRes = p.matches[numPairs - 2];
+
+      if (lenRes == p.numFastBytes) {
+         auto pby = internal::matchFinderGetPointerToCurrentPos(p.matchFinder) - 1;
+         auto distance = p.matches[numPairs - 1] + 1;
+         auto numAvail = std::min(p.numAvail, LZMA_MATCH_LEN_MAX);
+         auto pby2 = pby - distance;
+
+         for (; lenRes < numAvail && pby[lenRes] == pby2[lenRes]; lenRes++);
+      }
+   }
+
+   p.additionalOffset++;
+   *numDistancePairsRes = numPairs;
+   return lenRes;
+}
+
+static inline void
+makeAsChar(Optimal *opt)
+{
+   opt->backPrev = static_cast<uint32_t>(-1);
+   opt->prev1IsChar = false;
+}
+
+static inline void
+makeAsShortRep(Optimal *opt)
+{
+   opt->backPrev = 0;
+   opt->prev1IsChar = false;
+}
+
+static inline bool
+isShortRep(const Optimal *opt)
+{
+   return opt->backPrev == 0;
+}
+
+static uint32_t
+getRepLen1Price(const LzmaEncoder &p,
+                uint32_t state,
+                uint32_t posState)
+{
+   return getPrice0(p.probPrices, p.isRepG0[state]) +
+          getPrice0(p.probPrices, p.isRep0Long[state][posState]);
+}
+
+static uint32_t
+getPureRepPrice(const LzmaEncoder &p,
+                uint32_t repIndex,
+                uint32_t state,
+                uint32_t posState)
+{
+   auto price = 0u;
+
+   if (repIndex == 0) {
+      price = getPrice0(p.probPrices, p.isRepG0[state]);
+      price += getPrice1(p.probPrices, p.isRep0Long[state][posState]);
+   } else {
+      price = getPrice1(p.probPrices, p.isRepG0[state]);
+
+      if (repIndex == 1) {
+         price += getPrice0(p.probPrices, p.isRepG1[state]);
+      } else {
+         price += getPrice1(p.probPrices, p.isRepG1[state]);
+         price += getPrice(p.probPrices, p.isRepG2[state], repIndex - 2);
+      }
+   }
+
+   return price;
+}
+
+static uint32_t
+getRepPrice(const LzmaEncoder &p,
+            uint32_t repIndex,
+            uint32_t len,
+            uint32_t state,
+            uint32_t posState)
+{
+   return p.repLenEnc.prices[posState][len - LZMA_MATCH_LEN_MIN] +
+          getPureRepPrice(p, repIndex, state, posState);
+}
+
+/**
+ * Walk the chosen path back from cur, reversing the links so that
+ * getOptimum can return the path one step at a time from the start.
+ */
+static uint32_t
+backward(LzmaEncoder &p,
+         uint32_t *backRes,
+         uint32_t cur)
+{
+   auto posMem = p.opt[cur].posPrev;
+   auto backMem = p.opt[cur].backPrev;
+   p.optimumEndIndex = cur;
+
+   do {
+      if (p.opt[cur].prev1IsChar) {
+         makeAsChar(&p.opt[posMem]);
+         p.opt[posMem].posPrev = posMem - 1;
+
+         if (p.opt[cur].prev2) {
+            p.opt[posMem - 1].prev1IsChar = false;
+            p.opt[posMem - 1].posPrev = p.opt[cur].posPrev2;
+            p.opt[posMem - 1].backPrev = p.opt[cur].backPrev2;
+         }
+      }
+
+      auto posPrev = posMem;
+      auto backCur = backMem;
+
+      backMem = p.opt[posPrev].backPrev;
+      posMem = p.opt[posPrev].posPrev;
+
+      p.opt[posPrev].backPrev = backCur;
+      p.opt[posPrev].posPrev = cur;
+      cur = posPrev;
+   } while (cur != 0);
+
+   *backRes = p.opt[0].backPrev;
+   p.optimumCurrentIndex = p.opt[0].posPrev;
+   return p.optimumCurrentIndex;
+}
+
+static inline const Prob *
+getLiteralProbs(const LzmaEncoder &p,
+                uint32_t pos,
+                uint32_t prevByte)
+{
+   return p.litProbs + (((pos & p.lpMask) << p.lc) + (prevByte >> (8 - p.lc))) * 0x300;
+}
+
+/**
+ * The normal mode parser, finds the cheapest sequence of literals, matches
+ * and reps for up to NumOpts bytes ahead using the current price tables.
+ * Returns the length of the first step and its distance in backRes, which
+ * is -1 for a literal, a rep index below NumReps or distance + NumReps.
+ */
+static uint32_t
+getOptimum(LzmaEncoder &p,
+           uint32_t position,
+           uint32_t *backRes)
+{
+   uint32_t reps[NumReps];
+   uint32_t repLens[NumReps];
+   auto numPairs = 0u;
+   auto mainLen = 0u;
+
+   if (p.optimumEndIndex != p.optimumCurrentIndex) {
+      auto opt = &p.opt[p.optimumCurrentIndex];
+      auto lenRes = opt->posPrev - p.optimumCurrentIndex;
+      *backRes = opt->backPrev;
+      p.optimumCurrentIndex = opt->posPrev;
+      return lenRes;
+   }
+
+   p.optimumCurrentIndex = p.optimumEndIndex = 0;
+
+   if (p.additionalOffset == 0) {
+      mainLen = readMatchDistances(p, &numPairs);
+   } else {
+      mainLen = p.longestMatchLength;
+      numPairs = p.numPairs;
+   }
+
+   auto numAvail = p.numAvail;
+   if (numAvail < 2) {
+      *backRes = static_cast<uint32_t>(-1);
+      return 1;
+   }
+
+   if (numAvail > LZMA_MATCH_LEN_MAX) {
+      numAvail = LZMA_MATCH_LEN_MAX;
+   }
+
+   auto data = internal::matchFinderGetPointerToCurrentPos(p.matchFinder) - 1;
+   auto repMaxIndex = 0u;
+
+   for (auto i = 0u; i < NumReps; ++i) {
+      reps[i] = p.reps[i];
+      auto data2 = data - (reps[i] + 1);
+
+      if (data[0] != data2[0] || data[1] != data2[1]) {
+         repLens[i] = 0;
+         continue;
+      }
+
+      auto lenTest = 2u;
+      for (; lenTest < numAvail && data[lenTest] == data2[lenTest]; lenTest++);
+      repLens[i] = lenTest;
+
+      if (lenTest > repLens[repMaxIndex]) {
+         repMaxIndex = i;
+      }
+   }
+
+   if (repLens[repMaxIndex] >= p.numFastBytes) {
+      *backRes = repMaxIndex;
+      auto lenRes = repLens[repMaxIndex];
+      movePos(p, lenRes - 1);
+      return lenRes;
+   }
+
+   auto matches = p.matches;
+   if (mainLen >= p.numFastBytes) {
+      *backRes = matches[numPairs - 1] + NumReps;
+      movePos(p, mainLen - 1);
+      return mainLen;
+   }
+
+   auto curByte = *data;
+   auto matchByte = *(data - (reps[0] + 1));
+
+   if (mainLen < 2 && curByte != matchByte && repLens[repMaxIndex] < 2) {
+      *backRes = static_cast<uint32_t>(-1);
+      return 1;
+   }
+
+   p.opt[0].state = p.state;
+
+   auto posState = position & p.pbMask;
+
+   {
+      auto probs = getLiteralProbs(p, position, *(data - 1));
+      p.opt[1].price = getPrice0(p.probPrices, p.isMatch[p.state][posState]) +
+         (!isCharState(p.state) ?
+            getLiteralPriceMatched(probs, curByte, matchByte, p.probPrices) :
+            getLiteralPrice(probs, curByte, p.probPrices));
+   }
+
+   makeAsChar(&p.opt[1]);
+
+   auto matchPrice = getPrice1(p.probPrices, p.isMatch[p.state][posState]);
+   auto repMatchPrice = matchPrice + getPrice1(p.probPrices, p.isRep[p.state]);
+
+   if (matchByte == curByte) {
+      auto shortRepPrice = repMatchPrice + getRepLen1Price(p, p.state, posState);
+      if (shortRepPrice < p.opt[1].price) {
+         p.opt[1].price = shortRepPrice;
+         makeAsShortRep(&p.opt[1]);
+      }
+   }
+
+   auto lenEnd = (mainLen >= repLens[repMaxIndex]) ? mainLen : repLens[repMaxIndex];
+
+   if (lenEnd < 2) {
+      *backRes = p.opt[1].backPrev;
+      return 1;
+   }
+
+   p.opt[1].posPrev = 0;
+
+   for (auto i = 0u; i < NumReps; ++i) {
+      p.opt[0].backs[i] = reps[i];
+   }
+
+   auto len = lenEnd;
+   do {
+      p.opt[len--].price = InfinityPrice;
+   } while (len >= 2);
+
+   for (auto i = 0u; i < NumReps; ++i) {
+      auto repLen = repLens[i];
+      if (repLen < 2) {
+         continue;
+      }
+
+      auto price = repMatchPrice + getPureRepPrice(p, i, p.state, posState);
+
+      do {
+         auto curAndLenPrice = price + p.repLenEnc.prices[posState][repLen - 2];
+         auto opt = &p.opt[repLen];
+
+         if (curAndLenPrice < opt->price) {
+            opt->price = curAndLenPrice;
+            opt->posPrev = 0;
+            opt->backPrev = i;
+            opt->prev1IsChar = false;
+         }
+      } while (--repLen >= 2);
+   }
+
+   auto normalMatchPrice = matchPrice + getPrice0(p.probPrices, p.isRep[p.state]);
+
+   len = (repLens[0] >= 2) ? repLens[0] + 1 : 2;
+
+   if (len <= mainLen) {
+      auto offs = 0u;
+      while (len > matches[offs]) {
+         offs += 2;
+      }
+
+      for (; ; len++) {
+         auto distance = matches[offs + 1];
+         auto curAndLenPrice = normalMatchPrice + p.lenEnc.prices[posState][len - LZMA_MATCH_LEN_MIN];
+         auto lenToPosState = getLenToPosState(len);
+
+         if (distance < NumFullDistances) {
+            curAndLenPrice += p.distancesPrices[lenToPosState][distance];
+         } else {
+            auto slot = getPosSlot2(p, distance);
+            curAndLenPrice += p.alignPrices[distance & AlignMask] + p.posSlotPrices[lenToPosState][slot];
+         }
+
+         auto opt = &p.opt[len];
+         if (curAndLenPrice < opt->price) {
+            opt->price = curAndLenPrice;
+            opt->posPrev = 0;
+            opt->backPrev = distance + NumReps;
+            opt->prev1IsChar = false;
+         }
+
+         if (len == matches[offs]) {
+            offs += 2;
+            if (offs == numPairs) {
+               break;
+            }
+         }
+      }
+   }
+
+   auto cur = 0u;
+
+   while (true) {
+      cur++;
+      if (cur == lenEnd) {
+         return backward(p, backRes, cur);
+      }
+
+      auto newLen = readMatchDistances(p, &numPairs);
+      if (newLen >= p.numFastBytes) {
+         p.numPairs = numPairs;
+         p.longestMatchLength = newLen;
+         return backward(p, backRes, cur);
+      }
+
+      position++;
+
+      auto curOpt = &p.opt[cur];
+      auto posPrev = curOpt->posPrev;
+      auto state = 0u;
+
+      if (curOpt->prev1IsChar) {
+         posPrev--;
+
+         if (curOpt->prev2) {
+            state = p.opt[curOpt->posPrev2].state;
+            if (curOpt->backPrev2 < NumReps) {
+               state = RepNextStates[state];
+            } else {
+               state = MatchNextStates[state];
+            }
+         } else {
+            state = p.opt[posPrev].state;
+         }
+
+         state = LiteralNextStates[state];
+      } else {
+         state = p.opt[posPrev].state;
+      }
+
+      if (posPrev == cur - 1) {
+         if (isShortRep(curOpt)) {
+            state = ShortRepNextStates[state];
+         } else {
+            state = LiteralNextStates[state];
+         }
+      } else {
+         auto pos = 0u;
+
+         if (curOpt->prev1IsChar && curOpt->prev2) {
+            posPrev = curOpt->posPrev2;
+            pos = curOpt->backPrev2;
+            state = RepNextStates[state];
+         } else {
+            pos = curOpt->backPrev;
+            if (pos < NumReps) {
+               state = RepNextStates[state];
+            } else {
+               state = MatchNextStates[state];
+            }
+         }
+
+         auto prevOpt = &p.opt[posPrev];
+
+         if (pos < NumReps) {
+            auto i = 1u;
+            reps[0] = prevOpt->backs[pos];
+
+            for (; i <= pos; ++i) {
+               reps[i] = prevOpt->backs[i - 1];
+            }
+
+            for (; i < NumReps; ++i) {
+               reps[i] = prevOpt->backs[i];
+            }
+         } else {
+            reps[0] = pos - NumReps;
+
+            for (auto i = 1u; i < NumReps; ++i) {
+               reps[i] = prevOpt->backs[i - 1];
+            }
+         }
+      }
+
+      curOpt->state = state;
+      curOpt->backs[0] = reps[0];
+      curOpt->backs[1] = reps[1];
+      curOpt->backs[2] = reps[2];
+      curOpt->backs[3] = reps[3];
+
+      auto curPrice = curOpt->price;
+      auto nextIsChar = false;
+      data = internal::matchFinderGetPointerToCurrentPos(p.matchFinder) - 1;
+      curByte = *data;
+      matchByte = *(data - (reps[0] + 1));
+
+      posState = position & p.pbMask;
+
+      auto curAnd1Price = curPrice + getPrice0(p.probPrices, p.isMatch[state][posState]);
+      {
+         auto probs = getLiteralProbs(p, position, *(data - 1));
+         curAnd1Price +=
+            (!isCharState(state) ?
+               getLiteralPriceMatched(probs, curByte, matchByte, p.probPrices) :
+               getLiteralPrice(probs, curByte, p.probPrices));
+      }
+
+      auto nextOpt = &p.opt[cur + 1];
+
+      if (curAnd1Price < nextOpt->price) {
+         nextOpt->price = curAnd1Price;
+         nextOpt->posPrev = cur;
+         makeAsChar(nextOpt);
+         nextIsChar = true;
+      }
+
+      matchPrice = curPrice + getPrice1(p.probPrices, p.isMatch[state][posState]);
+      repMatchPrice = matchPrice + getPrice1(p.probPrices, p.isRep[state]);
+
+      if (matchByte == curByte && !(nextOpt->posPrev < cur && nextOpt->backPrev == 0)) {
+         auto shortRepPrice = repMatchPrice + getRepLen1Price(p, state, posState);
+         if (shortRepPrice <= nextOpt->price) {
+            nextOpt->price = shortRepPrice;
+            nextOpt->posPrev = cur;
+            makeAsShortRep(nextOpt);
+            nextIsChar = true;
+         }
+      }
+
+      auto numAvailFull = std::min(p.numAvail, NumOpts - 1 - cur);
+      if (numAvailFull < 2) {
+         continue;
+      }
+
+      numAvail = std::min(numAvailFull, p.numFastBytes);
+
+      if (!nextIsChar && matchByte != curByte) {
+         // Try literal + rep0
+         auto data2 = data - (reps[0] + 1);
+         auto limit = std::min(p.numFastBytes + 1, numAvailFull);
+         auto temp = 1u;
+
+         for (; temp < limit && data[temp] == data2[temp]; temp++);
+         auto lenTest2 = temp - 1;
+
+         if (lenTest2 >= 2) {
+            auto state2 = LiteralNextStates[state];
+            auto posStateNext = (position + 1) & p.pbMask;
+            auto nextRepMatchPrice = curAnd1Price +
+               getPrice1(p.probPrices, p.isMatch[state2][posStateNext]) +
+               getPrice1(p.probPrices, p.isRep[state2]);
+            auto offset = cur + 1 + lenTest2;
+
+            while (lenEnd < offset) {
+               p.opt[++lenEnd].price = InfinityPrice;
+            }
+
+            auto curAndLenPrice = nextRepMatchPrice + getRepPrice(p, 0, lenTest2, state2, posStateNext);
+            auto opt = &p.opt[offset];
+
+            if (curAndLenPrice < opt->price) {
+               opt->price = curAndLenPrice;
+               opt->posPrev = cur + 1;
+               opt->backPrev = 0;
+               opt->prev1IsChar = true;
+               opt->prev2 = false;
+            }
+         }
+      }
+
+      auto startLen = 2u;
+
+      for (auto repIndex = 0u; repIndex < NumReps; ++repIndex) {
+         auto data2 = data - (reps[repIndex] + 1);
+         if (data[0] != data2[0] || data[1] != data2[1]) {
+            continue;
+         }
+
+         auto lenTest = 2u;
+         for (; lenTest < numAvail && data[lenTest] == data2[lenTest]; lenTest++);
+
+         while (lenEnd < cur + lenTest) {
+            p.opt[++lenEnd].price = InfinityPrice;
+         }
+
+         auto lenTestTemp = lenTest;
+         auto price = repMatchPrice + getPureRepPrice(p, repIndex, state, posState);
+
+         do {
+            auto curAndLenPrice = price + p.repLenEnc.prices[posState][lenTest - 2];
+            auto opt = &p.opt[cur + lenTest];
+
+            if (curAndLenPrice < opt->price) {
+               opt->price = curAndLenPrice;
+               opt->posPrev = cur;
+               opt->backPrev = repIndex;
+               opt->prev1IsChar = false;
+            }
+         } while (--lenTest >= 2);
+
+         lenTest = lenTestTemp;
+
+         if (repIndex == 0) {
+            startLen = lenTest + 1;
+         }
+
+         // Try rep + literal + rep0
+         auto lenTest2 = lenTest + 1;
+         auto limit = std::min(lenTest2 + p.numFastBytes, numAvailFull);
+
+         for (; lenTest2 < limit && data[lenTest2] == data2[lenTest2]; lenTest2++);
+         lenTest2 -= lenTest + 1;
+
+         if (lenTest2 >= 2) {
+            auto state2 = RepNextStates[state];
+            auto posStateNext = (position + lenTest) & p.pbMask;
+            auto curAndLenCharPrice =
+               price + p.repLenEnc.prices[posState][lenTest - 2] +
+               getPrice0(p.probPrices, p.isMatch[state2][posStateNext]) +
+               getLiteralPriceMatched(getLiteralProbs(p, position + lenTest, data[lenTest - 1]),
+                                      data[lenTest], data2[lenTest], p.probPrices);
+
+            state2 = LiteralNextStates[state2];
+            posStateNext = (position + lenTest + 1) & p.pbMask;
+
+            auto nextRepMatchPrice = curAndLenCharPrice +
+               getPrice1(p.probPrices, p.isMatch[state2][posStateNext]) +
+               getPrice1(p.probPrices, p.isRep[state2]);
+            auto offset = cur + lenTest + 1 + lenTest2;
+
+            while (lenEnd < offset) {
+               p.opt[++lenEnd].price = InfinityPrice;
+            }
+
+            auto curAndLenPrice = nextRepMatchPrice + getRepPrice(p, 0, lenTest2, state2, posStateNext);
+            auto opt = &p.opt[offset];
+
+            if (curAndLenPrice < opt->price) {
+               opt->price = curAndLenPrice;
+               opt->posPrev = cur + lenTest + 1;
+               opt->backPrev = 0;
+               opt->prev1IsChar = true;
+               opt->prev2 = true;
+               opt->posPrev2 = cur;
+               opt->backPrev2 = repIndex;
+            }
+         }
+      }
+
+      if (newLen > numAvail) {
+         newLen = numAvail;
+         for (numPairs = 0; newLen > matches[numPairs]; numPairs += 2);
+         matches[numPairs] = newLen;
+         numPairs += 2;
+      }
+
+      if (newLen >= startLen) {
+         auto normalMatchPrice = matchPrice + getPrice0(p.probPrices, p.isRep[state]);
+
+         while (lenEnd < cur + newLen) {
+            p.opt[++lenEnd].price = InfinityPrice;
+         }
+
+         auto offs = 0u;
+         while (startLen > matches[offs]) {
+            offs += 2;
+         }
+
+         auto curBack = matches[offs + 1];
+         auto posSlot = getPosSlot2(p, curBack);
+
+         for (auto lenTest = startLen; ; lenTest++) {
+            auto curAndLenPrice = normalMatchPrice + p.lenEnc.prices[posState][lenTest - LZMA_MATCH_LEN_MIN];
+            auto lenToPosState = getLenToPosState(lenTest);
+
+            if (curBack < NumFullDistances) {
+               curAndLenPrice += p.distancesPrices[lenToPosState][curBack];
+            } else {
+               curAndLenPrice += p.posSlotPrices[lenToPosState][posSlot] + p.alignPrices[curBack & AlignMask];
+            }
+
+            auto opt = &p.opt[cur + lenTest];
+            if (curAndLenPrice < opt->price) {
+               opt->price = curAndLenPrice;
+               opt->posPrev = cur;
+               opt->backPrev = curBack + NumReps;
+               opt->prev1IsChar = false;
+            }
+
+            if (lenTest == matches[offs]) {
+               // Try match + literal + rep0
+               auto data2 = data - (curBack + 1);
+               auto lenTest2 = lenTest + 1;
+               auto limit = std::min(lenTest2 + p.numFastBytes, numAvailFull);
+
+               for (; lenTest2 < limit && data[lenTest2] == data2[lenTest2]; lenTest2++);
+               lenTest2 -= lenTest + 1;
+
+               if (lenTest2 >= 2) {
+                  auto state2 = MatchNextStates[state];
+                  auto posStateNext = (position + lenTest) & p.pbMask;
+                  auto curAndLenCharPrice = curAndLenPrice +
+                     getPrice0(p.probPrices, p.isMatch[state2][posStateNext]) +
+                     getLiteralPriceMatched(getLiteralProbs(p, position + lenTest, data[lenTest - 1]),
+                                            data[lenTest], data2[lenTest], p.probPrices);
+
+                  state2 = LiteralNextStates[state2];
+                  posStateNext = (posStateNext + 1) & p.pbMask;
+
+                  auto nextRepMatchPrice = curAndLenCharPrice +
+                     getPrice1(p.probPrices, p.isMatch[state2][posStateNext]) +
+                     getPrice1(p.probPrices, p.isRep[state2]);
+                  auto offset = cur + lenTest + 1 + lenTest2;
+
+                  while (lenEnd < offset) {
+                     p.opt[++lenEnd].price = InfinityPrice;
+                  }
+
+                  curAndLenPrice = nextRepMatchPrice + getRepPrice(p, 0, lenTest2, state2, posStateNext);
+                  opt = &p.opt[offset];
+
+                  if (curAndLenPrice < opt->price) {
+                     opt->price = curAndLenPrice;
+                     opt->posPrev = cur + lenTest + 1;
+                     opt->backPrev = 0;
+                     opt->prev1IsChar = true;
+                     opt->prev2 = true;
+                     opt->posPrev2 = cur;
+                     opt->backPrev2 = curBack + NumReps;
+                  }
+               }
+
+               offs += 2;
+               if (offs == numPairs) {
+                  break;
+               }
+
+               curBack = matches[offs + 1];
+               if (curBack >= NumFullDistances) {
+                  posSlot = getPosSlot2(p, curBack);
+               }
+            }
+         }
+      }
+   }
+}
+
+static inline bool
+changePair(uint32_t smallDist,
+           uint32_t bigDist)
+{
+   return (bigDist >> 7) > smallDist;
+}
+
+/**
+ * The fast mode parser, greedily takes the longest match or rep with a one
+ * byte lookahead instead of pricing every path.
+ */
+static uint32_t
+getOptimumFast(LzmaEncoder &p,
+               uint32_t *backRes)
+{
+   auto mainLen = 0u;
+   auto numPairs = 0u;
+
+   if (p.additionalOffset == 0) {
+      mainLen = readMatchDistances(p, &numPairs);
+   } else {
+      mainLen = p.longestMatchLength;
+      numPairs = p.numPairs;
+   }
+
+   auto numAvail = p.numAvail;
+   *backRes = static_cast<uint32_t>(-1);
+
+   if (numAvail < 2) {
+      return 1;
+   }
+
+   if (numAvail > LZMA_MATCH_LEN_MAX) {
+      numAvail = LZMA_MATCH_LEN_MAX;
+   }
+
+   auto data = internal::matchFinderGetPointerToCurrentPos(p.matchFinder) - 1;
+   auto repLen = 0u;
+   auto repIndex = 0u;
+
+   for (auto i = 0u; i < NumReps; ++i) {
+      auto data2 = data - (p.reps[i] + 1);
+      if (data[0] != data2[0] || data[1] != data2[1]) {
+         continue;
+      }
+
+      auto len = 2u;
+      for (; len < numAvail && data[len] == data2[len]; len++);
+
+      if (len >= p.numFastBytes) {
+         *backRes = i;
+         movePos(p, len - 1);
+         return len;
+      }
+
+      if (len > repLen) {
+         repIndex = i;
+         repLen = len;
+      }
+   }
+
+   auto matches = p.matches;
+   if (mainLen >= p.numFastBytes) {
+      *backRes = matches[numPairs - 1] + NumReps;
+      movePos(p, mainLen - 1);
+      return mainLen;
+   }
+
+   auto mainDist = 0u;
+   if (mainLen >= 2) {
+      mainDist = matches[numPairs - 1];
+
+      while (numPairs > 2 && mainLen == matches[numPairs - 4] + 1) {
+         if (!changePair(matches[numPairs - 3], mainDist)) {
+            break;
+         }
+
+         numPairs -= 2;
+         mainLen = matches[numPairs - 2];
+         mainDist = matches[numPairs - 1];
+      }
+
+      if (mainLen == 2 && mainDist >= 0x80) {
+         mainLen = 1;
+      }
+   }
+
+   if (repLen >= 2 && (
+         (repLen + 1 >= mainLen) ||
+         (repLen + 2 >= mainLen && mainDist >= (1 << 9)) ||
+         (repLen + 3 >= mainLen && mainDist >= (1 << 15)))) {
+      *backRes = repIndex;
+      movePos(p, repLen - 1);
+      return repLen;
+   }
+
+   if (mainLen < 2 || numAvail <= 2) {
+      return 1;
+   }
+
+   p.longestMatchLength = readMatchDistances(p, &p.numPairs);
+
+   if (p.longestMatchLength >= 2) {
+      auto newDistance = matches[p.numPairs - 1];
+      if ((p.longestMatchLength >= mainLen && newDistance < mainDist) ||
+          (p.longestMatchLength == mainLen + 1 && !changePair(mainDist, newDistance)) ||
+          (p.longestMatchLength > mainLen + 1) ||
+          (p.longestMatchLength + 1 >= mainLen && mainLen >= 3 && changePair(newDistance, mainDist))) {
+         return 1;
+      }
+   }
+
+   data = internal::matchFinderGetPointerToCurrentPos(p.matchFinder) - 1;
+
+   for (auto i = 0u; i < NumReps; ++i) {
+      auto data2 = data - (p.reps[i] + 1);
+      if (data[0] != data2[0] || data[1] != data2[1]) {
+         continue;
+      }
+
+      auto limit = mainLen - 1;
+      auto len = 2u;
+      for (; len < limit && data[len] == data2[len]; len++);
+
+      if (len >= limit) {
+         return 1;
+      }
+   }
+
+   *backRes = mainDist + NumReps;
+   movePos(p, mainLen - 2);
+   return mainLen;
+}
+
+static void
+writeEndMarker(LzmaEncoder &p,
+               uint32_t posState)
+{
+   p.rc.encodeBit(&p.isMatch[p.state][posState], 1);
+   p.rc.encodeBit(&p.isRep[p.state], 0);
+   p.state = MatchNextStates[p.state];
+
+   auto len = LZMA_MATCH_LEN_MIN;
+   encodeLengthAndUpdatePrices(p.lenEnc, p.rc, len - LZMA_MATCH_LEN_MIN, posState,
+                               !p.fastMode, p.probPrices);
+   p.rc.encodeTree(p.posSlotEncoder[getLenToPosState(len)], NumPosSlotBits,
+                    (1 << NumPosSlotBits) - 1);
+   p.rc.encodeDirectBits(((1u << 30) - 1) >> NumAlignBits, 30 - NumAlignBits);
+   p.rc.encodeTreeReverse(p.posAlignEncoder, NumAlignBits, AlignMask);
+}
+
+static int32_t
+checkErrors(LzmaEncoder &p)
+{
+   if (p.result != SZ_OK) {
+      return p.result;
+   }
+
+   if (p.rc.res != SZ_OK) {
+      p.result = SZ_ERROR_WRITE;
+   }
+
+   if (p.matchFinder.result != SZ_OK) {
+      p.result = SZ_ERROR_READ;
+   }
+
+   if (p.result != SZ_OK) {
+      p.finished = true;
+   }
+
+   return p.result;
+}
+
+static int32_t
+flush(LzmaEncoder &p,
+      uint32_t nowPos)
+{
+   p.finished = true;
+
+   if (p.writeEndMark) {
+      writeEndMarker(p, nowPos & p.pbMask);
+   }
+
+   p.rc.flushData();
+   p.rc.flushStream();
+   return checkErrors(p);
+}
+
+static void
+fillAlignPrices(LzmaEncoder &p)
+{
+   for (auto i = 0u; i < AlignTableSize; ++i) {
+      p.alignPrices[i] = getTreeReversePrice(p.posAlignEncoder, NumAlignBits, i, p.probPrices);
+   }
+
+   p.alignPriceCount = 0;
+}
+
+static void
+fillDistancesPrices(LzmaEncoder &p)
+{
+   uint32_t tempPrices[NumFullDistances];
+
+   for (auto i = StartPosModelIndex; i < NumFullDistances; ++i) {
+      auto posSlot = getPosSlot1(p, i);
+      auto footerBits = (posSlot >> 1) - 1;
+      auto base = (2 | (posSlot & 1)) << footerBits;
+      tempPrices[i] = getTreeReversePrice(p.posEncoders + base - posSlot - 1,
+                                          footerBits, i - base, p.probPrices);
+   }
+
+   for (auto lenToPosState = 0u; lenToPosState < NumLenToPosStates; ++lenToPosState) {
+      auto encoder = p.posSlotEncoder[lenToPosState];
+      auto posSlotPrices = p.posSlotPrices[lenToPosState];
+
+      for (auto posSlot = 0u; posSlot < p.distTableSize; ++posSlot) {
+         posSlotPrices[posSlot] = getTreePrice(encoder, NumPosSlotBits, posSlot, p.probPrices);
+      }
+
+      for (auto posSlot = EndPosModelIndex; posSlot < p.distTableSize; ++posSlot) {
+         posSlotPrices[posSlot] += (((posSlot >> 1) - 1) - NumAlignBits) << NumBitPriceShiftBits;
+      }
+
+      auto distancesPrices = p.distancesPrices[lenToPosState];
+      auto i = 0u;
+
+      for (; i < StartPosModelIndex; ++i) {
+         distancesPrices[i] = posSlotPrices[i];
+      }
+
+      for (; i < NumFullDistances; ++i) {
+         distancesPrices[i] = posSlotPrices[getPosSlot1(p, i)] + tempPrices[i];
+      }
+   }
+
+   p.matchPriceCount = 0;
+}
+
+static void
+freeLiterals(LzmaEncoder &p,
+             virt_ptr<ISzAlloc> alloc)
+{
+   freeGuestMemory(alloc, p.litProbs);
+   freeGuestMemory(alloc, p.saveLitProbs);
+   p.litProbs = nullptr;
+   p.saveLitProbs = nullptr;
+}
+
+static void
+construct(LzmaEncoder &p)
+{
+   p.rc.outStream = nullptr;
+   p.rc.outBuffer = nullptr;
+   p.rc.bufBase = nullptr;
+   internal::matchFinderConstruct(p.matchFinder);
+
+   auto props = internal::EncoderProps { };
+   internal::initEncoderProps(props);
+   setProps(p, props);
+
+   initFastPos(p.fastPos);
+   initPriceTables(p.probPrices);
+   p.litProbs = nullptr;
+   p.saveLitProbs = nullptr;
+}
+
+/**
+ * Encode until the input runs out, or with useLimits until the next chunk
+ * would no longer fit in maxPackSize and maxUnpackSize. Without useLimits
+ * this returns after every 32 KiB of input so the caller can report
+ * progress.
+ */
+static int32_t
+codeOneBlock(LzmaEncoder &p,
+             bool useLimits,
+             uint32_t maxPackSize,
+             uint32_t maxUnpackSize)
+{
+   if (p.needInit) {
+      internal::matchFinderInit(p.matchFinder);
+      p.needInit = false;
+   }
+
+   if (p.finished) {
+      return p.result;
+   }
+
+   if (auto res = checkErrors(p); res != SZ_OK) {
+      return res;
+   }
+
+   auto nowPos32 = static_cast<uint32_t>(p.nowPos64);
+   auto startPos32 = nowPos32;
+
+   if (p.nowPos64 == 0) {
+      if (internal::matchFinderGetNumAvailableBytes(p.matchFinder) == 0) {
+         return flush(p, nowPos32);
+      }
+
+      auto numPairs = 0u;
+      readMatchDistances(p, &numPairs);
+      p.rc.encodeBit(&p.isMatch[p.state][0], 0);
+      p.state = LiteralNextStates[p.state];
+
+      auto curByte = internal::matchFinderGetPointerToCurrentPos(p.matchFinder)[0 - static_cast<ptrdiff_t>(p.additionalOffset)];
+      p.rc.encodeLiteral(p.litProbs, curByte);
+      p.additionalOffset--;
+      nowPos32++;
+   }
+
+   if (internal::matchFinderGetNumAvailableBytes(p.matchFinder) != 0) {
+      while (true) {
+         auto pos = 0u;
+         auto len = p.fastMode ? getOptimumFast(p, &pos) : getOptimum(p, nowPos32, &pos);
+         auto posState = nowPos32 & p.pbMask;
+
+         if (len == 1 && pos == static_cast<uint32_t>(-1)) {
+            p.rc.encodeBit(&p.isMatch[p.state][posState], 0);
+
+            auto data = internal::matchFinderGetPointerToCurrentPos(p.matchFinder) - p.additionalOffset;
+            auto curByte = *data;
+            auto probs = const_cast<Prob *>(getLiteralProbs(p, nowPos32, *(data - 1)));
+
+            if (isCharState(p.state)) {
+               p.rc.encodeLiteral(probs, curByte);
+            } else {
+               p.rc.encodeLiteralMatched(probs, curByte, *(data - p.reps[0] - 1));
+            }
+
+            p.state = LiteralNextStates[p.state];
+         } else {
+            p.rc.encodeBit(&p.isMatch[p.state][posState], 1);
+
+            if (pos < NumReps) {
+               p.rc.encodeBit(&p.isRep[p.state], 1);
+
+               if (pos == 0) {
+                  p.rc.encodeBit(&p.isRepG0[p.state], 0);
+                  p.rc.encodeBit(&p.isRep0Long[p.state][posState], (len == 1) ? 0 : 1);
+               } else {
+                  auto distance = p.reps[pos];
+                  p.rc.encodeBit(&p.isRepG0[p.state], 1);
+
+                  if (pos == 1) {
+                     p.rc.encodeBit(&p.isRepG1[p.state], 0);
+                  } else {
+                     p.rc.encodeBit(&p.isRepG1[p.state], 1);
+                     p.rc.encodeBit(&p.isRepG2[p.state], pos - 2);
+
+                     if (pos == 3) {
+                        p.reps[3] = p.reps[2];
+                     }
+
+                     p.reps[2] = p.reps[1];
+                  }
+
+                  p.reps[1] = p.reps[0];
+                  p.reps[0] = distance;
+               }
+
+               if (len == 1) {
+                  p.state = ShortRepNextStates[p.state];
+               } else {
+                  encodeLengthAndUpdatePrices(p.repLenEnc, p.rc, len - LZMA_MATCH_LEN_MIN,
+                                              posState, !p.fastMode, p.probPrices);
+                  p.state = RepNextStates[p.state];
+               }
+            } else {
+               p.rc.encodeBit(&p.isRep[p.state], 0);
+               p.state = MatchNextStates[p.state];
+               encodeLengthAndUpdatePrices(p.lenEnc, p.rc, len - LZMA_MATCH_LEN_MIN,
+                                           posState, !p.fastMode, p.probPrices);
+
+               pos -= NumReps;
+               auto posSlot = getPosSlot(p, pos);
+               p.rc.encodeTree(p.posSlotEncoder[getLenToPosState(len)], NumPosSlotBits, posSlot);
+
+               if (posSlot >= StartPosModelIndex) {
+                  auto footerBits = (posSlot >> 1) - 1;
+                  auto base = (2 | (posSlot & 1)) << footerBits;
+                  auto posReduced = pos - base;
+
+                  if (posSlot < EndPosModelIndex) {
+                     p.rc.encodeTreeReverse(p.posEncoders + base - posSlot - 1,
+                                             footerBits, posReduced);
+                  } else {
+                     p.rc.encodeDirectBits(posReduced >> NumAlignBits, footerBits - NumAlignBits);
+                     p.rc.encodeTreeReverse(p.posAlignEncoder, NumAlignBits, posReduced & AlignMask);
+                     p.alignPriceCount++;
+                  }
+               }
+
+               p.reps[3] = p.reps[2];
+               p.reps[2] = p.reps[1];
+               p.reps[1] = p.reps[0];
+               p.reps[0] = pos;
+               p.matchPriceCount++;
+            }
+         }
+
+         p.additionalOffset -= len;
+         nowPos32 += len;
+
+         if (p.additionalOffset == 0) {
+            if (!p.fastMode) {
+               if (p.matchPriceCount >= (1 << 7)) {
+                  fillDistancesPrices(p);
+               }
+
+               if (p.alignPriceCount >= AlignTableSize) {
+                  fillAlignPrices(p);
+               }
+            }
+
+            if (internal::matchFinderGetNumAvailableBytes(p.matchFinder) == 0) {
+               break;
+            }
+
+            auto processed = nowPos32 - startPos32;
+
+            if (useLimits) {
+               if (processed + NumOpts + 300 >= maxUnpackSize ||
+                   p.rc.getProcessed() + NumOpts * 2 >= maxPackSize) {
+                  break;
+               }
+            } else if (processed >= (1 << 15)) {
+               p.nowPos64 += nowPos32 - startPos32;
+               return checkErrors(p);
+            }
+         }
+      }
+   }
+
+   p.nowPos64 += nowPos32 - startPos32;
+   return flush(p, nowPos32);
+}
+
+static int32_t
+allocateEncoder(LzmaEncoder &p,
+                uint32_t keepWindowSize,
+                virt_ptr<ISzAlloc> alloc,
+                virt_ptr<ISzAlloc> allocBig)
+{
+   auto beforeSize = NumOpts;
+
+   if (!p.rc.bufBase) {
+      p.rc.bufBase = virt_cast<uint8_t *>(internal::allocMemory(alloc, RcBufSize)).get();
+      if (!p.rc.bufBase) {
+         return SZ_ERROR_MEM;
+      }
+
+      p.rc.bufLim = p.rc.bufBase + RcBufSize;
+   }
+
+   auto lclp = p.lc + p.lp;
+   if (!p.litProbs || !p.saveLitProbs || p.lclp != lclp) {
+      auto size = static_cast<uint32_t>((0x300u << lclp) * sizeof(Prob));
+      freeLiterals(p, alloc);
+      p.litProbs = static_cast<Prob *>(internal::allocMemory(alloc, size).get());
+      p.saveLitProbs = static_cast<Prob *>(internal::allocMemory(alloc, size).get());
+
+      if (!p.litProbs || !p.saveLitProbs) {
+         freeLiterals(p, alloc);
+         return SZ_ERROR_MEM;
+      }
+
+      p.lclp = lclp;
+   }
+
+   p.matchFinder.bigHash = (p.dictSize > BigHashDicLimit);
+
+   if (beforeSize + p.dictSize < keepWindowSize) {
+      beforeSize = keepWindowSize - p.dictSize;
+   }
+
+   if (!internal::matchFinderCreate(p.matchFinder, p.dictSize, beforeSize,
+                                    p.numFastBytes, LZMA_MATCH_LEN_MAX, allocBig)) {
+      return SZ_ERROR_MEM;
+   }
+
+   return SZ_OK;
+}
+
+static void
+initEncoder(LzmaEncoder &p)
+{
+   p.state = 0;
+   std::fill(std::begin(p.reps), std::end(p.reps), 0u);
+   p.rc.init();
+
+   for (auto i = 0u; i < NumStates; ++i) {
+      std::fill(std::begin(p.isMatch[i]), std::end(p.isMatch[i]), ProbInitValue);
+      std::fill(std::begin(p.isRep0Long[i]), std::end(p.isRep0Long[i]), ProbInitValue);
+      p.isRep[i] = ProbInitValue;
+      p.isRepG0[i] = ProbInitValue;
+      p.isRepG1[i] = ProbInitValue;
+      p.isRepG2[i] = ProbInitValue;
+   }
+
+   std::fill_n(p.litProbs, 0x300u << (p.lp + p.lc), ProbInitValue);
+
+   for (auto i = 0u; i < NumLenToPosStates; ++i) {
+      std::fill(std::begin(p.posSlotEncoder[i]), std::end(p.posSlotEncoder[i]), ProbInitValue);
+   }
+
+   std::fill(std::begin(p.posEncoders), std::end(p.posEncoders), ProbInitValue);
+   initLengthEncoder(p.lenEnc.p);
+   initLengthEncoder(p.repLenEnc.p);
+   std::fill(std::begin(p.posAlignEncoder), std::end(p.posAlignEncoder), ProbInitValue);
+
+   p.optimumEndIndex = 0;
+   p.optimumCurrentIndex = 0;
+   p.additionalOffset = 0;
+
+   p.pbMask = (1u << p.pb) - 1;
+   p.lpMask = (1u << p.lp) - 1;
+}
+
+static void
+initPrices(LzmaEncoder &p)
+{
+   if (!p.fastMode) {
+      fillDistancesPrices(p);
+      fillAlignPrices(p);
+   }
+
+   p.lenEnc.tableSize = p.numFastBytes + 1 - LZMA_MATCH_LEN_MIN;
+   p.repLenEnc.tableSize = p.numFastBytes + 1 - LZMA_MATCH_LEN_MIN;
+   updateLengthPriceTables(p.lenEnc, 1u << p.pb, p.probPrices);
+   updateLengthPriceTables(p.repLenEnc, 1u << p.pb, p.probPrices);
+}
+
+static int32_t
+allocateAndInit(LzmaEncoder &p,
+                uint32_t keepWindowSize,
+                virt_ptr<ISzAlloc> alloc,
+                virt_ptr<ISzAlloc> allocBig)
+{
+   auto i = 0u;
+   for (; i < DicLogSizeMaxCompress; ++i) {
+      if (p.dictSize <= (1u << i)) {
+         break;
+      }
+   }
+
+   p.distTableSize = i * 2;
+   p.finished = false;
+   p.result = SZ_OK;
+
+   if (auto res = allocateEncoder(p, keepWindowSize, alloc, allocBig); res != SZ_OK) {
+      return res;
+   }
+
+   initEncoder(p);
+   initPrices(p);
+   p.nowPos64 = 0;
+   return SZ_OK;
+}
+
+static int32_t
+encode2(LzmaEncoder &p,
+        virt_ptr<ICompressProgress> progress)
+{
+   auto res = SZ_OK;
+
+   while (true) {
+      res = codeOneBlock(p, false, 0, 0);
+      if (res != SZ_OK || p.finished) {
+         break;
+      }
+
+      if (progress) {
+         res = cafe::invoke(cpu::this_core::state(),
+                            progress->Progress,
+                            progress,
+                            p.nowPos64,
+                            p.rc.getProcessed());
+
+         if (res != SZ_OK) {
+            res = SZ_ERROR_PROGRESS;
+            break;
+         }
+      }
+   }
+
+   return res;
+}
+
+void
+LzmaEncProps_Init(virt_ptr<CLzmaEncProps> p)
+{
+   auto props = internal::EncoderProps { };
+   internal::initEncoderProps(props);
+   internal::storeEncoderProps(props, p);
+}
+
+void
+LzmaEncProps_Normalize(virt_ptr<CLzmaEncProps> p)
+{
+   auto props = internal::loadEncoderProps(p);
+   internal::normalizeEncoderProps(props);
+   internal::storeEncoderProps(props, p);
+}
+
+uint32_t
+LzmaEncProps_GetDictSize(virt_ptr<const CLzmaEncProps> props2)
+{
+   auto props = internal::loadEncoderProps(props2);
+   internal::normalizeEncoderProps(props);
+   return props.dictSize;
+}
+
+CLzmaEncHandle
+LzmaEnc_Create(virt_ptr<ISzAlloc> alloc)
+{
+   auto p = internal::allocMemory(alloc, sizeof(LzmaEncoder) + 4);
+   if (p) {
+      construct(getEncoder(p));
+   }
+
+   return p;
+}
+
+void
+LzmaEnc_Destroy(CLzmaEncHandle handle,
+                virt_ptr<ISzAlloc> alloc,
+                virt_ptr<ISzAlloc> allocBig)
+{
+   auto &p = getEncoder(handle);
+   internal::matchFinderFree(p.matchFinder, allocBig);
+   freeLiterals(p, alloc);
+   freeGuestMemory(alloc, p.rc.bufBase);
+   p.rc.bufBase = nullptr;
+   internal::freeMemory(alloc, handle);
+}
+
+int32_t
+LzmaEnc_SetProps(CLzmaEncHandle p,
+                 virt_ptr<const CLzmaEncProps> props)
+{
+   return internal::lzmaEncSetProps(p, internal::loadEncoderProps(props));
+}
+
+int32_t
+LzmaEnc_WriteProperties(CLzmaEncHandle p,
+                        virt_ptr<uint8_t> properties,
+                        virt_ptr<uint32_t> size)
+{
+   auto hostSize = static_cast<uint32_t>(*size);
+   auto res = internal::lzmaEncWriteProperties(p, properties.get(), &hostSize);
+   *size = hostSize;
+   return res;
+}
+
+int32_t
+LzmaEnc_Encode(CLzmaEncHandle handle,
+               virt_ptr<ISeqOutStream> outStream,
+               virt_ptr<ISeqInStream> inStream,
+               virt_ptr<ICompressProgress> progress,
+               virt_ptr<ISzAlloc> alloc,
+               virt_ptr<ISzAlloc> allocBig)
+{
+   auto &p = getEncoder(handle);
+   internal::matchFinderSetStream(p.matchFinder, inStream);
+   p.needInit = true;
+   p.rc.outStream = outStream;
+   p.rc.outBuffer = nullptr;
+
+   if (auto res = allocateAndInit(p, 0, alloc, allocBig); res != SZ_OK) {
+      return res;
+   }
+
+   return encode2(p, progress);
+}
+
+int32_t
+LzmaEnc_MemEncode(CLzmaEncHandle handle,
+                  virt_ptr<uint8_t> dest,
+                  virt_ptr<uint32_t> destLen,
+                  virt_ptr<const uint8_t> src,
+                  uint32_t srcLen,
+                  int32_t writeEndMark,
+                  virt_ptr<ICompressProgress> progress,
+                  virt_ptr<ISzAlloc> alloc,
+                  virt_ptr<ISzAlloc> allocBig)
+{
+   auto &p = getEncoder(handle);
+   auto outBuffer = OutputBuffer { dest.get(), *destLen, false };
+
+   p.writeEndMark = writeEndMark != 0;
+   p.rc.outBuffer = &outBuffer;
+
+   auto res = internal::lzmaEncMemPrepare(handle, src.get(), srcLen, 0, alloc, allocBig);
+   if (res == SZ_OK) {
+      res = encode2(p, progress);
+   }
+
+   p.rc.outBuffer = nullptr;
+   *destLen -= outBuffer.rem;
+
+   if (outBuffer.overflow) {
+      return SZ_ERROR_OUTPUT_EOF;
+   }
+
+   return res;
+}
+
+int32_t
+LzmaEncode(virt_ptr<uint8_t> dest,
+           virt_ptr<uint32_t> destLen,
+           virt_ptr<const uint8_t> src,
+           uint32_t srcLen,
+           virt_ptr<const CLzmaEncProps> props,
+           virt_ptr<uint8_t> propsEncoded,
+           virt_ptr<uint32_t> propsSize,
+           int32_t writeEndMark,
+           virt_ptr<ICompressProgress> progress,
+           virt_ptr<ISzAlloc> alloc,
+           virt_ptr<ISzAlloc> allocBig)
+{
+   auto p = LzmaEnc_Create(alloc);
+   if (!p) {
+      return SZ_ERROR_MEM;
+   }
+
+   auto res = LzmaEnc_SetProps(p, props);
+   if (res == SZ_OK) {
+      res = LzmaEnc_WriteProperties(p, propsEncoded, propsSize);
+
+      if (res == SZ_OK) {
+         res = LzmaEnc_MemEncode(p, dest, destLen, src, srcLen, writeEndMark,
+                                 progress, alloc, allocBig);
+      }
+   }
+
+   LzmaEnc_Destroy(p, alloc, allocBig);
+   return res;
+}
+
+/**
+ * From LzmaLib, which allocates from the default heap and never writes an
+ * end marker.
+ */
+int32_t
+LzmaCompress(virt_ptr<uint8_t> dest,
+             virt_ptr<uint32_t> destLen,
+             virt_ptr<const uint8_t> src,
+             uint32_t srcLen,
+             virt_ptr<uint8_t> outProps,
+             virt_ptr<uint32_t> outPropsSize,
+             int32_t level,
+             uint32_t dictSize,
+             int32_t lc,
+             int32_t lp,
+             int32_t pb,
+             int32_t fb,
+             int32_t numThreads)
+{
+   auto props = StackObject<CLzmaEncProps> { };
+   LzmaEncProps_Init(props);
+   props->level = level;
+   props->dictSize = dictSize;
+   props->lc = lc;
+   props->lp = lp;
+   props->pb = pb;
+   props->fb = fb;
+   props->numThreads = numThreads;
+
+   return LzmaEncode(dest, destLen, src, srcLen, props, outProps, outPropsSize,
+                     0, nullptr, nullptr, nullptr);
+}
+
+namespace internal
+{
+
+int32_t
+lzmaEncSetProps(CLzmaEncHandle p,
+                const EncoderProps &props)
+{
+   return setProps(getEncoder(p), props);
+}
+
+int32_t
+lzmaEncPrepareForLzma2(CLzmaEncHandle handle,
+                       virt_ptr<ISeqInStream> inStream,
+                       uint32_t keepWindowSize,
+                       virt_ptr<ISzAlloc> alloc,
+                       virt_ptr<ISzAlloc> allocBig)
+{
+   auto &p = getEncoder(handle);
+   internal::matchFinderSetStream(p.matchFinder, inStream);
+   p.needInit = true;
+   return allocateAndInit(p, keepWindowSize, alloc, allocBig);
+}
+
+int32_t
+lzmaEncMemPrepare(CLzmaEncHandle handle,
+                  const uint8_t *src,
+                  uint32_t srcLen,
+                  uint32_t keepWindowSize,
+                  virt_ptr<ISzAlloc> alloc,
+                  virt_ptr<ISzAlloc> allocBig)
+{
+   auto &p = getEncoder(handle);
+   internal::matchFinderSetInputBuffer(p.matchFinder, src, srcLen, allocBig);
+   p.needInit = true;
+   return allocateAndInit(p, keepWindowSize, alloc, allocBig);
+}
+
+/**
+ * Encode one LZMA2 chunk into dest without an end marker, reInit resets
+ * the probabilities and reps first. On return unpackSize is the number of
+ * input bytes the chunk covers.
+ */
+int32_t
+lzmaEncCodeOneMemBlock(CLzmaEncHandle handle,
+                       bool reInit,
+                       uint8_t *dest,
+                       uint32_t *destLen,
+                       uint32_t desiredPackSize,
+                       uint32_t *unpackSize)
+{
+   auto &p = getEncoder(handle);
+   auto outBuffer = OutputBuffer { dest, *destLen, false };
+
+   p.writeEndMark = false;
+   p.finished = false;
+   p.result = SZ_OK;
+
+   if (reInit) {
+      initEncoder(p);
+   }
+
+   initPrices(p);
+
+   auto nowPos64 = p.nowPos64;
+   p.rc.init();
+   p.rc.outBuffer = &outBuffer;
+
+   auto res = codeOneBlock(p, true, desiredPackSize, *unpackSize);
+   p.rc.outBuffer = nullptr;
+
+   *unpackSize = static_cast<uint32_t>(p.nowPos64 - nowPos64);
+   *destLen -= outBuffer.rem;
+
+   if (outBuffer.overflow) {
+      return SZ_ERROR_OUTPUT_EOF;
+   }
+
+   return res;
+}
+
+const uint8_t *
+lzmaEncGetCurBuf(CLzmaEncHandle handle)
+{
+   auto &p = getEncoder(handle);
+   return internal::matchFinderGetPointerToCurrentPos(p.matchFinder) - p.additionalOffset;
+}
+
+void
+lzmaEncSaveState(CLzmaEncHandle handle)
+{
+   auto &p = getEncoder(handle);
+   p.saveState = static_cast<const EncoderState &>(p);
+   std::memcpy(p.saveLitProbs, p.litProbs, (0x300u << p.lclp) * sizeof(Prob));
+}
+
+void
+lzmaEncRestoreState(CLzmaEncHandle handle)
+{
+   auto &p = getEncoder(handle);
+   static_cast<EncoderState &>(p) = p.saveState;
+   std::memcpy(p.litProbs, p.saveLitProbs, (0x300u << p.lclp) * sizeof(Prob));
+}
+
+int32_t
+lzmaEncWriteProperties(CLzmaEncHandle handle,
+                       uint8_t *properties,
+                       uint32_t *size)
+{
+   auto &p = getEncoder(handle);
+   auto dictSize = p.dictSize;
+
+   if (*size < LZMA_PROPS_SIZE) {
+      return SZ_ERROR_PARAM;
+   }
+
+   *size = LZMA_PROPS_SIZE;
+   properties[0] = static_cast<uint8_t>((p.pb * 5 + p.lp) * 9 + p.lc);
+
+   for (auto i = 11u; i <= 30; ++i) {
+      if (dictSize <= (2u << i)) {
+         dictSize = 2u << i;
+         break;
+      }
+
+      if (dictSize <= (3u << i)) {
+         dictSize = 3u << i;
+         break;
+      }
+   }
+
+   for (auto i = 0u; i < 4; ++i) {
+      properties[1 + i] = static_cast<uint8_t>(dictSize >> (8 * i));
+   }
+
+   return SZ_OK;
+}
+
+} // namespace internal
+
+void
+Library::registerLzmaEncSymbols()
+{
+   RegisterFunctionExport(LzmaEncProps_Init);
+   RegisterFunctionExport(LzmaEncProps_Normalize);
+   RegisterFunctionExport(LzmaEncProps_GetDictSize);
+   RegisterFunctionExport(LzmaEnc_Create);
+   RegisterFunctionExport(LzmaEnc_Destroy);
+   RegisterFunctionExport(LzmaEnc_SetProps);
+   RegisterFunctionExport(LzmaEnc_WriteProperties);
+   RegisterFunctionExport(LzmaEnc_Encode);
+   RegisterFunctionExport(LzmaEnc_MemEncode);
+   RegisterFunctionExport(LzmaEncode);
+   RegisterFunctionExport(LzmaCompress);
+}
+
+} // namespace cafe::lzma920
@@ -0,0 +1,266 @@
+#pragma once
+#include "lzma920_lzmadec.h"
+
+#include <cstdint>
+#include <libcpu/be2_struct.h>
+
+namespace cafe::lzma920
+{
+
+/*
+Host implementation of the LzmaEnc API from the LZMA SDK 9.20 and the
+LzmaCompress wrapper from LzmaLib. The encoder handle is opaque to titles so
+it holds a decaf specific host struct, its buffers are still allocated from
+guest memory through the title's allocators.
+*/
+
+constexpr uint32_t LZMA_MATCH_LEN_MIN = 2;
+constexpr uint32_t LZMA_MATCH_LEN_MAX = 273;
+
+#pragma pack(push, 1)
+
+struct ISeqInStream;
+struct ISeqOutStream;
+struct ICompressProgress;
+
+using ISeqInStreamReadFn = virt_func_ptr<
+   int32_t(virt_ptr<ISeqInStream> p, virt_ptr<void> buf, virt_ptr<uint32_t> size)>;
+
+using ISeqOutStreamWriteFn = virt_func_ptr<
+   uint32_t(virt_ptr<ISeqOutStream> p, virt_ptr<const void> buf, uint32_t size)>;
+
+using ICompressProgressFn = virt_func_ptr<
+   int32_t(virt_ptr<ICompressProgress> p, uint64_t inSize, uint64_t outSize)>;
+
+struct ISeqInStream
+{
+   be2_val<ISeqInStreamReadFn> Read;
+};
+CHECK_OFFSET(ISeqInStream, 0x00, Read);
+CHECK_SIZE(ISeqInStream, 0x04);
+
+struct ISeqOutStream
+{
+   be2_val<ISeqOutStreamWriteFn> Write;
+};
+CHECK_OFFSET(ISeqOutStream, 0x00, Write);
+CHECK_SIZE(ISeqOutStream, 0x04);
+
+struct ICompressProgress
+{
+   be2_val<ICompressProgressFn> Progress;
+};
+CHECK_OFFSET(ICompressProgress, 0x00, Progress);
+CHECK_SIZE(ICompressProgress, 0x04);
+
+struct CLzmaEncProps
+{
+   //! 0 <= level <= 9
+   be2_val<int32_t> level;
+
+   //! (1 << 12) <= dictSize <= (1 << 27), default = (1 << 24)
+   be2_val<uint32_t> dictSize;
+
+   //! 0 <= lc <= 8, default = 3
+   be2_val<int32_t> lc;
+
+   //! 0 <= lp <= 4, default = 0
+   be2_val<int32_t> lp;
+
+   //! 0 <= pb <= 4, default = 2
+   be2_val<int32_t> pb;
+
+   //! 0 - fast, 1 - normal, default = 1
+   be2_val<int32_t> algo;
+
+   //! 5 <= fb <= 273, default = 32
+   be2_val<int32_t> fb;
+
+   //! 0 - hashChain mode, 1 - binTree mode - normal, default = 1
+   be2_val<int32_t> btMode;
+
+   //! 2, 3 or 4, default = 4
+   be2_val<int32_t> numHashBytes;
+
+   //! 1 <= mc <= (1 << 30), default = 32
+   be2_val<uint32_t> mc;
+
+   //! 0 - do not write EOPM, 1 - write EOPM, default = 0
+   be2_val<uint32_t> writeEndMark;
+
+   //! 1 or 2, default = 2
+   be2_val<int32_t> numThreads;
+};
+CHECK_OFFSET(CLzmaEncProps, 0x00, level);
+CHECK_OFFSET(CLzmaEncProps, 0x04, dictSize);
+CHECK_OFFSET(CLzmaEncProps, 0x08, lc);
+CHECK_OFFSET(CLzmaEncProps, 0x0C, lp);
+CHECK_OFFSET(CLzmaEncProps, 0x10, pb);
+CHECK_OFFSET(CLzmaEncProps, 0x14, algo);
+CHECK_OFFSET(CLzmaEncProps, 0x18, fb);
+CHECK_OFFSET(CLzmaEncProps, 0x1C, btMode);
+CHECK_OFFSET(CLzmaEncProps, 0x20, numHashBytes);
+CHECK_OFFSET(CLzmaEncProps, 0x24, mc);
+CHECK_OFFSET(CLzmaEncProps, 0x28, writeEndMark);
+CHECK_OFFSET(CLzmaEncProps, 0x2C, numThreads);
+CHECK_SIZE(CLzmaEncProps, 0x30);
+
+#pragma pack(pop)
+
+using CLzmaEncHandle = virt_ptr<void>;
+
+void
+LzmaEncProps_Init(virt_ptr<CLzmaEncProps> p);
+
+void
+LzmaEncProps_Normalize(virt_ptr<CLzmaEncProps> p);
+
+uint32_t
+LzmaEncProps_GetDictSize(virt_ptr<const CLzmaEncProps> props2);
+
+CLzmaEncHandle
+LzmaEnc_Create(virt_ptr<ISzAlloc> alloc);
+
+void
+LzmaEnc_Destroy(CLzmaEncHandle p,
+                virt_ptr<ISzAlloc> alloc,
+                virt_ptr<ISzAlloc> allocBig);
+
+int32_t
+LzmaEnc_SetProps(CLzmaEncHandle p,
+                 virt_ptr<const CLzmaEncProps> props);
+
+int32_t
+LzmaEnc_WriteProperties(CLzmaEncHandle p,
+                        virt_ptr<uint8_t> properties,
+                        virt_ptr<uint32_t> size);
+
+int32_t
+LzmaEnc_Encode(CLzmaEncHandle p,
+               virt_ptr<ISeqOutStream> outStream,
+               virt_ptr<ISeqInStream> inStream,
+               virt_ptr<ICompressProgress> progress,
+               virt_ptr<ISzAlloc> alloc,
+               virt_ptr<ISzAlloc> allocBig);
+
+int32_t
+LzmaEnc_MemEncode(CLzmaEncHandle p,
+                  virt_ptr<uint8_t> dest,
+                  virt_ptr<uint32_t> destLen,
+                  virt_ptr<const uint8_t> src,
+                  uint32_t srcLen,
+                  int32_t writeEndMark,
+                  virt_ptr<ICompressProgress> progress,
+                  virt_ptr<ISzAlloc> alloc,
+                  virt_ptr<ISzAlloc> allocBig);
+
+int32_t
+LzmaEncode(virt_ptr<uint8_t> dest,
+           virt_ptr<uint32_t> destLen,
+           virt_ptr<const uint8_t> src,
+           uint32_t srcLen,
+           virt_ptr<const CLzmaEncProps> props,
+           virt_ptr<uint8_t> propsEncoded,
+           virt_ptr<uint32_t> propsSize,
+           int32_t writeEndMark,
+           virt_ptr<ICompressProgress> progress,
+           virt_ptr<ISzAlloc> alloc,
+           virt_ptr<ISzAlloc> allocBig);
+
+int32_t
+LzmaCompress(virt_ptr<uint8_t> dest,
+             virt_ptr<uint32_t> destLen,
+             virt_ptr<const uint8_t> src,
+             uint32_t srcLen,
+             virt_ptr<uint8_t> outProps,
+             virt_ptr<uint32_t> outPropsSize,
+             int32_t level,
+             uint32_t dictSize,
+             int32_t lc,
+             int32_t lp,
+             int32_t pb,
+             int32_t fb,
+             int32_t numThreads);
+
+namespace internal
+{
+
+/*
+The parts of LzmaEnc which Lzma2Enc drives directly, these work on the host
+encoder so Lzma2Enc can encode chunks without any guest round trips.
+*/
+
+//! Host copy of CLzmaEncProps.
+struct EncoderProps
+{
+   int32_t level;
+   uint32_t dictSize;
+   int32_t lc;
+   int32_t lp;
+   int32_t pb;
+   int32_t algo;
+   int32_t fb;
+   int32_t btMode;
+   int32_t numHashBytes;
+   uint32_t mc;
+   uint32_t writeEndMark;
+   int32_t numThreads;
+};
+
+EncoderProps
+loadEncoderProps(virt_ptr<const CLzmaEncProps> props);
+
+void
+storeEncoderProps(const EncoderProps &props,
+                  virt_ptr<CLzmaEncProps> out);
+
+void
+initEncoderProps(EncoderProps &p);
+
+void
+normalizeEncoderProps(EncoderProps &p);
+
+int32_t
+lzmaEncSetProps(CLzmaEncHandle p,
+                const EncoderProps &props);
+
+int32_t
+lzmaEncPrepareForLzma2(CLzmaEncHandle p,
+                       virt_ptr<ISeqInStream> inStream,
+                       uint32_t keepWindowSize,
+                       virt_ptr<ISzAlloc> alloc,
+                       virt_ptr<ISzAlloc> allocBig);
+
+int32_t
+lzmaEncMemPrepare(CLzmaEncHandle p,
+                  const uint8_t *src,
+                  uint32_t srcLen,
+                  uint32_t keepWindowSize,
+                  virt_ptr<ISzAlloc> alloc,
+                  virt_ptr<ISzAlloc> allocBig);
+
+int32_t
+lzmaEncCodeOneMemBlock(CLzmaEncHandle p,
+                       bool reInit,
+                       uint8_t *dest,
+                       uint32_t *destLen,
+                       uint32_t desiredPackSize,
+                       uint32_t *unpackSize);
+
+const uint8_t *
+lzmaEncGetCurBuf(CLzmaEncHandle p);
+
+void
+lzmaEncSaveState(CLzmaEncHandle p);
+
+void
+lzmaEncRestoreState(CLzmaEncHandle p);
+
+int32_t
+lzmaEncWriteProperties(CLzmaEncHandle p,
+                       uint8_t *properties,
+                       uint32_t *size);
+
+} // namespace internal
+
+} // namespace cafe::lzma920
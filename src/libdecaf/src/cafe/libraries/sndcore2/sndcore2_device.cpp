@@ -2,14 +2,21 @@
 #include "sndcore2_config.h"
 #include "sndcore2_constants.h"
 #include "sndcore2_device.h"
+#include "sndcore2_mix.h"
 #include "sndcore2_voice.h"
 #include "decaf_sound.h"
 
 #include "cafe/cafe_ppc_interface_invoke_guest.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <common/fixed.h>
+#include <condition_variable>
 #include <libcpu/mmu.h>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace cafe::sndcore2
 {
@@ -308,24 +315,168 @@ void applyADSR(virt_ptr<AXVoice> voice,
    extras->ve.volume += extras->ve.delta.value() * numSamples;
 }
 
-void
-decodeVoiceSamples(int numSamples)
+static void
+decodeVoice(virt_ptr<AXVoice> voice,
+            int numSamples)
 {
-   const auto voices = getAcquiredVoices();
+   auto extras = getVoiceExtras(voice->index);
 
-   for (auto voice : voices) {
-      auto extras = getVoiceExtras(voice->index);
+   if (voice->state == AXVoiceState::Stopped) {
+      extras->numSamples = 0;
+      return;
+   }
 
-      if (voice->state == AXVoiceState::Stopped) {
-         extras->numSamples = 0;
-         continue;
+   extras->numSamples = numSamples;
+   sampleVoice(voice, extras->samples, numSamples);
+   applyADSR(voice, extras->samples, numSamples);
+}
+
+/**
+ * Every voice only reads and writes its own AXVoice and AXVoiceExtras, so
+ * when there are enough of them the voices are decoded across a few host
+ * threads. The thread calling decode takes voices too and returns once all
+ * of them have been decoded and every worker has let go of the voice list.
+ */
+struct VoiceDecodePool
+{
+   static constexpr auto MinParallelVoices = 8u;
+   static constexpr auto MaxThreads = 3u;
+
+   ~VoiceDecodePool()
+   {
+      {
+         auto lock = std::unique_lock { mutex };
+         quit = true;
+      }
+
+      workCondition.notify_all();
+
+      for (auto &thread : threads) {
+         thread.join();
+      }
+   }
+
+   void decode(const std::vector<virt_ptr<AXVoice>> &voices,
+               int numSamples)
+   {
+      if (voices.size() < MinParallelVoices || !startThreads()) {
+         for (auto voice : voices) {
+            decodeVoice(voice, numSamples);
+         }
+
+         return;
+      }
+
+      {
+         auto lock = std::unique_lock { mutex };
+         workVoices = &voices;
+         workNumSamples = numSamples;
+         nextVoice = 0;
+         remainingVoices = voices.size();
+         ++generation;
+      }
+
+      workCondition.notify_all();
+      auto numDecoded = decodeVoices(voices, numSamples);
+
+      // A worker which woke late may still be about to look at the voice
+      // list, so wait for every worker to go idle before dropping it.
+      auto lock = std::unique_lock { mutex };
+      remainingVoices -= numDecoded;
+      doneCondition.wait(lock, [this] {
+         return remainingVoices == 0 && activeWorkers == 0;
+      });
+      workVoices = nullptr;
+   }
+
+private:
+   bool startThreads()
+   {
+      if (!threadsStarted) {
+         auto numThreads = std::min(MaxThreads, std::thread::hardware_concurrency() / 2);
+         for (auto i = 0u; i < numThreads; ++i) {
+            threads.emplace_back([this] { workerThread(); });
+         }
+
+         threadsStarted = true;
       }
 
-      extras->numSamples = numSamples;
-      sampleVoice(voice, extras->samples, numSamples);
-      applyADSR(voice, extras->samples, numSamples);
+      return !threads.empty();
    }
 
+   size_t decodeVoices(const std::vector<virt_ptr<AXVoice>> &voices,
+                       int numSamples)
+   {
+      auto numDecoded = size_t { 0 };
+
+      for (auto i = nextVoice++; i < voices.size(); i = nextVoice++) {
+         decodeVoice(voices[i], numSamples);
+         ++numDecoded;
+      }
+
+      return numDecoded;
+   }
+
+   void workerThread()
+   {
+      auto lastGeneration = uint64_t { 0 };
+
+      while (true) {
+         const std::vector<virt_ptr<AXVoice>> *voices = nullptr;
+         auto numSamples = 0;
+
+         {
+            auto lock = std::unique_lock { mutex };
+            workCondition.wait(lock, [&] {
+               return quit || (workVoices && generation != lastGeneration);
+            });
+
+            if (quit) {
+               return;
+            }
+
+            lastGeneration = generation;
+            voices = workVoices;
+            numSamples = workNumSamples;
+            ++activeWorkers;
+         }
+
+         auto numDecoded = decodeVoices(*voices, numSamples);
+
+         auto lock = std::unique_lock { mutex };
+         remainingVoices -= numDecoded;
+         --activeWorkers;
+
+         if (remainingVoices == 0 && activeWorkers == 0) {
+            doneCondition.notify_all();
+         }
+      }
+   }
+
+   std::mutex mutex;
+   std::condition_variable workCondition;
+   std::condition_variable doneCondition;
+   std::vector<std::thread> threads;
+   bool threadsStarted = false;
+   bool quit = false;
+
+   uint64_t generation = 0;
+   const std::vector<virt_ptr<AXVoice>> *workVoices = nullptr;
+   int workNumSamples = 0;
+   std::atomic<size_t> nextVoice { 0 };
+   size_t remainingVoices = 0;
+   uint32_t activeWorkers = 0;
+};
+
+static VoiceDecodePool
+sVoiceDecodePool;
+
+void
+decodeVoiceSamples(int numSamples)
+{
+   const auto voices = getAcquiredVoices();
+   sVoiceDecodePool.decode(voices, numSamples);
+
    // TODO: Apply Volume Evelope (ADSR)
 
    // TODO: Apply Biquad Filter
@@ -514,9 +665,10 @@ mixDevice(AXDeviceType type, uint16_t numSamples)
                auto &volume = getVoiceMixVolume(extras, type, deviceId, channel, bus);
                auto &out = busSamples[bus][deviceId][channel];
 
-               for (auto i = 0u; i < numSamples; ++i) {
-                  out[i] += extras->samples[i] * volume.volume;
-               }
+               mixSamples(reinterpret_cast<int16_t *>(out),
+                          reinterpret_cast<const int16_t *>(extras->samples),
+                          fixed_to_data(volume.volume),
+                          numSamples);
 
                volume.volume += volume.delta;
             }
@@ -543,9 +695,10 @@ mixDevice(AXDeviceType type, uint16_t numSamples)
          auto subBus = busSamples[bus];
 
          for (auto channel = 0u; channel < numChannels; ++channel) {
-            for (auto i = 0u; i < numSamples; ++i) {
-               mainBus[deviceId][channel][i] += subBus[deviceId][channel][i] * returnVolume;
-            }
+            mixSamples(reinterpret_cast<int16_t *>(mainBus[deviceId][channel]),
+                       reinterpret_cast<const int16_t *>(subBus[deviceId][channel]),
+                       fixed_to_data(returnVolume),
+                       numSamples);
          }
       }
    }
@@ -555,9 +708,9 @@ mixDevice(AXDeviceType type, uint16_t numSamples)
       auto &device = devices->devices[deviceId];
 
       for (auto channel = 0u; channel < numChannels; ++channel) {
-         for (auto i = 0u; i < numSamples; ++i) {
-            mainBus[deviceId][channel][i] = mainBus[deviceId][channel][i] * device.volume;
-         }
+         scaleSamples(reinterpret_cast<int16_t *>(mainBus[deviceId][channel]),
+                      fixed_to_data(device.volume),
+                      numSamples);
       }
    }
 
@@ -0,0 +1,202 @@
+#include "sndcore2_mix.h"
+
+#include <common/platform.h>
+#include <common/platform_intrin.h>
+
+namespace cafe::sndcore2::internal
+{
+
+/*
+For a product p = in * volume split as p = q * 2^15 + r with q = p >> 15 and
+0 <= r < 2^15, (acc * 2^15 + p) / 2^15 truncated towards zero is acc + q,
+plus one when acc + q is negative and r is non zero. This keeps every
+intermediate within 32 bits so the vector versions can use the same steps.
+*/
+
+static inline int16_t
+mixSample(int16_t acc,
+          int16_t in,
+          uint16_t volume)
+{
+   auto product = static_cast<int32_t>(in) * static_cast<int32_t>(volume);
+   auto result = acc + (product >> 15);
+
+   if (result < 0 && (product & 0x7FFF)) {
+      result += 1;
+   }
+
+   return static_cast<int16_t>(result);
+}
+
+#ifdef PLATFORM_HAS_AVX2
+static inline __m256i
+mixSamples16(__m256i acc,
+             __m256i in,
+             __m256i volumeLo,
+             bool volumeHi)
+{
+   // volume = volumeHi * 2^15 + volumeLo, so in * volumeLo fits a signed
+   // 16 bit multiply and the high part is just a shift.
+   auto mulLo = _mm256_mullo_epi16(in, volumeLo);
+   auto mulHi = _mm256_mulhi_epi16(in, volumeLo);
+   auto product0 = _mm256_unpacklo_epi16(mulLo, mulHi);
+   auto product1 = _mm256_unpackhi_epi16(mulLo, mulHi);
+
+   if (volumeHi) {
+      product0 = _mm256_add_epi32(product0,
+         _mm256_slli_epi32(_mm256_srai_epi32(_mm256_unpacklo_epi16(in, in), 16), 15));
+      product1 = _mm256_add_epi32(product1,
+         _mm256_slli_epi32(_mm256_srai_epi32(_mm256_unpackhi_epi16(in, in), 16), 15));
+   }
+
+   auto mask = _mm256_set1_epi32(0x7FFF);
+   auto zero = _mm256_setzero_si256();
+   auto acc0 = _mm256_srai_epi32(_mm256_unpacklo_epi16(acc, acc), 16);
+   auto acc1 = _mm256_srai_epi32(_mm256_unpackhi_epi16(acc, acc), 16);
+   auto result0 = _mm256_add_epi32(acc0, _mm256_srai_epi32(product0, 15));
+   auto result1 = _mm256_add_epi32(acc1, _mm256_srai_epi32(product1, 15));
+
+   // Round towards zero, the compare masks are -1 where true
+   auto round0 = _mm256_andnot_si256(
+      _mm256_cmpeq_epi32(_mm256_and_si256(product0, mask), zero),
+      _mm256_cmpgt_epi32(zero, result0));
+   auto round1 = _mm256_andnot_si256(
+      _mm256_cmpeq_epi32(_mm256_and_si256(product1, mask), zero),
+      _mm256_cmpgt_epi32(zero, result1));
+   result0 = _mm256_sub_epi32(result0, round0);
+   result1 = _mm256_sub_epi32(result1, round1);
+
+   // Wrap to 16 bits then pack, the packs no longer saturate anything
+   result0 = _mm256_srai_epi32(_mm256_slli_epi32(result0, 16), 16);
+   result1 = _mm256_srai_epi32(_mm256_slli_epi32(result1, 16), 16);
+   return _mm256_packs_epi32(result0, result1);
+}
+#endif
+
+#ifdef PLATFORM_HAS_SSE2
+static inline __m128i
+mixSamples8(__m128i acc,
+            __m128i in,
+            __m128i volumeLo,
+            bool volumeHi)
+{
+   auto mulLo = _mm_mullo_epi16(in, volumeLo);
+   auto mulHi = _mm_mulhi_epi16(in, volumeLo);
+   auto product0 = _mm_unpacklo_epi16(mulLo, mulHi);
+   auto product1 = _mm_unpackhi_epi16(mulLo, mulHi);
+
+   if (volumeHi) {
+      product0 = _mm_add_epi32(product0,
+         _mm_slli_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16), 15));
+      product1 = _mm_add_epi32(product1,
+         _mm_slli_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16), 15));
+   }
+
+   auto mask = _mm_set1_epi32(0x7FFF);
+   auto zero = _mm_setzero_si128();
+   auto acc0 = _mm_srai_epi32(_mm_unpacklo_epi16(acc, acc), 16);
+   auto acc1 = _mm_srai_epi32(_mm_unpackhi_epi16(acc, acc), 16);
+   auto result0 = _mm_add_epi32(acc0, _mm_srai_epi32(product0, 15));
+   auto result1 = _mm_add_epi32(acc1, _mm_srai_epi32(product1, 15));
+
+   auto round0 = _mm_andnot_si128(
+      _mm_cmpeq_epi32(_mm_and_si128(product0, mask), zero),
+      _mm_cmplt_epi32(result0, zero));
+   auto round1 = _mm_andnot_si128(
+      _mm_cmpeq_epi32(_mm_and_si128(product1, mask), zero),
+      _mm_cmplt_epi32(result1, zero));
+   result0 = _mm_sub_epi32(result0, round0);
+   result1 = _mm_sub_epi32(result1, round1);
+
+   result0 = _mm_srai_epi32(_mm_slli_epi32(result0, 16), 16);
+   result1 = _mm_srai_epi32(_mm_slli_epi32(result1, 16), 16);
+   return _mm_packs_epi32(result0, result1);
+}
+#endif
+
+void
+mixSamples(int16_t *out,
+           const int16_t *in,
+           uint16_t volume,
+           uint32_t numSamples)
+{
+   auto i = 0u;
+
+   if (volume == 0) {
+      return;
+   }
+
+#ifdef PLATFORM_HAS_AVX2
+   {
+      auto volumeLo = _mm256_set1_epi16(static_cast<int16_t>(volume & 0x7FFF));
+      auto volumeHi = !!(volume & 0x8000);
+
+      for (; i + 16 <= numSamples; i += 16) {
+         auto acc = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(out + i));
+         auto src = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+         _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                             mixSamples16(acc, src, volumeLo, volumeHi));
+      }
+   }
+#endif
+
+#ifdef PLATFORM_HAS_SSE2
+   {
+      auto volumeLo = _mm_set1_epi16(static_cast<int16_t>(volume & 0x7FFF));
+      auto volumeHi = !!(volume & 0x8000);
+
+      for (; i + 8 <= numSamples; i += 8) {
+         auto acc = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out + i));
+         auto src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+         _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                          mixSamples8(acc, src, volumeLo, volumeHi));
+      }
+   }
+#endif
+
+   for (; i < numSamples; ++i) {
+      out[i] = mixSample(out[i], in[i], volume);
+   }
+}
+
+void
+scaleSamples(int16_t *samples,
+             uint16_t volume,
+             uint32_t numSamples)
+{
+   auto i = 0u;
+
+#ifdef PLATFORM_HAS_AVX2
+   {
+      auto volumeLo = _mm256_set1_epi16(static_cast<int16_t>(volume & 0x7FFF));
+      auto volumeHi = !!(volume & 0x8000);
+      auto zero = _mm256_setzero_si256();
+
+      for (; i + 16 <= numSamples; i += 16) {
+         auto src = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(samples + i));
+         _mm256_storeu_si256(reinterpret_cast<__m256i *>(samples + i),
+                             mixSamples16(zero, src, volumeLo, volumeHi));
+      }
+   }
+#endif
+
+#ifdef PLATFORM_HAS_SSE2
+   {
+      auto volumeLo = _mm_set1_epi16(static_cast<int16_t>(volume & 0x7FFF));
+      auto volumeHi = !!(volume & 0x8000);
+      auto zero = _mm_setzero_si128();
+
+      for (; i + 8 <= numSamples; i += 8) {
+         auto src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + i));
+         _mm_storeu_si128(reinterpret_cast<__m128i *>(samples + i),
+                          mixSamples8(zero, src, volumeLo, volumeHi));
+      }
+   }
+#endif
+
+   for (; i < numSamples; ++i) {
+      samples[i] = mixSample(0, samples[i], volume);
+   }
+}
+
+} // namespace cafe::sndcore2::internal
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+
+namespace cafe::sndcore2::internal
+{
+
+/*
+Sample kernels for the mixer operating on raw Q15 samples and Q1.15 volumes.
+These compute exactly what the equivalent fixed_point expressions do:
+
+   mixSamples:   out[i] += in[i] * volume
+   scaleSamples: samples[i] = samples[i] * volume
+
+The Q30 product is truncated towards zero when converted back to Q15 and
+the result wraps to 16 bits.
+*/
+
+void
+mixSamples(int16_t *out,
+           const int16_t *in,
+           uint16_t volume,
+           uint32_t numSamples);
+
+void
+scaleSamples(int16_t *samples,
+             uint16_t volume,
+             uint32_t numSamples);
+
+} // namespace cafe::sndcore2::internal
@@ -13,6 +13,7 @@
 #include "cafe_loader_minfileinfo.h"
 #include "cafe_loader_utils.h"
 #include "cafe/cafe_stackobject.h"
+#include "cafe/kernel/cafe_kernel_symbolindex.h"
 
 #include <libcpu/cpu_formatters.h>
 
@@ -116,6 +117,8 @@ LOADER_Init(kernel::UniqueProcessId upid,
    globals->availableCodeSize = maxCodeSize - trackingBlockSize;
    globals->userHasControl = FALSE;
    globals->firstLoadedRpl = nullptr;
+   kernel::internal::resetSymbolIndex(
+      kernel::getRamPartitionIdFromUniqueProcessId(upid));
    globals->lastLoadedRpl = nullptr;
    globals->loadedRpx = nullptr;
 
@@ -324,6 +327,8 @@ LOADER_Init(kernel::UniqueProcessId upid,
    Loader_LogEntry(2, 1, 1024, "LOADER_Init");
 
    for (auto module = globals->firstLoadedRpl; module; module = module->nextLoadedRpl) {
+      kernel::internal::addModuleSymbolIndex(
+         kernel::getRamPartitionIdFromUniqueProcessId(upid), module);
       gLog->debug("Loaded module {}", module->moduleNameBuffer);
       for (auto i = 0u; i < module->elfHeader.shnum; ++i) {
          auto size = 0u;
@@ -9,6 +9,7 @@
 #include "cafe_loader_reloc.h"
 #include "cafe_loader_query.h"
 #include "cafe_loader_utils.h"
+#include "cafe/kernel/cafe_kernel_symbolindex.h"
 
 #include <algorithm>
 #include <cctype>
@@ -266,6 +267,9 @@ sSetLinkOutput(virt_ptr<LOADER_LinkInfo> linkInfo,
       linkOutput.loadAddr = linkModule->loadAddr;
       linkOutput.loadOffset = linkModule->loadOffset;
       linkOutput.loadSize = linkModule->loadSize;
+      kernel::internal::addModuleSymbolIndex(
+         kernel::getRamPartitionIdFromUniqueProcessId(getGlobalStorage()->currentUpid),
+         linkModule);
    }
 }
 
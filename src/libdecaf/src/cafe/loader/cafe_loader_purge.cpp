@@ -3,6 +3,7 @@
 #include "cafe_loader_log.h"
 #include "cafe_loader_loaded_rpl.h"
 #include "cafe_loader_purge.h"
+#include "cafe/kernel/cafe_kernel_symbolindex.h"
 
 namespace cafe::loader::internal
 {
@@ -16,6 +17,9 @@ LiPurgeOneUnlinkedModule(virt_ptr<LOADED_RPL> rpl)
       return;
    }
 
+   kernel::internal::removeModuleSymbolIndex(
+      kernel::getRamPartitionIdFromUniqueProcessId(globals->currentUpid), rpl);
+
    if (!(rpl->loadStateFlags & LoaderStateFlags_Unk0x20000000)) {
       if (rpl->textBuffer) {
          LiCacheLineCorrectFreeEx(globals->processCodeHeap,
@@ -4,6 +4,7 @@
 #include "cafe_loader_iop.h"
 #include "cafe_loader_loaded_rpl.h"
 #include "cafe_loader_reloc.h"
+#include "cafe_loader_reloccache.h"
 #include "cafe_loader_rpl.h"
 #include "cafe_loader_log.h"
 #include "cafe_loader_globals.h"
@@ -11,17 +12,21 @@
 
 #include "cafe/libraries/cafe_hle.h"
 
+#include <algorithm>
+#include <atomic>
+#include <common/datahash.h>
 #include <libcpu/be2_struct.h>
 #include <libcpu/cpu_formatters.h>
 #include <libcpu/espresso/espresso_instructionset.h>
 #include <libcpu/espresso/espresso_spr.h>
+#include <thread>
+#include <vector>
 #include <zlib.h>
 
 namespace cafe::loader::internal
 {
 
 constexpr auto TrampSize = uint32_t { 16 };
-static std::array<uint8_t, 0x1FF8> sRelocBuffer;
 
 static virt_ptr<rpl::Export>
 LiBinSearchExport(virt_ptr<rpl::Export> exports,
@@ -376,7 +381,8 @@ sExecReloc(virt_ptr<LOADED_RPL> rpl,
            uint32_t *preTrampBufferSize,
            virt_addr *postTrampBuffer,
            uint32_t *postTrampBufferSize,
-           virt_ptr<LiImportTracking> imports)
+           virt_ptr<LiImportTracking> imports,
+           const InflatedRelocations *inflated)
 {
    if (sectionHeader->info >= rpl->elfHeader.shnum ||
        !rpl->sectionAddressBuffer[sectionHeader->info]) {
@@ -442,224 +448,176 @@ sExecReloc(virt_ptr<LOADED_RPL> rpl,
       return 0;
    }
 
-   auto stream = z_stream { };
-   std::memset(&stream, 0, sizeof(stream));
+   auto relas = virt_cast<rpl::Rela *>(relaSectionAddress).get();
+   auto zlibError = Z_STREAM_END;
 
    if (sectionHeader->flags & rpl::SHF_DEFLATED) {
-      auto zlibError = inflateInit(&stream);
-      if (zlibError != Z_OK) {
+      decaf_check(inflated);
+
+      switch (inflated->initError) {
+      case Z_OK:
+         break;
+      case Z_STREAM_ERROR:
+         LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 186);
+         Loader_ReportError("*** sExecReloc: could not initialize ZLIB uncompressor; ZLIB err = {}.",
+                            Error::ZlibStreamError);
+         return Error::ZlibStreamError;
+      case Z_MEM_ERROR:
+         LiSetFatalError(0x187298u, rpl->fileType, 0, "sExecReloc", 178);
+         Loader_ReportError("*** sExecReloc: could not initialize ZLIB uncompressor; ZLIB err = {}.",
+                            Error::ZlibMemError);
+         return Error::ZlibMemError;
+      case Z_VERSION_ERROR:
+         LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 182);
+         Loader_ReportError("*** sExecReloc: could not initialize ZLIB uncompressor; ZLIB err = {}.",
+                            Error::ZlibVersionError);
+         return Error::ZlibVersionError;
+      default:
+         LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 191);
+         Loader_ReportError("***Unknown ZLIB error {} (0x{:08X}).",
+                            inflated->initError, inflated->initError);
+         return Error::ZlibUnknownError;
+      }
+
+      zlibError = inflated->zlibError;
+      if (zlibError != Z_BUF_ERROR &&
+         (zlibError < Z_OK || zlibError == Z_NEED_DICT)) {
+         auto error = 0;
+
          switch (zlibError) {
-         case Z_STREAM_ERROR:
-            LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 186);
-            Loader_ReportError("*** sExecReloc: could not initialize ZLIB uncompressor; ZLIB err = {}.",
-                               Error::ZlibStreamError);
-            return Error::ZlibStreamError;
          case Z_MEM_ERROR:
-            LiSetFatalError(0x187298u, rpl->fileType, 0, "sExecReloc", 178);
-            Loader_ReportError("*** sExecReloc: could not initialize ZLIB uncompressor; ZLIB err = {}.",
-                               Error::ZlibMemError);
-            return Error::ZlibMemError;
-         case Z_VERSION_ERROR:
-            LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 182);
-            Loader_ReportError("*** sExecReloc: could not initialize ZLIB uncompressor; ZLIB err = {}.",
-                               Error::ZlibVersionError);
-            return Error::ZlibVersionError;
+            LiSetFatalError(0x187298u, rpl->fileType, 0, "sExecReloc", 236);
+            error = Error::ZlibMemError;
+            break;
+         case Z_NEED_DICT:
+            zlibError = Z_DATA_ERROR;
+            // fallthrough
+         case Z_DATA_ERROR:
+            LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 240);
+            error = Error::ZlibDataError;
+            break;
+         case Z_STREAM_ERROR:
+            LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 244);
+            error = Error::ZlibStreamError;
+            break;
          default:
             LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 191);
-            Loader_ReportError("***Unknown ZLIB error {} (0x{:08X}).", zlibError, zlibError);
-            return Error::ZlibUnknownError;
+            error = Error::ZlibUnknownError;
+            break;
          }
+
+         Loader_ReportError("*** sExecReloc: unable to uncompress relocation section; ZLIB err = {}.",
+                            zlibError);
+         return error;
+      }
+
+      if (inflated->availOut) {
+         Loader_ReportError("*** sExecReloc: ZLIB inflate's avail_out is {}, expected 0; err = {}.",
+                            inflated->availOut, -470055);
+         LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 254);
+         return -470055;
       }
 
-      stream.avail_in = sectionHeader->size;
-      stream.next_in = virt_cast<Bytef *>(relaSectionAddress + 4).get();
+      relas = reinterpret_cast<rpl::Rela *>(const_cast<uint8_t *>(inflated->data.data()));
    }
 
-   auto remainingBytes = relaSectionSize;
-   auto remainingRela = relaCount;
-   auto zlibError = Z_STREAM_END;
+   auto error = 0;
+   for (auto relaIndex = 0u; relaIndex < relaCount; ++relaIndex) {
+      auto &rela = relas[relaIndex];
+      auto symbolIndex = rela.info >> 8;
+      auto relaType = static_cast<rpl::RelocationType>(rela.info & 0xFF);
 
-   while (remainingBytes > 0) {
-      // Read whole shit
-      auto availableBytes = remainingBytes;
-      auto relas = virt_cast<rpl::Rela *>(relaSectionAddress).get();
-      auto error = 0;
-
-      if (sectionHeader->flags & rpl::SHF_DEFLATED) {
-         availableBytes = std::min<uInt>(remainingBytes, static_cast<uInt>(sRelocBuffer.size()));
-         stream.avail_out = availableBytes;
-         stream.next_out = reinterpret_cast<Bytef *>(sRelocBuffer.data());
-
-         LiCheckAndHandleInterrupts();
-         zlibError = inflate(&stream, Z_NO_FLUSH);
-         if (zlibError != Z_BUF_ERROR &&
-            (zlibError < Z_OK || zlibError == Z_NEED_DICT)) {
-            switch (zlibError) {
-            case Z_MEM_ERROR:
-               LiSetFatalError(0x187298u, rpl->fileType, 0, "sExecReloc", 236);
-               error = Error::ZlibMemError;
-               break;
-            case Z_NEED_DICT:
-               zlibError = Z_DATA_ERROR;
-               // fallthrough
-            case Z_DATA_ERROR:
-               LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 240);
-               error = Error::ZlibDataError;
-               break;
-            case Z_STREAM_ERROR:
-               LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 244);
-               error = Error::ZlibStreamError;
-               break;
-            default:
-               LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 191);
-               error = Error::ZlibUnknownError;
-               break;
-            }
+      LiCheckAndHandleInterrupts();
 
-            Loader_ReportError("*** sExecReloc: unable to uncompress relocation section; ZLIB err = {}.",
-                               zlibError);
-            inflateEnd(&stream);
-            return error;
-         }
+      if (symbolIndex > symbolCount) {
+         Loader_ReportError(
+            "***{} Rel invalid: rel ix {}, ref sym ix {}, max is {}. type {}",
+            sectionIndex,
+            relaIndex,
+            symbolIndex,
+            symbolCount,
+            static_cast<int>(relaType));
+         Loader_ReportError("*** r_info 0x{:08X}\n", rela.offset);
+         Loader_ReportError("*** r_addend 0x{:08X}\n", rela.addend);
+         Loader_ReportError("*** r_offset 0x{:08X}\n", rela.offset);
+         LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 286);
+         error = -470005;
+         break;
+      }
 
-         if (stream.avail_out) {
-            Loader_ReportError("*** sExecReloc: ZLIB inflate's avail_out is {}, expected 0; err = {}.",
-                               stream.avail_out, -470055);
-            LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 254);
-            inflateEnd(&stream);
-            return -470055;
-         }
+      auto symbol = virt_cast<rpl::Symbol *>(symbolSection + symbolIndex * symbolSectionEntSize);
+      auto symbolValue = symbol->value;
+      auto symbolBinding = symbol->info >> 4;
+      auto symbolType = symbol->info & 0xf;
+
+      if ((symbolValue & 0xFF000000) == 0xCD000000) {
+         if (symbolBinding != rpl::STB_WEAK) {
+            if (symbolStringTable) {
+               Loader_ReportError(
+                  "***Rel invalid: sym ix {} val 0x{:08X} \"{}\"",
+                  symbolIndex, symbolValue, symbolStringTable + symbol->name);
+            } else {
+               Loader_ReportError(
+                  "***Rel invalid: sym ix {} val 0x{:08X}",
+                  symbolIndex, symbolValue);
+            }
 
-         if (stream.total_out != sizeof(rpl::Rela) * (stream.total_out / sizeof(rpl::Rela))) {
-            Loader_ReportError(
-               "*** sExecReloc: inflate did not read a multiple of sizeof(ELF32_RELOC_ADD); err = {}.",
-               -470055);
-            LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 261);
-            inflateEnd(&stream);
-            return -470055;
+            LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 308);
+            error = -470006;
+            break;
+         } else {
+            symbolValue = 0u;
          }
+      }
 
-         relas = reinterpret_cast<rpl::Rela *>(sRelocBuffer.data());
-      }
-
-      auto availableRela = availableBytes / sizeof(rpl::Rela);
-      for (auto relaIndex = 0u; relaIndex < availableRela; ++relaIndex) {
-         auto &rela = relas[relaIndex];
-         auto symbolIndex = rela.info >> 8;
-         auto relaType = static_cast<rpl::RelocationType>(rela.info & 0xFF);
-
-         LiCheckAndHandleInterrupts();
-
-         if (symbolIndex > symbolCount) {
-            Loader_ReportError(
-               "***{} Rel invalid: rel ix {}, ref sym ix {}, max is {}. type {}",
-               sectionIndex,
-               relaIndex,
-               symbolIndex,
-               symbolCount,
-               static_cast<int>(relaType));
-            Loader_ReportError("*** r_info 0x{:08X}\n", rela.offset);
-            Loader_ReportError("*** r_addend 0x{:08X}\n", rela.addend);
-            Loader_ReportError("*** r_offset 0x{:08X}\n", rela.offset);
-            LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 286);
-            error = -470005;
+      auto tlsModuleIndex = -1;
+      if (relaType == rpl::R_PPC_DTPMOD32 || relaType == rpl::R_PPC_DTPREL32) {
+         if (symbolType != rpl::STT_TLS) {
+            Loader_ReportError("***TLS relocation used with non-TLS symbol 0x{:08X}", symbolValue);
+            LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 349);
+            error = -470065;
             break;
          }
 
-         auto symbol = virt_cast<rpl::Symbol *>(symbolSection + symbolIndex * symbolSectionEntSize);
-         auto symbolValue = symbol->value;
-         auto symbolBinding = symbol->info >> 4;
-         auto symbolType = symbol->info & 0xf;
-
-         if ((symbolValue & 0xFF000000) == 0xCD000000) {
-            if (symbolBinding != rpl::STB_WEAK) {
-               if (symbolStringTable) {
-                  Loader_ReportError(
-                     "***Rel invalid: sym ix {} val 0x{:08X} \"{}\"",
-                     symbolIndex, symbolValue, symbolStringTable + symbol->name);
-               } else {
-                  Loader_ReportError(
-                     "***Rel invalid: sym ix {} val 0x{:08X}",
-                     symbolIndex, symbolValue);
-               }
-
-               LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 308);
-               error = -470006;
+         if (imports && imports[symbol->shndx].numExports) {
+            tlsModuleIndex = imports[symbol->shndx].tlsModuleIndex;
+            if (tlsModuleIndex == -1) {
+               Loader_ReportError("***TLS relocation used with non-TLS import module 0x{:08X}.", symbolValue);
+               LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 327);
+               error = -470101;
                break;
-            } else {
-               symbolValue = 0u;
             }
-         }
-
-         auto tlsModuleIndex = -1;
-         if (relaType == rpl::R_PPC_DTPMOD32 || relaType == rpl::R_PPC_DTPREL32) {
-            if (symbolType != rpl::STT_TLS) {
-               Loader_ReportError("***TLS relocation used with non-TLS symbol 0x{:08X}", symbolValue);
-               LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 349);
-               error = -470065;
+         } else {
+            tlsModuleIndex = rpl->fileInfoBuffer->tlsModuleIndex;
+            if (tlsModuleIndex == -1) {
+               Loader_ReportError("***TLS relocation used with non-TLS module 0x{:08X}.", symbolValue);
+               LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 339);
+               error = -470102;
                break;
             }
-
-            if (imports && imports[symbol->shndx].numExports) {
-               tlsModuleIndex = imports[symbol->shndx].tlsModuleIndex;
-               if (tlsModuleIndex == -1) {
-                  Loader_ReportError("***TLS relocation used with non-TLS import module 0x{:08X}.", symbolValue);
-                  LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 327);
-                  error = -470101;
-                  break;
-               }
-            } else {
-               tlsModuleIndex = rpl->fileInfoBuffer->tlsModuleIndex;
-               if (tlsModuleIndex == -1) {
-                  Loader_ReportError("***TLS relocation used with non-TLS module 0x{:08X}.", symbolValue);
-                  LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 339);
-                  error = -470102;
-                  break;
-               }
-            }
-         }
-
-         error = LiCpu_RelocAdd(isRpx,
-                                targetSectionBuffer,
-                                relaType,
-                                symbolBinding == rpl::STB_WEAK,
-                                rela.offset - targetSectionVirtualAddress,
-                                rela.addend,
-                                symbolValue,
-                                preTrampBuffer,
-                                preTrampBufferSize,
-                                postTrampBuffer,
-                                postTrampBufferSize,
-                                tlsModuleIndex,
-                                rpl->fileType);
-         if (error) {
-            break;
          }
-
-         --remainingRela;
       }
 
+      error = LiCpu_RelocAdd(isRpx,
+                             targetSectionBuffer,
+                             relaType,
+                             symbolBinding == rpl::STB_WEAK,
+                             rela.offset - targetSectionVirtualAddress,
+                             rela.addend,
+                             symbolValue,
+                             preTrampBuffer,
+                             preTrampBufferSize,
+                             postTrampBuffer,
+                             postTrampBufferSize,
+                             tlsModuleIndex,
+                             rpl->fileType);
       if (error) {
-         if (sectionHeader->flags & rpl::SHF_DEFLATED) {
-            inflateEnd(&stream);
-         }
-
-         return error;
+         break;
       }
-
-      remainingBytes -= availableBytes;
-   }
-
-   if (sectionHeader->flags & rpl::SHF_DEFLATED) {
-      inflateEnd(&stream);
    }
 
-   if (remainingRela) {
-      Loader_ReportError(
-         "*** sExecReloc: not all relocations were uncompressed; err = {}.",
-         -470053);
-      LiSetFatalError(0x18729Bu, rpl->fileType, 1, "sExecReloc", 379);
-      return -470053;
+   if (error) {
+      return error;
    }
 
    if (zlibError != Z_STREAM_END) {
@@ -674,6 +632,237 @@ sExecReloc(virt_ptr<LOADED_RPL> rpl,
    return 0;
 }
 
+static void
+sInflateRelocations(const uint8_t *src,
+                    uint32_t srcSize,
+                    uint32_t inflatedSize,
+                    InflatedRelocations &out)
+{
+   auto stream = z_stream { };
+   std::memset(&stream, 0, sizeof(stream));
+
+   out.initError = inflateInit(&stream);
+   if (out.initError != Z_OK) {
+      return;
+   }
+
+   out.data.resize(inflatedSize);
+   stream.avail_in = srcSize;
+   stream.next_in = const_cast<Bytef *>(src);
+   stream.avail_out = inflatedSize;
+   stream.next_out = reinterpret_cast<Bytef *>(out.data.data());
+
+   out.zlibError = inflate(&stream, Z_NO_FLUSH);
+   out.availOut = stream.avail_out;
+   inflateEnd(&stream);
+}
+
+/**
+ * Inflate every deflated relocation section of a module on up to maxWorkers
+ * threads, the relocations themselves are still applied in order by
+ * sExecReloc as trampoline allocation depends on it.
+ */
+std::vector<InflatedRelocations>
+LiInflateRelocationSections(virt_ptr<LOADED_RPL> rpl,
+                            uint32_t maxWorkers)
+{
+   struct PendingInflate
+   {
+      const uint8_t *src;
+      uint32_t srcSize;
+      uint32_t inflatedSize;
+      InflatedRelocations *out;
+   };
+
+   auto inflated = std::vector<InflatedRelocations> { };
+   auto pending = std::vector<PendingInflate> { };
+   inflated.resize(rpl->elfHeader.shnum);
+
+   for (auto i = 1u; i < static_cast<unsigned int>(rpl->elfHeader.shnum - 2); ++i) {
+      auto sectionHeader = getSectionHeader(rpl, i);
+      auto sectionAddress = rpl->sectionAddressBuffer[i];
+      if (sectionHeader->type != rpl::SHT_RELA ||
+          !(sectionHeader->flags & rpl::SHF_DEFLATED) ||
+          !sectionAddress) {
+         continue;
+      }
+
+      auto inflatedSize = *virt_cast<uint32_t *>(sectionAddress);
+      if (inflatedSize % sizeof(rpl::Rela)) {
+         // sExecReloc will report this
+         continue;
+      }
+
+      pending.push_back({
+         virt_cast<const uint8_t *>(sectionAddress + 4).get(),
+         static_cast<uint32_t>(sectionHeader->size),
+         static_cast<uint32_t>(inflatedSize),
+         &inflated[i]
+      });
+   }
+
+   auto numWorkers = std::min<size_t>({
+      static_cast<size_t>(std::max(1u, maxWorkers)),
+      static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency())),
+      pending.size()
+   });
+
+   // The calling thread is one of the workers
+   auto nextPending = std::atomic<size_t> { 0 };
+   auto worker = [&]() {
+      for (auto i = nextPending++; i < pending.size(); i = nextPending++) {
+         auto &task = pending[i];
+         sInflateRelocations(task.src, task.srcSize, task.inflatedSize, *task.out);
+      }
+   };
+
+   auto threads = std::vector<std::thread> { };
+   for (auto i = size_t { 1 }; i < numWorkers; ++i) {
+      threads.emplace_back(worker);
+   }
+
+   worker();
+
+   for (auto &thread : threads) {
+      thread.join();
+   }
+
+   return inflated;
+}
+
+/**
+ * The memory written by relocation: the text buffer, which holds the
+ * trampolines, and any other section targeted by a relocation section.
+ */
+static std::vector<RelocCacheRange>
+sGetRelocatedRanges(virt_ptr<LOADED_RPL> rpl)
+{
+   auto ranges = std::vector<RelocCacheRange> { };
+   auto textStart = virt_cast<virt_addr>(rpl->textBuffer);
+   auto textEnd = textStart + rpl->textBufferSize;
+
+   if (textStart) {
+      ranges.push_back({ textStart, rpl->textBufferSize });
+   }
+
+   for (auto i = 1u; i < static_cast<unsigned int>(rpl->elfHeader.shnum - 2); ++i) {
+      auto sectionHeader = getSectionHeader(rpl, i);
+      if (sectionHeader->type != rpl::SHT_RELA ||
+          sectionHeader->info >= rpl->elfHeader.shnum) {
+         continue;
+      }
+
+      auto targetAddress = rpl->sectionAddressBuffer[sectionHeader->info];
+      auto targetSize = getSectionHeader(rpl, sectionHeader->info)->size;
+      if (!targetAddress || !targetSize ||
+          (textStart && targetAddress >= textStart && targetAddress < textEnd)) {
+         continue;
+      }
+
+      auto duplicate = std::any_of(ranges.begin(), ranges.end(),
+                                   [&](const RelocCacheRange &range) {
+                                      return range.start == targetAddress;
+                                   });
+      if (!duplicate) {
+         ranges.push_back({ targetAddress, targetSize });
+      }
+   }
+
+   return ranges;
+}
+
+/**
+ * Hashes a stream of relocation inputs into a RelocCacheKey. Unlike DataHash
+ * the hashes depend on the order of the writes, and two independent hashes
+ * plus the total size are kept so an accidental collision between two
+ * modules would have to match all three.
+ */
+class RelocInputHash
+{
+public:
+   RelocInputHash()
+   {
+      XXH64_reset(&mHash, 0);
+      XXH32_reset(&mCheck, 0x52454C41);
+   }
+
+   void write(const void *data, size_t size)
+   {
+      XXH64_update(&mHash, data, size);
+      XXH32_update(&mCheck, data, size);
+      mSize += size;
+   }
+
+   template<typename Type>
+   void write(const Type &value)
+   {
+      static_assert(std::is_trivially_copyable<Type>::value,
+                    "Hashed types must be trivial");
+      write(&value, sizeof(Type));
+   }
+
+   RelocCacheKey key()
+   {
+      return { XXH64_digest(&mHash), XXH32_digest(&mCheck), mSize };
+   }
+
+private:
+   XXH64_state_t mHash;
+   XXH32_state_t mCheck;
+   uint64_t mSize = 0;
+};
+
+/**
+ * Hash everything which relocation reads, so two modules with the same key
+ * produce identical relocated memory.
+ */
+static RelocCacheKey
+sHashRelocationInputs(virt_ptr<LOADED_RPL> rpl,
+                      bool isRpx,
+                      virt_ptr<LiImportTracking> imports,
+                      const std::vector<RelocCacheRange> &ranges)
+{
+   auto hash = RelocInputHash { };
+   auto shnum = static_cast<uint32_t>(rpl->elfHeader.shnum);
+   hash.write(isRpx);
+   hash.write(shnum);
+   hash.write(static_cast<uint32_t>(rpl->postTrampBuffer));
+   hash.write(static_cast<uint32_t>(rpl->fileInfoBuffer->trampAdjust));
+   hash.write(static_cast<uint32_t>(rpl->fileInfoBuffer->textSize));
+   hash.write(static_cast<int32_t>(rpl->fileInfoBuffer->tlsModuleIndex));
+
+   if (isRpx) {
+      hash.write(static_cast<uint32_t>(getGlobalStorage()->sdaBase));
+      hash.write(static_cast<uint32_t>(getGlobalStorage()->sda2Base));
+   }
+
+   for (auto i = 0u; i < shnum; ++i) {
+      auto sectionHeader = getSectionHeader(rpl, i);
+      auto sectionAddress = rpl->sectionAddressBuffer[i];
+      hash.write(sectionHeader.get(), sizeof(rpl::SectionHeader));
+      hash.write(static_cast<uint32_t>(sectionAddress));
+
+      if (imports) {
+         hash.write(static_cast<uint32_t>(imports[i].numExports));
+         hash.write(static_cast<uint32_t>(imports[i].tlsModuleIndex));
+      }
+
+      if (sectionAddress &&
+          (sectionHeader->type == rpl::SHT_SYMTAB ||
+           sectionHeader->type == rpl::SHT_RELA)) {
+         hash.write(virt_cast<const uint8_t *>(sectionAddress).get(),
+                    sectionHeader->size);
+      }
+   }
+
+   for (auto &range : ranges) {
+      hash.write(static_cast<uint32_t>(range.start));
+      hash.write(virt_cast<const uint8_t *>(range.start).get(), range.size);
+   }
+
+   return hash.key();
+}
+
 int32_t
 LiFixupRelocOneRPL(virt_ptr<LOADED_RPL> rpl,
                    virt_ptr<LiImportTracking> imports,
@@ -706,22 +895,42 @@ LiFixupRelocOneRPL(virt_ptr<LOADED_RPL> rpl,
 
    auto textMax = rpl->postTrampBuffer + (postTrampAvailable * TrampSize);
 
-   // Apply relocations
-   for (auto i = 1u; i < static_cast<unsigned int>(rpl->elfHeader.shnum - 2); ++i) {
-      auto sectionHeader = getSectionHeader(rpl, i);
-      if (sectionHeader->type == rpl::SHT_RELA) {
-         if (auto error = sExecReloc(rpl,
-                                     isRpx,
-                                     i,
-                                     sectionHeader,
-                                     &preTrampNext,
-                                     &preTrampAvailable,
-                                     &postTrampNext,
-                                     &postTrampAvailable,
-                                     imports)) {
-            return error;
+   // Apply relocations, or copy the result of a previous identical link
+   // from the relocation cache.
+   auto relocCacheKey = RelocCacheKey { };
+   auto relocCacheRanges = std::vector<RelocCacheRange> { };
+   auto relocCacheHit = false;
+
+   if (isRelocCacheEnabled()) {
+      relocCacheRanges = sGetRelocatedRanges(rpl);
+      relocCacheKey = sHashRelocationInputs(rpl, isRpx, imports, relocCacheRanges);
+      relocCacheHit = loadRelocCache(relocCacheKey, relocCacheRanges);
+   }
+
+   if (!relocCacheHit) {
+      auto inflated = LiInflateRelocationSections(rpl, MaxRelocationInflateWorkers);
+
+      for (auto i = 1u; i < static_cast<unsigned int>(rpl->elfHeader.shnum - 2); ++i) {
+         auto sectionHeader = getSectionHeader(rpl, i);
+         if (sectionHeader->type == rpl::SHT_RELA) {
+            if (auto error = sExecReloc(rpl,
+                                        isRpx,
+                                        i,
+                                        sectionHeader,
+                                        &preTrampNext,
+                                        &preTrampAvailable,
+                                        &postTrampNext,
+                                        &postTrampAvailable,
+                                        imports,
+                                        &inflated[i])) {
+               return error;
+            }
          }
       }
+
+      if (isRelocCacheEnabled()) {
+         saveRelocCache(relocCacheKey, relocCacheRanges);
+      }
    }
 
    // Flush the code cache
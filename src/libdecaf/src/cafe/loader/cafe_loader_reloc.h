@@ -2,6 +2,8 @@
 #include "cafe_loader_basics.h"
 #include "cafe_loader_rpl.h"
 #include <libcpu/be2_struct.h>
+#include <vector>
+#include <zlib.h>
 
 namespace cafe::loader::internal
 {
@@ -19,6 +21,22 @@ CHECK_OFFSET(LiImportTracking, 0x08, tlsModuleIndex);
 CHECK_OFFSET(LiImportTracking, 0x0C, rpl);
 CHECK_SIZE(LiImportTracking, 0x10);
 
+//! Upper bound on the threads used to inflate a module's relocations.
+constexpr auto MaxRelocationInflateWorkers = 4u;
+
+//! A deflated relocation section, inflated ahead of sExecReloc.
+struct InflatedRelocations
+{
+   int initError = Z_OK;
+   int zlibError = Z_STREAM_END;
+   uInt availOut = 0;
+   std::vector<uint8_t> data;
+};
+
+std::vector<InflatedRelocations>
+LiInflateRelocationSections(virt_ptr<LOADED_RPL> rpl,
+                            uint32_t maxWorkers);
+
 int32_t
 LiFixupRelocOneRPL(virt_ptr<LOADED_RPL> rpl,
                    virt_ptr<LiImportTracking> imports,
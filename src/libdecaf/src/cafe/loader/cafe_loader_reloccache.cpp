@@ -0,0 +1,153 @@
+#include "cafe_loader_reloccache.h"
+#include "decaf_config.h"
+
+#include <common/log.h>
+#include <cstring>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+
+namespace cafe::loader::internal
+{
+
+/*
+The relocation cache stores the contents of every range written by
+LiFixupRelocOneRPL, keyed by everything relocation reads: the section headers
+and load addresses, the fixed up symbol tables, the relocation sections and
+the contents of the ranges before relocation. The key holds two independent
+hashes of those inputs and their total size, all three are checked on load.
+
+File layout, all little endian:
+  RelocCacheHeader
+  numRanges * { uint32_t start, uint32_t size, uint8_t data[size] }
+*/
+
+static constexpr uint32_t RelocCacheMagic = 0x43524C52; // "RLRC"
+static constexpr uint32_t RelocCacheVersion = 2;
+
+struct RelocCacheHeader
+{
+   uint32_t magic;
+   uint32_t version;
+   uint64_t keyHash;
+   uint64_t keySize;
+   uint32_t keyCheck;
+   uint32_t numRanges;
+};
+
+static std::filesystem::path
+getRelocCachePath(const RelocCacheKey &key)
+{
+   return std::filesystem::path { decaf::config()->system.rpl_cache_path } /
+          fmt::format("{:016X}{:08X}.bin", key.hash, key.check);
+}
+
+bool
+isRelocCacheEnabled()
+{
+   return !decaf::config()->system.rpl_cache_path.empty();
+}
+
+bool
+loadRelocCache(const RelocCacheKey &key,
+               const std::vector<RelocCacheRange> &ranges)
+{
+   auto path = getRelocCachePath(key);
+   auto file = std::ifstream { path, std::ifstream::binary };
+   if (!file.is_open()) {
+      return false;
+   }
+
+   auto header = RelocCacheHeader { };
+   file.read(reinterpret_cast<char *>(&header), sizeof(header));
+   if (!file ||
+       header.magic != RelocCacheMagic ||
+       header.version != RelocCacheVersion ||
+       header.keyHash != key.hash ||
+       header.keyCheck != key.check ||
+       header.keySize != key.size ||
+       header.numRanges != ranges.size()) {
+      return false;
+   }
+
+   // Read everything before touching guest memory so a truncated file can
+   // not leave a module half relocated.
+   auto data = std::vector<std::vector<char>> { };
+   data.resize(ranges.size());
+
+   for (auto i = 0u; i < ranges.size(); ++i) {
+      uint32_t start, size;
+      file.read(reinterpret_cast<char *>(&start), sizeof(start));
+      file.read(reinterpret_cast<char *>(&size), sizeof(size));
+
+      if (!file ||
+          start != static_cast<uint32_t>(ranges[i].start) ||
+          size != ranges[i].size) {
+         return false;
+      }
+
+      data[i].resize(size);
+      file.read(data[i].data(), size);
+      if (!file) {
+         return false;
+      }
+   }
+
+   for (auto i = 0u; i < ranges.size(); ++i) {
+      std::memcpy(virt_cast<char *>(ranges[i].start).get(),
+                  data[i].data(), data[i].size());
+   }
+
+   return true;
+}
+
+void
+saveRelocCache(const RelocCacheKey &key,
+               const std::vector<RelocCacheRange> &ranges)
+{
+   auto path = getRelocCachePath(key);
+   auto tmpPath = path;
+   tmpPath += ".tmp";
+
+   auto error = std::error_code { };
+   std::filesystem::create_directories(path.parent_path(), error);
+
+   {
+      auto file = std::ofstream { tmpPath, std::ofstream::binary };
+      if (!file.is_open()) {
+         gLog->warn("Could not open relocation cache file {}", tmpPath.string());
+         return;
+      }
+
+      auto header = RelocCacheHeader { };
+      header.magic = RelocCacheMagic;
+      header.version = RelocCacheVersion;
+      header.keyHash = key.hash;
+      header.keySize = key.size;
+      header.keyCheck = key.check;
+      header.numRanges = static_cast<uint32_t>(ranges.size());
+      file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+      for (auto &range : ranges) {
+         auto start = static_cast<uint32_t>(range.start);
+         file.write(reinterpret_cast<const char *>(&start), sizeof(start));
+         file.write(reinterpret_cast<const char *>(&range.size), sizeof(range.size));
+         file.write(virt_cast<const char *>(range.start).get(), range.size);
+      }
+
+      if (!file) {
+         gLog->warn("Could not write relocation cache file {}", tmpPath.string());
+         file.close();
+         std::filesystem::remove(tmpPath, error);
+         return;
+      }
+   }
+
+   // Rename into place so another instance never reads a partial file
+   std::filesystem::rename(tmpPath, path, error);
+   if (error) {
+      std::filesystem::remove(tmpPath, error);
+   }
+}
+
+} // namespace cafe::loader::internal
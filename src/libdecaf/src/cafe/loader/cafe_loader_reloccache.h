@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <libcpu/be2_struct.h>
+#include <vector>
+
+namespace cafe::loader::internal
+{
+
+/**
+ * A range of guest memory written by relocation, its contents after
+ * relocation are what gets cached.
+ */
+struct RelocCacheRange
+{
+   virt_addr start;
+   uint32_t size;
+};
+
+/**
+ * Identifies the inputs to relocation: two independent hashes of them and
+ * their total size in bytes.
+ */
+struct RelocCacheKey
+{
+   uint64_t hash = 0;
+   uint32_t check = 0;
+   uint64_t size = 0;
+};
+
+bool
+isRelocCacheEnabled();
+
+/**
+ * Copy the cached relocated contents of ranges into guest memory, returns
+ * false if there is no cache entry for key.
+ */
+bool
+loadRelocCache(const RelocCacheKey &key,
+               const std::vector<RelocCacheRange> &ranges);
+
+void
+saveRelocCache(const RelocCacheKey &key,
+               const std::vector<RelocCacheRange> &ranges);
+
+} // namespace cafe::loader::internal
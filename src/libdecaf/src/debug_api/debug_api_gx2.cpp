@@ -0,0 +1,35 @@
+#include "decaf_debug_api.h"
+
+#include "cafe/libraries/gx2/gx2_aperture.h"
+#include "cafe/libraries/gx2/gx2_event.h"
+
+namespace decaf::debug
+{
+
+bool
+sampleFrameStats(FrameStats &stats)
+{
+   auto swapStats = cafe::gx2::internal::getSwapStats();
+   stats.numFrames = swapStats.numSwaps;
+   stats.totalFrameTime = std::chrono::nanoseconds { swapStats.totalSwapIntervalNs };
+   stats.maxFrameTime = std::chrono::nanoseconds { swapStats.maxSwapIntervalNs };
+   stats.frameTimeBucketSize = std::chrono::nanoseconds { cafe::gx2::internal::SwapIntervalBucketNs };
+   stats.frameTimeHistogram.assign(swapStats.swapIntervalHistogram.begin(),
+                                   swapStats.swapIntervalHistogram.end());
+   return true;
+}
+
+bool
+sampleTilingApertureStats(TilingApertureStats &stats)
+{
+   auto apertureStats = cafe::gx2::internal::getApertureStats();
+   stats.numApertures = apertureStats.numApertures;
+   stats.numPagesAllocated = apertureStats.numPagesAllocated;
+   stats.numPagesTouched = apertureStats.numPagesTouched;
+   stats.numPagesDirty = apertureStats.numPagesDirty;
+   stats.numRowsUntiled = apertureStats.numRowsUntiled;
+   stats.numRowsRetiled = apertureStats.numRowsRetiled;
+   return true;
+}
+
+} // namespace decaf::debug
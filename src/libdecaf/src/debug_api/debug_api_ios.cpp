@@ -0,0 +1,46 @@
+#include "decaf_debug_api.h"
+
+#include "ios/ios_worker_thread.h"
+#include "ios/kernel/ios_kernel_ipc_thread.h"
+
+namespace decaf::debug
+{
+
+bool
+sampleIosWorkerStats(IosWorkerStats &stats)
+{
+   auto workerStats = ios::internal::getWorkerStats();
+   stats.numThreads = workerStats.numThreads;
+   stats.queueDepth = workerStats.queueDepth;
+   stats.peakQueueDepth = workerStats.peakQueueDepth;
+   stats.tasksSubmitted = workerStats.tasksSubmitted;
+   stats.tasksCompleted = workerStats.tasksCompleted;
+   stats.totalLatency = std::chrono::nanoseconds { workerStats.totalLatencyNs };
+   stats.maxLatency = std::chrono::nanoseconds { workerStats.maxLatencyNs };
+   return true;
+}
+
+bool
+sampleIosIpcStats(IosIpcStats &stats)
+{
+   auto ipcStats = ios::kernel::internal::getIpcStats();
+   stats.numRequests = ipcStats.numRequests;
+   stats.numRequestBatches = ipcStats.numRequestBatches;
+   stats.maxRequestBatchSize = ipcStats.maxRequestBatchSize;
+   stats.numReplies = ipcStats.numReplies;
+   stats.numReplyBatches = ipcStats.numReplyBatches;
+   stats.maxReplyBatchSize = ipcStats.maxReplyBatchSize;
+   stats.devices.clear();
+
+   for (auto &ipcDevice : ipcStats.devices) {
+      auto &device = stats.devices.emplace_back();
+      device.device = ipcDevice.device;
+      device.numRequests = ipcDevice.numRequests;
+      device.totalLatency = std::chrono::nanoseconds { ipcDevice.totalLatencyNs };
+      device.maxLatency = std::chrono::nanoseconds { ipcDevice.maxLatencyNs };
+   }
+
+   return true;
+}
+
+} // namespace decaf::debug
@@ -129,14 +129,15 @@ initialise(const std::string &gamePath)
    filesystem->makeFolder(user, "/vol/temp");
 
    if (!volPath.empty()) {
-      filesystem->mountDevice(user, "/vol/code", std::make_shared<vfs::HostDevice>(volPath / "code"));
-      filesystem->mountDevice(user, "/vol/content", std::make_shared<vfs::HostDevice>(volPath / "content"));
+      // Title code and content are read-only, serve them from memory mappings
+      filesystem->mountDevice(user, "/vol/code", std::make_shared<vfs::HostDevice>(volPath / "code", true));
+      filesystem->mountDevice(user, "/vol/content", std::make_shared<vfs::HostDevice>(volPath / "content", true));
       filesystem->mountDevice(user, "/vol/meta", std::make_shared<vfs::HostDevice>(volPath / "meta"));
    } else if (!rpxPath.empty()) {
-      filesystem->mountDevice(user, "/vol/code", std::make_shared<vfs::HostDevice>(rpxPath.parent_path()));
+      filesystem->mountDevice(user, "/vol/code", std::make_shared<vfs::HostDevice>(rpxPath.parent_path(), true));
 
       if (!decaf::config()->system.content_path.empty()) {
-         filesystem->mountDevice(user, "/vol/content", std::make_shared<vfs::HostDevice>(decaf::config()->system.content_path));
+         filesystem->mountDevice(user, "/vol/content", std::make_shared<vfs::HostDevice>(decaf::config()->system.content_path, true));
       }
 
       cafe::kernel::setExecutableFilename(rpxPath.filename().string());
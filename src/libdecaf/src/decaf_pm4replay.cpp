@@ -0,0 +1,309 @@
+#include "decaf_pm4replay.h"
+
+#include <cstring>
+#include <zlib.h>
+
+namespace decaf::pm4
+{
+
+/**
+ * Copy a Type from offset in the mapped file, fails if it does not fit
+ * before end. Packets are not aligned in the file so never cast in place.
+ */
+template<typename Type>
+bool
+CaptureReader::readStruct(size_t offset,
+                          size_t end,
+                          Type &out) const
+{
+   if (offset > end || end - offset < sizeof(Type)) {
+      return false;
+   }
+
+   std::memcpy(&out, mView + offset, sizeof(Type));
+   return true;
+}
+
+CaptureReader::~CaptureReader()
+{
+   close();
+}
+
+bool
+CaptureReader::open(const std::string &path)
+{
+   close();
+
+   mHandle = platform::openMemoryMappedFile(path, platform::ProtectFlags::ReadOnly, &mSize);
+   if (mHandle == platform::InvalidMapFileHandle) {
+      return false;
+   }
+
+   mView = reinterpret_cast<const uint8_t *>(
+      platform::mapViewOfFile(mHandle, platform::ProtectFlags::ReadOnly, 0, mSize));
+   if (!mView || mSize < CaptureMagic.size()) {
+      close();
+      return false;
+   }
+
+   auto magic = std::array<char, 4> { };
+   std::memcpy(magic.data(), mView, magic.size());
+
+   auto header = CaptureFileHeader { };
+   if (magic == CaptureMagic) {
+      mVersion = 1;
+      mDataStart = CaptureMagic.size();
+      mDataEnd = mSize;
+   } else if (magic == CaptureMagicV2 &&
+              readStruct(CaptureMagicV2.size(), mSize, header)) {
+      mVersion = 2;
+      mDataStart = CaptureMagicV2.size() + sizeof(CaptureFileHeader);
+      mDataEnd = mSize;
+
+      if (!readIndex(header.indexOffset)) {
+         scanIndex();
+      }
+   } else {
+      close();
+      return false;
+   }
+
+   mPosition = mDataStart;
+   return true;
+}
+
+void
+CaptureReader::close()
+{
+   if (mView) {
+      platform::unmapViewOfFile(const_cast<uint8_t *>(mView), mSize);
+      mView = nullptr;
+   }
+
+   if (mHandle != platform::InvalidMapFileHandle) {
+      platform::closeMemoryMappedFile(mHandle);
+      mHandle = platform::InvalidMapFileHandle;
+   }
+
+   mSize = 0;
+   mDataStart = 0;
+   mDataEnd = 0;
+   mPosition = 0;
+   mVersion = 0;
+   mFrames.clear();
+   mBlocks.clear();
+   mBlockCache.clear();
+}
+
+bool
+CaptureReader::readIndex(uint64_t offset)
+{
+   auto header = CaptureIndexHeader { };
+   if (offset < mDataStart || !readStruct(offset, mSize, header)) {
+      return false;
+   }
+
+   // Compare counts rather than computing sizes so nothing can overflow
+   auto framesOffset = static_cast<size_t>(offset) + sizeof(CaptureIndexHeader);
+   auto maxFrames = (mSize - framesOffset) / sizeof(CaptureFrameIndexEntry);
+   if (header.numFrames > maxFrames) {
+      return false;
+   }
+
+   auto blocksOffset = framesOffset + header.numFrames * sizeof(CaptureFrameIndexEntry);
+   auto maxBlocks = (mSize - blocksOffset) / sizeof(CaptureBlockIndexEntry);
+   if (header.numBlocks > maxBlocks) {
+      return false;
+   }
+
+   mFrames.reserve(header.numFrames);
+
+   for (auto i = 0u; i < header.numFrames; ++i) {
+      auto frame = CaptureFrameIndexEntry { };
+      readStruct(framesOffset + i * sizeof(CaptureFrameIndexEntry), mSize, frame);
+      mFrames.push_back({
+         static_cast<size_t>(frame.offset),
+         frame.timestamp
+      });
+   }
+
+   mBlocks.reserve(header.numBlocks);
+
+   for (auto i = 0u; i < header.numBlocks; ++i) {
+      auto block = CaptureBlockIndexEntry { };
+      readStruct(blocksOffset + i * sizeof(CaptureBlockIndexEntry), mSize, block);
+      mBlocks[block.hash] = static_cast<size_t>(block.offset);
+   }
+
+   mDataEnd = static_cast<size_t>(offset);
+   return true;
+}
+
+void
+CaptureReader::scanIndex()
+{
+   auto pos = mDataStart;
+   auto packet = CapturePacket { };
+
+   while (readStruct(pos, mSize, packet)) {
+      auto dataOffset = pos + sizeof(CapturePacket);
+      if (packet.size > mSize - dataOffset) {
+         break;
+      }
+
+      auto block = CaptureMemoryBlock { };
+      if (packet.type == CapturePacket::MemoryBlock &&
+          packet.size >= sizeof(CaptureMemoryBlock) &&
+          readStruct(dataOffset, mSize, block)) {
+         mBlocks[block.hash] = pos;
+      } else if (packet.type == CapturePacket::Frame) {
+         mFrames.push_back({ pos, packet.timestamp });
+      }
+
+      pos = dataOffset + packet.size;
+   }
+
+   // Ignore any partially written packet at the end of the file
+   mDataEnd = pos;
+}
+
+const uint8_t *
+CaptureReader::getBlock(const CaptureBlockRef &ref)
+{
+   if (!ref.size) {
+      // Any non-null pointer will do for an empty block
+      return mView;
+   }
+
+   auto cached = mBlockCache.find(ref.hash);
+   if (cached != mBlockCache.end()) {
+      return cached->second.size() == ref.size ? cached->second.data() : nullptr;
+   }
+
+   auto itr = mBlocks.find(ref.hash);
+   if (itr == mBlocks.end()) {
+      return nullptr;
+   }
+
+   // The offset may have come from the index, check it really is a block
+   auto packetOffset = itr->second;
+   auto packet = CapturePacket { };
+   auto block = CaptureMemoryBlock { };
+   if (!readStruct(packetOffset, mDataEnd, packet) ||
+       packet.type != CapturePacket::MemoryBlock ||
+       packet.size < sizeof(CaptureMemoryBlock) ||
+       packet.size > mDataEnd - packetOffset - sizeof(CapturePacket)) {
+      return nullptr;
+   }
+
+   auto blockOffset = packetOffset + sizeof(CapturePacket);
+   readStruct(blockOffset, mDataEnd, block);
+   if (block.hash != ref.hash || block.size != ref.size) {
+      return nullptr;
+   }
+
+   auto stored = mView + blockOffset + sizeof(CaptureMemoryBlock);
+   auto storedSize = packet.size - static_cast<uint32_t>(sizeof(CaptureMemoryBlock));
+
+   switch (block.compression) {
+   case CaptureMemoryBlock::None:
+      return storedSize == ref.size ? stored : nullptr;
+   case CaptureMemoryBlock::Zlib:
+   {
+      auto &buffer = mBlockCache[ref.hash];
+      auto size = static_cast<uLongf>(ref.size);
+      buffer.resize(ref.size);
+
+      if (uncompress(buffer.data(), &size, stored, storedSize) != Z_OK ||
+          size != ref.size) {
+         mBlockCache.erase(ref.hash);
+         return nullptr;
+      }
+
+      return buffer.data();
+   }
+   default:
+      return nullptr;
+   }
+}
+
+bool
+CaptureReader::next(Packet &packet)
+{
+   auto header = CapturePacket { };
+
+   while (readStruct(mPosition, mDataEnd, header)) {
+      auto dataOffset = mPosition + sizeof(CapturePacket);
+      if (header.size > mDataEnd - dataOffset) {
+         return false;
+      }
+
+      auto data = mView + dataOffset;
+      packet.type = header.type;
+      packet.timestamp = header.timestamp;
+      packet.offset = mPosition;
+      packet.memoryLoad = { };
+      packet.data = data;
+      packet.size = header.size;
+      mPosition = dataOffset + header.size;
+
+      switch (header.type) {
+      case CapturePacket::MemoryBlock:
+         // Only read through the CaptureBlockRef of another packet
+         continue;
+      case CapturePacket::CommandBuffer:
+         if (mVersion >= 2) {
+            auto ref = CaptureBlockRef { };
+            if (header.size != sizeof(CaptureBlockRef)) {
+               return false;
+            }
+
+            std::memcpy(&ref, data, sizeof(CaptureBlockRef));
+            packet.data = getBlock(ref);
+            packet.size = ref.size;
+         }
+         break;
+      case CapturePacket::MemoryLoad:
+         if (header.size < sizeof(CaptureMemoryLoad)) {
+            return false;
+         }
+
+         std::memcpy(&packet.memoryLoad, data, sizeof(CaptureMemoryLoad));
+
+         if (mVersion >= 2) {
+            auto ref = CaptureBlockRef { };
+            if (header.size != sizeof(CaptureMemoryLoad) + sizeof(CaptureBlockRef)) {
+               return false;
+            }
+
+            std::memcpy(&ref, data + sizeof(CaptureMemoryLoad), sizeof(CaptureBlockRef));
+            packet.data = getBlock(ref);
+            packet.size = ref.size;
+         } else {
+            packet.data = data + sizeof(CaptureMemoryLoad);
+            packet.size = header.size - static_cast<uint32_t>(sizeof(CaptureMemoryLoad));
+         }
+         break;
+      default:
+         break;
+      }
+
+      return packet.data != nullptr;
+   }
+
+   return false;
+}
+
+void
+CaptureReader::seek(size_t offset)
+{
+   mPosition = offset;
+}
+
+void
+CaptureReader::rewind()
+{
+   mPosition = mDataStart;
+}
+
+} // namespace decaf::pm4
@@ -38,6 +38,7 @@ struct StaticFsaAsyncData
 
 static std::mutex sCompletedTasksMutex;
 static std::vector<CompletedTask> sCompletedTasks;
+static bool sCompletedTasksInterruptRaised = false;
 static phys_ptr<StaticFsaAsyncData> sFsaAsyncData = nullptr;
 
 static void
@@ -55,6 +56,16 @@ fsaTaskCompleteHandler()
    }
 
    IOS_ClearAndEnable(DeviceId::Sata);
+
+   // Tasks which completed while we were replying did not raise their own
+   // interrupt, so raise one now to pick them up in the next batch.
+   sCompletedTasksMutex.lock();
+   if (sCompletedTasks.empty()) {
+      sCompletedTasksInterruptRaised = false;
+   } else {
+      setInterruptAhbAll(AHBALL::get(0).Sata(true));
+   }
+   sCompletedTasksMutex.unlock();
 }
 
 void
@@ -63,9 +74,15 @@ fsaAsyncTaskComplete(phys_ptr<ResourceRequest> resourceRequest,
 {
    sCompletedTasksMutex.lock();
    sCompletedTasks.push_back({ resourceRequest, result });
+
+   // Only one interrupt is needed per batch of completed tasks
+   auto raiseInterrupt = !sCompletedTasksInterruptRaised;
+   sCompletedTasksInterruptRaised = true;
    sCompletedTasksMutex.unlock();
 
-   setInterruptAhbAll(AHBALL::get(0).Sata(true));
+   if (raiseInterrupt) {
+      setInterruptAhbAll(AHBALL::get(0).Sata(true));
+   }
 }
 
 static Error
@@ -138,6 +155,8 @@ void
 initialiseStaticFsaAsyncTaskData()
 {
    sFsaAsyncData = allocProcessStatic<StaticFsaAsyncData>();
+   sCompletedTasks.clear();
+   sCompletedTasksInterruptRaised = false;
 }
 
 } // namespace ios::fs
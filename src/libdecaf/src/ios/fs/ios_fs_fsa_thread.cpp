@@ -16,6 +16,9 @@
 
 using namespace ios::kernel;
 using ios::internal::submitWorkerTask;
+using ios::internal::WorkerQueueKey;
+using ios::internal::WorkerTask;
+using ios::internal::WorkerTaskMode;
 
 namespace ios::fs::internal
 {
@@ -57,6 +60,24 @@ getDevice(FSADeviceHandle handle,
    return FSAStatus::OK;
 }
 
+/**
+ * Requests from the same client execute in order, requests from different
+ * clients may execute concurrently on the IOS worker pool.
+ *
+ * Anything which may modify the vfs tree or file contents (including OpenFile,
+ * which can create files) is submitted as exclusive, everything else only
+ * reads the tree and can run alongside other shared tasks.
+ */
+static void
+submitFsaTask(phys_ptr<ResourceRequest> resourceRequest,
+              WorkerTaskMode mode,
+              WorkerTask task)
+{
+   auto key = static_cast<WorkerQueueKey>(
+      static_cast<uint32_t>(resourceRequest->requestData.handle));
+   submitWorkerTask(key, mode, std::move(task));
+}
+
 static FSAStatus
 fsaDeviceOpen(phys_ptr<RequestOrigin> origin,
               FSADeviceHandle *outHandle,
@@ -127,63 +148,63 @@ fsaDeviceIoctl(phys_ptr<ResourceRequest> resourceRequest,
 
    switch (command) {
    case FSACommand::AppendFile:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Exclusive, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->appendFile(user, phys_addrof(request->appendFile)));
          });
       break;
    case FSACommand::ChangeDir:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->changeDir(user, phys_addrof(request->changeDir)));
          });
       break;
    case FSACommand::ChangeMode:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Exclusive, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->changeMode(user, phys_addrof(request->changeMode)));
          });
       break;
    case FSACommand::CloseDir:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->closeDir(user, phys_addrof(request->closeDir)));
          });
       break;
    case FSACommand::CloseFile:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->closeFile(user, phys_addrof(request->closeFile)));
          });
       break;
    case FSACommand::FlushFile:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->flushFile(user, phys_addrof(request->flushFile)));
          });
       break;
    case FSACommand::FlushQuota:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Exclusive, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->flushQuota(user, phys_addrof(request->flushQuota)));
          });
       break;
    case FSACommand::GetCwd:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->getCwd(user, phys_addrof(response->getCwd)));
          });
       break;
    case FSACommand::GetInfoByQuery:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->getInfoByQuery(user,
@@ -192,7 +213,7 @@ fsaDeviceIoctl(phys_ptr<ResourceRequest> resourceRequest,
          });
       break;
    case FSACommand::GetPosFile:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->getPosFile(user,
@@ -201,28 +222,28 @@ fsaDeviceIoctl(phys_ptr<ResourceRequest> resourceRequest,
          });
       break;
    case FSACommand::IsEof:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->isEof(user, phys_addrof(request->isEof)));
          });
       break;
    case FSACommand::MakeDir:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Exclusive, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->makeDir(user, phys_addrof(request->makeDir)));
          });
       break;
    case FSACommand::MakeQuota:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Exclusive, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->makeQuota(user, phys_addrof(request->makeQuota)));
          });
       break;
    case FSACommand::OpenDir:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->openDir(user,
@@ -231,7 +252,7 @@ fsaDeviceIoctl(phys_ptr<ResourceRequest> resourceRequest,
          });
       break;
    case FSACommand::OpenFile:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Exclusive, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->openFile(user,
@@ -240,7 +261,7 @@ fsaDeviceIoctl(phys_ptr<ResourceRequest> resourceRequest,
          });
       break;
    case FSACommand::ReadDir:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->readDir(user,
@@ -249,35 +270,35 @@ fsaDeviceIoctl(phys_ptr<ResourceRequest> resourceRequest,
          });
       break;
    case FSACommand::Remove:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Exclusive, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->remove(user, phys_addrof(request->remove)));
          });
       break;
    case FSACommand::Rename:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Exclusive, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->rename(user, phys_addrof(request->rename)));
          });
       break;
    case FSACommand::RewindDir:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->rewindDir(user, phys_addrof(request->rewindDir)));
          });
       break;
    case FSACommand::SetPosFile:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->setPosFile(user, phys_addrof(request->setPosFile)));
          });
       break;
    case FSACommand::StatFile:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Shared, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->statFile(user,
@@ -286,21 +307,21 @@ fsaDeviceIoctl(phys_ptr<ResourceRequest> resourceRequest,
          });
       break;
    case FSACommand::TruncateFile:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Exclusive, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->truncateFile(user, phys_addrof(request->truncateFile)));
          });
       break;
    case FSACommand::Unmount:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Exclusive, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->unmount(user, phys_addrof(request->unmount)));
          });
       break;
    case FSACommand::UnmountWithProcess:
-      submitWorkerTask([=]() {
+      submitFsaTask(resourceRequest, WorkerTaskMode::Exclusive, [=]() {
             fsaAsyncTaskComplete(
                resourceRequest,
                device->unmountWithProcess(user,
@@ -340,7 +361,8 @@ fsaDeviceIoctlv(phys_ptr<ResourceRequest> resourceRequest,
    switch (command) {
    case FSACommand::ReadFile:
    {
-      submitWorkerTask(
+      submitFsaTask(
+         resourceRequest, WorkerTaskMode::Shared,
          [=]() {
             auto buffer = phys_cast<uint8_t *>(vecs[1].paddr);
             auto length = vecs[1].len;
@@ -354,7 +376,8 @@ fsaDeviceIoctlv(phys_ptr<ResourceRequest> resourceRequest,
    }
    case FSACommand::WriteFile:
    {
-      submitWorkerTask(
+      submitFsaTask(
+         resourceRequest, WorkerTaskMode::Exclusive,
          [=]()
          {
             auto buffer = phys_cast<uint8_t *>(vecs[1].paddr);
@@ -369,7 +392,8 @@ fsaDeviceIoctlv(phys_ptr<ResourceRequest> resourceRequest,
    }
    case FSACommand::Mount:
    {
-      submitWorkerTask(
+      submitFsaTask(
+         resourceRequest, WorkerTaskMode::Exclusive,
          [=]()
          {
             fsaAsyncTaskComplete(
@@ -380,7 +404,8 @@ fsaDeviceIoctlv(phys_ptr<ResourceRequest> resourceRequest,
    }
    case FSACommand::MountWithProcess:
    {
-      submitWorkerTask(
+      submitFsaTask(
+         resourceRequest, WorkerTaskMode::Exclusive,
          [=]()
          {
             fsaAsyncTaskComplete(
@@ -1,19 +1,44 @@
 #include "ios_worker_thread.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <mutex>
 #include <queue>
+#include <shared_mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace ios::internal
 {
 
-using WorkerTask = std::function<void()>;
+constexpr auto MaxWorkerThreads = 4u;
 
-static std::thread
-sWorkerThread;
+//! Key used by submitWorkerTask(task), keeps those tasks strictly ordered.
+constexpr auto DefaultWorkerQueueKey = ~WorkerQueueKey { 0 };
+
+using WorkerClock = std::chrono::steady_clock;
+
+struct PendingTask
+{
+   WorkerTaskMode mode;
+   WorkerClock::time_point submitTime;
+   WorkerTask task;
+};
+
+struct WorkerQueue
+{
+   //! Set while one of the workers is executing a task from this queue.
+   bool running = false;
+   std::queue<PendingTask> tasks;
+};
+
+static std::vector<std::thread>
+sWorkerThreads;
 
 static std::atomic<bool>
 sWorkerThreadRunning { false };
@@ -24,27 +49,73 @@ sWorkerThreadConditionVariable;
 static std::mutex
 sWorkerThreadMutex;
 
-static std::queue<WorkerTask>
-sWorkerThreadTasks;
+//! Queues which have tasks ready and are not currently being executed.
+static std::deque<WorkerQueueKey>
+sWorkerReadyQueues;
+
+static std::unordered_map<WorkerQueueKey, WorkerQueue>
+sWorkerQueues;
+
+//! Taken shared by Shared tasks and unique by Exclusive tasks.
+static std::shared_mutex
+sWorkerTaskExecuteMutex;
+
+static WorkerStats
+sWorkerStats;
+
+static void
+executeTask(PendingTask &pending)
+{
+   if (pending.mode == WorkerTaskMode::Exclusive) {
+      auto lock = std::unique_lock { sWorkerTaskExecuteMutex };
+      pending.task();
+   } else {
+      auto lock = std::shared_lock { sWorkerTaskExecuteMutex };
+      pending.task();
+   }
+}
 
 static void
 iosWorkerThread()
 {
-   while (sWorkerThreadRunning) {
-      auto lock = std::unique_lock { sWorkerThreadMutex };
+   auto lock = std::unique_lock { sWorkerThreadMutex };
 
-      if (sWorkerThreadTasks.empty()) {
+   while (sWorkerThreadRunning) {
+      if (sWorkerReadyQueues.empty()) {
          sWorkerThreadConditionVariable.wait(lock);
-         if (!sWorkerThreadRunning) {
-            break;
-         }
+         continue;
       }
 
-      auto task = std::move(sWorkerThreadTasks.front());
-      sWorkerThreadTasks.pop();
+      auto key = sWorkerReadyQueues.front();
+      sWorkerReadyQueues.pop_front();
+
+      auto &queue = sWorkerQueues[key];
+      auto pending = std::move(queue.tasks.front());
+      queue.tasks.pop();
+      queue.running = true;
       lock.unlock();
 
-      task();
+      executeTask(pending);
+
+      auto latency = static_cast<uint64_t>(
+         std::chrono::duration_cast<std::chrono::nanoseconds>(
+            WorkerClock::now() - pending.submitTime).count());
+
+      lock.lock();
+      sWorkerStats.queueDepth--;
+      sWorkerStats.tasksCompleted++;
+      sWorkerStats.totalLatencyNs += latency;
+      sWorkerStats.maxLatencyNs = std::max(sWorkerStats.maxLatencyNs, latency);
+
+      // References into sWorkerQueues are stable across rehashing
+      queue.running = false;
+
+      if (!queue.tasks.empty()) {
+         sWorkerReadyQueues.push_back(key);
+         sWorkerThreadConditionVariable.notify_one();
+      } else {
+         sWorkerQueues.erase(key);
+      }
    }
 }
 
@@ -52,8 +123,15 @@ void
 startWorkerThread()
 {
    if (!sWorkerThreadRunning) {
+      auto numThreads = std::clamp(std::thread::hardware_concurrency(),
+                                   1u, MaxWorkerThreads);
       sWorkerThreadRunning = true;
-      sWorkerThread = std::thread { iosWorkerThread };
+      sWorkerStats = { };
+      sWorkerStats.numThreads = numThreads;
+
+      for (auto i = 0u; i < numThreads; ++i) {
+         sWorkerThreads.emplace_back(iosWorkerThread);
+      }
    }
 }
 
@@ -61,19 +139,55 @@ void
 stopWorkerThread()
 {
    if (sWorkerThreadRunning) {
-      sWorkerThreadRunning = false;
-      sWorkerThreadConditionVariable.notify_all();
-      sWorkerThread.join();
-      sWorkerThreadTasks = {};
+      {
+         auto lock = std::unique_lock { sWorkerThreadMutex };
+         sWorkerThreadRunning = false;
+         sWorkerThreadConditionVariable.notify_all();
+      }
+
+      for (auto &thread : sWorkerThreads) {
+         thread.join();
+      }
+
+      sWorkerThreads.clear();
+      sWorkerReadyQueues.clear();
+      sWorkerQueues.clear();
    }
 }
 
 void
 submitWorkerTask(WorkerTask task)
+{
+   submitWorkerTask(DefaultWorkerQueueKey, WorkerTaskMode::Exclusive,
+                    std::move(task));
+}
+
+void
+submitWorkerTask(WorkerQueueKey key,
+                 WorkerTaskMode mode,
+                 WorkerTask task)
+{
+   auto lock = std::unique_lock { sWorkerThreadMutex };
+   auto &queue = sWorkerQueues[key];
+   auto wasIdle = !queue.running && queue.tasks.empty();
+   queue.tasks.push({ mode, WorkerClock::now(), std::move(task) });
+
+   sWorkerStats.tasksSubmitted++;
+   sWorkerStats.queueDepth++;
+   sWorkerStats.peakQueueDepth =
+      std::max(sWorkerStats.peakQueueDepth, sWorkerStats.queueDepth);
+
+   if (wasIdle) {
+      sWorkerReadyQueues.push_back(key);
+      sWorkerThreadConditionVariable.notify_one();
+   }
+}
+
+WorkerStats
+getWorkerStats()
 {
    auto lock = std::unique_lock { sWorkerThreadMutex };
-   sWorkerThreadTasks.push(std::move(task));
-   sWorkerThreadConditionVariable.notify_all();
+   return sWorkerStats;
 }
 
 } // namespace ios::internal
@@ -1,3 +1,5 @@
+#pragma once
+#include <cstdint>
 #include <functional>
 
 namespace ios::internal
@@ -5,6 +7,33 @@ namespace ios::internal
 
 using WorkerTask = std::function<void()>;
 
+/**
+ * Tasks submitted with the same queue key are executed in submission order,
+ * tasks with different keys may execute concurrently.
+ */
+using WorkerQueueKey = uint64_t;
+
+enum class WorkerTaskMode
+{
+   //! May run concurrently with other shared tasks.
+   Shared,
+
+   //! Runs with no other task executing, used for anything which modifies
+   //! the shared vfs tree.
+   Exclusive,
+};
+
+struct WorkerStats
+{
+   uint32_t numThreads = 0;
+   uint32_t queueDepth = 0;
+   uint32_t peakQueueDepth = 0;
+   uint64_t tasksSubmitted = 0;
+   uint64_t tasksCompleted = 0;
+   uint64_t totalLatencyNs = 0;
+   uint64_t maxLatencyNs = 0;
+};
+
 void
 startWorkerThread();
 
@@ -14,4 +43,12 @@ stopWorkerThread();
 void
 submitWorkerTask(WorkerTask task);
 
+void
+submitWorkerTask(WorkerQueueKey key,
+                 WorkerTaskMode mode,
+                 WorkerTask task);
+
+WorkerStats
+getWorkerStats();
+
 } // namespace ios::internal
@@ -6,11 +6,15 @@
 #include "ios/ios_stackobject.h"
 #include "cafe/kernel/cafe_kernel_ipckdriver.h"
 
-#include <common/atomicqueue.h>
+#include <algorithm>
+#include <chrono>
 #include <common/log.h>
 #include <libcpu/cpu_formatters.h>
+#include <map>
 #include <mutex>
-#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace ios::kernel
 {
@@ -30,14 +34,61 @@ struct StaticIpcData
 static phys_ptr<StaticIpcData>
 sData = nullptr;
 
-static AtomicQueue<phys_ptr<IpcRequest>, 128>
-sIpcRequestQueue;
+using IpcClock = std::chrono::steady_clock;
+
+struct IpcDeviceCounters
+{
+   uint64_t numRequests = 0;
+   uint64_t totalLatencyNs = 0;
+   uint64_t maxLatencyNs = 0;
+};
+
+struct PendingIpcRequest
+{
+   IpcClock::time_point submitTime;
+
+   //! Set when IOS replies, nullptr if the request never reached a device.
+   IpcDeviceCounters *device = nullptr;
+};
+
+static std::mutex
+sIpcMutex;
+
+//! Requests submitted since the IPC thread last woke up.
+static std::vector<phys_ptr<IpcRequest>>
+sPendingIpcRequests;
+
+//! Submit time of every request which has not been replied to yet, keyed by
+//! the physical address of the request.
+static std::unordered_map<uint32_t, PendingIpcRequest>
+sInFlightIpcRequests;
+
+static std::map<std::string, IpcDeviceCounters, std::less<>>
+sIpcDeviceCounters;
+
+static IpcStats
+sIpcStats;
+
+static uint32_t
+getIpcRequestKey(phys_ptr<IpcRequest> request)
+{
+   return static_cast<uint32_t>(phys_cast<phys_addr>(request));
+}
 
 void
 submitIpcRequest(phys_ptr<IpcRequest> request)
 {
-   decaf_check(!sIpcRequestQueue.wasFull());
-   sIpcRequestQueue.push(request);
+   auto lock = std::unique_lock { sIpcMutex };
+   auto wasEmpty = sPendingIpcRequests.empty();
+   sPendingIpcRequests.push_back(request);
+   sInFlightIpcRequests[getIpcRequestKey(request)] = { IpcClock::now(), nullptr };
+   sIpcStats.numRequests++;
+   lock.unlock();
+
+   if (!wasEmpty) {
+      // The IPC thread has already been signalled for this batch
+      return;
+   }
 
    switch (request->cpuId) {
    case CpuId::PPC0:
@@ -55,11 +106,162 @@ submitIpcRequest(phys_ptr<IpcRequest> request)
 namespace internal
 {
 
+/**
+ * Attribute an in flight request to the device which is replying to it.
+ */
+void
+setIpcReplyDevice(phys_ptr<IpcRequest> request,
+                  std::string_view device)
+{
+   auto lock = std::unique_lock { sIpcMutex };
+   auto itr = sInFlightIpcRequests.find(getIpcRequestKey(request));
+   if (itr == sInFlightIpcRequests.end()) {
+      return;
+   }
+
+   auto counters = sIpcDeviceCounters.find(device);
+   if (counters == sIpcDeviceCounters.end()) {
+      counters = sIpcDeviceCounters.emplace(std::string { device },
+                                            IpcDeviceCounters { }).first;
+   }
+
+   itr->second.device = &counters->second;
+}
+
+/**
+ * Called by the PPC kernel once a batch of replies has been delivered.
+ */
+void
+completeIpcReplies(const std::vector<phys_ptr<IpcRequest>> &replies)
+{
+   auto now = IpcClock::now();
+   auto lock = std::unique_lock { sIpcMutex };
+   sIpcStats.numReplyBatches++;
+   sIpcStats.numReplies += replies.size();
+   sIpcStats.maxReplyBatchSize =
+      std::max<uint32_t>(sIpcStats.maxReplyBatchSize,
+                         static_cast<uint32_t>(replies.size()));
+
+   for (auto reply : replies) {
+      auto itr = sInFlightIpcRequests.find(getIpcRequestKey(reply));
+      if (itr == sInFlightIpcRequests.end()) {
+         continue;
+      }
+
+      if (auto device = itr->second.device) {
+         auto latency = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+               now - itr->second.submitTime).count());
+
+         device->numRequests++;
+         device->totalLatencyNs += latency;
+         device->maxLatencyNs = std::max(device->maxLatencyNs, latency);
+      }
+
+      sInFlightIpcRequests.erase(itr);
+   }
+}
+
+IpcStats
+getIpcStats()
+{
+   auto lock = std::unique_lock { sIpcMutex };
+   auto stats = sIpcStats;
+   stats.devices.clear();
+
+   for (auto &[name, counters] : sIpcDeviceCounters) {
+      auto &device = stats.devices.emplace_back();
+      device.device = name;
+      device.numRequests = counters.numRequests;
+      device.totalLatencyNs = counters.totalLatencyNs;
+      device.maxLatencyNs = counters.maxLatencyNs;
+   }
+
+   return stats;
+}
+
+static Error
+dispatchIpcRequest(phys_ptr<MessageQueue> queue,
+                   phys_ptr<IpcRequest> request)
+{
+   if (request->clientPid > 7) {
+      gLog->error("Received IPC request with invalid clientPid of {}", request->clientPid);
+      return Error::Invalid;
+   }
+
+   auto pid = static_cast<ProcessId>(request->clientPid + ProcessId::COSKERNEL);
+
+   switch (request->command) {
+   case Command::Open:
+      return internal::dispatchIosOpen(request->args.open.name.get(),
+                                       request->args.open.mode,
+                                       queue,
+                                       request,
+                                       pid,
+                                       request->cpuId);
+   case Command::Close:
+      return internal::dispatchIosClose(request->handle,
+                                        queue,
+                                        request,
+                                        request->args.close.unkArg0,
+                                        pid,
+                                        request->cpuId);
+   case Command::Read:
+      return internal::dispatchIosRead(request->handle,
+                                       request->args.read.data,
+                                       request->args.read.length,
+                                       queue,
+                                       request,
+                                       pid,
+                                       request->cpuId);
+   case Command::Write:
+      return internal::dispatchIosWrite(request->handle,
+                                        request->args.write.data,
+                                        request->args.write.length,
+                                        queue,
+                                        request,
+                                        pid,
+                                        request->cpuId);
+   case Command::Seek:
+      return internal::dispatchIosSeek(request->handle,
+                                       request->args.seek.offset,
+                                       request->args.seek.origin,
+                                       queue,
+                                       request,
+                                       pid,
+                                       request->cpuId);
+   case Command::Ioctl:
+      return internal::dispatchIosIoctl(request->handle,
+                                        request->args.ioctl.request,
+                                        request->args.ioctl.inputBuffer,
+                                        request->args.ioctl.inputLength,
+                                        request->args.ioctl.outputBuffer,
+                                        request->args.ioctl.outputLength,
+                                        queue,
+                                        request,
+                                        pid,
+                                        request->cpuId);
+   case Command::Ioctlv:
+      return internal::dispatchIosIoctlv(request->handle,
+                                         request->args.ioctlv.request,
+                                         request->args.ioctlv.numVecIn,
+                                         request->args.ioctlv.numVecOut,
+                                         request->args.ioctlv.vecs,
+                                         queue,
+                                         request,
+                                         pid,
+                                         request->cpuId);
+   default:
+      return Error::Invalid;
+   }
+}
+
 static Error
 ipcThreadEntry(phys_ptr<void> context)
 {
    StackObject<Message> message;
    phys_ptr<MessageQueue> queue;
+   std::vector<phys_ptr<IpcRequest>> requests;
 
    auto error = IOS_CreateMessageQueue(phys_addrof(sData->messageBuffer),
                                        static_cast<uint32_t>(sData->messageBuffer.size()));
@@ -93,102 +295,42 @@ ipcThreadEntry(phys_ptr<void> context)
       /*
        * We're kind of cheating here, we have combined all 3 IPC queues into a
        * single queue in order to make it easier to reduce chances of race
-       * conditions. Also we attempt to fully empty the ipc request queue
-       * rather than processing a single message per interrupt like on hardware.
+       * conditions. Also we process every request submitted since the last
+       * wakeup as a single batch rather than a single message per interrupt
+       * like on hardware.
+       *
+       * The interrupts are cleared before taking the batch, submitIpcRequest
+       * only raises the interrupt for the first request of a batch so any
+       * request submitted after we take the batch will wake us up again.
        */
-      while (!sIpcRequestQueue.wasEmpty()) {
-         auto request = sIpcRequestQueue.pop();
-
-         if (request->clientPid > 7) {
-            gLog->error("Received IPC request with invalid clientPid of {}", request->clientPid);
-            error = Error::Invalid;
-         } else {
-            auto pid = static_cast<ProcessId>(request->clientPid + ProcessId::COSKERNEL);
-
-            switch (request->command) {
-            case Command::Open:
-               error = internal::dispatchIosOpen(request->args.open.name.get(),
-                                                 request->args.open.mode,
-                                                 queue,
-                                                 request,
-                                                 pid,
-                                                 request->cpuId);
-               break;
-            case Command::Close:
-               error = internal::dispatchIosClose(request->handle,
-                                                  queue,
-                                                  request,
-                                                  request->args.close.unkArg0,
-                                                  pid,
-                                                  request->cpuId);
-               break;
-            case Command::Read:
-               error = internal::dispatchIosRead(request->handle,
-                                                 request->args.read.data,
-                                                 request->args.read.length,
-                                                 queue,
-                                                 request,
-                                                 pid,
-                                                 request->cpuId);
-               break;
-            case Command::Write:
-               error = internal::dispatchIosWrite(request->handle,
-                                                  request->args.write.data,
-                                                  request->args.write.length,
-                                                  queue,
-                                                  request,
-                                                  pid,
-                                                  request->cpuId);
-               break;
-            case Command::Seek:
-               error = internal::dispatchIosSeek(request->handle,
-                                                 request->args.seek.offset,
-                                                 request->args.seek.origin,
-                                                 queue,
-                                                 request,
-                                                 pid,
-                                                 request->cpuId);
-               break;
-            case Command::Ioctl:
-               error = internal::dispatchIosIoctl(request->handle,
-                                                  request->args.ioctl.request,
-                                                  request->args.ioctl.inputBuffer,
-                                                  request->args.ioctl.inputLength,
-                                                  request->args.ioctl.outputBuffer,
-                                                  request->args.ioctl.outputLength,
-                                                  queue,
-                                                  request,
-                                                  pid,
-                                                  request->cpuId);
-               break;
-            case Command::Ioctlv:
-               error = internal::dispatchIosIoctlv(request->handle,
-                                                   request->args.ioctlv.request,
-                                                   request->args.ioctlv.numVecIn,
-                                                   request->args.ioctlv.numVecOut,
-                                                   request->args.ioctlv.vecs,
-                                                   queue,
-                                                   request,
-                                                   pid,
-                                                   request->cpuId);
-               break;
-            default:
-               error = Error::Invalid;
-            }
+      IOS_ClearAndEnable(DeviceId::IpcStarbuckCore0);
+      IOS_ClearAndEnable(DeviceId::IpcStarbuckCore1);
+      IOS_ClearAndEnable(DeviceId::IpcStarbuckCore2);
+
+      {
+         auto lock = std::unique_lock { sIpcMutex };
+         requests.swap(sPendingIpcRequests);
+
+         if (!requests.empty()) {
+            sIpcStats.numRequestBatches++;
+            sIpcStats.maxRequestBatchSize =
+               std::max<uint32_t>(sIpcStats.maxRequestBatchSize,
+                                  static_cast<uint32_t>(requests.size()));
          }
+      }
+
+      for (auto request : requests) {
+         error = dispatchIpcRequest(queue, request);
 
          if (error < Error::OK) {
             // Reply with error!
             request->command = Command::Reply;
             request->reply = error;
             cafe::kernel::ipckDriverIosSubmitReply(request);
-            continue;
          }
       }
 
-      IOS_ClearAndEnable(DeviceId::IpcStarbuckCore0);
-      IOS_ClearAndEnable(DeviceId::IpcStarbuckCore1);
-      IOS_ClearAndEnable(DeviceId::IpcStarbuckCore2);
+      requests.clear();
    }
 }
 
@@ -203,6 +345,14 @@ startIpcThread()
 {
    sData = allocProcessStatic<StaticIpcData>();
 
+   {
+      auto lock = std::unique_lock { sIpcMutex };
+      sPendingIpcRequests.clear();
+      sInFlightIpcRequests.clear();
+      sIpcDeviceCounters.clear();
+      sIpcStats = { };
+   }
+
    // Create thread
    auto error = IOS_CreateThread(&ipcThreadEntry, nullptr,
                                  phys_addrof(sData->threadStack) + sData->threadStack.size(),
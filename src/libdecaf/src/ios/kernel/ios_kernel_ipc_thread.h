@@ -2,9 +2,41 @@
 #include "ios_kernel_messagequeue.h"
 #include "ios/ios_ipc.h"
 
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
 namespace ios::kernel
 {
 
+struct IpcDeviceStats
+{
+   std::string device;
+
+   //! Number of replies delivered for requests to this device.
+   uint64_t numRequests = 0;
+
+   //! Sum of submit to reply delivery latency of all requests.
+   uint64_t totalLatencyNs = 0;
+
+   //! Highest submit to reply delivery latency of a single request.
+   uint64_t maxLatencyNs = 0;
+};
+
+struct IpcStats
+{
+   uint64_t numRequests = 0;
+   uint64_t numRequestBatches = 0;
+   uint32_t maxRequestBatchSize = 0;
+
+   uint64_t numReplies = 0;
+   uint64_t numReplyBatches = 0;
+   uint32_t maxReplyBatchSize = 0;
+
+   std::vector<IpcDeviceStats> devices;
+};
+
 void
 submitIpcRequest(phys_ptr<IpcRequest> request);
 
@@ -14,6 +46,16 @@ namespace internal
 MessageQueueId
 getIpcMessageQueueId();
 
+void
+setIpcReplyDevice(phys_ptr<IpcRequest> request,
+                  std::string_view device);
+
+void
+completeIpcReplies(const std::vector<phys_ptr<IpcRequest>> &replies);
+
+IpcStats
+getIpcStats();
+
 Error
 startIpcThread();
 
@@ -650,6 +650,12 @@ dispatchResourceReply(phys_ptr<ResourceRequest> resourceRequest,
    ipcRequest->reply = reply;
 
    if (resourceRequest->messageQueueId == getIpcMessageQueueId()) {
+      auto resourceManager = resourceRequest->resourceManager;
+      setIpcReplyDevice(ipcRequest,
+                        std::string_view {
+                           phys_addrof(resourceManager->device).get(),
+                           resourceManager->deviceLen
+                        });
       cafe::kernel::ipckDriverIosSubmitReply(ipcRequest);
       error = Error::OK;
    } else {
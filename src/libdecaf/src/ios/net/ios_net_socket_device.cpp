@@ -8,10 +8,12 @@
 #include "ios/ios_error.h"
 #include "ios/ios_network_thread.h"
 
+#include <algorithm>
 #include <atomic>
 #include <ares.h>
 #include <common/platform.h>
 #include <common/strutils.h>
+#include <cstring>
 #include <libcpu/cpu_formatters.h>
 #include <functional>
 #include <mutex>
@@ -179,7 +181,18 @@ SocketDevice::uvCloseSocketCallback(uv_handle_t *handle)
    decaf_check(socket->pendingReads.empty());
    decaf_check(socket->pendingWrites.empty());
 
+   // Any select still waiting on this socket will now fail with BadFd
+   auto device = socket->device;
+   auto pendingSelects = std::move(socket->pendingSelects);
    *socket = SocketDevice::Socket {};
+
+   for (auto pending : pendingSelects) {
+      auto result = device->checkSelect(pending->resourceRequest);
+      if (result.has_value()) {
+         completeSocketTask(pending->resourceRequest, result);
+         device->removePendingSelect(pending);
+      }
+   }
 }
 
 std::optional<Error>
@@ -196,11 +209,103 @@ SocketDevice::closeSocket(phys_ptr<ResourceRequest> resourceRequest,
    return {};
 }
 
+void
+SocketDevice::ReadRing::reallocate(size_t capacity)
+{
+   // Unwrap the existing contents to the start of the new storage
+   auto newStorage = std::vector<char>(capacity);
+   copy(newStorage.data(), 0, size);
+   storage = std::move(newStorage);
+   head = 0;
+}
+
+void
+SocketDevice::ReadRing::push(const char *src,
+                             size_t length)
+{
+   if (size + length > storage.size()) {
+      auto capacity = std::max<size_t>(storage.size(), ReadBufferSize);
+      while (capacity < size + length) {
+         capacity *= 2;
+      }
+
+      reallocate(capacity);
+   }
+
+   auto tail = (head + size) % storage.size();
+   auto first = std::min(length, storage.size() - tail);
+   std::memcpy(storage.data() + tail, src, first);
+   std::memcpy(storage.data(), src + first, length - first);
+   size += length;
+}
+
+size_t
+SocketDevice::ReadRing::copy(char *dst,
+                             size_t offset,
+                             size_t length) const
+{
+   if (offset >= size) {
+      return 0;
+   }
+
+   length = std::min(length, size - offset);
+   auto start = (head + offset) % storage.size();
+   auto first = std::min(length, storage.size() - start);
+   std::memcpy(dst, storage.data() + start, first);
+   std::memcpy(dst + first, storage.data(), length - first);
+   return length;
+}
+
+void
+SocketDevice::ReadRing::consume(size_t length)
+{
+   length = std::min(length, size);
+   size -= length;
+
+   if (size == 0) {
+      head = 0;
+   } else {
+      head = (head + length) % storage.size();
+   }
+
+   // Give back the memory grown for a burst once most of it has been read,
+   // the smallest capacity we shrink to is still under half full so a steady
+   // stream does not keep growing and shrinking.
+   if (storage.size() > ReadBufferSize && size <= storage.size() / 4) {
+      auto capacity = storage.size() / 2;
+      while (capacity > ReadBufferSize && size <= capacity / 4) {
+         capacity /= 2;
+      }
+
+      reallocate(std::max<size_t>(capacity, ReadBufferSize));
+   }
+}
+
+char *
+SocketDevice::allocReadBuffer()
+{
+   if (mFreeReadBuffers.empty()) {
+      mReadBuffers.emplace_back(new char[ReadBufferSize]);
+      return mReadBuffers.back().get();
+   }
+
+   auto buffer = mFreeReadBuffers.back();
+   mFreeReadBuffers.pop_back();
+   return buffer;
+}
+
+void
+SocketDevice::freeReadBuffer(char *buffer)
+{
+   mFreeReadBuffers.push_back(buffer);
+}
+
 static void
 uvReadAllocCallback(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
 {
-   buf->base = new char[suggested_size];
-   buf->len = static_cast<decltype(buf->len)>(suggested_size);
+   auto socket = reinterpret_cast<SocketDevice::Socket *>(handle->data);
+   buf->base = socket->device->allocReadBuffer();
+   buf->len = static_cast<decltype(buf->len)>(SocketDevice::ReadBufferSize);
 }
 
 static void
@@ -208,15 +313,23 @@ uvReadCallback(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
 {
    auto socket = reinterpret_cast<SocketDevice::Socket *>(stream->data);
 
-   if (nread >= 0) {
-      socket->readBuffer.insert(socket->readBuffer.end(), buf->base, buf->base + buf->len);
+   if (nread > 0) {
+      socket->readBuffer.push(buf->base, static_cast<size_t>(nread));
    } else if (nread < 0) {
       socket->except = makeError(ErrorCategory::Socket, SocketError::GenericError);
    }
 
-   delete buf->base;
+   // libuv may call us with a null buffer on EOF or error
+   if (buf->base) {
+      socket->device->freeReadBuffer(buf->base);
+   }
+
+   if (nread == 0) {
+      return;
+   }
+
    socket->device->checkPendingReads(socket);
-   socket->device->checkPendingSelects();
+   socket->device->checkPendingSelects(socket);
 }
 
 static void
@@ -244,7 +357,7 @@ uvConnectCallback(uv_connect_t *req, int status)
    }
 
    socket->connected = true;
-   socket->device->checkPendingSelects();
+   socket->device->checkPendingSelects(socket);
 }
 
 std::optional<Error>
@@ -423,32 +536,22 @@ SocketDevice::checkRecv(phys_ptr<kernel::ResourceRequest> resourceRequest)
 
    auto readBytes = size_t { 0u };
    if (alignedBeforeBuffer && alignedBeforeLength) {
-      auto len = std::min<size_t>(socket->readBuffer.size() - readBytes, alignedBeforeLength);
-      std::memcpy(alignedBeforeBuffer.get(), socket->readBuffer.data() + readBytes, len);
-      readBytes += len;
+      readBytes += socket->readBuffer.copy(
+         phys_cast<char *>(alignedBeforeBuffer).get(), readBytes, alignedBeforeLength);
    }
 
    if (alignedBuffer && alignedLength) {
-      auto len = std::min<size_t>(socket->readBuffer.size() - readBytes, alignedLength);
-      std::memcpy(alignedBuffer.get(), socket->readBuffer.data() + readBytes, len);
-      readBytes += len;
+      readBytes += socket->readBuffer.copy(
+         phys_cast<char *>(alignedBuffer).get(), readBytes, alignedLength);
    }
 
    if (alignedAfterBuffer && alignedAfterLength) {
-      auto len = std::min<size_t>(socket->readBuffer.size() - readBytes, alignedAfterLength);
-      std::memcpy(alignedAfterBuffer.get(), socket->readBuffer.data() + readBytes, len);
-      readBytes += len;
+      readBytes += socket->readBuffer.copy(
+         phys_cast<char *>(alignedAfterBuffer).get(), readBytes, alignedAfterLength);
    }
 
    if (!(request->flags & SO_MSG_PEEK)) {
-      if (readBytes == socket->readBuffer.size()) {
-         socket->readBuffer.clear();
-      } else {
-         std::memmove(socket->readBuffer.data(),
-                        socket->readBuffer.data() + readBytes,
-                        socket->readBuffer.size() - readBytes);
-         socket->readBuffer.resize(socket->readBuffer.size() - readBytes);
-      }
+      socket->readBuffer.consume(readBytes);
    }
 
    return static_cast<Error>(readBytes);
@@ -671,34 +774,66 @@ SocketDevice::checkPendingReads(Socket *socket)
 }
 
 void
-SocketDevice::checkPendingSelects()
+SocketDevice::checkPendingSelects(Socket *socket)
 {
-   auto now = std::chrono::system_clock::now();
-   auto itr = mPendingSelects.begin();
+   // Only the selects waiting on this socket can have become ready, copy the
+   // list as completing a select removes it from every socket it waits on.
+   auto pendingSelects = socket->pendingSelects;
 
-   while (itr != mPendingSelects.end()) {
-      auto result = checkSelect((*itr)->resourceRequest);
+   for (auto pending : pendingSelects) {
+      auto result = checkSelect(pending->resourceRequest);
       if (result.has_value()) {
-         completeSocketTask((*itr)->resourceRequest, result);
-         itr = mPendingSelects.erase(itr);
-      } else {
-         ++itr;
+         completeSocketTask(pending->resourceRequest, result);
+         removePendingSelect(pending);
       }
    }
 }
 
+void
+SocketDevice::removePendingSelect(PendingSelect *pending)
+{
+   for (auto i = 0u; i < 32; ++i) {
+      if (!((pending->fds >> i) & 1)) {
+         continue;
+      }
+
+      if (auto socket = getSocket(i)) {
+         auto &selects = socket->pendingSelects;
+         selects.erase(std::remove(selects.begin(), selects.end(), pending),
+                       selects.end());
+      }
+   }
+
+   auto itr = std::find_if(mPendingSelects.begin(), mPendingSelects.end(),
+                           [pending](const auto &other) {
+                              return other.get() == pending;
+                           });
+   if (itr == mPendingSelects.end()) {
+      return;
+   }
+
+   // The timer handle belongs to the libuv loop until its close callback
+   // runs, so the PendingSelect is only freed there.
+   itr->release();
+   mPendingSelects.erase(itr);
+   uv_timer_stop(&pending->timer);
+   uv_close(reinterpret_cast<uv_handle_t *>(&pending->timer),
+            uvClosePendingSelectCallback);
+}
+
+void
+SocketDevice::uvClosePendingSelectCallback(uv_handle_t *handle)
+{
+   delete reinterpret_cast<PendingSelect *>(handle->data);
+}
+
 void
 SocketDevice::uvExpirePendingSelectCallback(uv_timer_t *timer)
 {
    auto pending = reinterpret_cast<PendingSelect *>(timer->data);
    completeSocketTask(pending->resourceRequest,
                       makeError(ErrorCategory::Socket, SocketError::TimedOut));
-
-   for (auto itr = pending->device->mPendingSelects.begin(); itr != pending->device->mPendingSelects.end(); ++itr) {
-      if (itr->get() == pending) {
-         pending->device->mPendingSelects.erase(itr);
-      }
-   }
+   pending->device->removePendingSelect(pending);
 }
 
 std::optional<Error>
@@ -718,10 +853,22 @@ SocketDevice::select(phys_ptr<ResourceRequest> resourceRequest,
 
       auto pending = std::make_unique<PendingSelect>();
       uv_timer_init(networkUvLoop(), &pending->timer);
-      pending->timer.data = resourceRequestToHandleData(resourceRequest);
+      pending->timer.data = pending.get();
       pending->resourceRequest = resourceRequest;
       pending->device = this;
 
+      // Index the select by every socket it waits on so that activity on a
+      // socket only has to recheck the selects which care about it.
+      auto fds = request->readfds | request->writefds | request->exceptfds;
+      pending->fds = 0u;
+
+      for (auto i = 0; i < request->nfds && i < 32; ++i) {
+         if ((fds >> i) & 1) {
+            pending->fds |= 1u << i;
+            getSocket(i)->pendingSelects.push_back(pending.get());
+         }
+      }
+
       auto expireMS = std::chrono::duration_cast<std::chrono::milliseconds>(
          std::chrono::seconds(request->timeout.tv_sec)
          + std::chrono::microseconds(request->timeout.tv_usec)
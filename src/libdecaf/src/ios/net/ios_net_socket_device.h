@@ -31,6 +31,9 @@ class SocketDevice
 public:
    struct Socket;
 
+   //! Size of the buffers we hand to libuv for reads, matches what it suggests.
+   static constexpr size_t ReadBufferSize = 64 * 1024;
+
    struct PendingWrite
    {
       Socket *socket;
@@ -41,13 +44,34 @@ public:
 
    struct PendingSelect
    {
-      ~PendingSelect() {
-         uv_timer_stop(&timer);
-      }
-
       SocketDevice *device;
       phys_ptr<kernel::ResourceRequest> resourceRequest;
       uv_timer_t timer;
+
+      //! Bitmask of every fd in readfds, writefds or exceptfds.
+      uint32_t fds;
+   };
+
+   /**
+    * Byte ring holding data received on a socket which has not yet been
+    * consumed by recv, grows to a power of two when full and shrinks back
+    * once a burst has been read.
+    */
+   struct ReadRing
+   {
+      bool empty() const
+      {
+         return size == 0;
+      }
+
+      void push(const char *src, size_t length);
+      size_t copy(char *dst, size_t offset, size_t length) const;
+      void consume(size_t length);
+      void reallocate(size_t capacity);
+
+      std::vector<char> storage;
+      size_t head = 0;
+      size_t size = 0;
    };
 
    struct Socket
@@ -67,8 +91,9 @@ public:
       phys_ptr<kernel::ResourceRequest> connectRequest = nullptr;
       bool connected = false;
       Error except = Error::OK;
-      std::vector<char> readBuffer;
+      ReadRing readBuffer;
       std::vector<phys_ptr<kernel::ResourceRequest>> pendingReads;
+      std::vector<PendingSelect *> pendingSelects;
       std::vector<std::unique_ptr<PendingWrite>> pendingWrites;
       phys_ptr<kernel::ResourceRequest> closeRequest = nullptr;
    };
@@ -153,21 +178,30 @@ public:
           SocketHandle fd,
           int32_t backlog);
 
-   void checkPendingSelects();
+   void checkPendingSelects(Socket *socket);
    void checkPendingReads(Socket *socket);
 
+   char *allocReadBuffer();
+   void freeReadBuffer(char *buffer);
+
 protected:
    Socket *getSocket(int sockfd);
    std::optional<Error> checkSelect(phys_ptr<kernel::ResourceRequest> resourceRequest);
    std::optional<Error> checkRecv(phys_ptr<kernel::ResourceRequest> resourceRequest);
+   void removePendingSelect(PendingSelect *pending);
 
    static void uvCloseSocketCallback(uv_handle_t *handle);
+   static void uvClosePendingSelectCallback(uv_handle_t *handle);
    static void uvExpirePendingSelectCallback(uv_timer_t *timer);
    static void uvWriteCallback(uv_write_t *req, int32_t status);
 
 private:
    std::array<Socket, 64> mSockets;
    std::vector<std::unique_ptr<PendingSelect>> mPendingSelects;
+
+   //! Slabs of ReadBufferSize bytes handed to libuv for reads.
+   std::vector<std::unique_ptr<char[]>> mReadBuffers;
+   std::vector<char *> mFreeReadBuffers;
 };
 
 /** @} */
@@ -1,6 +1,7 @@
 #include "vfs_host_device.h"
 #include "vfs_host_directoryiterator.h"
 #include "vfs_host_filehandle.h"
+#include "vfs_host_mappedfilehandle.h"
 #include "vfs_link_device.h"
 #include "vfs_virtual_device.h"
 
@@ -9,12 +10,21 @@
 #include <system_error>
 #include <vector>
 
+#ifdef PLATFORM_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace vfs
 {
 
-HostDevice::HostDevice(std::filesystem::path path) :
+HostDevice::HostDevice(std::filesystem::path path,
+                       bool mapReadOnlyFiles) :
    Device(Device::Host),
    mHostPath(std::move(path)),
+   mMapReadOnlyFiles(mapReadOnlyFiles),
    mVirtualDevice(std::make_shared<VirtualDevice>())
 {
 }
@@ -204,6 +214,14 @@ HostDevice::openFile(const User &user,
       }
    }
 
+   if (mMapReadOnlyFiles &&
+       (mode & FileHandle::Read) &&
+       !(mode & (FileHandle::Write | FileHandle::Append | FileHandle::Update))) {
+      if (auto handle = openMappedFile(makeHostPath(path)); handle) {
+         return { std::move(handle) };
+      }
+   }
+
    auto hostMode = translateOpenMode(mode);
 #ifdef PLATFORM_WINDOWS
    auto handle = static_cast<FILE *>(nullptr);
@@ -226,6 +244,37 @@ HostDevice::openFile(const User &user,
    return { Error::NotFound };
 }
 
+std::unique_ptr<FileHandle>
+HostDevice::openMappedFile(const std::filesystem::path &hostPath) const
+{
+#ifdef PLATFORM_POSIX
+   auto fd = ::open(hostPath.string().c_str(), O_RDONLY);
+   if (fd < 0) {
+      return nullptr;
+   }
+
+   // Empty files can not be mapped, let those fall back to a FILE *
+   struct stat st;
+   if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+      ::close(fd);
+      return nullptr;
+   }
+
+   auto data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                    MAP_SHARED, fd, 0);
+   if (data == MAP_FAILED) {
+      ::close(fd);
+      return nullptr;
+   }
+
+   return std::make_unique<HostMappedFileHandle>(
+      fd, reinterpret_cast<uint8_t *>(data),
+      static_cast<int64_t>(st.st_size));
+#else
+   return nullptr;
+#endif
+}
+
 Error
 HostDevice::remove(const User &user,
                    const Path &path)
@@ -22,7 +22,7 @@ class VirtualDevice;
 class HostDevice : public Device, public std::enable_shared_from_this<HostDevice>
 {
 public:
-   HostDevice(std::filesystem::path path);
+   HostDevice(std::filesystem::path path, bool mapReadOnlyFiles = false);
    ~HostDevice() override = default;
 
    Result<std::shared_ptr<Device>>
@@ -84,6 +84,7 @@ private:
    bool checkExecutePermission(const User &user, const Path &path);
 
    std::filesystem::path makeHostPath(const Path &guestPath) const;
+   std::unique_ptr<FileHandle> openMappedFile(const std::filesystem::path &hostPath) const;
 
    Error translateError(const std::error_code &ec) const;
    Error translateError(const std::system_error &ec) const;
@@ -92,6 +93,11 @@ private:
    std::filesystem::path mHostPath;
    std::map<std::string, HostNodePermission> mPermissionsCache;
 
+   //! Files opened for reading only are served from a memory mapping rather
+   //! than a FILE *, only safe for content which is not modified on the host
+   //! while the title is running, such as /vol/code and /vol/content.
+   bool mMapReadOnlyFiles;
+
    //! We want a virtual device backing this host device so we can do things
    //! like mount other devices within a host device. For example this could
    //! be useful if we have MLC / SLC on host device and we want to mount
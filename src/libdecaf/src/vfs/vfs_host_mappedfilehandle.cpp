@@ -0,0 +1,265 @@
+#include "vfs_host_mappedfilehandle.h"
+
+#ifdef PLATFORM_POSIX
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vfs
+{
+
+//! Number of back to back reads before we treat the file as streaming.
+static constexpr auto SequentialReadThreshold = 2u;
+static constexpr auto MinReadAheadWindow = int64_t { 256 * 1024 };
+static constexpr auto MaxReadAheadWindow = int64_t { 8 * 1024 * 1024 };
+
+HostMappedFileHandle::HostMappedFileHandle(int fd,
+                                           uint8_t *data,
+                                           int64_t size) :
+   mFd(fd),
+   mData(data),
+   mMapSize(size),
+   mSize(size)
+{
+}
+
+HostMappedFileHandle::~HostMappedFileHandle()
+{
+   close();
+}
+
+Error
+HostMappedFileHandle::close()
+{
+   if (mData) {
+      munmap(mData, static_cast<size_t>(mMapSize));
+      mData = nullptr;
+   }
+
+   if (mFd >= 0) {
+      ::close(mFd);
+      mFd = -1;
+   }
+
+   return Error::Success;
+}
+
+Result<bool>
+HostMappedFileHandle::eof()
+{
+   if (!mData) {
+      return { Error::NotOpen };
+   }
+
+   return { mEof };
+}
+
+Error
+HostMappedFileHandle::flush()
+{
+   if (!mData) {
+      return Error::NotOpen;
+   }
+
+   return Error::Success;
+}
+
+Error
+HostMappedFileHandle::seek(SeekDirection direction, int64_t offset)
+{
+   if (!mData) {
+      return Error::NotOpen;
+   }
+
+   auto position = int64_t { 0 };
+   switch (direction) {
+   case SeekCurrent:
+      position = mPosition + offset;
+      break;
+   case SeekEnd:
+      position = mSize + offset;
+      break;
+   case SeekStart:
+      position = offset;
+      break;
+   default:
+      return Error::InvalidSeekDirection;
+   }
+
+   if (position < 0) {
+      return Error::InvalidSeekPosition;
+   }
+
+   mPosition = position;
+   mEof = false;
+   return Error::Success;
+}
+
+Result<int64_t>
+HostMappedFileHandle::size()
+{
+   if (!mData) {
+      return { Error::NotOpen };
+   }
+
+   return { mSize };
+}
+
+Result<int64_t>
+HostMappedFileHandle::tell()
+{
+   if (!mData) {
+      return { Error::NotOpen };
+   }
+
+   return { mPosition };
+}
+
+Result<int64_t>
+HostMappedFileHandle::truncate()
+{
+   return { Error::ReadOnly };
+}
+
+Result<int64_t>
+HostMappedFileHandle::read(void *buffer, int64_t size, int64_t count)
+{
+   if (!mData) {
+      return { Error::NotOpen };
+   }
+
+   if (size <= 0 || count <= 0) {
+      return { int64_t { 0 } };
+   }
+
+   // Match fread semantics: copy as many bytes as are available, advance
+   // by that many and return the number of complete elements read.
+   auto requested = size * count;
+   if (mPosition + requested > mSize) {
+      updateSize();
+   }
+
+   auto available = std::max<int64_t>(mSize - mPosition, 0);
+   auto length = std::min(requested, available);
+
+   if (length > 0) {
+      updateReadAhead(mPosition, length);
+      std::memcpy(buffer, mData + mPosition, static_cast<size_t>(length));
+      mPosition += length;
+   }
+
+   if (length < requested) {
+      mEof = true;
+   }
+
+   return { length / size };
+}
+
+Result<int64_t>
+HostMappedFileHandle::write(const void *buffer, int64_t size, int64_t count)
+{
+   if (!mData) {
+      return { Error::NotOpen };
+   }
+
+   return { Error::ReadOnly };
+}
+
+void
+HostMappedFileHandle::updateReadAhead(int64_t offset, int64_t length)
+{
+   if (offset == mLastReadEnd) {
+      mSequentialReads++;
+   } else {
+      mSequentialReads = 0;
+      mReadAheadEnd = 0;
+      mReadAheadWindow = 0;
+   }
+
+   mLastReadEnd = offset + length;
+
+   if (mSequentialReads < SequentialReadThreshold) {
+      if (mSequentialReads == 0 && mAccessPattern == AccessPattern::Sequential) {
+         setAccessPattern(AccessPattern::Random);
+      }
+
+      return;
+   }
+
+   setAccessPattern(AccessPattern::Sequential);
+
+   // Keep the kernel one window ahead of the reader, doubling the window
+   // each time the reader catches up with it.
+   if (mLastReadEnd + mReadAheadWindow / 2 < mReadAheadEnd) {
+      return;
+   }
+
+   mReadAheadWindow = std::clamp(mReadAheadWindow * 2,
+                                 MinReadAheadWindow, MaxReadAheadWindow);
+
+   auto pageSize = static_cast<int64_t>(sysconf(_SC_PAGESIZE));
+   auto start = std::max(mReadAheadEnd, mLastReadEnd) & ~(pageSize - 1);
+   auto end = std::min(mLastReadEnd + mReadAheadWindow, mSize);
+   if (start < end) {
+      madvise(mData + start, static_cast<size_t>(end - start), MADV_WILLNEED);
+   }
+
+   mReadAheadEnd = end;
+}
+
+/**
+ * Check the host file size again after a read reached the end of it.
+ *
+ * Pages of the mapping past the end of a file which has shrunk raise SIGBUS
+ * when touched so we stop reads there, and remap a file which has grown so
+ * reads can see the new data.
+ */
+void
+HostMappedFileHandle::updateSize()
+{
+   struct stat st;
+   if (fstat(mFd, &st) != 0) {
+      return;
+   }
+
+   auto hostSize = static_cast<int64_t>(st.st_size);
+   if (hostSize <= mMapSize) {
+      mSize = hostSize;
+      return;
+   }
+
+   auto data = mmap(nullptr, static_cast<size_t>(hostSize), PROT_READ,
+                    MAP_SHARED, mFd, 0);
+   if (data == MAP_FAILED) {
+      mSize = mMapSize;
+      return;
+   }
+
+   munmap(mData, static_cast<size_t>(mMapSize));
+   mData = reinterpret_cast<uint8_t *>(data);
+   mMapSize = hostSize;
+   mSize = hostSize;
+
+   // The new mapping has no advice or read ahead yet
+   mAccessPattern = AccessPattern::Unknown;
+   mReadAheadEnd = 0;
+   mReadAheadWindow = 0;
+}
+
+void
+HostMappedFileHandle::setAccessPattern(AccessPattern pattern)
+{
+   if (mAccessPattern == pattern) {
+      return;
+   }
+
+   auto advice = (pattern == AccessPattern::Sequential) ? MADV_SEQUENTIAL : MADV_RANDOM;
+   madvise(mData, static_cast<size_t>(mMapSize), advice);
+   mAccessPattern = pattern;
+}
+
+} // namespace vfs
+
+#endif // ifdef PLATFORM_POSIX
@@ -0,0 +1,79 @@
+#pragma once
+#include <common/platform.h>
+
+#ifdef PLATFORM_POSIX
+#include "vfs_filehandle.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vfs
+{
+
+/**
+ * A read-only host file accessed through a memory mapping, reads copy
+ * directly from the page cache into the destination buffer.
+ *
+ * Sequential access is detected from consecutive reads and grows a
+ * read-ahead window which is hinted to the kernel with MADV_WILLNEED,
+ * random access drops back to MADV_RANDOM.
+ *
+ * Only meant for read-only title content. The host file size is cached
+ * when it is mapped and only checked again when a read reaches that size,
+ * picking up a file which has grown or shrunk since. A host file truncated
+ * by another process while a read is copying from it can still raise
+ * SIGBUS, as it would for any memory mapped reader, so the host must not
+ * modify title content while a title is running.
+ */
+class HostMappedFileHandle : public FileHandle
+{
+   enum class AccessPattern
+   {
+      Unknown,
+      Sequential,
+      Random,
+   };
+
+public:
+   HostMappedFileHandle(int fd, uint8_t *data, int64_t size);
+   ~HostMappedFileHandle() override;
+
+   Error close() override;
+   Result<bool> eof() override;
+   Error flush() override;
+   Error seek(SeekDirection direction, int64_t offset) override;
+   Result<int64_t> size() override;
+   Result<int64_t> tell() override;
+   Result<int64_t> truncate() override;
+   Result<int64_t> read(void *buffer, int64_t size, int64_t count) override;
+   Result<int64_t> write(const void *buffer, int64_t size, int64_t count) override;
+
+private:
+   void updateReadAhead(int64_t offset, int64_t length);
+   void setAccessPattern(AccessPattern pattern);
+   void updateSize();
+
+private:
+   int mFd;
+   uint8_t *mData;
+
+   //! Size of the mapping at mData.
+   int64_t mMapSize;
+
+   //! Size of the host file when it was last checked, never more than
+   //! mMapSize.
+   int64_t mSize;
+
+   int64_t mPosition = 0;
+   bool mEof = false;
+
+   AccessPattern mAccessPattern = AccessPattern::Unknown;
+   int64_t mLastReadEnd = -1;
+   uint32_t mSequentialReads = 0;
+   int64_t mReadAheadEnd = 0;
+   int64_t mReadAheadWindow = 0;
+};
+
+} // namespace vfs
+
+#endif // ifdef PLATFORM_POSIX
@@ -18,4 +18,24 @@ tile(const RetileInfo& desc,
      uint32_t firstSlice,
      uint32_t numSlices);
 
+/**
+ * Retile only the tiles [firstTile, firstTile + numTiles) of a single slice of
+ * a tiled surface, untiled points to the start of the untiled slice.
+ */
+void
+untileRange(const RetileInfo& desc,
+            uint8_t* untiled,
+            uint8_t* tiled,
+            uint32_t slice,
+            uint32_t firstTile,
+            uint32_t numTiles);
+
+void
+tileRange(const RetileInfo& desc,
+          uint8_t* untiled,
+          uint8_t* tiled,
+          uint32_t slice,
+          uint32_t firstTile,
+          uint32_t numTiles);
+
 }  // namespace gpu7::tiling::cpu
@@ -17,6 +17,19 @@ struct DebugSettings
 
    //! Only dump shader binaries
    bool dump_shader_binaries_only = false;
+
+   //! Run the SPIR-V optimizer over translated shaders
+   bool optimize_shaders = false;
+
+   //! Validate optimized shaders, falling back to the unoptimized shader
+   //! when validation fails
+   bool validate_optimized_shaders = false;
+
+   //! Cache byte swapped and decoded indirect buffers between calls
+   bool cache_display_lists = true;
+
+   //! Byte swap and decode PM4 on a separate thread to command recording
+   bool pm4_decode_thread = true;
 };
 
 struct DisplaySettings
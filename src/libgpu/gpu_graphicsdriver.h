@@ -34,6 +34,12 @@ struct WindowSystemInfo
    double renderSurfaceScale = 1.0;
 };
 
+enum class FrameCaptureFormat
+{
+   Tga,
+   Qoi,
+};
+
 struct GraphicsDriverDebugInfo
 {
    GraphicsDriverType type = GraphicsDriverType::Null;
@@ -67,15 +73,20 @@ public:
    virtual void notifyGpuFlush(phys_addr address,
                                uint32_t size) = 0;
 
-   // Begin a frame capture, frames will be dumped to outPrefix0.tga -> outPrefixN.tga
+   // Begin a frame capture, frames will be dumped to outPrefix0_tv.tga ->
+   //  outPrefixN_tv.tga (and _drc).  Frames are read back and encoded
+   //  asynchronously, if encoding falls behind frames are dropped rather than
+   //  stalling the GPU, which leaves gaps in the numbering.
    virtual bool
    startFrameCapture(const std::string &outPrefix,
+                     FrameCaptureFormat format,
                      bool captureTV,
                      bool captureDRC)
    {
       return false;
    }
 
+   // Stops a frame capture, returns the number of frames written.
    virtual size_t
    stopFrameCapture()
    {
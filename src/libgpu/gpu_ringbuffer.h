@@ -7,6 +7,18 @@ namespace gpu::ringbuffer
 
 using Buffer = gsl::span<uint32_t>;
 
+struct Stats
+{
+   //! Number of times the CPU wrote to the ring buffer.
+   uint64_t numWrites = 0;
+
+   //! Number of dwords written by the CPU.
+   uint64_t numWordsWritten = 0;
+
+   //! Number of times the GPU read a non-empty batch from the ring buffer.
+   uint64_t numReads = 0;
+};
+
 void
 write(const Buffer &buffer);
 
@@ -19,4 +31,7 @@ wait();
 void
 wake();
 
+Stats
+sampleStats();
+
 } // namespace gpu::ringbuffer
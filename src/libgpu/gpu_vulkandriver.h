@@ -21,6 +21,32 @@ struct VulkanDriverDebugInfo : GraphicsDriverDebugInfo
    uint64_t numSamplers = 0;
    uint64_t numSurfaces = 0;
    uint64_t numDataBuffers = 0;
+
+   uint64_t numOptimizedShaders = 0;
+   uint64_t shaderWordsBeforeOptimize = 0;
+   uint64_t shaderWordsAfterOptimize = 0;
+   double shaderOptimizeTimeMS = 0.0;
+   double pipelineCompileTimeMS = 0.0;
+
+   uint64_t numDisplayListCacheHits = 0;
+   uint64_t numDisplayListCacheMisses = 0;
+   uint64_t numDisplayListCacheInvalidations = 0;
+   uint64_t numDisplayListCacheEntries = 0;
+   uint64_t displayListCacheBytes = 0;
+
+   uint64_t numCachedDescriptorSets = 0;
+   uint64_t numDescriptorSetCacheHits = 0;
+   uint64_t numDescriptorSetCacheMisses = 0;
+
+   //! Descriptors written in the last frame, skipped writes are the ones
+   //! avoided by the descriptor set cache or by eliding identical pushes.
+   uint64_t descriptorWritesLastFrame = 0;
+   uint64_t descriptorWritesSkippedLastFrame = 0;
+
+   //! Frames written by the current frame capture, dropped frames are the
+   //! ones skipped because every readback buffer was still being encoded.
+   uint64_t numFramesCaptured = 0;
+   uint64_t numFramesCaptureDropped = 0;
 };
 
 } // namespace gpu
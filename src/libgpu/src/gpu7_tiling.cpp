@@ -69,28 +69,34 @@ addrLibFree(const ADDR_FREESYSMEM_INPUT *pInput)
 }
 
 static ADDR_HANDLE
-getAddrLibHandle()
+createAddrLib()
 {
-   static ADDR_HANDLE handle = nullptr;
-   if (!handle) {
-      auto input = ADDR_CREATE_INPUT { };
-      input.size = sizeof(ADDR_CREATE_INPUT);
-      input.chipEngine = CIASICIDGFXENGINE_R600;
-      input.chipFamily = 0x51;
-      input.chipRevision = 71;
-      input.createFlags.fillSizeFields = 1;
-      input.regValue.gbAddrConfig = 0x44902;
-      input.callbacks.allocSysMem = &addrLibAlloc;
-      input.callbacks.freeSysMem = &addrLibFree;
-
-      auto output = ADDR_CREATE_OUTPUT { };
-      output.size = sizeof(ADDR_CREATE_OUTPUT);
-
-      if (AddrCreate(&input, &output) == ADDR_OK) {
-         handle = output.hLib;
-      }
+   auto input = ADDR_CREATE_INPUT { };
+   input.size = sizeof(ADDR_CREATE_INPUT);
+   input.chipEngine = CIASICIDGFXENGINE_R600;
+   input.chipFamily = 0x51;
+   input.chipRevision = 71;
+   input.createFlags.fillSizeFields = 1;
+   input.regValue.gbAddrConfig = 0x44902;
+   input.callbacks.allocSysMem = &addrLibAlloc;
+   input.callbacks.freeSysMem = &addrLibFree;
+
+   auto output = ADDR_CREATE_OUTPUT { };
+   output.size = sizeof(ADDR_CREATE_OUTPUT);
+
+   if (AddrCreate(&input, &output) != ADDR_OK) {
+      return nullptr;
    }
 
+   return output.hLib;
+}
+
+static ADDR_HANDLE
+getAddrLibHandle()
+{
+   // Static initialisation is thread safe, so concurrent callers such as the
+   // gfd-tool batch workers all share the one AddrLib instance.
+   static ADDR_HANDLE handle = createAddrLib();
    return handle;
 }
 
@@ -469,7 +469,8 @@ retileTiledSurface3(const RetileInfo& info,
                     uint8_t *untiled,
                     uint8_t *tiled,
                     uint32_t firstSlice,
-                    uint32_t numSlices)
+                    uint32_t firstTile,
+                    uint32_t numTiles)
 {
    using Retiler = RetileCore<
       IsUntiling,
@@ -493,8 +494,7 @@ retileTiledSurface3(const RetileInfo& info,
    params.pipeSwizzle = info.pipeSwizzle;
    params.bankSwapWidth = info.bankSwapWidth;
 
-   uint32_t numTiles = numSlices * info.numTilesPerSlice;
-   for (auto tileIndex = 0u; tileIndex < numTiles; ++tileIndex) {
+   for (auto tileIndex = firstTile; tileIndex < firstTile + numTiles; ++tileIndex) {
       Retiler::retile(params, tileIndex, untiled, tiled);
    }
 }
@@ -505,29 +505,30 @@ retileTiledSurface2(const RetileInfo& info,
                     uint8_t *untiled,
                     uint8_t *tiled,
                     uint32_t firstSlice,
-                    uint32_t numSlices)
+                    uint32_t firstTile,
+                    uint32_t numTiles)
 {
    if (!info.isDepth) {
       if (info.bitsPerElement == 8) {
-         retileTiledSurface3<IsUntiling, RetileMode, 8, false>(info, untiled, tiled, firstSlice, numSlices);
+         retileTiledSurface3<IsUntiling, RetileMode, 8, false>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       } else if (info.bitsPerElement == 16) {
-         retileTiledSurface3<IsUntiling, RetileMode, 16, false>(info, untiled, tiled, firstSlice, numSlices);
+         retileTiledSurface3<IsUntiling, RetileMode, 16, false>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       } else if (info.bitsPerElement == 32) {
-         retileTiledSurface3<IsUntiling, RetileMode, 32, false>(info, untiled, tiled, firstSlice, numSlices);
+         retileTiledSurface3<IsUntiling, RetileMode, 32, false>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       } else if (info.bitsPerElement == 64) {
-         retileTiledSurface3<IsUntiling, RetileMode, 64, false>(info, untiled, tiled, firstSlice, numSlices);
+         retileTiledSurface3<IsUntiling, RetileMode, 64, false>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       } else if (info.bitsPerElement == 128) {
-         retileTiledSurface3<IsUntiling, RetileMode, 128, false>(info, untiled, tiled, firstSlice, numSlices);
+         retileTiledSurface3<IsUntiling, RetileMode, 128, false>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       } else {
          decaf_abort("Invalid color surface bpp");
       }
    } else {
       if (info.bitsPerElement == 16) {
-         retileTiledSurface3<IsUntiling, RetileMode, 16, true>(info, untiled, tiled, firstSlice, numSlices);
+         retileTiledSurface3<IsUntiling, RetileMode, 16, true>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       } else if (info.bitsPerElement == 32) {
-         retileTiledSurface3<IsUntiling, RetileMode, 32, true>(info, untiled, tiled, firstSlice, numSlices);
+         retileTiledSurface3<IsUntiling, RetileMode, 32, true>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       } else if (info.bitsPerElement == 64) {
-         retileTiledSurface3<IsUntiling, RetileMode, 64, true>(info, untiled, tiled, firstSlice, numSlices);
+         retileTiledSurface3<IsUntiling, RetileMode, 64, true>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       } else {
          decaf_abort("Invalid depth surface bpp");
       }
@@ -540,50 +541,51 @@ retileTiledSurface(const RetileInfo& info,
                    uint8_t *untiled,
                    uint8_t *tiled,
                    uint32_t firstSlice,
-                   uint32_t numSlices)
+                   uint32_t firstTile,
+                   uint32_t numTiles)
 {
    switch (info.tileMode) {
    case TileMode::Micro1DTiledThin1:
-      retileTiledSurface2<IsUntiling, TileMode::Micro1DTiledThin1>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Micro1DTiledThin1>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Micro1DTiledThick:
-      retileTiledSurface2<IsUntiling, TileMode::Micro1DTiledThick>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Micro1DTiledThick>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro2DTiledThin1:
-      retileTiledSurface2<IsUntiling, TileMode::Macro2DTiledThin1>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro2DTiledThin1>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro2DTiledThin2:
-      retileTiledSurface2<IsUntiling, TileMode::Macro2DTiledThin2>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro2DTiledThin2>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro2DTiledThin4:
-      retileTiledSurface2<IsUntiling, TileMode::Macro2DTiledThin4>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro2DTiledThin4>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro2DTiledThick:
-      retileTiledSurface2<IsUntiling, TileMode::Macro2DTiledThick>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro2DTiledThick>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro2BTiledThin1:
-      retileTiledSurface2<IsUntiling, TileMode::Macro2BTiledThin1>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro2BTiledThin1>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro2BTiledThin2:
-      retileTiledSurface2<IsUntiling, TileMode::Macro2BTiledThin2>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro2BTiledThin2>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro2BTiledThin4:
-      retileTiledSurface2<IsUntiling, TileMode::Macro2BTiledThin4>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro2BTiledThin4>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro2BTiledThick:
-      retileTiledSurface2<IsUntiling, TileMode::Macro2BTiledThick>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro2BTiledThick>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro3DTiledThin1:
-      retileTiledSurface2<IsUntiling, TileMode::Macro3DTiledThin1>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro3DTiledThin1>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro3DTiledThick:
-      retileTiledSurface2<IsUntiling, TileMode::Macro3DTiledThick>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro3DTiledThick>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro3BTiledThin1:
-      retileTiledSurface2<IsUntiling, TileMode::Macro3BTiledThin1>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro3BTiledThin1>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    case TileMode::Macro3BTiledThick:
-      retileTiledSurface2<IsUntiling, TileMode::Macro3BTiledThick>(info, untiled, tiled, firstSlice, numSlices);
+      retileTiledSurface2<IsUntiling, TileMode::Macro3BTiledThick>(info, untiled, tiled, firstSlice, firstTile, numTiles);
       break;
    default:
       decaf_abort("Unexpected tiled tile mode");
@@ -629,7 +631,8 @@ retile(const RetileInfo& info,
       return retileLinearSurface<IsUntiling>(info, untiled, tiled, firstSlice, numSlices);
    }
 
-   retileTiledSurface<IsUntiling>(info, untiled, tiled, firstSlice, numSlices);
+   retileTiledSurface<IsUntiling>(info, untiled, tiled, firstSlice,
+                                  0, numSlices * info.numTilesPerSlice);
 }
 
 void
@@ -652,4 +655,30 @@ tile(const RetileInfo& info,
    retile<false>(info, untiled, tiled, firstSlice, numSlices);
 }
 
+void
+untileRange(const RetileInfo& info,
+            uint8_t *untiled,
+            uint8_t *tiled,
+            uint32_t slice,
+            uint32_t firstTile,
+            uint32_t numTiles)
+{
+   decaf_check(info.isTiled);
+   decaf_check(firstTile + numTiles <= info.numTilesPerSlice);
+   retileTiledSurface<true>(info, untiled, tiled, slice, firstTile, numTiles);
+}
+
+void
+tileRange(const RetileInfo& info,
+          uint8_t *untiled,
+          uint8_t *tiled,
+          uint32_t slice,
+          uint32_t firstTile,
+          uint32_t numTiles)
+{
+   decaf_check(info.isTiled);
+   decaf_check(firstTile + numTiles <= info.numTilesPerSlice);
+   retileTiledSurface<false>(info, untiled, tiled, slice, firstTile, numTiles);
+}
+
 } // namespace gpu::tiling::cpu
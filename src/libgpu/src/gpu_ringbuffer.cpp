@@ -22,11 +22,16 @@ sConditionVariable;
 static bool
 sPendingWake = false;
 
+static Stats
+sStats;
+
 void
 write(const Buffer &items)
 {
    std::unique_lock<std::mutex> lock { sMutex };
    mWriteVector.insert(mWriteVector.end(), items.begin(), items.end());
+   sStats.numWrites++;
+   sStats.numWordsWritten += items.size();
    sConditionVariable.notify_all();
 }
 
@@ -36,6 +41,11 @@ read()
    std::unique_lock<std::mutex> lock { sMutex };
    mReadVector.clear();
    mReadVector.swap(mWriteVector);
+
+   if (!mReadVector.empty()) {
+      sStats.numReads++;
+   }
+
    return mReadVector;
 }
 
@@ -60,4 +70,11 @@ wake()
    sConditionVariable.notify_all();
 }
 
+Stats
+sampleStats()
+{
+   std::unique_lock<std::mutex> lock { sMutex };
+   return sStats;
+}
+
 } // namespace gpu::ringbuffer
@@ -6,18 +6,328 @@
 #include <common/log.h>
 #include <libcpu/mmu.h>
 
+static inline uint64_t
+getIndirectBufferKey(phys_addr address,
+                     uint32_t numDwords)
+{
+   return (static_cast<uint64_t>(address.getAddress()) << 32) | numDwords;
+}
+
+static void
+buildDisplayList(const uint32_t *buffer,
+                 uint32_t numDwords,
+                 Pm4DisplayList &displayList)
+{
+   displayList.dwords.resize(numDwords);
+   byte_swap_unaligned<uint32_t>(displayList.dwords.data(),
+                                 buffer, buffer + numDwords);
+
+   auto &swapped = displayList.dwords;
+
+   for (auto pos = 0u; pos < numDwords; ) {
+      auto header = Header::get(swapped[pos]);
+      auto size = 0u;
+
+      if (swapped[pos] == 0) {
+         break;
+      }
+
+      switch (header.type()) {
+      case PacketType::Type3:
+         size = HeaderType3::get(header.value).size() + 1;
+         decaf_check(pos + size <= numDwords);
+         displayList.packets.push_back({ header.value, pos + 1, size });
+         break;
+      case PacketType::Type0:
+         size = HeaderType0::get(header.value).count() + 1;
+         decaf_check(pos + size <= numDwords);
+         displayList.packets.push_back({ header.value, pos + 1, size });
+         break;
+      case PacketType::Type2:
+         // Filler packet, ignore
+         break;
+      case PacketType::Type1:
+      default:
+         gLog->error("Invalid packet header type {}, header = 0x{:08X}",
+                     header.type(), header.value);
+         pos = numDwords;
+         break;
+      }
+
+      pos += size + 1;
+   }
+
+   displayList.packets.shrink_to_fit();
+}
+
 void
 Pm4Processor::indirectBufferCall(const IndirectBufferCall &data)
 {
-   auto buffer = gpu::internal::translateAddress<uint32_t>(data.addr);
-   runCommandBuffer({ buffer, data.size });
+   runIndirectBuffer(data.addr, data.size);
 }
 
 void
 Pm4Processor::indirectBufferCallPriv(const IndirectBufferCallPriv &data)
 {
-   auto buffer = gpu::internal::translateAddress<uint32_t>(data.addr);
-   runCommandBuffer({ buffer, data.size });
+   runIndirectBuffer(data.addr, data.size);
+}
+
+void
+Pm4Processor::runIndirectBuffer(phys_addr address,
+                                uint32_t numDwords)
+{
+   auto buffer = gpu::internal::translateAddress<uint32_t>(address);
+
+   if (mDecodedIndirectBuffers) {
+      auto itr = mDecodedIndirectBuffers->find(getIndirectBufferKey(address, numDwords));
+      if (itr != mDecodedIndirectBuffers->end()) {
+         runDisplayList(*itr->second);
+         return;
+      }
+
+      // Not decoded ahead as it comes after a packet which may have changed
+      // it, so read it now that those packets have executed.
+   }
+
+   auto displayList = std::shared_ptr<const Pm4DisplayList> { };
+   if (mDisplayListCacheEnabled) {
+      displayList = lookupDisplayList(address, numDwords);
+   } else {
+      clearDisplayListCache();
+   }
+
+   if (displayList) {
+      runDisplayList(*displayList);
+   } else {
+      runCommandBuffer({ buffer, numDwords });
+   }
+}
+
+std::shared_ptr<const Pm4DisplayList>
+Pm4Processor::lookupDisplayList(phys_addr address,
+                                uint32_t numDwords)
+{
+   std::unique_lock lock { mDisplayListCacheMutex };
+   auto key = getIndirectBufferKey(address, numDwords);
+   auto &entry = mDisplayListCache[key];
+
+   if (entry && entry->uncacheable) {
+      if (--entry->uncacheableCalls > 0) {
+         mDisplayListCacheStats.uncached++;
+         return nullptr;
+      }
+
+      // Give it another chance, it is rebuilt below as a fresh entry
+      entry.reset();
+   }
+
+   auto state = cpu::getMemoryState(address, numDwords * sizeof(uint32_t));
+
+   if (entry && entry->state == state) {
+      mDisplayListCacheStats.hits++;
+      entry->numHits++;
+      return entry;
+   }
+
+   mDisplayListCacheStats.misses++;
+
+   // Entries are never modified in place once built as they may still be
+   // executing further up the call stack, or on another thread.
+   auto numInvalidations = 0u;
+
+   if (entry) {
+      mDisplayListCacheStats.invalidations++;
+      mDisplayListCacheStats.cachedBytes -= entry->dwords.size() * sizeof(uint32_t);
+
+      // Only count invalidations which happen back to back, any hit in
+      // between shows the list is worth caching.
+      numInvalidations = entry->numHits ? 1 : entry->numInvalidations + 1;
+
+      if (numInvalidations >= MaxDisplayListInvalidations) {
+         entry = std::make_shared<Pm4DisplayList>();
+         entry->uncacheable = true;
+         entry->uncacheableCalls = DisplayListUncacheableCalls;
+         return nullptr;
+      }
+   } else if (mDisplayListCache.size() > MaxDisplayListCacheEntries ||
+              mDisplayListCacheStats.cachedBytes + numDwords * sizeof(uint32_t) > MaxDisplayListCacheBytes) {
+      // This invalidates entry, so we must re-lookup key below
+      clearDisplayListCacheNoLock();
+   }
+
+   auto displayList = std::make_shared<Pm4DisplayList>();
+   displayList->state = state;
+   displayList->numInvalidations = numInvalidations;
+   buildDisplayList(gpu::internal::translateAddress<uint32_t>(address),
+                    numDwords, *displayList);
+
+   mDisplayListCache[key] = displayList;
+   mDisplayListCacheStats.numEntries = mDisplayListCache.size();
+   mDisplayListCacheStats.cachedBytes += numDwords * sizeof(uint32_t);
+   return displayList;
+}
+
+Pm4DisplayListCacheStats
+Pm4Processor::getDisplayListCacheStats()
+{
+   std::unique_lock lock { mDisplayListCacheMutex };
+   return mDisplayListCacheStats;
+}
+
+void
+Pm4Processor::runDisplayList(const Pm4DisplayList &displayList)
+{
+   decaf_check(mSwapScratchDepth + 1 < MaxPm4IndirectDepth);
+   mSwapScratchDepth++;
+
+   // The handlers take a mutable span for historical reasons, none of them
+   // actually write to the packet data.
+   auto dwords = const_cast<uint32_t *>(displayList.dwords.data());
+
+   for (auto &packet : displayList.packets) {
+      auto data = gsl::make_span(dwords + packet.offset, packet.size);
+
+      if (Header::get(packet.header).type() == PacketType::Type3) {
+         handlePacketType3(HeaderType3::get(packet.header), data);
+      } else {
+         handlePacketType0(HeaderType0::get(packet.header), data);
+      }
+   }
+
+   mSwapScratchDepth--;
+}
+
+void
+Pm4Processor::clearDisplayListCache()
+{
+   std::unique_lock lock { mDisplayListCacheMutex };
+   clearDisplayListCacheNoLock();
+}
+
+void
+Pm4Processor::clearDisplayListCacheNoLock()
+{
+   if (mDisplayListCache.empty()) {
+      return;
+   }
+
+   mDisplayListCache.clear();
+   mDisplayListCacheStats.numEntries = 0;
+   mDisplayListCacheStats.cachedBytes = 0;
+}
+
+/**
+ * Whether a packet can wait on or write to guest memory, any indirect buffer
+ * after one of these may not have its final contents until it has executed.
+ */
+static bool
+isMemorySyncPacket(IT_OPCODE opcode)
+{
+   switch (opcode) {
+   case IT_OPCODE::WAIT_REG_MEM:
+   case IT_OPCODE::MEM_SEMAPHORE:
+   case IT_OPCODE::MEM_WRITE:
+   case IT_OPCODE::COPY_DW:
+   case IT_OPCODE::EVENT_WRITE:
+   case IT_OPCODE::EVENT_WRITE_EOP:
+   case IT_OPCODE::PFP_SYNC_ME:
+   case IT_OPCODE::SURFACE_SYNC:
+   case IT_OPCODE::STRMOUT_BUFFER_UPDATE:
+   case IT_OPCODE::DECAF_COPY_SURFACE:
+      return true;
+   default:
+      return false;
+   }
+}
+
+void
+Pm4Processor::decodeBuffer(const gpu::ringbuffer::Buffer &buffer,
+                           Pm4DecodedBuffer &decoded,
+                           bool resolveIndirectBuffers)
+{
+   buildDisplayList(buffer.data(), static_cast<uint32_t>(buffer.size()),
+                    decoded.commands);
+
+   if (!mDisplayListCacheEnabled) {
+      clearDisplayListCache();
+   }
+
+   if (!decodeIndirectBuffers(decoded.commands, decoded, 1,
+                              resolveIndirectBuffers)) {
+      decoded.hasMemorySync = true;
+   }
+}
+
+/**
+ * Resolve the indirect buffers called from a display list in execution
+ * order, stopping at the first packet which could change what a later one
+ * contains. Returns false once such a packet has been seen.
+ */
+bool
+Pm4Processor::decodeIndirectBuffers(const Pm4DisplayList &displayList,
+                                    Pm4DecodedBuffer &decoded,
+                                    uint32_t depth,
+                                    bool resolveIndirectBuffers)
+{
+   for (auto &packet : displayList.packets) {
+      if (Header::get(packet.header).type() != PacketType::Type3) {
+         continue;
+      }
+
+      auto header = HeaderType3::get(packet.header);
+      if (isMemorySyncPacket(header.opcode())) {
+         return false;
+      }
+
+      if (header.opcode() != IT_OPCODE::INDIRECT_BUFFER &&
+          header.opcode() != IT_OPCODE::INDIRECT_BUFFER_PRIV) {
+         continue;
+      }
+
+      // We cannot tell what an unresolved buffer contains
+      if (!resolveIndirectBuffers || depth + 1 >= MaxPm4IndirectDepth) {
+         return false;
+      }
+
+      // INDIRECT_BUFFER and INDIRECT_BUFFER_PRIV share the same layout
+      auto dwords = const_cast<uint32_t *>(displayList.dwords.data());
+      auto reader = PacketReader { gsl::make_span(dwords + packet.offset, packet.size) };
+      auto data = read<IndirectBufferCall>(reader);
+      auto key = getIndirectBufferKey(data.addr, data.size);
+
+      if (decoded.indirectBuffers.count(key)) {
+         continue;
+      }
+
+      auto indirectBuffer = std::shared_ptr<const Pm4DisplayList> { };
+      if (mDisplayListCacheEnabled) {
+         indirectBuffer = lookupDisplayList(data.addr, data.size);
+      }
+
+      if (!indirectBuffer) {
+         auto uncached = std::make_shared<Pm4DisplayList>();
+         buildDisplayList(gpu::internal::translateAddress<uint32_t>(data.addr),
+                          data.size, *uncached);
+         indirectBuffer = uncached;
+      }
+
+      decoded.indirectBuffers.emplace(key, indirectBuffer);
+
+      if (!decodeIndirectBuffers(*indirectBuffer, decoded, depth + 1,
+                                 resolveIndirectBuffers)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+void
+Pm4Processor::runDecodedBuffer(const Pm4DecodedBuffer &decoded)
+{
+   mDecodedIndirectBuffers = &decoded.indirectBuffers;
+   runDisplayList(decoded.commands);
+   mDecodedIndirectBuffers = nullptr;
 }
 
 void
@@ -89,6 +399,13 @@ Pm4Processor::handlePacketType3(HeaderType3 header, const gsl::span<uint32_t> &d
 {
    PacketReader reader{ data };
 
+   // decodeBuffer stopped at the first of these packets, any indirect buffer
+   // called after it must be read when it executes even if an earlier call
+   // to the same buffer was decoded ahead.
+   if (mDecodedIndirectBuffers && isMemorySyncPacket(header.opcode())) {
+      mDecodedIndirectBuffers = nullptr;
+   }
+
    switch (header.opcode()) {
    case IT_OPCODE::DECAF_COPY_COLOR_TO_SCAN:
       decafCopyColorToScan(read<DecafCopyColorToScan>(reader));
@@ -251,12 +568,15 @@ Pm4Processor::indexType(const IndexType &data)
 {
    mRegisters[latte::Register::VGT_INDEX_TYPE / 4] = data.type.value;
    mRegisters[latte::Register::VGT_DMA_INDEX_TYPE / 4] = data.type.value;
+   markRegistersDirty(latte::Register::VGT_INDEX_TYPE, 4);
+   markRegistersDirty(latte::Register::VGT_DMA_INDEX_TYPE, 4);
 }
 
 void
 Pm4Processor::numInstances(const NumInstances &data)
 {
    mRegisters[latte::Register::VGT_DMA_NUM_INSTANCES / 4] = data.count;
+   markRegistersDirty(latte::Register::VGT_DMA_NUM_INSTANCES, 4);
 }
 
 void Pm4Processor::contextControl(const ContextControl &data)
@@ -298,6 +618,45 @@ Pm4Processor::setRegisters(latte::Register base,
    }
 
    memcpy(&mRegisters[base / 4], values.data(), values.size_bytes());
+   markRegistersDirty(base, static_cast<uint32_t>(values.size_bytes()));
+}
+
+struct RegisterGroupRange
+{
+   RegisterGroup group;
+   uint32_t begin;
+   uint32_t end;
+};
+
+static constexpr RegisterGroupRange
+sRegisterGroupRanges[] = {
+   { RegisterGroup::Config, latte::Register::ConfigRegisterBase, latte::Register::ConfigRegisterEnd },
+   { RegisterGroup::Context, latte::Register::ContextRegisterBase, latte::Register::ContextRegisterEnd },
+   { RegisterGroup::AluConst, latte::Register::AluConstRegisterBase, latte::Register::AluConstRegisterEnd },
+   { RegisterGroup::Resource, latte::Register::ResourceRegisterBase, latte::Register::ResourceRegisterEnd },
+   { RegisterGroup::Sampler, latte::Register::SamplerRegisterBase, latte::Register::SamplerRegisterEnd },
+   { RegisterGroup::Control, latte::Register::ControlRegisterBase, latte::Register::ControlRegisterEnd },
+   { RegisterGroup::LoopConst, latte::Register::LoopConstRegisterBase, latte::Register::LoopConstRegisterEnd },
+   { RegisterGroup::BoolConst, latte::Register::BoolConstRegisterBase, latte::Register::BoolConstRegisterEnd },
+};
+
+void
+Pm4Processor::markRegistersDirty(uint32_t base,
+                                 uint32_t size)
+{
+   auto end = base + size;
+   auto matched = false;
+
+   for (auto &range : sRegisterGroupRanges) {
+      if (base < range.end && end > range.begin) {
+         mDirtyStates |= mRegisterGroupStates[static_cast<size_t>(range.group)];
+         matched = true;
+      }
+   }
+
+   if (!matched) {
+      mDirtyStates |= mRegisterGroupStates[static_cast<size_t>(RegisterGroup::Other)];
+   }
 }
 
 void Pm4Processor::setAluConsts(const SetAluConsts &data)
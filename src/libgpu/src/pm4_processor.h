@@ -3,14 +3,104 @@
 #include "gpu_ringbuffer.h"
 
 #include <array>
+#include <atomic>
 #include <common/byte_swap_array.h>
+#include <libcpu/memtrack.h>
 #include <libcpu/pointer.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 using namespace latte::pm4;
 
 constexpr int MaxPm4IndirectDepth = 6;
 
+//! Total size of swapped display lists we will keep before flushing the cache.
+constexpr size_t MaxDisplayListCacheBytes = 32 * 1024 * 1024;
+
+//! Maximum number of display lists we will track before flushing the cache.
+constexpr size_t MaxDisplayListCacheEntries = 4096;
+
+//! Number of times in a row a display list can change without being hit in
+//! between before we stop trying to cache it, this catches the command buffer
+//! pool which reuses the same memory with new contents every frame.
+constexpr uint32_t MaxDisplayListInvalidations = 4;
+
+//! Number of calls an uncacheable display list is run uncached before we try
+//! caching it again, so a buffer which settles down after a busy period (e.g.
+//! a loading screen) is not left uncached for the rest of the run.
+constexpr uint32_t DisplayListUncacheableCalls = 256;
+
+/**
+ * An indirect buffer which has already been byte swapped and had its packet
+ * headers decoded, so repeated calls can dispatch straight to the handlers.
+ */
+struct Pm4DisplayList
+{
+   struct Packet
+   {
+      uint32_t header;
+      uint32_t offset;
+      uint32_t size;
+   };
+
+   cpu::MemtrackState state = { 0 };
+   std::vector<uint32_t> dwords;
+   std::vector<Packet> packets;
+   uint32_t numHits = 0;
+   uint32_t numInvalidations = 0;
+   uint32_t uncacheableCalls = 0;
+   bool uncacheable = false;
+};
+
+/**
+ * A ring buffer submission which has been byte swapped and decoded ahead of
+ * execution, along with every indirect buffer reachable from it.
+ */
+struct Pm4DecodedBuffer
+{
+   Pm4DisplayList commands;
+   std::unordered_map<uint64_t, std::shared_ptr<const Pm4DisplayList>> indirectBuffers;
+
+   //! Set when the submission contains a packet which can wait on or write
+   //! guest memory, indirect buffers after it were not resolved ahead.
+   bool hasMemorySync = false;
+};
+
+struct Pm4DisplayListCacheStats
+{
+   uint64_t hits = 0;
+   uint64_t misses = 0;
+   uint64_t invalidations = 0;
+   uint64_t uncached = 0;
+   uint64_t numEntries = 0;
+   uint64_t cachedBytes = 0;
+};
+
+/**
+ * Groups of registers which are tracked for dirty state.
+ */
+enum class RegisterGroup : uint32_t
+{
+   Config,
+   Context,
+   AluConst,
+   Resource,
+   Sampler,
+   Control,
+   LoopConst,
+   BoolConst,
+   Other,
+   Count,
+};
+
+constexpr uint32_t
+registerGroupMask(RegisterGroup group)
+{
+   return 1u << static_cast<uint32_t>(group);
+}
+
 class Pm4Processor
 {
 protected:
@@ -72,6 +162,62 @@ protected:
                       const gsl::span<std::pair<uint32_t, uint32_t>> &registers);
 
    void runCommandBuffer(const gpu::ringbuffer::Buffer &buffer);
+   void runIndirectBuffer(phys_addr address, uint32_t numDwords);
+   void runDisplayList(const Pm4DisplayList &displayList);
+   std::shared_ptr<const Pm4DisplayList> lookupDisplayList(phys_addr address, uint32_t numDwords);
+   void clearDisplayListCache();
+   void clearDisplayListCacheNoLock();
+   Pm4DisplayListCacheStats getDisplayListCacheStats();
+
+   /**
+    * Byte swap and decode a ring buffer submission and the indirect buffers it
+    * calls, this does not touch any register state so it can be run on a
+    * different thread to runDecodedBuffer.
+    *
+    * Indirect buffers are only resolved up to the first packet which can
+    * wait on or write guest memory, the rest are read when they execute.
+    * Pass resolveIndirectBuffers = false when an earlier submission which
+    * has not executed yet contains such a packet.
+    */
+   void decodeBuffer(const gpu::ringbuffer::Buffer &buffer, Pm4DecodedBuffer &decoded, bool resolveIndirectBuffers = true);
+   bool decodeIndirectBuffers(const Pm4DisplayList &displayList, Pm4DecodedBuffer &decoded, uint32_t depth, bool resolveIndirectBuffers);
+   void runDecodedBuffer(const Pm4DecodedBuffer &decoded);
+
+   /**
+    * Register a driver state object which depends on the given register
+    * groups, any write to a register in those groups marks it dirty.
+    */
+   void setStateRegisterGroups(uint32_t state, uint32_t groupMask)
+   {
+      decaf_check(state < 32);
+
+      for (auto group = 0u; group < mRegisterGroupStates.size(); ++group) {
+         if (groupMask & (1u << group)) {
+            mRegisterGroupStates[group] |= 1u << state;
+         } else {
+            mRegisterGroupStates[group] &= ~(1u << state);
+         }
+      }
+
+      mDirtyStates |= 1u << state;
+   }
+
+   bool isStateDirty(uint32_t state) const
+   {
+      return !!(mDirtyStates & (1u << state));
+   }
+
+   void markStateClean(uint32_t state)
+   {
+      mDirtyStates &= ~(1u << state);
+   }
+
+   void markAllStatesDirty()
+   {
+      mDirtyStates = ~0u;
+   }
+
+   void markRegistersDirty(uint32_t base, uint32_t size);
 
    uint32_t *byteSwapRegValues(uint32_t *values, size_t numValues)
    {
@@ -100,7 +246,26 @@ protected:
    std::array<uint32_t, 0x10000> mRegisters = { 0 };
    phys_addr mRegAddr_VGT_STRMOUT_DRAW_OPAQUE_BUFFER_FILLED_SIZE = phys_addr { 0 };
 
+   //! Bitmask of driver state objects which depend on each register group.
+   std::array<uint32_t, static_cast<size_t>(RegisterGroup::Count)> mRegisterGroupStates = { 0 };
+
+   //! Bitmask of driver state objects whose registers changed since they
+   //! were last marked clean.
+   uint32_t mDirtyStates = ~0u;
+
    std::vector<uint8_t> mRegisterScratch;
    std::array<std::vector<uint8_t>, MaxPm4IndirectDepth> mSwapScratch;
    uint32_t mSwapScratchDepth = 0;
+
+   //! Indirect buffers keyed by (address << 32) | size, entries are shared
+   //! so the cache can be flushed while a display list is executing. The
+   //! cache is used by both the decode and command recording threads so must
+   //! only be accessed with mDisplayListCacheMutex held.
+   std::atomic<bool> mDisplayListCacheEnabled { true };
+   std::mutex mDisplayListCacheMutex;
+   std::unordered_map<uint64_t, std::shared_ptr<Pm4DisplayList>> mDisplayListCache;
+   Pm4DisplayListCacheStats mDisplayListCacheStats;
+
+   //! Indirect buffers prepared by decodeBuffer for the executing submission.
+   const std::unordered_map<uint64_t, std::shared_ptr<const Pm4DisplayList>> *mDecodedIndirectBuffers = nullptr;
 };
@@ -0,0 +1,92 @@
+#ifdef DECAF_VULKAN
+#include "spirv_translate.h"
+
+#include <chrono>
+#include <common/log.h>
+
+#ifdef DECAF_SPIRV_OPT
+#include <spirv-tools/libspirv.hpp>
+#include <spirv-tools/optimizer.hpp>
+#endif
+
+namespace spirv
+{
+
+#ifdef DECAF_SPIRV_OPT
+
+static constexpr auto OptimizeTargetEnv = SPV_ENV_VULKAN_1_0;
+
+bool
+optimize(std::vector<unsigned int> &binary,
+         bool validate,
+         OptimizeResult *result)
+{
+   auto startTime = std::chrono::steady_clock::now();
+   auto optimizer = spvtools::Optimizer { OptimizeTargetEnv };
+   optimizer.SetMessageConsumer(
+      [](spv_message_level_t level, const char *, const spv_position_t &position, const char *message) {
+         if (level <= SPV_MSG_ERROR) {
+            gLog->error("spirv-opt: {} at word {}", message, position.index);
+         }
+      });
+
+   // The transpiler emits the Latte GPR file as a single private array and
+   // the PV/PS temporaries as private variables.  The performance recipe
+   // inlines fs_main / dc_main, moves those privates into function storage,
+   // splits constant indexed arrays (scalar replacement) and then rewrites
+   // them into SSA form, after which constant propagation can fold the
+   // constant-file and register indexing and ADCE strips the dead stores.
+   optimizer.RegisterPerformancePasses();
+
+   auto options = spvtools::OptimizerOptions { };
+   options.set_run_validator(validate);
+
+   auto optimized = std::vector<uint32_t> { };
+   auto success = optimizer.Run(binary.data(), binary.size(), &optimized, options);
+
+   if (success && validate) {
+      auto tools = spvtools::SpirvTools { OptimizeTargetEnv };
+      success = tools.Validate(optimized);
+      if (!success) {
+         gLog->error("spirv-opt: optimized shader failed validation");
+      }
+   }
+
+   if (result) {
+      result->wordsBefore = static_cast<uint32_t>(binary.size());
+      result->wordsAfter = success ? static_cast<uint32_t>(optimized.size())
+                                   : static_cast<uint32_t>(binary.size());
+      result->elapsedMS = std::chrono::duration<double, std::milli> {
+         std::chrono::steady_clock::now() - startTime }.count();
+   }
+
+   if (!success) {
+      // Leave the unoptimized shader in place so we can still render
+      return false;
+   }
+
+   binary.assign(optimized.begin(), optimized.end());
+   return true;
+}
+
+#else
+
+bool
+optimize(std::vector<unsigned int> &binary,
+         bool validate,
+         OptimizeResult *result)
+{
+   if (result) {
+      result->wordsBefore = static_cast<uint32_t>(binary.size());
+      result->wordsAfter = static_cast<uint32_t>(binary.size());
+      result->elapsedMS = 0.0;
+   }
+
+   return false;
+}
+
+#endif // ifdef DECAF_SPIRV_OPT
+
+} // namespace spirv
+
+#endif // ifdef DECAF_VULKAN
@@ -209,9 +209,23 @@ struct RectStubShader
    std::vector<unsigned int> binary;
 };
 
+struct OptimizeResult
+{
+   uint32_t wordsBefore = 0;
+   uint32_t wordsAfter = 0;
+   double elapsedMS = 0.0;
+};
+
 bool
 translate(const ShaderDesc& shaderDesc, Shader *shader);
 
+// Runs the SPIR-V optimizer over a translated shader, returns false and
+// leaves binary untouched if the optimizer is unavailable or failed.
+bool
+optimize(std::vector<unsigned int> &binary,
+         bool validate,
+         OptimizeResult *result = nullptr);
+
 RectStubShaderDesc
 generateRectSubShaderDesc(VertexShader *vertexShader);
 
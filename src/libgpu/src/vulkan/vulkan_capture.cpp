@@ -0,0 +1,356 @@
+#ifdef DECAF_VULKAN
+#include "vulkan_driver.h"
+
+#include <algorithm>
+#include <common/log.h>
+#include <common/qoi_encoder.h>
+#include <common/tga_encoder.h>
+#include <cstring>
+#include <fmt/format.h>
+
+namespace vulkan
+{
+
+/*
+Frame capture copies the TV and DRC scan buffers into host visible readback
+buffers at the end of each frame's command buffer.  Once the sync waiter for
+that command buffer retires, the slot is handed to a pool of encoder threads,
+so neither the readback nor the encoding ever blocks the GPU thread.  When
+all slots are still waiting to be encoded the frame is dropped instead.
+*/
+
+bool
+Driver::startFrameCapture(const std::string &outPrefix,
+                          gpu::FrameCaptureFormat format,
+                          bool captureTV,
+                          bool captureDRC)
+{
+   if (!captureTV && !captureDRC) {
+      return false;
+   }
+
+   auto lock = std::unique_lock { mFrameCaptureMutex };
+   if (mFrameCaptureEnabled) {
+      return false;
+   }
+
+   mFrameCapturePrefix = outPrefix;
+   mFrameCaptureFormat = format;
+   mFrameCaptureTv = captureTV;
+   mFrameCaptureDrc = captureDRC;
+   mFrameCaptureNextFrame = 0;
+   mFramesCaptured = 0;
+   mFramesCaptureDropped = 0;
+
+   // stopFrameCapture waits for every outstanding slot to be returned, so
+   // they are all free at this point.
+   decaf_check(mFrameCaptureSlotsOutstanding == 0);
+   mFreeFrameCaptureSlots.clear();
+   mReadbackFrameCaptureSlots.clear();
+   mEncodeFrameCaptureSlots.clear();
+
+   for (auto &slot : mFrameCaptureSlots) {
+      mFreeFrameCaptureSlots.push_back(&slot);
+   }
+
+   auto numThreads = std::clamp(std::thread::hardware_concurrency() / 2,
+                                1u, MaxFrameCaptureThreads);
+   mFrameCaptureThreadsRunning = true;
+
+   for (auto i = 0u; i < numThreads; ++i) {
+      mFrameCaptureThreads.emplace_back(&Driver::frameCaptureThread, this);
+   }
+
+   mFrameCaptureEnabled = true;
+   return true;
+}
+
+size_t
+Driver::stopFrameCapture()
+{
+   auto lock = std::unique_lock { mFrameCaptureMutex };
+   if (!mFrameCaptureEnabled) {
+      return 0;
+   }
+
+   // No new slots can be taken once this is cleared, as captureFrame checks
+   // it with the lock held.
+   mFrameCaptureEnabled = false;
+
+   // Let frames which have already been taken finish reading back and
+   // encoding. The retire tasks only run while the driver is running, if it
+   // has stopped we wait for the GPU to go idle and hand over the readbacks
+   // ourselves.
+   while (mFrameCaptureSlotsOutstanding > 0) {
+      if (mRunState != RunState::Running && !mReadbackFrameCaptureSlots.empty()) {
+         lock.unlock();
+         mDevice.waitIdle();
+         lock.lock();
+
+         for (auto slot : mReadbackFrameCaptureSlots) {
+            mEncodeFrameCaptureSlots.push_back(slot);
+         }
+
+         mReadbackFrameCaptureSlots.clear();
+         mFrameCaptureSignal.notify_all();
+      }
+
+      mFrameCaptureSignal.wait_for(lock, std::chrono::milliseconds { 100 });
+   }
+
+   mFrameCaptureThreadsRunning = false;
+   mFrameCaptureSignal.notify_all();
+
+   auto framesCaptured = mFramesCaptured;
+   auto framesDropped = mFramesCaptureDropped;
+   auto threads = std::move(mFrameCaptureThreads);
+   mFrameCaptureThreads.clear();
+   lock.unlock();
+
+   for (auto &thread : threads) {
+      thread.join();
+   }
+
+   gLog->info("Frame capture finished, {} frames captured, {} frames dropped",
+              framesCaptured, framesDropped);
+   return static_cast<size_t>(framesCaptured);
+}
+
+void
+Driver::destroyFrameCapture()
+{
+   stopFrameCapture();
+
+   for (auto &slot : mFrameCaptureSlots) {
+      for (auto &buffer : slot.buffers) {
+         if (buffer) {
+            vmaDestroyBuffer(mAllocator, buffer->buffer, buffer->memory);
+            delete buffer;
+            buffer = nullptr;
+         }
+      }
+   }
+}
+
+void
+Driver::captureFrame()
+{
+   auto frameNumber = mFrameCaptureNextFrame++;
+   auto scanBuffers = std::array<SwapChainObject *, 2> {
+      mFrameCaptureTv ? mTvSwapChain : nullptr,
+      mFrameCaptureDrc ? mDrcSwapChain : nullptr,
+   };
+
+   auto anyPresentable = false;
+   for (auto scanBuffer : scanBuffers) {
+      anyPresentable |= (scanBuffer && scanBuffer->presentable);
+   }
+
+   if (!anyPresentable) {
+      return;
+   }
+
+   auto slot = static_cast<FrameCaptureSlot *>(nullptr);
+   {
+      auto lock = std::unique_lock { mFrameCaptureMutex };
+      if (!mFrameCaptureEnabled) {
+         // Capture was stopped since decafSwapBuffers checked
+         return;
+      }
+
+      if (mFreeFrameCaptureSlots.empty()) {
+         mFramesCaptureDropped++;
+         return;
+      }
+
+      slot = mFreeFrameCaptureSlots.back();
+      mFreeFrameCaptureSlots.pop_back();
+      mReadbackFrameCaptureSlots.push_back(slot);
+      mFrameCaptureSlotsOutstanding++;
+   }
+
+   slot->frameNumber = frameNumber;
+
+   for (auto i = 0u; i < scanBuffers.size(); ++i) {
+      auto scanBuffer = scanBuffers[i];
+      slot->captured[i] = scanBuffer && scanBuffer->presentable;
+      if (!slot->captured[i]) {
+         continue;
+      }
+
+      auto width = scanBuffer->desc.width;
+      auto height = scanBuffer->desc.height;
+      auto size = width * height * 4;
+      auto &buffer = slot->buffers[i];
+
+      // The slot is free so nothing on the GPU can still be using its buffer
+      if (buffer && buffer->maximumSize < size) {
+         vmaDestroyBuffer(mAllocator, buffer->buffer, buffer->memory);
+         delete buffer;
+         buffer = nullptr;
+      }
+
+      if (!buffer) {
+         buffer = _allocStagingBuffer(size, StagingBufferType::GpuToCpu);
+      }
+
+      buffer->size = size;
+      slot->extents[i] = vk::Extent2D { width, height };
+
+      // Scan buffers rest in TransferDstOptimal, see allocateSwapChain
+      auto imageBarrier = vk::ImageMemoryBarrier { };
+      imageBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+      imageBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+      imageBarrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+      imageBarrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+      imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      imageBarrier.image = scanBuffer->image;
+      imageBarrier.subresourceRange = scanBuffer->subresRange;
+
+      mActiveCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                           vk::PipelineStageFlagBits::eTransfer,
+                                           vk::DependencyFlags { },
+                                           {},
+                                           {},
+                                           { imageBarrier });
+
+      auto copyRegion = vk::BufferImageCopy { };
+      copyRegion.bufferOffset = 0;
+      copyRegion.bufferRowLength = 0;
+      copyRegion.bufferImageHeight = 0;
+      copyRegion.imageSubresource = vk::ImageSubresourceLayers { vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
+      copyRegion.imageOffset = vk::Offset3D { 0, 0, 0 };
+      copyRegion.imageExtent = vk::Extent3D { width, height, 1 };
+      mActiveCommandBuffer.copyImageToBuffer(scanBuffer->image,
+                                             vk::ImageLayout::eTransferSrcOptimal,
+                                             buffer->buffer,
+                                             { copyRegion });
+
+      imageBarrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+      imageBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderRead;
+      imageBarrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+      imageBarrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+
+      mActiveCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                           vk::PipelineStageFlagBits::eAllCommands,
+                                           vk::DependencyFlags { },
+                                           {},
+                                           {},
+                                           { imageBarrier });
+   }
+
+   auto hostBarrier = vk::MemoryBarrier { };
+   hostBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+   hostBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+   mActiveCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                        vk::PipelineStageFlagBits::eHost,
+                                        vk::DependencyFlags { },
+                                        { hostBarrier },
+                                        {},
+                                        {});
+
+   addRetireTask([=](){
+      auto lock = std::unique_lock { mFrameCaptureMutex };
+      auto itr = std::find(mReadbackFrameCaptureSlots.begin(),
+                           mReadbackFrameCaptureSlots.end(),
+                           slot);
+
+      // stopFrameCapture may have already handed it over after a waitIdle
+      if (itr != mReadbackFrameCaptureSlots.end()) {
+         mReadbackFrameCaptureSlots.erase(itr);
+         mEncodeFrameCaptureSlots.push_back(slot);
+         mFrameCaptureSignal.notify_all();
+      }
+   });
+}
+
+void
+Driver::frameCaptureThread()
+{
+   auto scratch = std::vector<uint8_t> { };
+   auto lock = std::unique_lock { mFrameCaptureMutex };
+
+   while (true) {
+      if (mEncodeFrameCaptureSlots.empty()) {
+         if (!mFrameCaptureThreadsRunning) {
+            break;
+         }
+
+         mFrameCaptureSignal.wait(lock);
+         continue;
+      }
+
+      auto slot = mEncodeFrameCaptureSlots.front();
+      mEncodeFrameCaptureSlots.pop_front();
+      lock.unlock();
+
+      encodeCapturedFrame(slot, scratch);
+
+      lock.lock();
+      mFramesCaptured++;
+      mFreeFrameCaptureSlots.push_back(slot);
+      mFrameCaptureSlotsOutstanding--;
+
+      // Wakes stopFrameCapture when it is waiting for the slots to drain
+      mFrameCaptureSignal.notify_all();
+   }
+}
+
+void
+Driver::encodeCapturedFrame(FrameCaptureSlot *slot,
+                            std::vector<uint8_t> &scratch)
+{
+   static constexpr std::array<const char *, 2> ScanNames = { "tv", "drc" };
+   auto extension = (mFrameCaptureFormat == gpu::FrameCaptureFormat::Qoi) ? "qoi" : "tga";
+
+   for (auto i = 0u; i < slot->buffers.size(); ++i) {
+      if (!slot->captured[i]) {
+         continue;
+      }
+
+      auto buffer = slot->buffers[i];
+      auto width = slot->extents[i].width;
+      auto height = slot->extents[i].height;
+      auto pitch = width * 4;
+      auto path = fmt::format("{}{}_{}.{}", mFrameCapturePrefix,
+                              slot->frameNumber, ScanNames[i], extension);
+
+      // Make the GPU writes visible to the CPU
+      vmaInvalidateAllocation(mAllocator, buffer->memory, 0, VK_WHOLE_SIZE);
+
+      auto src = static_cast<const uint8_t *>(buffer->mappedPtr);
+      scratch.resize(pitch * height);
+
+      // The scan buffers are R8G8B8A8, their alpha is ignored on scan-out
+      // so we force the captured frames to be opaque.
+      if (mFrameCaptureFormat == gpu::FrameCaptureFormat::Tga) {
+         // TGA is stored bottom-up in BGRA order
+         for (auto y = 0u; y < height; ++y) {
+            auto srcRow = src + (height - 1 - y) * pitch;
+            auto dstRow = scratch.data() + y * pitch;
+
+            for (auto x = 0u; x < width; ++x) {
+               dstRow[x * 4 + 0] = srcRow[x * 4 + 2];
+               dstRow[x * 4 + 1] = srcRow[x * 4 + 1];
+               dstRow[x * 4 + 2] = srcRow[x * 4 + 0];
+               dstRow[x * 4 + 3] = 0xFF;
+            }
+         }
+
+         tga::writeFile(path, 32, 8, width, height, scratch.data());
+      } else {
+         std::memcpy(scratch.data(), src, pitch * height);
+
+         for (auto x = 3u; x < scratch.size(); x += 4) {
+            scratch[x] = 0xFF;
+         }
+
+         qoi::writeFile(path, width, height, scratch.data());
+      }
+   }
+}
+
+} // namespace vulkan
+
+#endif // ifdef DECAF_VULKAN
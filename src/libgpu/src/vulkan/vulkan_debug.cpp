@@ -39,6 +39,25 @@ Driver::updateDebuggerInfo()
    mDebugInfo.numSamplers = mSamplers.size();
    mDebugInfo.numSurfaces = mSurfaceGroups.size();
    mDebugInfo.numDataBuffers = mMemCaches.size();
+
+   auto displayListCacheStats = getDisplayListCacheStats();
+   mDebugInfo.numDisplayListCacheHits = displayListCacheStats.hits;
+   mDebugInfo.numDisplayListCacheMisses = displayListCacheStats.misses;
+   mDebugInfo.numDisplayListCacheInvalidations = displayListCacheStats.invalidations;
+   mDebugInfo.numDisplayListCacheEntries = displayListCacheStats.numEntries;
+   mDebugInfo.displayListCacheBytes = displayListCacheStats.cachedBytes;
+
+   mDebugInfo.numCachedDescriptorSets = mDescriptorSetCache.size();
+   mDebugInfo.numDescriptorSetCacheHits = mDescriptorSetCacheHits;
+   mDebugInfo.numDescriptorSetCacheMisses = mDescriptorSetCacheMisses;
+   mDebugInfo.descriptorWritesLastFrame = mDescriptorWritesLastFrame;
+   mDebugInfo.descriptorWritesSkippedLastFrame = mDescriptorWritesSkippedLastFrame;
+
+   {
+      auto lock = std::unique_lock { mFrameCaptureMutex };
+      mDebugInfo.numFramesCaptured = mFramesCaptured;
+      mDebugInfo.numFramesCaptureDropped = mFramesCaptureDropped;
+   }
 }
 
 void
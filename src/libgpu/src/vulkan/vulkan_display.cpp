@@ -19,6 +19,12 @@
 namespace vulkan
 {
 
+//! Scan-out resolution used when there is no window to present to.
+static constexpr auto HeadlessDisplayWidth = 1280u;
+static constexpr auto HeadlessDisplayHeight = 720u;
+static constexpr auto NumHeadlessImages = 2u;
+static constexpr auto HeadlessSurfaceFormat = vk::Format::eR8G8B8A8Srgb;
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL
 debugMessageCallback(VkDebugReportFlagsEXT flags,
                      VkDebugReportObjectTypeEXT objectType,
@@ -150,6 +156,9 @@ getWindowSystemExtensions(gpu::WindowSystemType wsiType, std::vector<const char*
     */
    switch (wsiType)
    {
+   case gpu::WindowSystemType::Headless:
+      // Scan-out is rendered to offscreen images, no surface is required
+      break;
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
    case gpu::WindowSystemType::Windows:
       extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
@@ -327,12 +336,15 @@ createDevice(vk::PhysicalDevice &physicalDevice, vk::SurfaceKHR &surface)
    };
 
    std::vector<const char *> requiredExtensions = {
-      VK_KHR_SWAPCHAIN_EXTENSION_NAME,
       VK_EXT_VERTEX_ATTRIBUTE_DIVISOR_EXTENSION_NAME,
       VK_KHR_MAINTENANCE1_EXTENSION_NAME,
       VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME,
       VK_KHR_STORAGE_BUFFER_STORAGE_CLASS_EXTENSION_NAME,
    };
+
+   if (surface) {
+      requiredExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+   }
    std::vector<const char *> missingRequiredExtensions = {};
 
    std::vector<const char *> optionalExtensions = {
@@ -453,7 +465,7 @@ createDevice(vk::PhysicalDevice &physicalDevice, vk::SurfaceKHR &surface)
    for (; queueFamilyIndex < queueFamilyProps.size(); ++queueFamilyIndex) {
       auto &qfp = queueFamilyProps[queueFamilyIndex];
 
-      if (!physicalDevice.getSurfaceSupportKHR(queueFamilyIndex, surface)) {
+      if (surface && !physicalDevice.getSurfaceSupportKHR(queueFamilyIndex, surface)) {
          continue;
       }
 
@@ -520,7 +532,12 @@ createRenderPass(VulkanDisplayPipeline &displayPipeline,
    colorAttachmentDesc.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
    colorAttachmentDesc.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
    colorAttachmentDesc.initialLayout = vk::ImageLayout::eUndefined;
-   colorAttachmentDesc.finalLayout = vk::ImageLayout::ePresentSrcKHR;
+
+   if (displayPipeline.headless) {
+      colorAttachmentDesc.finalLayout = vk::ImageLayout::eTransferSrcOptimal;
+   } else {
+      colorAttachmentDesc.finalLayout = vk::ImageLayout::ePresentSrcKHR;
+   }
 
    auto colorAttachmentRef = vk::AttachmentReference { };
    colorAttachmentRef.attachment = 0;
@@ -909,6 +926,98 @@ chooseMemoryTypeIndex(vk::PhysicalDevice &physicalDevice,
    return { };
 }
 
+static bool
+createOffscreenTargets(VulkanDisplayPipeline &displayPipeline,
+                       vk::PhysicalDevice &physicalDevice,
+                       vk::Device &device)
+{
+   displayPipeline.swapchainExtents = vk::Extent2D { HeadlessDisplayWidth, HeadlessDisplayHeight };
+   displayPipeline.offscreenImages.resize(NumHeadlessImages);
+   displayPipeline.offscreenImageMemory.resize(NumHeadlessImages);
+   displayPipeline.swapchainImageViews.resize(NumHeadlessImages);
+   displayPipeline.framebuffers.resize(NumHeadlessImages);
+
+   for (auto i = 0u; i < NumHeadlessImages; ++i) {
+      auto imageCreateInfo = vk::ImageCreateInfo { };
+      imageCreateInfo.imageType = vk::ImageType::e2D;
+      imageCreateInfo.format = displayPipeline.windowSurfaceFormat;
+      imageCreateInfo.extent = vk::Extent3D { HeadlessDisplayWidth, HeadlessDisplayHeight, 1 };
+      imageCreateInfo.mipLevels = 1;
+      imageCreateInfo.arrayLayers = 1;
+      imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
+      imageCreateInfo.tiling = vk::ImageTiling::eOptimal;
+      imageCreateInfo.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+      imageCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+      imageCreateInfo.initialLayout = vk::ImageLayout::eUndefined;
+      displayPipeline.offscreenImages[i] = device.createImage(imageCreateInfo);
+
+      auto imageMemoryRequirements =
+         device.getImageMemoryRequirements(displayPipeline.offscreenImages[i]);
+
+      auto memoryTypeIndex =
+         chooseMemoryTypeIndex(physicalDevice,
+                               imageMemoryRequirements.memoryTypeBits,
+                               vk::MemoryPropertyFlagBits::eDeviceLocal);
+      if (!memoryTypeIndex) {
+         return false;
+      }
+
+      auto allocateInfo = vk::MemoryAllocateInfo { };
+      allocateInfo.allocationSize = imageMemoryRequirements.size;
+      allocateInfo.memoryTypeIndex = *memoryTypeIndex;
+      displayPipeline.offscreenImageMemory[i] = device.allocateMemory(allocateInfo);
+      device.bindImageMemory(displayPipeline.offscreenImages[i], displayPipeline.offscreenImageMemory[i], 0);
+
+      auto imageViewCreateInfo = vk::ImageViewCreateInfo { };
+      imageViewCreateInfo.image = displayPipeline.offscreenImages[i];
+      imageViewCreateInfo.viewType = vk::ImageViewType::e2D;
+      imageViewCreateInfo.format = displayPipeline.windowSurfaceFormat;
+      imageViewCreateInfo.components = vk::ComponentMapping();
+      imageViewCreateInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+      imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+      imageViewCreateInfo.subresourceRange.levelCount = 1;
+      imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+      imageViewCreateInfo.subresourceRange.layerCount = 1;
+      displayPipeline.swapchainImageViews[i] = device.createImageView(imageViewCreateInfo);
+
+      auto framebufferCreateInfo = vk::FramebufferCreateInfo { };
+      framebufferCreateInfo.renderPass = displayPipeline.renderPass;
+      framebufferCreateInfo.attachmentCount = 1;
+      framebufferCreateInfo.pAttachments = &displayPipeline.swapchainImageViews[i];
+      framebufferCreateInfo.width = HeadlessDisplayWidth;
+      framebufferCreateInfo.height = HeadlessDisplayHeight;
+      framebufferCreateInfo.layers = 1;
+      displayPipeline.framebuffers[i] = device.createFramebuffer(framebufferCreateInfo);
+   }
+
+   return true;
+}
+
+static void
+destroyOffscreenTargets(VulkanDisplayPipeline &displayPipeline,
+                        vk::Device &device)
+{
+   for (const auto &framebuffer : displayPipeline.framebuffers) {
+      device.destroyFramebuffer(framebuffer);
+   }
+   displayPipeline.framebuffers.clear();
+
+   for (const auto &imageView : displayPipeline.swapchainImageViews) {
+      device.destroyImageView(imageView);
+   }
+   displayPipeline.swapchainImageViews.clear();
+
+   for (const auto &image : displayPipeline.offscreenImages) {
+      device.destroyImage(image);
+   }
+   displayPipeline.offscreenImages.clear();
+
+   for (const auto &memory : displayPipeline.offscreenImageMemory) {
+      device.freeMemory(memory);
+   }
+   displayPipeline.offscreenImageMemory.clear();
+}
+
 static bool
 createBuffers(VulkanDisplayPipeline &displayPipeline,
               vk::PhysicalDevice &physicalDevice,
@@ -1018,14 +1127,20 @@ Driver::setWindowSystemInfo(const gpu::WindowSystemInfo &wsi)
       decaf_abort("choosePhysicalDevice failed");
    }
 
-   auto windowSurface = createVulkanSurface(instance, wsi);
-   if (!windowSurface) {
-      decaf_abort("createVulkanSurface failed");
-   }
+   auto headless = (wsi.type == gpu::WindowSystemType::Headless);
+   auto windowSurface = vk::SurfaceKHR { };
+   auto surfaceFormat = HeadlessSurfaceFormat;
+
+   if (!headless) {
+      windowSurface = createVulkanSurface(instance, wsi);
+      if (!windowSurface) {
+         decaf_abort("createVulkanSurface failed");
+      }
 
-   auto surfaceFormat = chooseSurfaceFormat(physicalDevice, windowSurface);
-   if (!windowSurface) {
-      decaf_abort("chooseSurfaceFormat failed");
+      surfaceFormat = chooseSurfaceFormat(physicalDevice, windowSurface);
+      if (!windowSurface) {
+         decaf_abort("chooseSurfaceFormat failed");
+      }
    }
 
 
@@ -1046,16 +1161,24 @@ Driver::setWindowSystemInfo(const gpu::WindowSystemInfo &wsi)
    initialise(instance, physicalDevice, device, queue, queueFamilyIndex);
 
    // Create our full display pipeline
+   mDisplayPipeline.headless = headless;
    mDisplayPipeline.windowSurface = windowSurface;
    mDisplayPipeline.windowSurfaceFormat = surfaceFormat;
    mDisplayPipeline.queueFamilyIndex = queueFamilyIndex;
-   mDisplayPipeline.presentMode = choosePresentMode(physicalDevice, windowSurface);
+
+   if (!headless) {
+      mDisplayPipeline.presentMode = choosePresentMode(physicalDevice, windowSurface);
+   }
 
    if (!createRenderPass(mDisplayPipeline, device)) {
       decaf_abort("createRenderPass failed");
    }
 
-   if (!createSwapchain(mDisplayPipeline, physicalDevice, device)) {
+   if (headless) {
+      if (!createOffscreenTargets(mDisplayPipeline, physicalDevice, device)) {
+         decaf_abort("createOffscreenTargets failed");
+      }
+   } else if (!createSwapchain(mDisplayPipeline, physicalDevice, device)) {
       decaf_abort("createSwapchain failed");
    }
 
@@ -1133,8 +1256,12 @@ Driver::destroyDisplayPipeline()
    mDisplayPipeline.descriptorSetLayout = nullptr;
    mDisplayPipeline.pipelineLayout = nullptr;
 
-   // createSwapchain
-   destroySwapchain(mDisplayPipeline, mDevice);
+   // createSwapchain / createOffscreenTargets
+   if (mDisplayPipeline.headless) {
+      destroyOffscreenTargets(mDisplayPipeline, mDevice);
+   } else {
+      destroySwapchain(mDisplayPipeline, mDevice);
+   }
 
    // createRenderPass
    mDevice.destroyRenderPass(mDisplayPipeline.renderPass);
@@ -1242,27 +1369,31 @@ Driver::renderDisplay()
                                        std::numeric_limits<uint64_t>::max());
    mDevice.resetFences({ renderFence });
 
-   // Acquire the next frame to render into
-   auto nextSwapImage = uint32_t { 0 };
-   try {
-      result = mDevice.acquireNextImageKHR(mDisplayPipeline.swapchain,
-                                           std::numeric_limits<uint64_t>::max(),
-                                           imageAvailableSemaphore,
-                                           vk::Fence {},
-                                           &nextSwapImage);
-   } catch (vk::OutOfDateKHRError err) {
-      result = vk::Result::eErrorOutOfDateKHR;
-   }
+   // Acquire the next frame to render into, in headless mode we just cycle
+   // through our offscreen images in step with the frame index.
+   auto nextSwapImage = static_cast<uint32_t>(frameIndex);
+
+   if (!mDisplayPipeline.headless) {
+      try {
+         result = mDevice.acquireNextImageKHR(mDisplayPipeline.swapchain,
+                                              std::numeric_limits<uint64_t>::max(),
+                                              imageAvailableSemaphore,
+                                              vk::Fence {},
+                                              &nextSwapImage);
+      } catch (vk::OutOfDateKHRError err) {
+         result = vk::Result::eErrorOutOfDateKHR;
+      }
 
-   if (result == vk::Result::eErrorOutOfDateKHR) {
-      // Recreate swapchain
-      recreateSwapchain(mDisplayPipeline, mPhysDevice, mDevice);
+      if (result == vk::Result::eErrorOutOfDateKHR) {
+         // Recreate swapchain
+         recreateSwapchain(mDisplayPipeline, mPhysDevice, mDevice);
 
-      // Try acquire again, this one will die if it fails :D
-      result = mDevice.acquireNextImageKHR(mDisplayPipeline.swapchain,
-                                           std::numeric_limits<uint64_t>::max(),
-                                           imageAvailableSemaphore, vk::Fence {},
-                                           &nextSwapImage);
+         // Try acquire again, this one will die if it fails :D
+         result = mDevice.acquireNextImageKHR(mDisplayPipeline.swapchain,
+                                              std::numeric_limits<uint64_t>::max(),
+                                              imageAvailableSemaphore, vk::Fence {},
+                                              &nextSwapImage);
+      }
    }
 
    // Allocate a command buffer to use
@@ -1361,6 +1492,16 @@ Driver::renderDisplay()
    }
    renderCmdBuf.end();
 
+   if (mDisplayPipeline.headless) {
+      auto submitInfo = vk::SubmitInfo { };
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers = &renderCmdBuf;
+      mQueue.submit({ submitInfo }, renderFence);
+
+      mDisplayPipeline.frameIndex = (frameIndex + 1) % NumHeadlessImages;
+      return;
+   }
+
    {
       auto submitInfo = vk::SubmitInfo { };
 
@@ -127,13 +127,9 @@ Driver::bindDescriptors()
    }
    */
 
-   vk::DescriptorSet dSet;
-   if (!mCurrentDraw->pipeline->pipelineLayout) {
-      // If there is no custom pipeline layout configured, this means we have to use
-      // standard descriptor sets rather than being able to take advantage of push.
-
-      dSet = allocateGenericDescriptorSet();
-   }
+   // If there is no custom pipeline layout configured, this means we have to use
+   // standard descriptor sets rather than being able to take advantage of push.
+   auto usePushDescriptors = !!mCurrentDraw->pipeline->pipelineLayout;
 
    mScratchDescriptorWrites.clear();
    auto &descWrites = mScratchDescriptorWrites;
@@ -148,7 +144,6 @@ Driver::bindDescriptors()
 
          descWrites.push_back({});
          vk::WriteDescriptorSet& writeDesc = descWrites.back();
-         writeDesc.dstSet = dSet;
          writeDesc.dstBinding = bindingBase + i;
          writeDesc.dstArrayElement = 0;
          writeDesc.descriptorCount = 1;
@@ -179,7 +174,6 @@ Driver::bindDescriptors()
 
          descWrites.push_back({});
          vk::WriteDescriptorSet& writeDesc = descWrites.back();
-         writeDesc.dstSet = dSet;
          writeDesc.dstBinding = bindingBase + i;
          writeDesc.dstArrayElement = 0;
          writeDesc.descriptorCount = 1;
@@ -190,20 +184,90 @@ Driver::bindDescriptors()
       }
    }
 
-   if (!dSet) {
+   auto descHash = hashDescriptorWrites(descWrites);
+   auto numWrites = static_cast<uint64_t>(descWrites.size());
+
+   if (usePushDescriptors) {
+      auto pipelineLayout = mCurrentDraw->pipeline->pipelineLayout->pipelineLayout;
+
+      // Pushed descriptors stay bound until something is bound to set 0 with
+      // an incompatible layout, so identical pushes can be skipped.
+      if (mActivePushDescriptorLayout == pipelineLayout &&
+          mActivePushDescriptorHash == descHash) {
+         mDescriptorWritesSkippedThisFrame += numWrites;
+         return;
+      }
+
       mActiveCommandBuffer.pushDescriptorSetKHR(vk::PipelineBindPoint::eGraphics,
-                                                mCurrentDraw->pipeline->pipelineLayout->pipelineLayout,
+                                                pipelineLayout,
                                                 0,
                                                 descWrites,
                                                 mVkDynLoader);
+
+      mActivePushDescriptorLayout = pipelineLayout;
+      mActivePushDescriptorHash = descHash;
+      mDescriptorWritesThisFrame += numWrites;
+      return;
+   }
+
+   auto dSet = vk::DescriptorSet { };
+   auto cacheIter = mDescriptorSetCache.find(descHash);
+
+   if (cacheIter != mDescriptorSetCache.end()) {
+      dSet = cacheIter->second;
+      mDescriptorSetCacheHits++;
+      mDescriptorWritesSkippedThisFrame += numWrites;
    } else {
+      dSet = allocateCachedDescriptorSet();
+
+      for (auto &writeDesc : descWrites) {
+         writeDesc.dstSet = dSet;
+
+         if (writeDesc.pImageInfo && writeDesc.pImageInfo->imageView) {
+            auto imageView = static_cast<VkImageView>(writeDesc.pImageInfo->imageView);
+            mDescriptorSetsByImageView[imageView].push_back(descHash);
+         }
+      }
+
       mDevice.updateDescriptorSets(descWrites, {});
+      mDescriptorSetCache.emplace(descHash, dSet);
+      mDescriptorSetCacheMisses++;
+      mDescriptorWritesThisFrame += numWrites;
+   }
+
+   mActiveCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                                           mPipelineLayout,
+                                           0,
+                                           { dSet }, {});
+
+   // Binding set 0 disturbs whatever was previously pushed
+   mActivePushDescriptorLayout = vk::PipelineLayout { };
+}
 
-      mActiveCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-                                              mPipelineLayout,
-                                              0,
-                                              { dSet }, {});
+DataHash
+Driver::hashDescriptorWrites(const std::vector<vk::WriteDescriptorSet> &descWrites)
+{
+   // DataHash combines successive writes with xor, so the whole key has to
+   // be hashed in one go for the binding order to be significant.
+   mScratchDescriptorKeys.clear();
+
+   for (auto &writeDesc : descWrites) {
+      mScratchDescriptorKeys.push_back(writeDesc.dstBinding);
+      mScratchDescriptorKeys.push_back(static_cast<uint64_t>(writeDesc.descriptorType));
+
+      if (writeDesc.pImageInfo) {
+         mScratchDescriptorKeys.push_back(reinterpret_cast<uint64_t>(static_cast<VkSampler>(writeDesc.pImageInfo->sampler)));
+         mScratchDescriptorKeys.push_back(reinterpret_cast<uint64_t>(static_cast<VkImageView>(writeDesc.pImageInfo->imageView)));
+      }
+
+      if (writeDesc.pBufferInfo) {
+         mScratchDescriptorKeys.push_back(reinterpret_cast<uint64_t>(static_cast<VkBuffer>(writeDesc.pBufferInfo->buffer)));
+         mScratchDescriptorKeys.push_back(writeDesc.pBufferInfo->offset);
+         mScratchDescriptorKeys.push_back(writeDesc.pBufferInfo->range);
+      }
    }
+
+   return DataHash {}.write(mScratchDescriptorKeys);
 }
 
 void
@@ -9,6 +9,16 @@
 namespace vulkan
 {
 
+//! Maximum number of descriptor sets we keep cached before flushing them all.
+static constexpr auto MaxCachedDescriptorSets = 8192u;
+
+//! Number of descriptor sets allocated from each descriptor pool.
+static constexpr auto DescriptorSetsPerPool = 32u;
+
+//! Number of decoded submissions the decode thread may queue up ahead of
+//! command recording.
+static constexpr auto MaxDecodedBuffers = 4u;
+
 Driver::Driver()
 {
 }
@@ -49,6 +59,9 @@ Driver::initialise(vk::Instance instance,
                mDebug = settings.debug.debug_enabled;
                mDumpShaders = settings.debug.dump_shaders;
                mDumpShaderBinariesOnly = settings.debug.dump_shader_binaries_only;
+               mOptimizeShaders = settings.debug.optimize_shaders;
+               mValidateOptimizedShaders = settings.debug.validate_optimized_shaders;
+               mDisplayListCacheEnabled = settings.debug.cache_display_lists;
             });
       });
 
@@ -57,6 +70,10 @@ Driver::initialise(vk::Instance instance,
    mDebug = gpuConfig->debug.debug_enabled;
    mDumpShaders = gpuConfig->debug.dump_shaders;
    mDumpShaderBinariesOnly = gpuConfig->debug.dump_shader_binaries_only;
+   mOptimizeShaders = gpuConfig->debug.optimize_shaders;
+   mValidateOptimizedShaders = gpuConfig->debug.validate_optimized_shaders;
+   mDisplayListCacheEnabled = gpuConfig->debug.cache_display_lists;
+   mDecodeThreadEnabled = gpuConfig->debug.pm4_decode_thread;
 
    mPhysDevice = physDevice;
    mDevice = device;
@@ -105,16 +122,50 @@ Driver::initialise(vk::Instance instance,
    initialiseBlankSampler();
    initialiseBlankImage();
    initialiseBlankBuffer();
+   initialiseDirtyStates();
 
    setupResources();
 }
 
+void
+Driver::initialiseDirtyStates()
+{
+   // Registers outside of the known groups are rare, we conservatively treat
+   // them as affecting every state.
+   auto shaderGroups =
+      registerGroupMask(RegisterGroup::Config) |
+      registerGroupMask(RegisterGroup::Context) |
+      registerGroupMask(RegisterGroup::Resource) |
+      registerGroupMask(RegisterGroup::Other);
+
+   setStateRegisterGroups(VertexShaderState, shaderGroups);
+   setStateRegisterGroups(GeometryShaderState, shaderGroups);
+   setStateRegisterGroups(PixelShaderState, shaderGroups);
+   setStateRegisterGroups(PipelineState, shaderGroups);
+
+   setStateRegisterGroups(SamplersState,
+                          registerGroupMask(RegisterGroup::Sampler) |
+                          registerGroupMask(RegisterGroup::Other));
+
+   setStateRegisterGroups(ViewportScissorState,
+                          registerGroupMask(RegisterGroup::Context) |
+                          registerGroupMask(RegisterGroup::Other));
+}
+
 void
 Driver::destroy()
 {
    mFenceSignal.notify_all();
    mFenceThread.join();
 
+   if (mDecodeThread.joinable()) {
+      mDecodeThread.join();
+   }
+
+   mDecodedBuffers.clear();
+   mPendingSyncBuffers = 0;
+
+   destroyFrameCapture();
    destroyDisplayPipeline();
 }
 
@@ -257,72 +308,106 @@ Driver::setupResources()
 }
 
 vk::DescriptorPool
-Driver::allocateDescriptorPool(uint32_t numDraws)
+Driver::createDescriptorPool(uint32_t numDraws)
 {
-   vk::DescriptorPool descriptorPool;
+   std::vector<vk::DescriptorPoolSize> descriptorPoolSizes = {
+      vk::DescriptorPoolSize(vk::DescriptorType::eSampler, latte::MaxSamplers * 3 * numDraws),
+      vk::DescriptorPoolSize(vk::DescriptorType::eSampledImage, latte::MaxTextures * 3 * numDraws),
+      vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, latte::MaxUniformBlocks * 3 * numDraws),
+   };
+
+   vk::DescriptorPoolCreateInfo descriptorPoolInfo;
+   descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
+   descriptorPoolInfo.pPoolSizes = descriptorPoolSizes.data();
+   descriptorPoolInfo.maxSets = static_cast<uint32_t>(numDraws);
+   return mDevice.createDescriptorPool(descriptorPoolInfo);
+}
 
-   if (!descriptorPool) {
-      if (!mDescriptorPools.empty()) {
-         descriptorPool = mDescriptorPools.back();
-         mDescriptorPools.pop_back();
-      }
+std::vector<vk::DescriptorSet>
+Driver::allocateBaseDescriptorSets(vk::DescriptorPool descriptorPool)
+{
+   std::array<vk::DescriptorSetLayout, DescriptorSetsPerPool> setLayouts;
+   setLayouts.fill(mBaseDescriptorSetLayout);
+
+   vk::DescriptorSetAllocateInfo allocInfo;
+   allocInfo.descriptorSetCount = static_cast<uint32_t>(setLayouts.size());
+   allocInfo.pSetLayouts = setLayouts.data();
+   allocInfo.descriptorPool = descriptorPool;
+   return mDevice.allocateDescriptorSets(allocInfo);
+}
+
+vk::DescriptorSet
+Driver::allocateCachedDescriptorSet()
+{
+   if (mDescriptorSetCache.size() >= MaxCachedDescriptorSets) {
+      flushDescriptorSetCache();
    }
 
-   if (!descriptorPool) {
-      std::vector<vk::DescriptorPoolSize> descriptorPoolSizes = {
-         vk::DescriptorPoolSize(vk::DescriptorType::eSampler, latte::MaxSamplers * 3 * numDraws),
-         vk::DescriptorPoolSize(vk::DescriptorType::eSampledImage, latte::MaxTextures * 3 * numDraws),
-         vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, latte::MaxUniformBlocks * 3 * numDraws),
-      };
-
-      vk::DescriptorPoolCreateInfo descriptorPoolInfo;
-      descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
-      descriptorPoolInfo.pPoolSizes = descriptorPoolSizes.data();
-      descriptorPoolInfo.maxSets = static_cast<uint32_t>(numDraws);
-      descriptorPool = mDevice.createDescriptorPool(descriptorPoolInfo);
+   if (mFreeCachedDescriptorSets.empty()) {
+      // Cached sets outlive command buffers, so their pools are never reset
+      // and the sets are instead recycled once the GPU is done with them.
+      auto newPool = createDescriptorPool(DescriptorSetsPerPool);
+      mDescriptorCachePools.push_back(newPool);
+      mFreeCachedDescriptorSets = allocateBaseDescriptorSets(newPool);
    }
 
-   mActiveSyncWaiter->descriptorPools.push_back(descriptorPool);
+   auto descriptorSet = mFreeCachedDescriptorSets.back();
+   mFreeCachedDescriptorSets.pop_back();
 
-   return descriptorPool;
+   return descriptorSet;
 }
 
-vk::DescriptorSet
-Driver::allocateGenericDescriptorSet()
+void
+Driver::retireCachedDescriptorSets(std::vector<vk::DescriptorSet> descriptorSets)
 {
-   if (mAvailableDescriptorSets.empty()) {
-      std::array<vk::DescriptorSetLayout, 32> setLayouts = {
-         mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout,
-         mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout,
-         mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout,
-         mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout,
-         mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout,
-         mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout,
-         mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout,
-         mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout, mBaseDescriptorSetLayout
-      };
-      auto numSetLayouts = static_cast<uint32_t>(setLayouts.size());
-
-      auto newPool = allocateDescriptorPool(numSetLayouts);
-
-      vk::DescriptorSetAllocateInfo allocInfo;
-      allocInfo.descriptorSetCount = numSetLayouts;
-      allocInfo.pSetLayouts = setLayouts.data();
-      allocInfo.descriptorPool = newPool;
-      mAvailableDescriptorSets = mDevice.allocateDescriptorSets(allocInfo);
+   if (descriptorSets.empty()) {
+      return;
    }
 
-   auto descriptorSet = mAvailableDescriptorSets.back();
-   mAvailableDescriptorSets.pop_back();
+   // The sets may still be referenced by in flight command buffers
+   addRetireTask([=](){
+      mFreeCachedDescriptorSets.insert(mFreeCachedDescriptorSets.end(),
+                                       descriptorSets.begin(),
+                                       descriptorSets.end());
+   });
+}
 
-   return descriptorSet;
+void
+Driver::invalidateDescriptorSets(vk::ImageView imageView)
+{
+   auto iter = mDescriptorSetsByImageView.find(static_cast<VkImageView>(imageView));
+   if (iter == mDescriptorSetsByImageView.end()) {
+      return;
+   }
+
+   auto retiredSets = std::vector<vk::DescriptorSet> { };
+
+   for (auto &hash : iter->second) {
+      // The set may have already been invalidated through another view
+      auto cacheIter = mDescriptorSetCache.find(hash);
+      if (cacheIter != mDescriptorSetCache.end()) {
+         retiredSets.push_back(cacheIter->second);
+         mDescriptorSetCache.erase(cacheIter);
+      }
+   }
+
+   mDescriptorSetsByImageView.erase(iter);
+   retireCachedDescriptorSets(std::move(retiredSets));
 }
 
 void
-Driver::retireDescriptorPool(vk::DescriptorPool descriptorPool)
+Driver::flushDescriptorSetCache()
 {
-   mDevice.resetDescriptorPool(descriptorPool, vk::DescriptorPoolResetFlags());
-   mDescriptorPools.push_back(descriptorPool);
+   auto retiredSets = std::vector<vk::DescriptorSet> { };
+   retiredSets.reserve(mDescriptorSetCache.size());
+
+   for (auto &item : mDescriptorSetCache) {
+      retiredSets.push_back(item.second);
+   }
+
+   mDescriptorSetCache.clear();
+   mDescriptorSetsByImageView.clear();
+   retireCachedDescriptorSets(std::move(retiredSets));
 }
 
 vk::QueryPool
@@ -357,26 +442,114 @@ Driver::retireOccQueryPool(vk::QueryPool pool)
    mOccQueryPools.push_back(pool);
 }
 
+/**
+ * The GPU thread. With gpu.pm4_decode_thread enabled PM4 decoding runs ahead
+ * on decodeThread, and this thread executes the decoded packets and records
+ * every command buffer itself.
+ *
+ * Recording stays on this one thread. Draws read and update the memcache,
+ * the surface and pipeline caches and the active render pass as they are
+ * recorded, so they can not be recorded into secondary command buffers on
+ * other threads without first snapshotting that state per draw.
+ */
 void
 Driver::run()
 {
+   if (mDecodeThreadEnabled) {
+      mDecodeThread = std::thread { std::bind(&Driver::decodeThread, this) };
+   }
+
    while (mRunState == RunState::Running) {
-      // Grab the next buffer
-      gpu::ringbuffer::wait();
-      auto buffer = gpu::ringbuffer::read();
+      auto decoded = std::unique_ptr<Pm4DecodedBuffer> { };
+
+      if (mDecodeThreadEnabled) {
+         // Grab the next buffer from the decode thread
+         std::unique_lock lock { mDecodeMutex };
+         if (mDecodedBuffers.empty() && !mDecodePendingWake) {
+            mDecodeSignal.wait(lock);
+         }
+
+         mDecodePendingWake = false;
+
+         if (!mDecodedBuffers.empty()) {
+            decoded = std::move(mDecodedBuffers.front());
+            mDecodedBuffers.pop_front();
+            mDecodeSignal.notify_all();
+         }
+      } else {
+         // Grab the next buffer
+         gpu::ringbuffer::wait();
+         auto buffer = gpu::ringbuffer::read();
+
+         if (!buffer.empty()) {
+            decoded = std::make_unique<Pm4DecodedBuffer>();
+            decodeBuffer(buffer, *decoded);
+         }
+      }
 
       // Check for any fences completing
       checkSyncFences();
 
       // Process the buffer if there is anything new
-      if (!buffer.empty()) {
-         executeBuffer(buffer);
+      if (decoded) {
+         executeBuffer(*decoded);
+
+         if (mDecodeThreadEnabled && decoded->hasMemorySync) {
+            std::unique_lock lock { mDecodeMutex };
+            mPendingSyncBuffers--;
+         }
       }
    }
 
    destroy();
 }
 
+void
+Driver::decodeThread()
+{
+   while (mRunState == RunState::Running) {
+      gpu::ringbuffer::wait();
+      auto buffer = gpu::ringbuffer::read();
+      auto decoded = std::unique_ptr<Pm4DecodedBuffer> { };
+
+      if (!buffer.empty()) {
+         // An earlier submission which can still wait on or write guest
+         // memory has not executed yet, so indirect buffers we would read
+         // now may not have their final contents.
+         auto resolveIndirectBuffers = false;
+         {
+            std::unique_lock lock { mDecodeMutex };
+            resolveIndirectBuffers = (mPendingSyncBuffers == 0);
+         }
+
+         decoded = std::make_unique<Pm4DecodedBuffer>();
+         decodeBuffer(buffer, *decoded, resolveIndirectBuffers);
+      }
+
+      std::unique_lock lock { mDecodeMutex };
+
+      // Don't let the guest get too far ahead of command recording
+      while (decoded &&
+             mDecodedBuffers.size() >= MaxDecodedBuffers &&
+             mRunState == RunState::Running) {
+         mDecodeSignal.wait(lock);
+      }
+
+      if (decoded) {
+         if (decoded->hasMemorySync) {
+            mPendingSyncBuffers++;
+         }
+
+         mDecodedBuffers.push_back(std::move(decoded));
+      }
+
+      // Forward the wake even without a new buffer, as the ring buffer is
+      // also woken when a fence completes.
+      mDecodePendingWake = true;
+      mDecodeSignal.notify_all();
+   }
+}
+
 void
 Driver::runUntilFlip()
 {
@@ -392,7 +565,9 @@ Driver::runUntilFlip()
       // Process the buffer if there is anything new
       auto buffer = gpu::ringbuffer::read();
       if (!buffer.empty()) {
-         executeBuffer(buffer);
+         auto decoded = Pm4DecodedBuffer { };
+         decodeBuffer(buffer, decoded);
+         executeBuffer(decoded);
       }
 
       if (mLastSwap > startingSwap) {
@@ -406,6 +581,10 @@ Driver::stop()
 {
    mRunState = RunState::Stopped;
    gpu::ringbuffer::wake();
+
+   std::unique_lock lock { mDecodeMutex };
+   mDecodePendingWake = true;
+   mDecodeSignal.notify_all();
 }
 
 void
@@ -427,7 +606,6 @@ Driver::endCommandGroup()
    // Clear our state in between command buffers for safety
    mActiveCommandBuffer = nullptr;
    mActiveSyncWaiter = nullptr;
-   mAvailableDescriptorSets.clear();
 }
 
 void
@@ -455,6 +633,10 @@ Driver::endCommandBuffer()
    mActivePsConstantsSet = false;
    mLastIndexBufferSet = false;
    mDrawCache = DrawDesc{};
+   mActivePushDescriptorLayout = vk::PipelineLayout { };
+
+   // Everything must be revalidated against the fresh draw cache
+   markAllStatesDirty();
 
    // Stop recording this host command buffer
    mActiveCommandBuffer.end();
@@ -17,6 +17,7 @@
 #include <atomic>
 #include <common/vulkan_hpp.h>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <gsl/gsl-lite.hpp>
 #include <list>
@@ -248,7 +249,6 @@ struct SyncWaiter
 {
    bool isCompleted = false;
    vk::Fence fence;
-   std::vector<vk::DescriptorPool> descriptorPools;
    std::vector<vk::QueryPool> occQueryPools;
    std::vector<gpu7::tiling::vulkan::RetileHandle> retileHandles;
    std::vector<StagingBuffer *> stagingBuffers;
@@ -257,6 +257,16 @@ struct SyncWaiter
    vk::CommandBuffer cmdBuffer;
 };
 
+//! Host visible copies of the scan buffers for one captured frame, index 0
+//! is the TV and index 1 is the DRC.
+struct FrameCaptureSlot
+{
+   uint64_t frameNumber = 0;
+   std::array<bool, 2> captured = { false, false };
+   std::array<vk::Extent2D, 2> extents;
+   std::array<StagingBuffer *, 2> buffers = { nullptr, nullptr };
+};
+
 struct SurfaceSubRange
 {
    uint32_t firstSlice;
@@ -442,6 +452,11 @@ struct DrawDesc
 
 struct VulkanDisplayPipeline
 {
+   //! Render scan-out to offscreen images instead of a window surface.
+   bool headless = false;
+   std::vector<vk::Image> offscreenImages;
+   std::vector<vk::DeviceMemory> offscreenImageMemory;
+
    vk::SurfaceKHR windowSurface;
    vk::Format windowSurfaceFormat;
    uint32_t queueFamilyIndex;
@@ -495,6 +510,12 @@ public:
    virtual void notifyCpuFlush(phys_addr address, uint32_t size) override;
    virtual void notifyGpuFlush(phys_addr address, uint32_t size) override;
 
+   virtual bool startFrameCapture(const std::string &outPrefix,
+                                  gpu::FrameCaptureFormat format,
+                                  bool captureTV,
+                                  bool captureDRC) override;
+   virtual size_t stopFrameCapture() override;
+
 protected:
    void initialise(vk::Instance instance, vk::PhysicalDevice physDevice,
                    vk::Device device, vk::Queue queue,
@@ -511,6 +532,12 @@ protected:
    void renderDisplay();
    void destroyDisplayPipeline();
 
+   // Frame Capture
+   void captureFrame();
+   void frameCaptureThread();
+   void encodeCapturedFrame(FrameCaptureSlot *slot, std::vector<uint8_t> &scratch);
+   void destroyFrameCapture();
+
    // Command Buffer Stuff
    void beginCommandGroup();
    void endCommandGroup();
@@ -518,9 +545,13 @@ protected:
    void endCommandBuffer();
 
    // Descriptor Sets
-   vk::DescriptorPool allocateDescriptorPool(uint32_t numDraws);
-   vk::DescriptorSet allocateGenericDescriptorSet();
-   void retireDescriptorPool(vk::DescriptorPool descriptorPool);
+   vk::DescriptorPool createDescriptorPool(uint32_t numDraws);
+   std::vector<vk::DescriptorSet> allocateBaseDescriptorSets(vk::DescriptorPool descriptorPool);
+   vk::DescriptorSet allocateCachedDescriptorSet();
+   void retireCachedDescriptorSets(std::vector<vk::DescriptorSet> descriptorSets);
+   void invalidateDescriptorSets(vk::ImageView imageView);
+   void flushDescriptorSetCache();
+   DataHash hashDescriptorWrites(const std::vector<vk::WriteDescriptorSet> &descWrites);
 
    // Fences
    SyncWaiter * allocateSyncWaiter();
@@ -548,7 +579,9 @@ protected:
    void retireOccQueryPool(vk::QueryPool pool);
 
    // Driver
-   void executeBuffer(const gpu::ringbuffer::Buffer &buffer);
+   void initialiseDirtyStates();
+   void executeBuffer(const Pm4DecodedBuffer &decoded);
+   void decodeThread();
    int32_t findMemoryType(uint32_t memoryTypeBits, vk::MemoryPropertyFlags props);
 
    // Viewports
@@ -655,6 +688,7 @@ protected:
    spirv::VertexShaderDesc getVertexShaderDesc();
    spirv::GeometryShaderDesc getGeometryShaderDesc();
    spirv::PixelShaderDesc getPixelShaderDesc();
+   void optimizeTranslatedShader(spirv::Shader *shader);
    bool checkCurrentVertexShader();
    bool checkCurrentGeometryShader();
    bool checkCurrentPixelShader();
@@ -720,6 +754,17 @@ private:
       Stopped
    };
 
+   //! Draw state which is only revalidated when its registers are dirty
+   enum DirtyState : uint32_t
+   {
+      VertexShaderState,
+      GeometryShaderState,
+      PixelShaderState,
+      PipelineState,
+      SamplersState,
+      ViewportScissorState,
+   };
+
    VulkanDisplayPipeline mDisplayPipeline =  { };
    vk::PhysicalDeviceTransformFeedbackFeaturesEXT mSupportedFeaturesTransformFeedback;
    vk::PhysicalDeviceFeatures2 mSupportedFeatures;
@@ -731,7 +776,39 @@ private:
    std::list<SyncWaiter *> mFencesWaiting;
    std::list<SyncWaiter *> mFencesPending;
    std::condition_variable mFenceSignal;
+   bool mDecodeThreadEnabled = true;
+   std::thread mDecodeThread;
+   std::mutex mDecodeMutex;
+   std::condition_variable mDecodeSignal;
+   std::deque<std::unique_ptr<Pm4DecodedBuffer>> mDecodedBuffers;
+   bool mDecodePendingWake = false;
+   uint32_t mPendingSyncBuffers = 0;
    std::vector<SyncWaiter *> mWaiterPool;
+
+   // Frame capture, slots cycle from free -> awaiting their sync waiter ->
+   // queued for encoding -> free, a frame is dropped when none are free.
+   static constexpr auto NumFrameCaptureSlots = 6u;
+   static constexpr auto MaxFrameCaptureThreads = 4u;
+   //! Only changed with mFrameCaptureMutex held, it is atomic so the GPU
+   //! thread can check it without the lock on every swap.
+   std::atomic<bool> mFrameCaptureEnabled { false };
+   std::string mFrameCapturePrefix;
+   gpu::FrameCaptureFormat mFrameCaptureFormat = gpu::FrameCaptureFormat::Tga;
+   bool mFrameCaptureTv = false;
+   bool mFrameCaptureDrc = false;
+   uint64_t mFrameCaptureNextFrame = 0;
+   std::array<FrameCaptureSlot, NumFrameCaptureSlots> mFrameCaptureSlots;
+   std::vector<FrameCaptureSlot *> mFreeFrameCaptureSlots;
+   std::vector<FrameCaptureSlot *> mReadbackFrameCaptureSlots;
+   std::deque<FrameCaptureSlot *> mEncodeFrameCaptureSlots;
+   uint32_t mFrameCaptureSlotsOutstanding = 0;
+   std::vector<std::thread> mFrameCaptureThreads;
+   std::mutex mFrameCaptureMutex;
+   std::condition_variable mFrameCaptureSignal;
+   bool mFrameCaptureThreadsRunning = false;
+   uint64_t mFramesCaptured = 0;
+   uint64_t mFramesCaptureDropped = 0;
+
    VmaAllocator mAllocator;
    uint64_t mMemChangeCounter = 0;
    uint64_t *mLastOccQueryAddr = nullptr;
@@ -740,7 +817,6 @@ private:
 
    SyncWaiter *mActiveSyncWaiter = nullptr;
    vk::CommandBuffer mActiveCommandBuffer;
-   std::vector<vk::DescriptorSet> mAvailableDescriptorSets;
    RenderPassObject *mActiveRenderPass = nullptr;
    FramebufferObject *mActiveFramebuffer = nullptr;
    PipelineObject *mActivePipeline = nullptr;
@@ -763,12 +839,35 @@ private:
 
    DrawDesc mDrawCache;
 
+   // Non-register inputs of the last validated samplers and viewport
+   std::array<void *, 3> mValidatedSamplerShaders = { nullptr };
+   vk::Extent2D mValidatedViewportRenderArea;
+
    std::vector<MemChangeRecord> mDirtyMemCaches;
 
    std::vector<uint8_t> mScratchRetiling;
    std::vector<uint8_t> mScratchIdxSwap;
    std::vector<uint8_t> mScratchIdxPrim;
    std::vector<vk::WriteDescriptorSet> mScratchDescriptorWrites;
+   std::vector<uint64_t> mScratchDescriptorKeys;
+
+   // Descriptor sets kept across command buffers, keyed by the hash of the
+   // writes used to fill them.  Samplers and buffers are never destroyed so
+   // only image views need to invalidate entries.
+   std::unordered_map<DataHash, vk::DescriptorSet> mDescriptorSetCache;
+   std::unordered_map<VkImageView, std::vector<DataHash>> mDescriptorSetsByImageView;
+   std::vector<vk::DescriptorSet> mFreeCachedDescriptorSets;
+   std::vector<vk::DescriptorPool> mDescriptorCachePools;
+
+   vk::PipelineLayout mActivePushDescriptorLayout;
+   DataHash mActivePushDescriptorHash;
+
+   uint64_t mDescriptorSetCacheHits = 0;
+   uint64_t mDescriptorSetCacheMisses = 0;
+   uint64_t mDescriptorWritesThisFrame = 0;
+   uint64_t mDescriptorWritesSkippedThisFrame = 0;
+   uint64_t mDescriptorWritesLastFrame = 0;
+   uint64_t mDescriptorWritesSkippedLastFrame = 0;
 
    using duration_system_clock = std::chrono::duration<double, std::chrono::system_clock::period>;
    using duration_ms = std::chrono::duration<double, std::chrono::milliseconds::period>;
@@ -789,7 +888,6 @@ private:
    RenderPassObject *mRenderPass = nullptr;
    std::array<std::array<std::vector<StagingBuffer *>, 20>, 3> mStagingBuffers;
    std::vector<StreamContextObject *> mStreamOutContextPool;
-   std::vector<vk::DescriptorPool> mDescriptorPools;
    std::vector<vk::QueryPool> mOccQueryPools;
    std::unordered_map<DataHash, SurfaceGroupObject*> mSurfaceGroups;
    std::unordered_map<DataHash, SurfaceObject*> mSurfaces;
@@ -811,6 +909,8 @@ private:
    bool mDebug = false;
    bool mDumpShaders = false;
    bool mDumpShaderBinariesOnly = false;
+   bool mOptimizeShaders = false;
+   bool mValidateOptimizedShaders = false;
    bool mDumpTextures = false;
 };
 
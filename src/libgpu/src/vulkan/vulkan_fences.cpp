@@ -37,7 +37,6 @@ Driver::releaseSyncWaiter(SyncWaiter *syncWaiter)
    syncWaiter->callbacks.clear();
    syncWaiter->stagingBuffers.clear();
    syncWaiter->retileHandles.clear();
-   syncWaiter->descriptorPools.clear();
    syncWaiter->occQueryPools.clear();
 
    // Put this fence back in the pool
@@ -68,10 +67,6 @@ Driver::executeSyncWaiter(SyncWaiter *syncWaiter)
       mGpuRetiler.releaseHandle(handle);
    }
 
-   for (auto &pool : syncWaiter->descriptorPools) {
-      retireDescriptorPool(pool);
-   }
-
    for (auto &pool : syncWaiter->occQueryPools) {
       retireOccQueryPool(pool);
    }
@@ -2,6 +2,7 @@
 #include "vulkan_driver.h"
 #include "vulkan_utils.h"
 
+#include <chrono>
 #include <common/log.h>
 
 static constexpr bool ForceDescriptorSets = false;
@@ -388,6 +389,21 @@ Driver::checkCurrentPipeline()
    decaf_check(mCurrentDraw->vertexShader);
    decaf_check(mCurrentDraw->renderPass);
 
+   if (!isStateDirty(PipelineState) && mCurrentDraw->pipeline) {
+      // The registers are unchanged, so the pipeline is still valid as long
+      // as it was built for the same shaders and render pass.
+      auto &activeDesc = *mCurrentDraw->pipeline->desc;
+      if (activeDesc.renderPass == mCurrentDraw->renderPass &&
+          activeDesc.vertexShader == mCurrentDraw->vertexShader &&
+          activeDesc.geometryShader == mCurrentDraw->geometryShader &&
+          activeDesc.pixelShader == mCurrentDraw->pixelShader &&
+          activeDesc.rectStubShader == mCurrentDraw->rectStubShader) {
+         return true;
+      }
+   }
+
+   markStateClean(PipelineState);
+
    HashedDesc<PipelineDesc> currentDesc = getPipelineDesc();
 
    if (mCurrentDraw->pipeline && mCurrentDraw->pipeline->desc == currentDesc) {
@@ -915,7 +931,12 @@ Driver::checkCurrentPipeline()
    pipelineInfo.subpass = 0;
    pipelineInfo.basePipelineHandle = vk::Pipeline();
    pipelineInfo.basePipelineIndex = -1;
+
+   auto compileStart = std::chrono::steady_clock::now();
    auto pipeline = mDevice.createGraphicsPipeline(mPipelineCache, pipelineInfo);
+   mDebugInfo.pipelineCompileTimeMS +=
+      std::chrono::duration<double, std::milli> {
+         std::chrono::steady_clock::now() - compileStart }.count();
 
    foundPipeline->pipeline = pipeline.value;
    foundPipeline->needsPremultipliedTargets = needsPremultipliedTargets;
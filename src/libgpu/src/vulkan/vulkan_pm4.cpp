@@ -118,6 +118,15 @@ Driver::decafSwapBuffers(const latte::pm4::DecafSwapBuffers &data)
 {
    static const auto weight = 0.9;
 
+   mDescriptorWritesLastFrame = mDescriptorWritesThisFrame;
+   mDescriptorWritesSkippedLastFrame = mDescriptorWritesSkippedThisFrame;
+   mDescriptorWritesThisFrame = 0;
+   mDescriptorWritesSkippedThisFrame = 0;
+
+   if (mFrameCaptureEnabled) {
+      captureFrame();
+   }
+
    addRetireTask([=](){
       // Send out the flip event
       gpu::onFlip();
@@ -597,7 +606,7 @@ Driver::waitMem(const latte::pm4::WaitMem &data)
 }
 
 void
-Driver::executeBuffer(const gpu::ringbuffer::Buffer &buffer)
+Driver::executeBuffer(const Pm4DecodedBuffer &decoded)
 {
    decaf_check(!mActiveSyncWaiter);
 
@@ -608,7 +617,7 @@ Driver::executeBuffer(const gpu::ringbuffer::Buffer &buffer)
    beginCommandBuffer();
 
    // Execute guest PM4 command buffer
-   runCommandBuffer(buffer);
+   runDecodedBuffer(decoded);
 
    // End preparing our command buffer
    endCommandBuffer();
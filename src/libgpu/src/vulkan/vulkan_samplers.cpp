@@ -76,6 +76,20 @@ Driver::updateDrawSampler(ShaderStage shaderStage, uint32_t samplerIdx)
 bool
 Driver::checkCurrentSamplers()
 {
+   auto shaders = std::array<void *, 3> {
+      mCurrentDraw->vertexShader,
+      mCurrentDraw->geometryShader,
+      mCurrentDraw->pixelShader
+   };
+
+   if (!isStateDirty(SamplersState) && shaders == mValidatedSamplerShaders) {
+      // Same shaders with the same sampler registers
+      return true;
+   }
+
+   markStateClean(SamplersState);
+   mValidatedSamplerShaders = shaders;
+
    if (mCurrentDraw->vertexShader) {
       for (auto samplerIdx = 0u; samplerIdx < latte::MaxSamplers; ++samplerIdx) {
          if (mCurrentDraw->vertexShader->shader.meta.samplerUsed[samplerIdx]) {
@@ -441,9 +441,33 @@ dumpTranslatedShader(const spirv::ShaderDesc *desc,
    }
 }
 
+void
+Driver::optimizeTranslatedShader(spirv::Shader *shader)
+{
+   auto result = spirv::OptimizeResult { };
+   auto optimized = spirv::optimize(shader->binary, mValidateOptimizedShaders, &result);
+   mDebugInfo.shaderOptimizeTimeMS += result.elapsedMS;
+
+   if (!optimized) {
+      // Optimizer failed or is not compiled in, the shader is unchanged
+      return;
+   }
+
+   mDebugInfo.numOptimizedShaders++;
+   mDebugInfo.shaderWordsBeforeOptimize += result.wordsBefore;
+   mDebugInfo.shaderWordsAfterOptimize += result.wordsAfter;
+}
+
 bool
 Driver::checkCurrentVertexShader()
 {
+   if (!isStateDirty(VertexShaderState)) {
+      // None of the shader registers have changed since the last draw
+      return true;
+   }
+
+   markStateClean(VertexShaderState);
+
    // We defer the hashing until after we check if this shader is even
    // actually enabled or not...  Performance !
    auto currentDescPrehash = getVertexShaderDesc();
@@ -480,6 +504,10 @@ Driver::checkCurrentVertexShader()
       decaf_abort("Failed to translate vertex shader");
    }
 
+   if (mOptimizeShaders) {
+      optimizeTranslatedShader(&foundShader->shader);
+   }
+
    if (mDumpShaders) {
       dumpTranslatedShader(&*currentDesc, &foundShader->shader);
    }
@@ -500,6 +528,13 @@ Driver::checkCurrentVertexShader()
 bool
 Driver::checkCurrentGeometryShader()
 {
+   if (!isStateDirty(GeometryShaderState)) {
+      // None of the shader registers have changed since the last draw
+      return true;
+   }
+
+   markStateClean(GeometryShaderState);
+
    // We defer the hashing until after we check if this shader is even
    // actually enabled or not...  Performance !
    auto currentDescPrehash = getGeometryShaderDesc();
@@ -536,6 +571,10 @@ Driver::checkCurrentGeometryShader()
       decaf_abort("Failed to translate geometry shader");
    }
 
+   if (mOptimizeShaders) {
+      optimizeTranslatedShader(&foundShader->shader);
+   }
+
    if (mDumpShaders) {
       dumpTranslatedShader(&*currentDesc, &foundShader->shader);
    }
@@ -556,6 +595,13 @@ Driver::checkCurrentGeometryShader()
 bool
 Driver::checkCurrentPixelShader()
 {
+   if (!isStateDirty(PixelShaderState)) {
+      // None of the shader registers have changed since the last draw
+      return true;
+   }
+
+   markStateClean(PixelShaderState);
+
    // We defer the hashing until after we check if this shader is even
    // actually enabled or not...  Performance !
    auto currentDescPrehash = getPixelShaderDesc();
@@ -591,6 +637,10 @@ Driver::checkCurrentPixelShader()
       decaf_abort("Failed to translate pixel shader");
    }
 
+   if (mOptimizeShaders) {
+      optimizeTranslatedShader(&foundShader->shader);
+   }
+
    if (mDumpShaders) {
       dumpTranslatedShader(&*currentDesc, &foundShader->shader);
    }
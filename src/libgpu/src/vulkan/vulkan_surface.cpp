@@ -1033,6 +1033,7 @@ Driver::transitionSurfaceView(SurfaceViewObject *surfaceView, ResourceUsage usag
 
    if (surfaceView->imageView) {
       auto oldImageView = surfaceView->imageView;
+      invalidateDescriptorSets(oldImageView);
       addRetireTask([=](){
          mDevice.destroyImageView(oldImageView);
       });
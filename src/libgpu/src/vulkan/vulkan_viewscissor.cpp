@@ -10,6 +10,16 @@ Driver::checkCurrentViewportAndScissor()
    // GPU7 actually supports many viewports and many scissors, but it
    // seems that CafeOS itself only supports a single one.
 
+   auto renderArea = mCurrentDraw->framebuffer->renderArea;
+   if (!isStateDirty(ViewportScissorState) &&
+       renderArea == mValidatedViewportRenderArea) {
+      // Viewport registers and render area are unchanged
+      return true;
+   }
+
+   markStateClean(ViewportScissorState);
+   mValidatedViewportRenderArea = renderArea;
+
    // ------------------------------------------------------------
    // Viewport
    // ------------------------------------------------------------
@@ -25,8 +35,8 @@ Driver::checkCurrentViewportAndScissor()
    auto pa_cl_vte_cntl = getRegister<latte::PA_CL_VTE_CNTL>(latte::Register::PA_CL_VTE_CNTL);
    auto pa_cl_clip_cntl = getRegister<latte::PA_CL_CLIP_CNTL>(latte::Register::PA_CL_CLIP_CNTL);
 
-   auto raWidth = static_cast<float>(mCurrentDraw->framebuffer->renderArea.width);
-   auto raHeight = static_cast<float>(mCurrentDraw->framebuffer->renderArea.height);
+   auto raWidth = static_cast<float>(renderArea.width);
+   auto raHeight = static_cast<float>(renderArea.height);
 
    // NOTE: Our shaders which output positions understand that if the
    // xoffset/yoffset/xscale/yscale are disabled, that we need to
@@ -0,0 +1,162 @@
+#include <catch.hpp>
+#include <common/qoi_encoder.h>
+
+#include <array>
+#include <random>
+#include <vector>
+
+/**
+ * Straightforward decoder written from the QOI specification, used to check
+ * the encoder output round trips.
+ */
+static bool
+decodeQoi(const std::vector<uint8_t> &data,
+          uint32_t &width,
+          uint32_t &height,
+          std::vector<uint8_t> &rgba)
+{
+   auto readU32BE =
+      [&](size_t pos) {
+         return (static_cast<uint32_t>(data[pos + 0]) << 24) |
+                (static_cast<uint32_t>(data[pos + 1]) << 16) |
+                (static_cast<uint32_t>(data[pos + 2]) << 8) |
+                 static_cast<uint32_t>(data[pos + 3]);
+      };
+
+   if (data.size() < 14 + 8 ||
+       data[0] != 'q' || data[1] != 'o' || data[2] != 'i' || data[3] != 'f') {
+      return false;
+   }
+
+   width = readU32BE(4);
+   height = readU32BE(8);
+   rgba.resize(static_cast<size_t>(width) * height * 4);
+
+   auto index = std::array<std::array<uint8_t, 4>, 64> { };
+   auto px = std::array<uint8_t, 4> { 0, 0, 0, 255 };
+   auto pos = size_t { 14 };
+   auto run = 0u;
+   auto end = data.size() - 8;
+
+   for (auto i = size_t { 0 }; i < rgba.size(); i += 4) {
+      if (run > 0) {
+         --run;
+      } else if (pos < end) {
+         auto op = data[pos++];
+
+         if (op == 0xFE) {
+            px[0] = data[pos++];
+            px[1] = data[pos++];
+            px[2] = data[pos++];
+         } else if (op == 0xFF) {
+            px[0] = data[pos++];
+            px[1] = data[pos++];
+            px[2] = data[pos++];
+            px[3] = data[pos++];
+         } else if ((op & 0xC0) == 0x00) {
+            px = index[op];
+         } else if ((op & 0xC0) == 0x40) {
+            px[0] += ((op >> 4) & 0x03) - 2;
+            px[1] += ((op >> 2) & 0x03) - 2;
+            px[2] += (op & 0x03) - 2;
+         } else if ((op & 0xC0) == 0x80) {
+            auto b2 = data[pos++];
+            auto vg = (op & 0x3F) - 32;
+            px[0] += vg - 8 + ((b2 >> 4) & 0x0F);
+            px[1] += vg;
+            px[2] += vg - 8 + (b2 & 0x0F);
+         } else {
+            run = op & 0x3F;
+         }
+
+         index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64] = px;
+      } else {
+         return false;
+      }
+
+      std::copy(px.begin(), px.end(), rgba.begin() + i);
+   }
+
+   // Everything must have been consumed, followed by the end marker
+   static const std::array<uint8_t, 8> EndMarker = { 0, 0, 0, 0, 0, 0, 0, 1 };
+   return run == 0 && pos == end &&
+          std::equal(EndMarker.begin(), EndMarker.end(), data.begin() + end);
+}
+
+static void
+checkRoundTrip(uint32_t width,
+               uint32_t height,
+               const std::vector<uint8_t> &rgba)
+{
+   auto encoded = std::vector<uint8_t> { };
+   REQUIRE(qoi::encode(width, height, rgba.data(), encoded));
+
+   auto decodedWidth = 0u;
+   auto decodedHeight = 0u;
+   auto decoded = std::vector<uint8_t> { };
+   REQUIRE(decodeQoi(encoded, decodedWidth, decodedHeight, decoded));
+   REQUIRE(decodedWidth == width);
+   REQUIRE(decodedHeight == height);
+   REQUIRE(decoded == rgba);
+}
+
+TEST_CASE("qoi encoder round trips random pixels")
+{
+   auto rng = std::mt19937 { 0x514F49 };
+   auto rgba = std::vector<uint8_t>(97 * 61 * 4);
+
+   for (auto &value : rgba) {
+      value = static_cast<uint8_t>(rng());
+   }
+
+   checkRoundTrip(97, 61, rgba);
+}
+
+TEST_CASE("qoi encoder round trips runs, diffs and repeats")
+{
+   // Exercises every op: long runs past the maximum run length, small and
+   // luma sized differences, colours seen before and alpha changes.
+   auto width = 320u;
+   auto height = 180u;
+   auto rng = std::mt19937 { 0xDECAF };
+   auto rgba = std::vector<uint8_t>(width * height * 4);
+
+   for (auto y = 0u; y < height; ++y) {
+      for (auto x = 0u; x < width; ++x) {
+         auto px = &rgba[(y * width + x) * 4];
+
+         if (y < 20) {
+            // Solid block, long runs
+            px[0] = 10; px[1] = 20; px[2] = 30; px[3] = 255;
+         } else if (y < 60) {
+            // Gentle gradient, diff and luma ops
+            px[0] = static_cast<uint8_t>(x + y);
+            px[1] = static_cast<uint8_t>(x * 3);
+            px[2] = static_cast<uint8_t>(x * 5 + y);
+            px[3] = 255;
+         } else if (y < 120) {
+            // Small palette, index ops
+            static const uint8_t palette[4][4] = {
+               { 255, 0, 0, 255 }, { 0, 255, 0, 255 },
+               { 0, 0, 255, 255 }, { 255, 255, 255, 128 },
+            };
+            auto &colour = palette[rng() % 4];
+            std::copy(colour, colour + 4, px);
+         } else {
+            // Varying alpha, rgba ops
+            px[0] = static_cast<uint8_t>(rng());
+            px[1] = static_cast<uint8_t>(rng());
+            px[2] = static_cast<uint8_t>(rng());
+            px[3] = static_cast<uint8_t>(rng());
+         }
+      }
+   }
+
+   checkRoundTrip(width, height, rgba);
+}
+
+TEST_CASE("qoi encoder handles a single pixel")
+{
+   checkRoundTrip(1, 1, { 0, 0, 0, 255 });
+   checkRoundTrip(1, 1, { 1, 2, 3, 4 });
+}
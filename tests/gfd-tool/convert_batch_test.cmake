@@ -0,0 +1,78 @@
+# Converts every fixture once with convert and once with convert-batch on 4
+# threads, then checks both wrote the same DDS files byte for byte.
+#
+# The fixtures hold random texel data with image and mipmap blocks sized
+# generously for their tiling so no untiling reads past their end:
+#
+#    rgba8_tiled2d.gtx        64x64 UNORM_R8_G8_B8_A8, Tiled2DThin1, 4 levels
+#    bc1_tiled1d.gtx          128x64 UNORM_BC1, Tiled1DThin1, 3 levels
+#    r8_linear.gtx            33x17 UNORM_R8, LinearAligned, 1 level
+#    multi.gtx                32x32 UNORM_R8_G8_B8_A8 Tiled1DThin1 and 64x64
+#                             UNORM_BC3 Tiled2DThin1 with a bank swizzle
+#    nested/bc3_swizzled.gtx  96x48 UNORM_BC3, Tiled2DThin1, pipe and bank
+#                             swizzled, found by the recursive directory scan
+
+function(run_gfd_tool)
+    execute_process(COMMAND "${GFD_TOOL}" ${ARGN}
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE output)
+
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "gfd-tool ${ARGN} failed with ${result}:\n${output}")
+    endif()
+
+    set(GFD_TOOL_OUTPUT "${output}" PARENT_SCOPE)
+endfunction()
+
+function(compare_outputs)
+    file(GLOB_RECURSE single_files RELATIVE "${WORK_DIR}/single" "${WORK_DIR}/single/*.dds")
+    file(GLOB_RECURSE batch_files RELATIVE "${WORK_DIR}/batch" "${WORK_DIR}/batch/*.dds")
+    list(SORT single_files)
+    list(SORT batch_files)
+
+    if(NOT single_files)
+        message(FATAL_ERROR "convert did not write any DDS files")
+    endif()
+
+    if(NOT single_files STREQUAL batch_files)
+        message(FATAL_ERROR "convert wrote ${single_files} but convert-batch wrote ${batch_files}")
+    endif()
+
+    foreach(dds ${single_files})
+        execute_process(COMMAND "${CMAKE_COMMAND}" -E compare_files
+                                "${WORK_DIR}/single/${dds}" "${WORK_DIR}/batch/${dds}"
+                        RESULT_VARIABLE result)
+
+        if(NOT result EQUAL 0)
+            message(FATAL_ERROR "${dds} differs between convert and convert-batch")
+        endif()
+    endforeach()
+endfunction()
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}/single" "${WORK_DIR}/batch")
+file(COPY "${FIXTURES_DIR}/" DESTINATION "${WORK_DIR}/single")
+file(COPY "${FIXTURES_DIR}/" DESTINATION "${WORK_DIR}/batch")
+
+file(GLOB_RECURSE gtx_files "${WORK_DIR}/single/*.gtx")
+foreach(gtx ${gtx_files})
+    run_gfd_tool(convert "${gtx}")
+endforeach()
+
+run_gfd_tool(convert-batch --threads 4 "${WORK_DIR}/batch")
+compare_outputs()
+
+# A file listed twice, even when spelt differently, must only be converted once
+file(WRITE "${WORK_DIR}/list.txt"
+     "${WORK_DIR}/batch/multi.gtx\n"
+     "${WORK_DIR}/batch/nested/../multi.gtx\n"
+     "${WORK_DIR}/batch/r8_linear.gtx\n"
+     "${WORK_DIR}/batch/multi.gtx\n")
+run_gfd_tool(convert-batch --threads 4 "${WORK_DIR}/list.txt")
+
+if(NOT GFD_TOOL_OUTPUT MATCHES "Converted 2 of 2 files")
+    message(FATAL_ERROR "Duplicate files were not removed from the batch:\n${GFD_TOOL_OUTPUT}")
+endif()
+
+compare_outputs()
@@ -0,0 +1,297 @@
+#include <catch.hpp>
+
+#include "gpu_memory.h"
+#include "pm4_processor.h"
+
+#include <common/byte_swap.h>
+#include <vector>
+
+/**
+ * A Pm4Processor which only tracks register state, enough to replay a
+ * command stream and compare the result with and without the display list
+ * cache.
+ */
+class ReplayProcessor : public Pm4Processor
+{
+public:
+   ReplayProcessor(bool cacheEnabled)
+   {
+      mDisplayListCacheEnabled = cacheEnabled;
+   }
+
+   void
+   replay(const std::vector<uint32_t> &ringBuffer)
+   {
+      // Byte swapped like a real ring buffer submission
+      auto swapped = std::vector<uint32_t> { };
+      for (auto value : ringBuffer) {
+         swapped.push_back(byte_swap(value));
+      }
+
+      runCommandBuffer({ swapped.data(), static_cast<uint32_t>(swapped.size()) });
+   }
+
+   void
+   replayDecoded(const std::vector<uint32_t> &ringBuffer)
+   {
+      auto decoded = Pm4DecodedBuffer { };
+      decode(ringBuffer, decoded);
+      runDecodedBuffer(decoded);
+   }
+
+   void
+   decode(const std::vector<uint32_t> &ringBuffer,
+          Pm4DecodedBuffer &decoded)
+   {
+      mSwappedRingBuffer.clear();
+      for (auto value : ringBuffer) {
+         mSwappedRingBuffer.push_back(byte_swap(value));
+      }
+
+      decodeBuffer({ mSwappedRingBuffer.data(), static_cast<uint32_t>(mSwappedRingBuffer.size()) }, decoded);
+   }
+
+   void
+   runDecoded(const Pm4DecodedBuffer &decoded)
+   {
+      runDecodedBuffer(decoded);
+   }
+
+   uint32_t
+   readRegister(latte::Register id)
+   {
+      return mRegisters[id / 4];
+   }
+
+   Pm4DisplayListCacheStats
+   stats()
+   {
+      return getDisplayListCacheStats();
+   }
+
+protected:
+   void decafSetBuffer(const DecafSetBuffer &data) override { }
+   void decafCopyColorToScan(const DecafCopyColorToScan &data) override { }
+   void decafSwapBuffers(const DecafSwapBuffers &data) override { }
+   void decafClearColor(const DecafClearColor &data) override { }
+   void decafClearDepthStencil(const DecafClearDepthStencil &data) override { }
+   void decafOSScreenFlip(const DecafOSScreenFlip &data) override { }
+   void decafCopySurface(const DecafCopySurface &data) override { }
+   void decafExpandColorBuffer(const DecafExpandColorBuffer &data) override { }
+   void drawIndexAuto(const DrawIndexAuto &data) override { }
+   void drawIndex2(const DrawIndex2 &data) override { }
+   void drawIndexImmd(const DrawIndexImmd &data) override { }
+   void waitMem(const WaitMem &data) override { }
+   void memWrite(const MemWrite &data) override { }
+   void eventWrite(const EventWrite &data) override { }
+   void eventWriteEOP(const EventWriteEOP &data) override { }
+   void pfpSyncMe(const PfpSyncMe &data) override { }
+   void setPredication(const SetPredication &data) override { }
+   void streamOutBaseUpdate(const StreamOutBaseUpdate &data) override { }
+   void streamOutBufferUpdate(const StreamOutBufferUpdate &data) override { }
+   void surfaceSync(const SurfaceSync &data) override { }
+
+private:
+   std::vector<uint32_t> mSwappedRingBuffer;
+};
+
+static void
+writeSetContextReg(std::vector<uint32_t> &buffer,
+                   latte::Register id,
+                   uint32_t value)
+{
+   auto header = HeaderType3::get(0)
+      .type(PacketType::Type3)
+      .opcode(IT_OPCODE::SET_CONTEXT_REG)
+      .size(1);
+
+   buffer.push_back(header.value);
+   buffer.push_back((id - latte::Register::ContextRegisterBase) / 4);
+   buffer.push_back(value);
+}
+
+static void
+writeIndirectBuffer(std::vector<uint32_t> &buffer,
+                    phys_addr address,
+                    uint32_t numDwords)
+{
+   auto header = HeaderType3::get(0)
+      .type(PacketType::Type3)
+      .opcode(IT_OPCODE::INDIRECT_BUFFER)
+      .size(2);
+
+   buffer.push_back(header.value);
+   buffer.push_back(address.getAddress());
+   buffer.push_back(0);
+   buffer.push_back(numDwords);
+}
+
+static void
+writeMemWrite(std::vector<uint32_t> &buffer,
+              phys_addr address,
+              uint32_t value)
+{
+   auto header = HeaderType3::get(0)
+      .type(PacketType::Type3)
+      .opcode(IT_OPCODE::MEM_WRITE)
+      .size(3);
+
+   buffer.push_back(header.value);
+   buffer.push_back(address.getAddress());
+   buffer.push_back(0);
+   buffer.push_back(value);
+   buffer.push_back(0);
+}
+
+//! Write a display list into guest physical memory in guest byte order.
+static void
+writeDisplayList(phys_addr address,
+                 const std::vector<uint32_t> &displayList)
+{
+   auto dst = gpu::internal::translateAddress<uint32_t>(address);
+   for (auto i = 0u; i < displayList.size(); ++i) {
+      dst[i] = byte_swap(displayList[i]);
+   }
+}
+
+static const auto StaticListAddress = phys_addr { 0x50000000u };
+static const auto PoolListAddress = phys_addr { 0x50001000u };
+static const auto RegA = latte::Register::DB_DEPTH_CONTROL;
+static const auto RegB = latte::Register::PA_SC_LINE_STIPPLE;
+
+/**
+ * Replays a synthetic trace of frames which call a display list that never
+ * changes and one that is rewritten every frame for a while (like the
+ * command buffer pool) and then settles down.
+ */
+struct FrameTrace
+{
+   FrameTrace()
+   {
+      auto staticList = std::vector<uint32_t> { };
+      writeSetContextReg(staticList, RegA, 0x1234);
+      writeDisplayList(StaticListAddress, staticList);
+      staticListSize = static_cast<uint32_t>(staticList.size());
+   }
+
+   std::vector<uint32_t>
+   frame(uint32_t poolValue)
+   {
+      auto poolList = std::vector<uint32_t> { };
+      writeSetContextReg(poolList, RegB, poolValue);
+      writeDisplayList(PoolListAddress, poolList);
+
+      auto ringBuffer = std::vector<uint32_t> { };
+      writeIndirectBuffer(ringBuffer, StaticListAddress, staticListSize);
+      writeIndirectBuffer(ringBuffer, PoolListAddress, static_cast<uint32_t>(poolList.size()));
+      return ringBuffer;
+   }
+
+   uint32_t staticListSize;
+};
+
+TEST_CASE("pm4 display list cache replay matches uncached")
+{
+   auto decoded = GENERATE(false, true);
+   auto trace = FrameTrace { };
+   auto cached = ReplayProcessor { true };
+   auto uncached = ReplayProcessor { false };
+
+   auto replayFrame =
+      [&](uint32_t poolValue) {
+         auto ringBuffer = trace.frame(poolValue);
+
+         if (decoded) {
+            cached.replayDecoded(ringBuffer);
+            uncached.replayDecoded(ringBuffer);
+         } else {
+            cached.replay(ringBuffer);
+            uncached.replay(ringBuffer);
+         }
+
+         REQUIRE(cached.readRegister(RegA) == uncached.readRegister(RegA));
+         REQUIRE(cached.readRegister(RegB) == uncached.readRegister(RegB));
+         REQUIRE(cached.readRegister(RegB) == poolValue);
+      };
+
+   // The pool list changes every frame so it becomes uncacheable
+   for (auto i = 0u; i < 2 * MaxDisplayListInvalidations; ++i) {
+      replayFrame(0x100 + i);
+   }
+
+   REQUIRE(cached.stats().uncached > 0);
+
+   // Once it settles down it must start being cached again
+   for (auto i = 0u; i < DisplayListUncacheableCalls + 8; ++i) {
+      replayFrame(0x5000);
+   }
+
+   auto hits = cached.stats().hits;
+   auto uncachedCalls = cached.stats().uncached;
+   replayFrame(0x5000);
+   REQUIRE(cached.stats().hits == hits + 2);
+   REQUIRE(cached.stats().uncached == uncachedCalls);
+
+   // Changing after it has been hit must not count towards uncacheable
+   for (auto i = 0u; i < 4 * MaxDisplayListInvalidations; ++i) {
+      replayFrame(0x6000 + i / 2);
+   }
+
+   REQUIRE(cached.stats().uncached == uncachedCalls);
+}
+
+TEST_CASE("pm4 decode ahead stops at memory sync packets")
+{
+   auto trace = FrameTrace { };
+   auto processor = ReplayProcessor { true };
+   auto ringBuffer = trace.frame(0x100);
+   auto poolListSize = static_cast<uint32_t>(ringBuffer.back());
+
+   // Static list is safe to decode ahead, the pool list comes after a
+   // MEM_WRITE so could be changed by it.
+   auto syncRingBuffer = std::vector<uint32_t> { };
+   writeIndirectBuffer(syncRingBuffer, StaticListAddress, trace.staticListSize);
+   writeMemWrite(syncRingBuffer, PoolListAddress, 0);
+   writeIndirectBuffer(syncRingBuffer, PoolListAddress, poolListSize);
+
+   auto decoded = Pm4DecodedBuffer { };
+   processor.decode(syncRingBuffer, decoded);
+   REQUIRE(decoded.hasMemorySync);
+   REQUIRE(decoded.indirectBuffers.size() == 1);
+
+   // Change the pool list between decode and execution, as an earlier packet
+   // would, it must be read when it executes rather than when decoded.
+   trace.frame(0x200);
+   processor.runDecoded(decoded);
+   REQUIRE(processor.readRegister(RegA) == 0x1234);
+   REQUIRE(processor.readRegister(RegB) == 0x200);
+
+   // The same list called either side of a MEM_WRITE, only the first call
+   // can use what was decoded ahead.
+   auto repeatRingBuffer = std::vector<uint32_t> { };
+   writeIndirectBuffer(repeatRingBuffer, PoolListAddress, poolListSize);
+   writeMemWrite(repeatRingBuffer, PoolListAddress, 0);
+   writeIndirectBuffer(repeatRingBuffer, PoolListAddress, poolListSize);
+
+   auto repeatDecoded = Pm4DecodedBuffer { };
+   processor.decode(repeatRingBuffer, repeatDecoded);
+   REQUIRE(repeatDecoded.hasMemorySync);
+   REQUIRE(repeatDecoded.indirectBuffers.size() == 1);
+
+   trace.frame(0x300);
+   processor.runDecoded(repeatDecoded);
+   REQUIRE(processor.readRegister(RegB) == 0x300);
+
+   // A later submission without a sync packet still runs what was decoded
+   auto plainRingBuffer = std::vector<uint32_t> { };
+   writeIndirectBuffer(plainRingBuffer, PoolListAddress, poolListSize);
+
+   auto plainDecoded = Pm4DecodedBuffer { };
+   processor.decode(plainRingBuffer, plainDecoded);
+   REQUIRE(!plainDecoded.hasMemorySync);
+   REQUIRE(plainDecoded.indirectBuffers.size() == 1);
+
+   trace.frame(0x400);
+   processor.runDecoded(plainDecoded);
+   REQUIRE(processor.readRegister(RegB) == 0x300);
+}
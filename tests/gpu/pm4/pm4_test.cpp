@@ -0,0 +1,20 @@
+#define CATCH_CONFIG_RUNNER
+#include <catch.hpp>
+
+#include <common/log.h>
+#include <libcpu/mmu.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/null_sink.h>
+
+int main(int argc, char *argv[])
+{
+   gLog = std::make_shared<spdlog::logger>("logger", std::make_shared<spdlog::sinks::null_sink_st>());
+
+   // Indirect buffers are read straight out of physical memory
+   if (!cpu::initialiseMemory()) {
+      printf("Could not initialise guest memory\n");
+      return -1;
+   }
+
+   return Catch::Session().run(argc, argv);
+}
@@ -0,0 +1,112 @@
+#include "tiling_tests.h"
+#include "test_helpers.h"
+
+#include <algorithm>
+#include <common/align.h>
+#include <libgpu/gpu7_tiling_cpu.h>
+
+/**
+ * Retile the slices one row of macro tiles at a time with untileRange and
+ * tileRange, the same way the GX2 aperture does, and check the result is
+ * identical to retiling the whole slices in one go.
+ */
+static inline void
+compareRangeToFullRetile(const gpu7::tiling::SurfaceDescription& desc,
+                         std::vector<uint8_t>& input,
+                         uint32_t firstSlice,
+                         uint32_t numSlices)
+{
+   auto info = gpu7::tiling::computeSurfaceInfo(desc, 0);
+   auto retileInfo = gpu7::tiling::computeRetileInfo(info);
+   if (!retileInfo.isTiled) {
+      return;
+   }
+
+   REQUIRE(input.size() >= info.surfSize);
+
+   auto fullUntiled = std::vector<uint8_t>(info.surfSize);
+   auto rangeUntiled = std::vector<uint8_t>(info.surfSize);
+   auto fullTiled = std::vector<uint8_t>(info.surfSize);
+   auto rangeTiled = std::vector<uint8_t>(info.surfSize);
+
+   auto tiledFirstSliceIndex = align_down(firstSlice, retileInfo.microTileThickness);
+   auto tiledSliceOffset = tiledFirstSliceIndex * retileInfo.thinSliceBytes;
+   auto untiledSliceOffset = firstSlice * retileInfo.thinSliceBytes;
+
+   gpu7::tiling::cpu::untile(retileInfo,
+                             fullUntiled.data() + untiledSliceOffset,
+                             input.data() + tiledSliceOffset,
+                             firstSlice, numSlices);
+
+   gpu7::tiling::cpu::tile(retileInfo,
+                           fullUntiled.data() + untiledSliceOffset,
+                           fullTiled.data() + tiledSliceOffset,
+                           firstSlice, numSlices);
+
+   auto rowTiles = retileInfo.numTilesPerRow * retileInfo.macroTileHeight;
+
+   for (auto slice = firstSlice; slice < firstSlice + numSlices; ++slice) {
+      auto untiledOffset = slice * retileInfo.thinSliceBytes;
+      auto tiledOffset = align_down(slice, retileInfo.microTileThickness) * retileInfo.thinSliceBytes;
+
+      for (auto firstTile = 0u; firstTile < retileInfo.numTilesPerSlice; firstTile += rowTiles) {
+         auto numTiles = std::min(rowTiles, retileInfo.numTilesPerSlice - firstTile);
+         gpu7::tiling::cpu::untileRange(retileInfo,
+                                        rangeUntiled.data() + untiledOffset,
+                                        input.data() + tiledOffset,
+                                        slice, firstTile, numTiles);
+      }
+
+      for (auto firstTile = 0u; firstTile < retileInfo.numTilesPerSlice; firstTile += rowTiles) {
+         auto numTiles = std::min(rowTiles, retileInfo.numTilesPerSlice - firstTile);
+         gpu7::tiling::cpu::tileRange(retileInfo,
+                                      fullUntiled.data() + untiledOffset,
+                                      rangeTiled.data() + tiledOffset,
+                                      slice, firstTile, numTiles);
+      }
+   }
+
+   CHECK(compareImages(rangeUntiled, fullUntiled));
+   CHECK(compareImages(rangeTiled, fullTiled));
+}
+
+TEST_CASE("cpuTilingRange")
+{
+   for (auto& layout : sTestLayout) {
+      SECTION(fmt::format("{}x{}x{} s{}n{}",
+                          layout.width, layout.height, layout.depth,
+                          layout.testFirstSlice, layout.testNumSlices))
+      {
+         for (auto& mode : sTestTilingMode) {
+            SECTION(fmt::format("{}", tileModeToString(mode.tileMode)))
+            {
+               for (auto& format : sTestFormats) {
+                  SECTION(fmt::format("{}bpp{}", format.bpp, format.depth ? " depth" : ""))
+                  {
+                     auto surface = gpu7::tiling::SurfaceDescription { };
+                     surface.tileMode = mode.tileMode;
+                     surface.format = format.format;
+                     surface.bpp = format.bpp;
+                     surface.width = layout.width;
+                     surface.height = layout.height;
+                     surface.numSlices = layout.depth;
+                     surface.numSamples = 1u;
+                     surface.numLevels = 1u;
+                     surface.bankSwizzle = 0u;
+                     surface.pipeSwizzle = 0u;
+                     surface.dim = gpu7::tiling::SurfaceDim::Texture2DArray;
+                     surface.use = format.depth ?
+                        gpu7::tiling::SurfaceUse::DepthBuffer :
+                        gpu7::tiling::SurfaceUse::None;
+
+                     compareRangeToFullRetile(surface,
+                                              sRandomData,
+                                              layout.testFirstSlice,
+                                              layout.testNumSlices);
+                  }
+               }
+            }
+         }
+      }
+   }
+}
@@ -0,0 +1,118 @@
+#include <catch.hpp>
+
+#include "test_memory.h"
+#include "cafe/libraries/coreinit/coreinit_alarm.h"
+#include "cafe/libraries/coreinit/coreinit_time.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace cafe::coreinit;
+
+static constexpr auto
+AlarmGroup = 0x1234u;
+
+static std::vector<virt_ptr<OSAlarm>>
+createAlarms(uint32_t count)
+{
+   auto alarms = std::vector<virt_ptr<OSAlarm>> { };
+   for (auto i = 0u; i < count; ++i) {
+      auto alarm = virt_cast<OSAlarm *>(allocateTestMemory(sizeof(OSAlarm), 8));
+      OSCreateAlarm(alarm);
+      OSSetAlarmTag(alarm, AlarmGroup);
+      alarms.push_back(alarm);
+   }
+
+   return alarms;
+}
+
+//! Walk a guest alarm queue starting from any alarm in it.
+static std::vector<virt_ptr<OSAlarm>>
+walkAlarmQueue(virt_ptr<OSAlarm> alarm)
+{
+   while (alarm->link.prev) {
+      alarm = alarm->link.prev;
+   }
+
+   auto result = std::vector<virt_ptr<OSAlarm>> { };
+   for (; alarm; alarm = alarm->link.next) {
+      result.push_back(alarm);
+   }
+
+   return result;
+}
+
+TEST_CASE("expired alarms fire in queue order")
+{
+   internal::resetAlarmTimers();
+
+   auto alarms = createAlarms(200);
+   auto rng = std::mt19937 { 0x5EED };
+   auto now = OSGetTime();
+   auto expected = std::vector<virt_ptr<OSAlarm>> { };
+
+   // Queue alarms with shuffled past deadlines, with every 4th in the future
+   for (auto i = 0u; i < alarms.size(); ++i) {
+      if (i % 4 == 3) {
+         OSSetPeriodicAlarm(alarms[i], now + 0x100000000ll + rng() % 1000, 0, nullptr);
+      } else {
+         OSSetPeriodicAlarm(alarms[i], 1 + rng() % 1000, 0, nullptr);
+         expected.push_back(alarms[i]);
+      }
+   }
+
+   // Moving an alarm sends it to the back of the queue
+   OSSetPeriodicAlarm(alarms[0], 1, 0, nullptr);
+   expected.erase(expected.begin());
+   expected.push_back(alarms[0]);
+
+   // Cancelled alarms must not fire
+   internal::cancelAlarm(alarms[1]);
+   expected.erase(std::find(expected.begin(), expected.end(), alarms[1]));
+
+   internal::handleAlarmInterrupt(nullptr);
+
+   // Expired alarms are appended to the callback queue in the order they fired
+   auto fired = walkAlarmQueue(expected.front());
+   REQUIRE(fired == expected);
+
+   for (auto &alarm : fired) {
+      REQUIRE(alarm->state == OSAlarmState::Expired);
+   }
+
+   for (auto i = 3u; i < alarms.size(); i += 4) {
+      REQUIRE(alarms[i]->state == OSAlarmState::Set);
+      internal::cancelAlarm(alarms[i]);
+   }
+
+   OSInitAlarmQueue(fired.front()->alarmQueue);
+   internal::resetAlarmTimers();
+   resetTestMemory();
+}
+
+TEST_CASE("alarm timers are reset for a new process")
+{
+   internal::resetAlarmTimers();
+
+   auto alarm = createAlarms(1).front();
+   OSSetPeriodicAlarm(alarm, OSGetTime() + 0x100000000ll, 0, nullptr);
+
+   // A new process starts with fresh alarm queues while the old alarm was
+   // still queued, setting an alarm at the same address must not trip the
+   // timer index.
+   auto queue = alarm->alarmQueue;
+   internal::resetAlarmTimers();
+   OSInitAlarmQueue(queue);
+
+   OSCreateAlarm(alarm);
+   OSSetPeriodicAlarm(alarm, OSGetTime() + 0x100000000ll, 0, nullptr);
+   REQUIRE(alarm->state == OSAlarmState::Set);
+   REQUIRE(walkAlarmQueue(alarm) == std::vector<virt_ptr<OSAlarm>> { alarm });
+
+   internal::cancelAlarm(alarm);
+   REQUIRE(!queue->head);
+
+   internal::resetAlarmTimers();
+   resetTestMemory();
+}
@@ -0,0 +1,205 @@
+#include <catch.hpp>
+
+#include "test_memory.h"
+#include "cafe/libraries/coreinit/coreinit_memexpheap.h"
+
+#include <common/align.h>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <vector>
+
+using namespace cafe::coreinit;
+
+static constexpr auto
+HeapSize = 8u * 1024 * 1024;
+
+static uint32_t
+getAddress(virt_ptr<void> ptr)
+{
+   return static_cast<uint32_t>(virt_cast<virt_addr>(ptr));
+}
+
+/**
+ * Walk the guest free list the way MEMAllocFromExpHeapEx used to before it
+ * had a host side index, returns the block an allocation must come from.
+ */
+static virt_ptr<MEMExpHeapBlock>
+referenceFindFreeBlock(virt_ptr<MEMExpHeap> heap,
+                       uint32_t size,
+                       int32_t alignment)
+{
+   auto mode = heap->attribs.value().allocMode();
+   auto fromEnd = alignment < 0;
+   auto align = static_cast<uint32_t>(std::max(4, fromEnd ? -alignment : alignment));
+   auto foundBlock = virt_ptr<MEMExpHeapBlock> { nullptr };
+   auto bestAlignedSize = 0xFFFFFFFFu;
+   size = align_up(std::max(size, 1u), 4);
+
+   for (auto block = heap->freeList.head; block; block = block->next) {
+      auto dataStart = getAddress(block) + static_cast<uint32_t>(sizeof(MEMExpHeapBlock));
+      auto dataEnd = dataStart + block->blockSize;
+      auto alignedSize = 0u;
+
+      if (fromEnd) {
+         auto alignedEnd = align_down(dataEnd, align);
+         alignedSize = alignedEnd > dataStart ? alignedEnd - dataStart : 0u;
+      } else {
+         auto alignedStart = align_up(dataStart, align);
+         alignedSize = alignedStart < dataEnd ? dataEnd - alignedStart : 0u;
+      }
+
+      if (alignedSize < size) {
+         continue;
+      }
+
+      if (mode == MEMExpHeapMode::FirstFree) {
+         return block;
+      }
+
+      if (alignedSize < bestAlignedSize) {
+         foundBlock = block;
+         bestAlignedSize = alignedSize;
+      }
+   }
+
+   return foundBlock;
+}
+
+static uint32_t
+referenceTotalFreeSize(virt_ptr<MEMExpHeap> heap)
+{
+   auto total = 0u;
+
+   for (auto block = heap->freeList.head; block; block = block->next) {
+      total += block->blockSize;
+   }
+
+   return total;
+}
+
+static void
+runAllocationStress(MEMHeapHandle handle,
+                    unsigned iterations,
+                    bool verify)
+{
+   auto heap = virt_cast<MEMExpHeap *>(handle);
+   auto rng = std::mt19937 { 0x4D454D };
+   auto allocations = std::vector<virt_ptr<void>> { };
+   const int32_t alignments[] = { 4, 16, 64, 256, -4, -32, -128 };
+
+   for (auto i = 0u; i < iterations; ++i) {
+      if (!allocations.empty() && rng() % 5 < 2) {
+         auto pos = rng() % allocations.size();
+         MEMFreeToExpHeap(handle, allocations[pos]);
+         allocations[pos] = allocations.back();
+         allocations.pop_back();
+      } else {
+         // Mostly small allocations with the occasional large one
+         auto size = (rng() % 8) ? 8u + rng() % 512 : 4096u + rng() % (64 * 1024);
+         auto alignment = alignments[rng() % std::size(alignments)];
+         auto expected = verify ? referenceFindFreeBlock(heap, size, alignment) : nullptr;
+         auto ptr = MEMAllocFromExpHeapEx(handle, size, alignment);
+
+         if (verify) {
+            if (!expected) {
+               REQUIRE(!ptr);
+            } else {
+               // The allocation must be carved out of the block a walk of
+               // the guest free list would have picked.
+               auto blockStart = getAddress(expected);
+               auto blockEnd = blockStart + static_cast<uint32_t>(sizeof(MEMExpHeapBlock)) + expected->blockSize;
+               REQUIRE(ptr);
+               REQUIRE(getAddress(ptr) >= blockStart);
+               REQUIRE(getAddress(ptr) + size <= blockEnd);
+            }
+
+            REQUIRE(MEMGetTotalFreeSizeForExpHeap(handle) == referenceTotalFreeSize(heap));
+         }
+
+         if (ptr) {
+            allocations.push_back(ptr);
+         }
+      }
+   }
+
+   for (auto ptr : allocations) {
+      MEMFreeToExpHeap(handle, ptr);
+   }
+}
+
+TEST_CASE("memexpheap matches guest free list walk")
+{
+   auto mode = GENERATE(MEMExpHeapMode::FirstFree, MEMExpHeapMode::NearestSize);
+   auto base = allocateTestMemory(HeapSize, 0x1000);
+   auto handle = MEMCreateExpHeapEx(base, HeapSize, 0);
+   REQUIRE(handle);
+
+   MEMSetAllocModeForExpHeap(handle, mode);
+   runAllocationStress(handle, 20000, true);
+
+   // Everything was freed so we should be back to one block
+   auto heap = virt_cast<MEMExpHeap *>(handle);
+   REQUIRE(heap->freeList.head == heap->freeList.tail);
+   REQUIRE(MEMGetTotalFreeSizeForExpHeap(handle) == referenceTotalFreeSize(heap));
+
+   MEMDestroyExpHeap(handle);
+   resetTestMemory();
+}
+
+TEST_CASE("memexpheap rebuilds index after guest memory changes")
+{
+   auto base = allocateTestMemory(HeapSize, 0x1000);
+   auto handle = MEMCreateExpHeapEx(base, HeapSize, 0);
+   auto heap = virt_cast<MEMExpHeap *>(handle);
+   REQUIRE(handle);
+
+   auto a = MEMAllocFromExpHeapEx(handle, 0x1000, 4);
+   auto b = MEMAllocFromExpHeapEx(handle, 0x1000, 4);
+   REQUIRE(a);
+   REQUIRE(b);
+
+   // Take a copy of the heap as a snapshot would, then change it
+   auto snapshot = std::vector<uint8_t>(HeapSize);
+   std::memcpy(snapshot.data(), base.get(), HeapSize);
+   MEMFreeToExpHeap(handle, a);
+   REQUIRE(MEMGetTotalFreeSizeForExpHeap(handle) == referenceTotalFreeSize(heap));
+
+   // Restoring guest memory behind the heap's back must not leave a stale index
+   std::memcpy(base.get(), snapshot.data(), HeapSize);
+   REQUIRE(MEMGetTotalFreeSizeForExpHeap(handle) == referenceTotalFreeSize(heap));
+   runAllocationStress(handle, 2000, true);
+
+   // A heap destroyed and recreated at the same address
+   MEMDestroyExpHeap(handle);
+   std::memset(base.get(), 0, HeapSize);
+   handle = MEMCreateExpHeapEx(base, HeapSize, 0);
+   heap = virt_cast<MEMExpHeap *>(handle);
+   REQUIRE(MEMGetTotalFreeSizeForExpHeap(handle) == referenceTotalFreeSize(heap));
+   runAllocationStress(handle, 2000, true);
+
+   MEMDestroyExpHeap(handle);
+   resetTestMemory();
+}
+
+TEST_CASE("memexpheap allocation stress", "[!benchmark]")
+{
+   auto base = allocateTestMemory(HeapSize, 0x1000);
+   auto handle = MEMCreateExpHeapEx(base, HeapSize, 0);
+   REQUIRE(handle);
+
+   BENCHMARK("FirstFree alloc/free")
+   {
+      MEMSetAllocModeForExpHeap(handle, MEMExpHeapMode::FirstFree);
+      runAllocationStress(handle, 20000, false);
+   };
+
+   BENCHMARK("NearestSize alloc/free")
+   {
+      MEMSetAllocModeForExpHeap(handle, MEMExpHeapMode::NearestSize);
+      runAllocationStress(handle, 20000, false);
+   };
+
+   MEMDestroyExpHeap(handle);
+   resetTestMemory();
+}
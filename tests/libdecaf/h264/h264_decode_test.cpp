@@ -0,0 +1,252 @@
+#ifdef DECAF_FFMPEG
+#include <catch.hpp>
+
+#include "test_memory.h"
+#include "cafe/libraries/h264/h264_decode.h"
+#include "cafe/libraries/h264/h264_stream.h"
+
+#include <algorithm>
+#include <common/align.h>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+using namespace cafe::h264;
+
+/*
+h264/streams/reorder16.h264 is 48 frames of 64x64 High profile video made
+with x264 using B-frame pyramids, two IDR frames and an access unit delimiter
+before every frame. The SPS was then rewritten to declare a reorder delay of
+16 frames, so ffmpeg holds 16 frames back plus one per frame thread.
+
+Frames are listed in display order with the index of the access unit they
+were decoded from and the CRC-32 of the NV12 picture, which came from a
+single threaded ffmpeg decode of the same stream.
+*/
+
+struct ExpectedFrame
+{
+   uint32_t decodeIndex;
+   uint32_t crc;
+};
+
+static const ExpectedFrame
+ExpectedFrames[] = {
+   {  0, 0x809FFF6C }, {  3, 0x21791ADF }, {  2, 0x2FBAB739 }, {  4, 0xFF817BF1 },
+   {  1, 0x82E3DF4A }, {  7, 0x3166E375 }, {  6, 0x357E409F }, {  8, 0x734148F1 },
+   {  5, 0xEFA243A3 }, { 11, 0x7A5331CA }, { 10, 0x5E11A752 }, { 12, 0x9D807776 },
+   {  9, 0x1A022222 }, { 15, 0xE757D1CA }, { 14, 0x54C6D7A1 }, { 16, 0x4B9CDF96 },
+   { 13, 0xE7D5E18E }, { 19, 0x35B544F7 }, { 18, 0xF9EBECF2 }, { 20, 0xE6384483 },
+   { 17, 0xF5E77C19 }, { 22, 0x26B15816 }, { 23, 0x6B57CA88 }, { 21, 0x38BED0E8 },
+   { 24, 0xB92E9A3B }, { 27, 0x67A1642C }, { 26, 0x22C83A6B }, { 28, 0xBA73B8E2 },
+   { 25, 0xFACD1BC2 }, { 31, 0x43781985 }, { 30, 0xCEE4A5D2 }, { 32, 0xE2E7B9D4 },
+   { 29, 0x6D00B092 }, { 35, 0x13A896E3 }, { 34, 0xA861A119 }, { 36, 0xA0326456 },
+   { 33, 0x8F99EB98 }, { 39, 0x3E50F622 }, { 38, 0x367F8EA5 }, { 40, 0xCA65B7BB },
+   { 37, 0x14305B2D }, { 43, 0x7CFAC3BA }, { 42, 0x66B9A42E }, { 44, 0xF75A5ECB },
+   { 41, 0x36FB4647 }, { 46, 0x71E20502 }, { 47, 0x116830D4 }, { 45, 0xFC4DCEC5 },
+};
+
+static constexpr auto
+FrameWidth = 64u;
+
+static constexpr auto
+FrameHeight = 64u;
+
+static constexpr auto
+FramePitch = align_up(FrameWidth, 256u);
+
+static constexpr auto
+FrameBufferSize = FramePitch * (FrameHeight + FrameHeight / 2);
+
+static constexpr auto
+MaxReorderDelay = 16u;
+
+static constexpr auto
+MaxLoggedFrames = 64u;
+
+//! What the output callback records about each frame.
+struct FrameLog
+{
+   be2_val<uint32_t> count;
+   UNKNOWN(0xC);
+
+   struct Entry
+   {
+      be2_virt_ptr<void> framebuffer;
+      UNKNOWN(4);
+      be2_val<double> timestamp;
+   };
+
+   be2_array<Entry, MaxLoggedFrames> frames;
+};
+
+/**
+ * The frame output callback, appends the framebuffer and timestamp of
+ * output->decodeResults[0] to the FrameLog in output->userMemory.
+ */
+static const std::vector<uint32_t>
+GuestOutputCallback = {
+   0x80830008, // lwz r4, 8(r3)
+   0x80A40000, // lwz r5, 0(r4)
+   0x80C30004, // lwz r6, 4(r3)
+   0x80C60000, // lwz r6, 0(r6)
+   0x54A72036, // slwi r7, r5, 4
+   0x7CE72214, // add r7, r7, r4
+   0x81060044, // lwz r8, 0x44(r6)
+   0x91070010, // stw r8, 0x10(r7)
+   0x81060008, // lwz r8, 0x8(r6)
+   0x91070018, // stw r8, 0x18(r7)
+   0x8106000C, // lwz r8, 0xC(r6)
+   0x9107001C, // stw r8, 0x1C(r7)
+   0x38A50001, // addi r5, r5, 1
+   0x90A40000, // stw r5, 0(r4)
+   0x4E800020, // blr
+};
+
+//! Split an Annex B stream into access units at each access unit delimiter.
+static std::vector<std::vector<uint8_t>>
+readAccessUnits(const std::string &path)
+{
+   auto file = std::ifstream { path, std::ifstream::binary };
+   REQUIRE(file.is_open());
+   auto data = std::vector<uint8_t> {
+      std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> { }
+   };
+
+   static const uint8_t delimiter[] = { 0, 0, 0, 1, 9 };
+   auto units = std::vector<std::vector<uint8_t>> { };
+   auto start = std::search(data.begin(), data.end(),
+                            std::begin(delimiter), std::end(delimiter));
+
+   while (start != data.end()) {
+      auto end = std::search(start + 1, data.end(),
+                             std::begin(delimiter), std::end(delimiter));
+      units.emplace_back(start, end);
+      start = end;
+   }
+
+   return units;
+}
+
+struct TestDecoder
+{
+   virt_ptr<void> memory;
+   virt_ptr<FrameLog> log;
+   std::vector<virt_ptr<uint8_t>> accessUnits;
+   std::vector<uint32_t> accessUnitSizes;
+   std::vector<virt_ptr<void>> frameBuffers;
+};
+
+static TestDecoder
+createTestDecoder()
+{
+   auto decoder = TestDecoder { };
+   auto units = readAccessUnits("h264/streams/reorder16.h264");
+   REQUIRE(units.size() == std::size(ExpectedFrames));
+
+   for (auto &unit : units) {
+      auto size = static_cast<uint32_t>(unit.size());
+      auto buffer = virt_cast<uint8_t *>(allocateTestMemory(size, 4));
+      std::memcpy(buffer.get(), unit.data(), size);
+      decoder.accessUnits.push_back(buffer);
+      decoder.accessUnitSizes.push_back(size);
+      decoder.frameBuffers.push_back(allocateTestMemory(FrameBufferSize, 256));
+   }
+
+   auto code = virt_cast<uint32_t *>(
+      allocateTestMemory(static_cast<uint32_t>(GuestOutputCallback.size() * 4), 32));
+   for (auto i = 0u; i < GuestOutputCallback.size(); ++i) {
+      code[i] = GuestOutputCallback[i];
+   }
+
+   auto memorySize = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   REQUIRE(H264DECMemoryRequirement(100, 10, FrameWidth, FrameHeight, memorySize) == H264Error::OK);
+   decoder.memory = allocateTestMemory(*memorySize, 0x100);
+   decoder.log = virt_cast<FrameLog *>(allocateTestMemory(sizeof(FrameLog), 8));
+
+   auto callback = virt_func_cast<H264DECFptrOutputFn::function_type>(virt_cast<virt_addr>(code));
+   REQUIRE(H264DECInitParam(static_cast<int32_t>(*memorySize), decoder.memory) == H264Error::OK);
+   REQUIRE(H264DECSetParam_FPTR_OUTPUT(decoder.memory, callback) == H264Error::OK);
+   REQUIRE(H264DECSetParam_USER_MEMORY(decoder.memory, decoder.log) == H264Error::OK);
+   REQUIRE(H264DECOpen(decoder.memory) == H264Error::OK);
+   return decoder;
+}
+
+//! Decode the whole stream, access unit i goes to frameBuffers[i] with a
+//! timestamp of i + 0.5.
+static void
+decodeStream(TestDecoder &decoder)
+{
+   decoder.log->count = 0u;
+   H264DECBegin(decoder.memory);
+
+   for (auto i = 0u; i < decoder.accessUnits.size(); ++i) {
+      H264DECSetBitstream(decoder.memory, decoder.accessUnits[i],
+                          decoder.accessUnitSizes[i], i + 0.5);
+      REQUIRE(H264DECExecute(decoder.memory, decoder.frameBuffers[i]) ==
+              static_cast<H264Error>(0x80 | 100));
+   }
+
+   // The declared reorder delay must hold frames back until the end
+   REQUIRE(decoder.log->count <= decoder.accessUnits.size() - MaxReorderDelay);
+   H264DECEnd(decoder.memory);
+}
+
+static uint32_t
+getFrameCrc(virt_ptr<void> frameBuffer)
+{
+   auto crc = crc32(0, nullptr, 0);
+   auto luma = virt_cast<uint8_t *>(frameBuffer).get();
+   auto chroma = luma + FrameHeight * FramePitch;
+
+   for (auto y = 0u; y < FrameHeight; ++y) {
+      crc = crc32(crc, luma + y * FramePitch, FrameWidth);
+   }
+
+   for (auto y = 0u; y < FrameHeight / 2; ++y) {
+      crc = crc32(crc, chroma + y * FramePitch, FrameWidth);
+   }
+
+   return static_cast<uint32_t>(crc);
+}
+
+TEST_CASE("h264 outputs reordered frames with the buffer they were submitted with")
+{
+   auto decoder = createTestDecoder();
+
+   // Run twice to check a new stream starts with fresh frame slots
+   for (auto run = 0; run < 2; ++run) {
+      decodeStream(decoder);
+      REQUIRE(decoder.log->count == std::size(ExpectedFrames));
+
+      for (auto i = 0u; i < std::size(ExpectedFrames); ++i) {
+         auto &expected = ExpectedFrames[i];
+         auto &frame = decoder.log->frames[i];
+         REQUIRE(frame.framebuffer == decoder.frameBuffers[expected.decodeIndex]);
+         REQUIRE(frame.timestamp == expected.decodeIndex + 0.5);
+         REQUIRE(getFrameCrc(frame.framebuffer) == expected.crc);
+      }
+   }
+
+   H264DECClose(decoder.memory);
+   resetTestMemory();
+}
+
+TEST_CASE("h264 decode throughput", "[!benchmark]")
+{
+   auto decoder = createTestDecoder();
+
+   BENCHMARK("decode 48 frames of 64x64")
+   {
+      decodeStream(decoder);
+      return static_cast<uint32_t>(decoder.log->count);
+   };
+
+   H264DECClose(decoder.memory);
+   resetTestMemory();
+}
+
+#endif // ifdef DECAF_FFMPEG
@@ -0,0 +1,150 @@
+#include <catch.hpp>
+
+#include "ios/net/ios_net_socket_device.h"
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+using ReadRing = ios::net::internal::SocketDevice::ReadRing;
+using ios::net::internal::SocketDevice;
+
+TEST_CASE("socket read ring matches a byte queue")
+{
+   auto ring = ReadRing { };
+   auto reference = std::deque<char> { };
+   auto rng = std::mt19937 { 0x5EED };
+   auto next = char { 0 };
+   auto input = std::vector<char> { };
+   auto output = std::vector<char> { };
+
+   for (auto i = 0; i < 20000; ++i) {
+      if (rng() % 2) {
+         // Mostly packet sized writes with the occasional burst
+         auto length = (rng() % 64) ? rng() % 1500 : rng() % (128 * 1024);
+         input.resize(length);
+         for (auto &byte : input) {
+            byte = next++;
+         }
+
+         ring.push(input.data(), input.size());
+         reference.insert(reference.end(), input.begin(), input.end());
+      } else {
+         auto offset = rng() % 16;
+         auto length = rng() % 8192;
+         output.resize(length);
+
+         auto copied = ring.copy(output.data(), offset, length);
+         auto expected = offset < reference.size() ?
+            std::min<size_t>(length, reference.size() - offset) : 0;
+         REQUIRE(copied == expected);
+         REQUIRE(std::equal(output.begin(), output.begin() + copied,
+                            reference.begin() + offset));
+
+         auto consumed = std::min<size_t>(length, reference.size());
+         ring.consume(length);
+         reference.erase(reference.begin(), reference.begin() + consumed);
+      }
+
+      REQUIRE(ring.size == reference.size());
+      REQUIRE(ring.empty() == reference.empty());
+   }
+}
+
+TEST_CASE("socket read ring shrinks after a burst")
+{
+   auto ring = ReadRing { };
+   auto burst = std::vector<char>(8 * 1024 * 1024, 'x');
+
+   ring.push(burst.data(), burst.size());
+   REQUIRE(ring.storage.size() >= burst.size());
+
+   // Reading most of the burst gives memory back while keeping the rest
+   ring.consume(burst.size() - 1000);
+   REQUIRE(ring.size == 1000);
+   REQUIRE(ring.storage.size() == SocketDevice::ReadBufferSize);
+
+   auto tail = std::vector<char>(1000);
+   REQUIRE(ring.copy(tail.data(), 0, tail.size()) == tail.size());
+   REQUIRE(std::all_of(tail.begin(), tail.end(), [](char c) { return c == 'x'; }));
+
+   ring.consume(1000);
+   REQUIRE(ring.empty());
+   REQUIRE(ring.storage.size() == SocketDevice::ReadBufferSize);
+}
+
+// Stream data through in TCP segment sized reads from libuv and 4 KiB recvs
+// from the guest, which only catches up every recvInterval segments.
+static constexpr auto TotalBytes = size_t { 16 * 1024 * 1024 };
+static constexpr auto SegmentSize = size_t { 1460 };
+static constexpr auto RecvSize = size_t { 4096 };
+
+static size_t
+streamThroughRing(size_t recvInterval)
+{
+   auto segment = std::vector<char>(SegmentSize, 'x');
+   auto output = std::vector<char>(RecvSize);
+   auto ring = ReadRing { };
+   auto received = size_t { 0 };
+
+   for (auto sent = size_t { 0 }; sent < TotalBytes; sent += SegmentSize) {
+      ring.push(segment.data(), segment.size());
+
+      if ((sent / SegmentSize) % recvInterval == 0) {
+         while (ring.size >= RecvSize) {
+            received += ring.copy(output.data(), 0, RecvSize);
+            ring.consume(RecvSize);
+         }
+      }
+   }
+
+   return received;
+}
+
+//! The vector and memmove the read ring replaced.
+static size_t
+streamThroughVector(size_t recvInterval)
+{
+   auto segment = std::vector<char>(SegmentSize, 'x');
+   auto output = std::vector<char>(RecvSize);
+   auto buffer = std::vector<char> { };
+   auto received = size_t { 0 };
+
+   for (auto sent = size_t { 0 }; sent < TotalBytes; sent += SegmentSize) {
+      buffer.insert(buffer.end(), segment.begin(), segment.end());
+
+      if ((sent / SegmentSize) % recvInterval == 0) {
+         while (buffer.size() >= RecvSize) {
+            std::copy_n(buffer.begin(), RecvSize, output.begin());
+            buffer.erase(buffer.begin(), buffer.begin() + RecvSize);
+            received += RecvSize;
+         }
+      }
+   }
+
+   return received;
+}
+
+TEST_CASE("socket read ring throughput", "[!benchmark]")
+{
+   BENCHMARK("read ring, guest keeping up")
+   {
+      return streamThroughRing(4);
+   };
+
+   BENCHMARK("vector, guest keeping up")
+   {
+      return streamThroughVector(4);
+   };
+
+   BENCHMARK("read ring, guest falling behind")
+   {
+      return streamThroughRing(256);
+   };
+
+   BENCHMARK("vector, guest falling behind")
+   {
+      return streamThroughVector(256);
+   };
+}
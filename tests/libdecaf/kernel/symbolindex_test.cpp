@@ -0,0 +1,259 @@
+#include <catch.hpp>
+
+#include "test_memory.h"
+#include "cafe/kernel/cafe_kernel_symbolindex.h"
+#include "cafe/loader/cafe_loader_rpl.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cafe;
+using namespace cafe::kernel;
+
+static constexpr auto
+SymbolStride = 0x40u;
+
+static virt_ptr<loader::rpl::SectionHeader>
+getSectionHeader(virt_ptr<loader::LOADED_RPL> rpl,
+                 uint32_t index)
+{
+   return virt_cast<loader::rpl::SectionHeader *>(
+      virt_cast<virt_addr>(rpl->sectionHeaderBuffer) +
+      rpl->elfHeader.shentsize * index);
+}
+
+/**
+ * Build a module with a text section at textAddr holding numSymbols symbols
+ * SymbolStride bytes apart. Every 16th symbol is a '$' mapping symbol and
+ * every 32nd symbol shares its address with the one before it.
+ *
+ * textAddr must be outside of test memory so the text section cannot overlap
+ * the module's symbol and string table sections.
+ */
+static virt_ptr<loader::LOADED_RPL>
+createModule(uint32_t textAddr,
+             uint32_t numSymbols)
+{
+   enum Sections
+   {
+      Null,
+      Text,
+      SymTab,
+      StrTab,
+      NumSections,
+   };
+
+   auto rpl = virt_cast<loader::LOADED_RPL *>(
+      allocateTestMemory(sizeof(loader::LOADED_RPL), 4));
+   rpl->elfHeader.shnum = uint16_t { NumSections };
+   rpl->elfHeader.shentsize = uint16_t { sizeof(loader::rpl::SectionHeader) };
+   rpl->sectionHeaderBuffer =
+      allocateTestMemory(NumSections * sizeof(loader::rpl::SectionHeader), 4);
+   rpl->sectionAddressBuffer = virt_cast<virt_addr *>(
+      allocateTestMemory(NumSections * sizeof(virt_addr), 4));
+
+   auto strings = std::string { };
+   strings.push_back('\0');
+
+   auto symbols = virt_cast<loader::rpl::Symbol *>(
+      allocateTestMemory(numSymbols * sizeof(loader::rpl::Symbol), 4));
+   for (auto i = 0u; i < numSymbols; ++i) {
+      auto name = (i % 16 == 15) ? "$d" : "func_" + std::to_string(i);
+      auto value = textAddr + i * SymbolStride;
+      if (i % 32 == 31) {
+         value -= SymbolStride;
+      }
+
+      symbols[i].name = static_cast<uint32_t>(strings.size());
+      symbols[i].value = value;
+      symbols[i].shndx = uint16_t { Text };
+      strings.append(name);
+      strings.push_back('\0');
+   }
+
+   auto strTab = allocateTestMemory(static_cast<uint32_t>(strings.size()), 4);
+   std::memcpy(strTab.get(), strings.data(), strings.size());
+
+   auto text = getSectionHeader(rpl, Text);
+   text->type = static_cast<uint32_t>(loader::rpl::SHT_PROGBITS);
+   text->size = numSymbols * SymbolStride;
+   rpl->sectionAddressBuffer[Text] = virt_addr { textAddr };
+
+   auto symTab = getSectionHeader(rpl, SymTab);
+   symTab->type = static_cast<uint32_t>(loader::rpl::SHT_SYMTAB);
+   symTab->size = numSymbols * static_cast<uint32_t>(sizeof(loader::rpl::Symbol));
+   symTab->entsize = static_cast<uint32_t>(sizeof(loader::rpl::Symbol));
+   symTab->link = uint32_t { StrTab };
+   rpl->sectionAddressBuffer[SymTab] = virt_cast<virt_addr>(symbols);
+
+   auto strTabHeader = getSectionHeader(rpl, StrTab);
+   strTabHeader->type = static_cast<uint32_t>(loader::rpl::SHT_STRTAB);
+   strTabHeader->size = static_cast<uint32_t>(strings.size());
+   rpl->sectionAddressBuffer[StrTab] = virt_cast<virt_addr>(strTab);
+   return rpl;
+}
+
+/**
+ * Find the nearest symbol by walking every section of every module the way
+ * findClosestSymbol did before the index.
+ */
+static internal::IndexedSymbol
+referenceLookup(const std::vector<virt_ptr<loader::LOADED_RPL>> &modules,
+                virt_addr addr)
+{
+   auto result = internal::IndexedSymbol { nullptr, nullptr, virt_addr { 0 } };
+   auto containingSection = 0u;
+
+   for (auto &rpl : modules) {
+      for (auto i = 0u; i < rpl->elfHeader.shnum; ++i) {
+         auto sectionAddress = rpl->sectionAddressBuffer[i];
+         auto sectionHeader = getSectionHeader(rpl, i);
+         if (sectionAddress && addr >= sectionAddress &&
+             addr < sectionAddress + sectionHeader->size) {
+            result.module = rpl;
+            containingSection = i;
+         }
+      }
+   }
+
+   if (!result.module) {
+      return result;
+   }
+
+   auto rpl = result.module;
+   auto nearestDistance = uint32_t { 0xFFFFFFFFu };
+   for (auto i = 0u; i < rpl->elfHeader.shnum; ++i) {
+      auto sectionHeader = getSectionHeader(rpl, i);
+      if (sectionHeader->type != loader::rpl::SHT_SYMTAB) {
+         continue;
+      }
+
+      auto symbols = virt_cast<loader::rpl::Symbol *>(rpl->sectionAddressBuffer[i]);
+      auto strTab = rpl->sectionAddressBuffer[sectionHeader->link];
+      auto numSymbols = sectionHeader->size / sectionHeader->entsize;
+
+      for (auto j = 0u; j < numSymbols; ++j) {
+         auto name = virt_cast<const char *>(strTab + symbols[j].name);
+         auto value = virt_addr { static_cast<uint32_t>(symbols[j].value) };
+         if (name[0] == '$' || name[0] == '.' ||
+             symbols[j].shndx != containingSection || value > addr) {
+            continue;
+         }
+
+         auto distance = static_cast<uint32_t>(addr - value);
+         if (distance < nearestDistance) {
+            nearestDistance = distance;
+            result.name = name;
+            result.address = value;
+         }
+      }
+   }
+
+   return result;
+}
+
+TEST_CASE("symbol index matches a walk of every module")
+{
+   auto modules = std::vector<virt_ptr<loader::LOADED_RPL>> {
+      createModule(0x10000000u, 3000),
+      createModule(0x10100000u, 500),
+      createModule(0x1E000000u, 1000),
+   };
+
+   internal::resetSymbolIndex(RamPartitionId::MainApplication);
+   for (auto &rpl : modules) {
+      internal::addModuleSymbolIndex(RamPartitionId::MainApplication, rpl);
+   }
+
+   auto rng = std::mt19937 { 0x5EED };
+   for (auto i = 0; i < 20000; ++i) {
+      auto &rpl = modules[rng() % modules.size()];
+      auto textAddr = rpl->sectionAddressBuffer[1];
+      auto textSize = getSectionHeader(rpl, 1)->size;
+
+      // Include some addresses just outside of every module
+      auto addr = textAddr + (rng() % (textSize + 0x100)) - 0x80;
+      auto expected = referenceLookup(modules, addr);
+      auto symbol = internal::lookupSymbolIndex(RamPartitionId::MainApplication, addr);
+
+      REQUIRE(symbol.module == expected.module);
+      REQUIRE(symbol.name == expected.name);
+      REQUIRE(symbol.address == expected.address);
+   }
+
+   internal::resetSymbolIndex(RamPartitionId::MainApplication);
+   resetTestMemory();
+}
+
+TEST_CASE("symbol index keeps partitions apart")
+{
+   auto app = createModule(0x10000000u, 100);
+   auto root = createModule(0x10000000u, 200);
+
+   internal::resetSymbolIndex(RamPartitionId::MainApplication);
+   internal::resetSymbolIndex(RamPartitionId::Root);
+   internal::addModuleSymbolIndex(RamPartitionId::MainApplication, app);
+   internal::addModuleSymbolIndex(RamPartitionId::Root, root);
+
+   // The same address resolves within the partition it is looked up in
+   auto addr = virt_addr { 0x10000000u + 150 * SymbolStride };
+   REQUIRE(!internal::lookupSymbolIndex(RamPartitionId::MainApplication, addr).module);
+   REQUIRE(internal::lookupSymbolIndex(RamPartitionId::Root, addr).module == root);
+   REQUIRE(!internal::lookupSymbolIndex(RamPartitionId::OverlayApp, addr).module);
+
+   // Purging a module only drops it from its own partition
+   internal::removeModuleSymbolIndex(RamPartitionId::Root, root);
+   REQUIRE(!internal::lookupSymbolIndex(RamPartitionId::Root, addr).module);
+   REQUIRE(internal::lookupSymbolIndex(RamPartitionId::MainApplication,
+                                       virt_addr { 0x10000000u }).module == app);
+
+   // Loading a new process into a partition starts a fresh index
+   internal::resetSymbolIndex(RamPartitionId::MainApplication);
+   REQUIRE(!internal::lookupSymbolIndex(RamPartitionId::MainApplication,
+                                        virt_addr { 0x10000000u }).module);
+   resetTestMemory();
+}
+
+TEST_CASE("symbol index lookup", "[!benchmark]")
+{
+   auto modules = std::vector<virt_ptr<loader::LOADED_RPL>> { };
+   for (auto i = 0u; i < 8; ++i) {
+      modules.push_back(createModule(0x10000000u + i * 0x01000000u, 20000));
+   }
+
+   internal::resetSymbolIndex(RamPartitionId::MainApplication);
+   for (auto &rpl : modules) {
+      internal::addModuleSymbolIndex(RamPartitionId::MainApplication, rpl);
+   }
+
+   auto rng = std::mt19937 { 0x5EED };
+   auto addresses = std::vector<virt_addr> { };
+   for (auto i = 0; i < 64; ++i) {
+      auto &rpl = modules[rng() % modules.size()];
+      addresses.push_back(rpl->sectionAddressBuffer[1] +
+                          rng() % getSectionHeader(rpl, 1)->size);
+   }
+
+   BENCHMARK("indexed lookup")
+   {
+      auto found = 0u;
+      for (auto addr : addresses) {
+         found += !!internal::lookupSymbolIndex(RamPartitionId::MainApplication, addr).name;
+      }
+      return found;
+   };
+
+   BENCHMARK("module walk")
+   {
+      auto found = 0u;
+      for (auto addr : addresses) {
+         found += !!referenceLookup(modules, addr).name;
+      }
+      return found;
+   };
+
+   internal::resetSymbolIndex(RamPartitionId::MainApplication);
+   resetTestMemory();
+}
@@ -0,0 +1,112 @@
+#include <catch.hpp>
+
+#include "test_memory.h"
+#include "cafe/loader/cafe_loader_loaded_rpl.h"
+#include "cafe/loader/cafe_loader_reloc.h"
+#include "cafe/loader/cafe_loader_rpl.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+#include <zlib.h>
+
+using namespace cafe::loader;
+
+static virt_ptr<rpl::SectionHeader>
+getSectionHeader(virt_ptr<LOADED_RPL> rpl,
+                 uint32_t index)
+{
+   return virt_cast<rpl::SectionHeader *>(
+      virt_cast<virt_addr>(rpl->sectionHeaderBuffer) +
+      rpl->elfHeader.shentsize * index);
+}
+
+/**
+ * Build a module whose sections 1 to numRela are deflated relocation
+ * sections holding random relocations, the contents of each before deflation
+ * is returned in outRelocations. Every 7th section has a corrupt stream.
+ */
+static virt_ptr<LOADED_RPL>
+createModule(uint32_t numRela,
+             std::vector<std::vector<uint8_t>> &outRelocations)
+{
+   // The last two sections are the crc and file info sections
+   auto shnum = numRela + 3;
+   auto rpl = virt_cast<LOADED_RPL *>(allocateTestMemory(sizeof(LOADED_RPL), 4));
+   rpl->elfHeader.shnum = static_cast<uint16_t>(shnum);
+   rpl->elfHeader.shentsize = uint16_t { sizeof(rpl::SectionHeader) };
+   rpl->sectionHeaderBuffer = allocateTestMemory(shnum * sizeof(rpl::SectionHeader), 4);
+   rpl->sectionAddressBuffer = virt_cast<virt_addr *>(
+      allocateTestMemory(shnum * sizeof(virt_addr), 4));
+
+   auto rng = std::mt19937 { 0x5EED };
+   outRelocations.clear();
+   outRelocations.resize(shnum);
+
+   for (auto i = 1u; i <= numRela; ++i) {
+      auto &relocations = outRelocations[i];
+      auto numRelocations = 1u + rng() % 20000;
+      relocations.resize(numRelocations * sizeof(rpl::Rela));
+
+      // Relocation data is very repetitive, keep most bytes in a small range
+      for (auto &byte : relocations) {
+         byte = static_cast<uint8_t>(rng() % 16);
+      }
+
+      auto deflated = std::vector<uint8_t>(compressBound(static_cast<uLong>(relocations.size())));
+      auto deflatedSize = static_cast<uLongf>(deflated.size());
+      REQUIRE(compress2(deflated.data(), &deflatedSize,
+                        relocations.data(), static_cast<uLong>(relocations.size()),
+                        Z_BEST_SPEED) == Z_OK);
+
+      if (i % 7 == 0) {
+         deflated[deflatedSize / 2] ^= 0xFF;
+         deflated[2] ^= 0xFF;
+      }
+
+      auto section = allocateTestMemory(static_cast<uint32_t>(deflatedSize + 4), 4);
+      *virt_cast<uint32_t *>(section) = static_cast<uint32_t>(relocations.size());
+      std::memcpy(virt_cast<uint8_t *>(section).get() + 4, deflated.data(), deflatedSize);
+
+      auto sectionHeader = getSectionHeader(rpl, i);
+      sectionHeader->type = static_cast<uint32_t>(rpl::SHT_RELA);
+      sectionHeader->flags = static_cast<uint32_t>(rpl::SHF_DEFLATED);
+      sectionHeader->size = static_cast<uint32_t>(deflatedSize + 4);
+      rpl->sectionAddressBuffer[i] = virt_cast<virt_addr>(section);
+   }
+
+   return rpl;
+}
+
+TEST_CASE("loader inflates relocations identically in parallel and serially")
+{
+   auto relocations = std::vector<std::vector<uint8_t>> { };
+   auto rpl = createModule(24, relocations);
+
+   auto serial = internal::LiInflateRelocationSections(rpl, 1);
+   auto parallel = internal::LiInflateRelocationSections(rpl, internal::MaxRelocationInflateWorkers);
+   auto wide = internal::LiInflateRelocationSections(rpl, 64);
+   REQUIRE(serial.size() == parallel.size());
+   REQUIRE(serial.size() == wide.size());
+
+   for (auto i = 0u; i < serial.size(); ++i) {
+      REQUIRE(parallel[i].initError == serial[i].initError);
+      REQUIRE(parallel[i].zlibError == serial[i].zlibError);
+      REQUIRE(parallel[i].availOut == serial[i].availOut);
+      REQUIRE(parallel[i].data == serial[i].data);
+
+      REQUIRE(wide[i].initError == serial[i].initError);
+      REQUIRE(wide[i].zlibError == serial[i].zlibError);
+      REQUIRE(wide[i].availOut == serial[i].availOut);
+      REQUIRE(wide[i].data == serial[i].data);
+
+      // Intact sections must inflate back to exactly what was deflated
+      if (!relocations[i].empty() && i % 7 != 0) {
+         REQUIRE(serial[i].zlibError == Z_STREAM_END);
+         REQUIRE(serial[i].availOut == 0);
+         REQUIRE(serial[i].data == relocations[i]);
+      }
+   }
+
+   resetTestMemory();
+}
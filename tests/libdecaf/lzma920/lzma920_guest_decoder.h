@@ -0,0 +1,460 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/*
+A straightforward LZMA decoder written in PowerPC assembly, used as the guest
+code path to compare the host LzmaDec against. It has none of the SDK's
+optimisations beyond what a compiler would do for the reference decoder and
+uses the same probability layout as LzmaDec.c.
+
+   uint32_t decode(uint8_t *dest, uint32_t destLen,
+                   const uint8_t *lzmaFile, uint16_t *probs);
+
+lzmaFile is a .lzma file with the 13 byte header, the whole output is kept in
+dest so the dictionary never wraps. probs needs room for
+1846 + (0x300 << (lc + lp)) probabilities. Returns the number of bytes
+decoded, which stops at destLen or the end marker.
+
+Register use:
+   r14 range, r15 code, r16 input, r17 dest, r18 outPos, r19 destLen,
+   r20 probs, r21 state, r22 - r25 rep0 - rep3, r26 lc, r27 lpMask,
+   r28 pbMask, r29 posState then len, r30 - r31 scratch
+*/
+
+static const std::vector<uint32_t>
+GuestLzmaDecoder = {
+   // decode:
+   0x9421FFA0, // stwu r1, -96(r1)
+   0x7C0802A6, // mflr r0
+   0x90010064, // stw r0, 100(r1)
+   0xBDC10010, // stmw r14, 16(r1)
+   0x7C711B78, // mr r17, r3
+   0x7C932378, // mr r19, r4
+   0x7CD43378, // mr r20, r6
+   0x88E50000, // lbz r7, 0(r5)
+   0x39000009, // li r8, 9
+   0x7D274396, // divwu r9, r7, r8
+   0x7D4941D6, // mullw r10, r9, r8
+   0x7F4A3850, // subf r26, r10, r7
+   0x39000005, // li r8, 5
+   0x7D494396, // divwu r10, r9, r8
+   0x7D6A41D6, // mullw r11, r10, r8
+   0x7D6B4850, // subf r11, r11, r9
+   0x39800001, // li r12, 1
+   0x7D9B5830, // slw r27, r12, r11
+   0x3B7BFFFF, // addi r27, r27, -1
+   0x7D9C5030, // slw r28, r12, r10
+   0x3B9CFFFF, // addi r28, r28, -1
+   0x7D6BD214, // add r11, r11, r26
+   0x39800300, // li r12, 0x300
+   0x7D8C5830, // slw r12, r12, r11
+   0x398C0736, // addi r12, r12, 1846
+   0x7D8903A6, // mtctr r12
+   0x38E00400, // li r7, 1024
+   0x3914FFFE, // addi r8, r20, -2
+
+   // init:
+   0xB4E80002, // sthu r7, 2(r8)
+   0x4200FFFC, // bdnz init
+   0x3A05000E, // addi r16, r5, 14
+   0x39E00000, // li r15, 0
+   0x39200004, // li r9, 4
+   0x7D2903A6, // mtctr r9
+
+   // code:
+   0x88F00000, // lbz r7, 0(r16)
+   0x3A100001, // addi r16, r16, 1
+   0x55EF402E, // slwi r15, r15, 8
+   0x7DEF3B78, // or r15, r15, r7
+   0x4200FFF0, // bdnz code
+   0x39C0FFFF, // li r14, -1
+   0x3A400000, // li r18, 0
+   0x3AA00000, // li r21, 0
+   0x3AC00000, // li r22, 0
+   0x3AE00000, // li r23, 0
+   0x3B000000, // li r24, 0
+   0x3B200000, // li r25, 0
+
+   // loop:
+   0x7C129840, // cmplw r18, r19
+   0x408002F0, // bge done
+   0x7E5DE038, // and r29, r18, r28
+   0x56A32834, // slwi r3, r21, 5
+   0x57A4083C, // slwi r4, r29, 1
+   0x7C632214, // add r3, r3, r4
+   0x7C63A214, // add r3, r3, r20
+   0x480002F1, // bl decodeBit
+   0x2C030000, // cmpwi r3, 0
+   0x408200DC, // bne match
+   0x38E00000, // li r7, 0
+   0x28120000, // cmplwi r18, 0
+   0x4182000C, // beq prev
+   0x7CF19214, // add r7, r17, r18
+   0x88E7FFFF, // lbz r7, -1(r7)
+
+   // prev:
+   0x211A0008, // subfic r8, r26, 8
+   0x7CE74430, // srw r7, r7, r8
+   0x7E48D838, // and r8, r18, r27
+   0x7D08D030, // slw r8, r8, r26
+   0x7CE74214, // add r7, r7, r8
+   0x1CE70600, // mulli r7, r7, 0x600
+   0x7FC7A214, // add r30, r7, r20
+   0x3BDE0E6C, // addi r30, r30, 3692
+   0x3BE00001, // li r31, 1
+   0x28150007, // cmplwi r21, 7
+   0x4180004C, // blt litNormal
+   0x7CF69050, // subf r7, r22, r18
+   0x7CE78A14, // add r7, r7, r17
+   0x8BA7FFFF, // lbz r29, -1(r7)
+
+   // litMatched:
+   0x57A9CFFE, // rlwinm r9, r29, 25, 31, 31
+   0x57BD083C, // slwi r29, r29, 1
+   0x38690001, // addi r3, r9, 1
+   0x5463402E, // slwi r3, r3, 8
+   0x7C63FA14, // add r3, r3, r31
+   0x5463083C, // slwi r3, r3, 1
+   0x7C63F214, // add r3, r3, r30
+   0x4800027D, // bl decodeBit
+   0x57FF083C, // slwi r31, r31, 1
+   0x7FFF1B78, // or r31, r31, r3
+   0x7C034840, // cmplw r3, r9
+   0x40820010, // bne litNormal
+   0x281F0100, // cmplwi r31, 0x100
+   0x4180FFCC, // blt litMatched
+   0x48000024, // b litDone
+
+   // litNormal:
+   0x281F0100, // cmplwi r31, 0x100
+   0x4080001C, // bge litDone
+   0x57E3083C, // slwi r3, r31, 1
+   0x7C63F214, // add r3, r3, r30
+   0x4800024D, // bl decodeBit
+   0x57FF083C, // slwi r31, r31, 1
+   0x7FFF1B78, // or r31, r31, r3
+   0x4BFFFFE4, // b litNormal
+
+   // litDone:
+   0x7FF191AE, // stbx r31, r17, r18
+   0x3A520001, // addi r18, r18, 1
+   0x28150004, // cmplwi r21, 4
+   0x41800014, // blt litState0
+   0x2815000A, // cmplwi r21, 10
+   0x41800014, // blt litState3
+   0x3AB5FFFA, // addi r21, r21, -6
+   0x4BFFFF14, // b loop
+
+   // litState0:
+   0x3AA00000, // li r21, 0
+   0x4BFFFF0C, // b loop
+
+   // litState3:
+   0x3AB5FFFD, // addi r21, r21, -3
+   0x4BFFFF04, // b loop
+
+   // match:
+   0x56A3083C, // slwi r3, r21, 1
+   0x7C63A214, // add r3, r3, r20
+   0x38630180, // addi r3, r3, 384
+   0x48000201, // bl decodeBit
+   0x2C030000, // cmpwi r3, 0
+   0x418200D8, // beq simpleMatch
+   0x56A3083C, // slwi r3, r21, 1
+   0x7C63A214, // add r3, r3, r20
+   0x38630198, // addi r3, r3, 408
+   0x480001E9, // bl decodeBit
+   0x2C030000, // cmpwi r3, 0
+   0x4082004C, // bne repG1
+   0x56A32834, // slwi r3, r21, 5
+   0x57A4083C, // slwi r4, r29, 1
+   0x7C632214, // add r3, r3, r4
+   0x7C63A214, // add r3, r3, r20
+   0x386301E0, // addi r3, r3, 480
+   0x480001C9, // bl decodeBit
+   0x2C030000, // cmpwi r3, 0
+   0x40820080, // bne repLen
+   0x28150007, // cmplwi r21, 7
+   0x3AA00009, // li r21, 9
+   0x41800008, // blt shortRep
+   0x3AA0000B, // li r21, 11
+
+   // shortRep:
+   0x7CF69050, // subf r7, r22, r18
+   0x7CE78A14, // add r7, r7, r17
+   0x88E7FFFF, // lbz r7, -1(r7)
+   0x7CF191AE, // stbx r7, r17, r18
+   0x3A520001, // addi r18, r18, 1
+   0x4BFFFE8C, // b loop
+
+   // repG1:
+   0x56A3083C, // slwi r3, r21, 1
+   0x7C63A214, // add r3, r3, r20
+   0x386301B0, // addi r3, r3, 432
+   0x48000189, // bl decodeBit
+   0x2C030000, // cmpwi r3, 0
+   0x4082000C, // bne repG2
+   0x7EE8BB78, // mr r8, r23
+   0x48000030, // b repShift1
+
+   // repG2:
+   0x56A3083C, // slwi r3, r21, 1
+   0x7C63A214, // add r3, r3, r20
+   0x386301C8, // addi r3, r3, 456
+   0x48000169, // bl decodeBit
+   0x2C030000, // cmpwi r3, 0
+   0x4082000C, // bne rep3
+   0x7F08C378, // mr r8, r24
+   0x4800000C, // b repShift2
+
+   // rep3:
+   0x7F28CB78, // mr r8, r25
+   0x7F19C378, // mr r25, r24
+
+   // repShift2:
+   0x7EF8BB78, // mr r24, r23
+
+   // repShift1:
+   0x7ED7B378, // mr r23, r22
+   0x7D164378, // mr r22, r8
+
+   // repLen:
+   0x38740A68, // addi r3, r20, 2664
+   0x48000279, // bl decodeLen
+   0x7C7D1B78, // mr r29, r3
+   0x28150007, // cmplwi r21, 7
+   0x3AA00008, // li r21, 8
+   0x418000D0, // blt copy
+   0x3AA0000B, // li r21, 11
+   0x480000C8, // b copy
+
+   // simpleMatch:
+   0x7F19C378, // mr r25, r24
+   0x7EF8BB78, // mr r24, r23
+   0x7ED7B378, // mr r23, r22
+   0x38740664, // addi r3, r20, 1636
+   0x4800024D, // bl decodeLen
+   0x7C7D1B78, // mr r29, r3
+   0x28150007, // cmplwi r21, 7
+   0x3AA00007, // li r21, 7
+   0x41800008, // blt lenState
+   0x3AA0000A, // li r21, 10
+
+   // lenState:
+   0x281D0003, // cmplwi r29, 3
+   0x7FA3EB78, // mr r3, r29
+   0x41800008, // blt posSlot
+   0x38600003, // li r3, 3
+
+   // posSlot:
+   0x54633830, // slwi r3, r3, 7
+   0x7C63A214, // add r3, r3, r20
+   0x38630360, // addi r3, r3, 864
+   0x38800006, // li r4, 6
+   0x48000145, // bl bitTree
+   0x28030004, // cmplwi r3, 4
+   0x41800070, // blt smallDist
+   0x7C7E1B78, // mr r30, r3
+   0x57DFF87E, // srwi r31, r30, 1
+   0x3BFFFFFF, // addi r31, r31, -1
+   0x73C70001, // andi. r7, r30, 1
+   0x60E70002, // ori r7, r7, 2
+   0x7CF6F830, // slw r22, r7, r31
+   0x281E000E, // cmplwi r30, 14
+   0x40800024, // bge directDist
+   0x7C7EB050, // subf r3, r30, r22
+   0x386302AF, // addi r3, r3, 687
+   0x5463083C, // slwi r3, r3, 1
+   0x7C63A214, // add r3, r3, r20
+   0x7FE4FB78, // mr r4, r31
+   0x48000145, // bl reverseBitTree
+   0x7ED61A14, // add r22, r22, r3
+   0x48000024, // b checkEnd
+
+   // directDist:
+   0x389FFFFC, // addi r4, r31, -4
+   0x4800017D, // bl directBits
+   0x54632036, // slwi r3, r3, 4
+   0x7ED61A14, // add r22, r22, r3
+   0x38740644, // addi r3, r20, 1604
+   0x38800004, // li r4, 4
+   0x48000121, // bl reverseBitTree
+   0x7ED61A14, // add r22, r22, r3
+
+   // checkEnd:
+   0x2C16FFFF, // cmpwi r22, -1
+   0x41820050, // beq done
+   0x48000008, // b copy
+
+   // smallDist:
+   0x7C761B78, // mr r22, r3
+
+   // copy:
+   0x3BBD0002, // addi r29, r29, 2
+   0x7CF29850, // subf r7, r18, r19
+   0x7C1D3840, // cmplw r29, r7
+   0x40810008, // ble copyLen
+   0x7CFD3B78, // mr r29, r7
+
+   // copyLen:
+   0x7D169050, // subf r8, r22, r18
+   0x3908FFFF, // addi r8, r8, -1
+   0x7D088A14, // add r8, r8, r17
+   0x7D319214, // add r9, r17, r18
+   0x7FA903A6, // mtctr r29
+   0x7E52EA14, // add r18, r18, r29
+
+   // copyByte:
+   0x88E80000, // lbz r7, 0(r8)
+   0x39080001, // addi r8, r8, 1
+   0x98E90000, // stb r7, 0(r9)
+   0x39290001, // addi r9, r9, 1
+   0x4200FFF0, // bdnz copyByte
+   0x4BFFFD10, // b loop
+
+   // done:
+   0x7E439378, // mr r3, r18
+   0xB9C10010, // lmw r14, 16(r1)
+   0x80010064, // lwz r0, 100(r1)
+   0x7C0803A6, // mtlr r0
+   0x38210060, // addi r1, r1, 96
+   0x4E800020, // blr
+
+   // decodeBit:
+   0xA0830000, // lhz r4, 0(r3)
+   0x55C5AAFE, // srwi r5, r14, 11
+   0x7CA521D6, // mullw r5, r5, r4
+   0x7C0F2840, // cmplw r15, r5
+   0x40800020, // bge bit1
+   0x7CAE2B78, // mr r14, r5
+   0x20C40800, // subfic r6, r4, 2048
+   0x54C6D97E, // srwi r6, r6, 5
+   0x7C843214, // add r4, r4, r6
+   0xB0830000, // sth r4, 0(r3)
+   0x38600000, // li r3, 0
+   0x4800001C, // b bitNormalize
+
+   // bit1:
+   0x7DC57050, // subf r14, r5, r14
+   0x7DE57850, // subf r15, r5, r15
+   0x5486D97E, // srwi r6, r4, 5
+   0x7C862050, // subf r4, r6, r4
+   0xB0830000, // sth r4, 0(r3)
+   0x38600001, // li r3, 1
+
+   // bitNormalize:
+   0x3CC00100, // lis r6, 0x100
+   0x7C0E3040, // cmplw r14, r6
+   0x4C800020, // bgelr
+   0x55CE402E, // slwi r14, r14, 8
+   0x88F00000, // lbz r7, 0(r16)
+   0x3A100001, // addi r16, r16, 1
+   0x55EF402E, // slwi r15, r15, 8
+   0x7DEF3B78, // or r15, r15, r7
+   0x4E800020, // blr
+
+   // bitTree:
+   0x7D6802A6, // mflr r11
+   0x7C6A1B78, // mr r10, r3
+   0x39000001, // li r8, 1
+   0x7C892378, // mr r9, r4
+   0x7C8903A6, // mtctr r4
+
+   // bitTreeLoop:
+   0x5503083C, // slwi r3, r8, 1
+   0x7C635214, // add r3, r3, r10
+   0x4BFFFF79, // bl decodeBit
+   0x5508083C, // slwi r8, r8, 1
+   0x7D081B78, // or r8, r8, r3
+   0x4200FFEC, // bdnz bitTreeLoop
+   0x38600001, // li r3, 1
+   0x7C634830, // slw r3, r3, r9
+   0x7C634050, // subf r3, r3, r8
+   0x7D6803A6, // mtlr r11
+   0x4E800020, // blr
+
+   // reverseBitTree:
+   0x7D6802A6, // mflr r11
+   0x7C6A1B78, // mr r10, r3
+   0x39000001, // li r8, 1
+   0x39200000, // li r9, 0
+   0x39800000, // li r12, 0
+   0x7C8903A6, // mtctr r4
+
+   // reverseLoop:
+   0x5503083C, // slwi r3, r8, 1
+   0x7C635214, // add r3, r3, r10
+   0x4BFFFF35, // bl decodeBit
+   0x5508083C, // slwi r8, r8, 1
+   0x7D081B78, // or r8, r8, r3
+   0x7C634830, // slw r3, r3, r9
+   0x7D8C1B78, // or r12, r12, r3
+   0x39290001, // addi r9, r9, 1
+   0x4200FFE0, // bdnz reverseLoop
+   0x7D836378, // mr r3, r12
+   0x7D6803A6, // mtlr r11
+   0x4E800020, // blr
+
+   // directBits:
+   0x38600000, // li r3, 0
+   0x7C8903A6, // mtctr r4
+
+   // directLoop:
+   0x55CEF87E, // srwi r14, r14, 1
+   0x5463083C, // slwi r3, r3, 1
+   0x7C0F7040, // cmplw r15, r14
+   0x4180000C, // blt directNormalize
+   0x7DEE7850, // subf r15, r14, r15
+   0x60630001, // ori r3, r3, 1
+
+   // directNormalize:
+   0x3CC00100, // lis r6, 0x100
+   0x7C0E3040, // cmplw r14, r6
+   0x40800018, // bge directNext
+   0x55CE402E, // slwi r14, r14, 8
+   0x88F00000, // lbz r7, 0(r16)
+   0x3A100001, // addi r16, r16, 1
+   0x55EF402E, // slwi r15, r15, 8
+   0x7DEF3B78, // or r15, r15, r7
+
+   // directNext:
+   0x4200FFC8, // bdnz directLoop
+   0x4E800020, // blr
+
+   // decodeLen:
+   0x7FE802A6, // mflr r31
+   0x7C7E1B78, // mr r30, r3
+   0x4BFFFEBD, // bl decodeBit
+   0x2C030000, // cmpwi r3, 0
+   0x4082001C, // bne lenMid
+   0x57A32036, // slwi r3, r29, 4
+   0x7C63F214, // add r3, r3, r30
+   0x38630004, // addi r3, r3, 4
+   0x38800003, // li r4, 3
+   0x4BFFFF0D, // bl bitTree
+   0x48000040, // b lenDone
+
+   // lenMid:
+   0x387E0002, // addi r3, r30, 2
+   0x4BFFFE95, // bl decodeBit
+   0x2C030000, // cmpwi r3, 0
+   0x40820020, // bne lenHigh
+   0x57A32036, // slwi r3, r29, 4
+   0x7C63F214, // add r3, r3, r30
+   0x38630104, // addi r3, r3, 260
+   0x38800003, // li r4, 3
+   0x4BFFFEE5, // bl bitTree
+   0x38630008, // addi r3, r3, 8
+   0x48000014, // b lenDone
+
+   // lenHigh:
+   0x387E0204, // addi r3, r30, 516
+   0x38800008, // li r4, 8
+   0x4BFFFED1, // bl bitTree
+   0x38630010, // addi r3, r3, 16
+
+   // lenDone:
+   0x7FE803A6, // mtlr r31
+   0x4E800020, // blr
+};
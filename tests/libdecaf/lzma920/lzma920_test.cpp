@@ -0,0 +1,801 @@
+#include <catch.hpp>
+
+#include "lzma920_guest_decoder.h"
+#include "test_memory.h"
+#include "cafe/cafe_ppc_interface_invoke_guest.h"
+#include "cafe/libraries/lzma920/lzma920_lzma2dec.h"
+#include "cafe/libraries/lzma920/lzma920_lzma2enc.h"
+#include "cafe/libraries/lzma920/lzma920_lzmadec.h"
+#include "cafe/libraries/lzma920/lzma920_lzmaenc.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cafe::lzma920;
+
+/*
+The streams in lzma920/streams were made with Python's lzma module from the
+plaintext below, both with a 4 KiB dictionary which the 192 KiB of output
+wraps many times:
+
+   text.lzma    .lzma file, 13 byte header then an LZMA stream with an end
+                marker, lc 3 lp 0 pb 2
+   text.lzma2   raw LZMA2 stream with dictionary prop 0, an uncompressed
+                chunk for the random bytes then an LZMA chunk for the text
+*/
+
+static constexpr auto
+LzmaHeaderSize = 13u;
+
+static constexpr auto
+PlaintextSize = 192u * 1024;
+
+static std::vector<uint8_t>
+makePlaintext()
+{
+   static const char *words[] = {
+      "decaf", "lzma", "dictionary", "wraps", "guest", "host",
+      "range", "coder", "match", "literal", "the", "a", "\n",
+   };
+
+   auto out = std::vector<uint8_t> { };
+   auto y = uint32_t { 0x5EED };
+   for (auto i = 0u; i < 96 * 1024; ++i) {
+      y ^= y << 13;
+      y ^= y >> 17;
+      y ^= y << 5;
+      out.push_back(static_cast<uint8_t>(y >> 24));
+   }
+
+   auto x = uint32_t { 0x5EED };
+   while (out.size() < PlaintextSize) {
+      x = x * 1103515245u + 12345u;
+      auto word = words[(x >> 16) % std::size(words)];
+      out.insert(out.end(), word, word + std::strlen(word));
+      out.push_back(' ');
+   }
+
+   out.resize(PlaintextSize);
+   return out;
+}
+
+static std::vector<uint8_t>
+readStream(const std::string &path)
+{
+   auto file = std::ifstream { path, std::ifstream::binary };
+   REQUIRE(file.is_open());
+   return { std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> { } };
+}
+
+static virt_ptr<uint8_t>
+copyToGuest(const uint8_t *data,
+            uint32_t size)
+{
+   auto ptr = virt_cast<uint8_t *>(allocateTestMemory(size, 4));
+   std::memcpy(ptr.get(), data, size);
+   return ptr;
+}
+
+/**
+ * An ISzAlloc which hands out memory from a guest arena, titles pass their
+ * own allocator so it has to be guest code called through cafe::invoke.
+ */
+struct TestAlloc
+{
+   be2_struct<ISzAlloc> alloc;
+   be2_val<uint32_t> next;
+   be2_val<int32_t> outstanding;
+};
+
+static const std::vector<uint32_t>
+GuestAlloc = {
+   0x80A30008, // lwz r5, 8(r3)
+   0x38C4001F, // addi r6, r4, 31
+   0x54C60034, // clrrwi r6, r6, 5
+   0x7CC53214, // add r6, r5, r6
+   0x90C30008, // stw r6, 8(r3)
+   0x80E3000C, // lwz r7, 12(r3)
+   0x38E70001, // addi r7, r7, 1
+   0x90E3000C, // stw r7, 12(r3)
+   0x7CA32B78, // mr r3, r5
+   0x4E800020, // blr
+};
+
+static const std::vector<uint32_t>
+GuestFree = {
+   0x2C040000, // cmpwi r4, 0
+   0x4D820020, // beqlr
+   0x80A3000C, // lwz r5, 12(r3)
+   0x38A5FFFF, // addi r5, r5, -1
+   0x90A3000C, // stw r5, 12(r3)
+   0x4E800020, // blr
+};
+
+static virt_ptr<uint32_t>
+copyCodeToGuest(const std::vector<uint32_t> &code)
+{
+   auto ptr = virt_cast<uint32_t *>(
+      allocateTestMemory(static_cast<uint32_t>(code.size() * 4), 32));
+   for (auto i = 0u; i < code.size(); ++i) {
+      ptr[i] = code[i];
+   }
+
+   return ptr;
+}
+
+static virt_ptr<TestAlloc>
+createTestAlloc(uint32_t arenaSize)
+{
+   auto testAlloc = virt_cast<TestAlloc *>(allocateTestMemory(sizeof(TestAlloc), 4));
+   auto arena = allocateTestMemory(arenaSize, 32);
+   testAlloc->alloc.Alloc = virt_func_cast<ISzAllocAllocFn::function_type>(
+      virt_cast<virt_addr>(copyCodeToGuest(GuestAlloc)));
+   testAlloc->alloc.Free = virt_func_cast<ISzAllocFreeFn::function_type>(
+      virt_cast<virt_addr>(copyCodeToGuest(GuestFree)));
+   testAlloc->next = static_cast<uint32_t>(virt_cast<virt_addr>(arena));
+   testAlloc->outstanding = 0;
+   return testAlloc;
+}
+
+/**
+ * The streams and progress callback for the encoders, reading from and
+ * writing to guest buffers through guest code like a title's would.
+ */
+struct TestStream
+{
+   be2_struct<ISeqInStream> in;
+   be2_struct<ISeqOutStream> out;
+   be2_struct<ICompressProgress> progress;
+   be2_virt_ptr<uint8_t> inPos;
+   be2_virt_ptr<uint8_t> inEnd;
+   be2_virt_ptr<uint8_t> outPos;
+   be2_val<uint32_t> progressCount;
+   be2_val<uint32_t> progressInSize;
+   be2_val<uint32_t> maxReadSize;
+};
+
+//! Reads at most maxReadSize bytes at a time from inPos.
+static const std::vector<uint32_t>
+GuestRead = {
+   0x80C50000, // lwz r6, 0(r5)
+   0x80E30020, // lwz r7, 0x20(r3)
+   0x7C063840, // cmplw r6, r7
+   0x40810008, // ble clampRemaining
+   0x7CE63B78, // mr r6, r7
+
+   // clampRemaining:
+   0x80E3000C, // lwz r7, 0xC(r3)
+   0x81030010, // lwz r8, 0x10(r3)
+   0x7D074050, // subf r8, r7, r8
+   0x7C064040, // cmplw r6, r8
+   0x40810008, // ble readCopy
+   0x7D064378, // mr r6, r8
+
+   // readCopy:
+   0x90C50000, // stw r6, 0(r5)
+   0x7D073214, // add r8, r7, r6
+   0x9103000C, // stw r8, 0xC(r3)
+   0x2C060000, // cmpwi r6, 0
+   0x4182001C, // beq readDone
+   0x7CC903A6, // mtctr r6
+   0x38E7FFFF, // addi r7, r7, -1
+   0x3884FFFF, // addi r4, r4, -1
+
+   // readByte:
+   0x8D070001, // lbzu r8, 1(r7)
+   0x9D040001, // stbu r8, 1(r4)
+   0x4200FFF8, // bdnz readByte
+
+   // readDone:
+   0x38600000, // li r3, 0
+   0x4E800020, // blr
+};
+
+//! Appends everything it is given at outPos.
+static const std::vector<uint32_t>
+GuestWrite = {
+   0x80C30010, // lwz r6, 0x10(r3)
+   0x2C050000, // cmpwi r5, 0
+   0x41820020, // beq writeDone
+   0x7CA903A6, // mtctr r5
+   0x3884FFFF, // addi r4, r4, -1
+   0x38C6FFFF, // addi r6, r6, -1
+
+   // writeByte:
+   0x8D040001, // lbzu r8, 1(r4)
+   0x9D060001, // stbu r8, 1(r6)
+   0x4200FFF8, // bdnz writeByte
+   0x38C60001, // addi r6, r6, 1
+
+   // writeDone:
+   0x90C30010, // stw r6, 0x10(r3)
+   0x7CA32B78, // mr r3, r5
+   0x4E800020, // blr
+};
+
+//! Counts calls and keeps the low word of the last inSize.
+static const std::vector<uint32_t>
+GuestProgress = {
+   0x80830010, // lwz r4, 0x10(r3)
+   0x38840001, // addi r4, r4, 1
+   0x90830010, // stw r4, 0x10(r3)
+   0x90C30014, // stw r6, 0x14(r3)
+   0x38600000, // li r3, 0
+   0x4E800020, // blr
+};
+
+static virt_ptr<TestStream>
+createTestStream(const std::vector<uint8_t> &input,
+                 uint32_t outputSize,
+                 uint32_t maxReadSize)
+{
+   auto stream = virt_cast<TestStream *>(allocateTestMemory(sizeof(TestStream), 4));
+   auto inBuf = copyToGuest(input.data(), static_cast<uint32_t>(input.size()));
+   stream->in.Read = virt_func_cast<ISeqInStreamReadFn::function_type>(
+      virt_cast<virt_addr>(copyCodeToGuest(GuestRead)));
+   stream->out.Write = virt_func_cast<ISeqOutStreamWriteFn::function_type>(
+      virt_cast<virt_addr>(copyCodeToGuest(GuestWrite)));
+   stream->progress.Progress = virt_func_cast<ICompressProgressFn::function_type>(
+      virt_cast<virt_addr>(copyCodeToGuest(GuestProgress)));
+   stream->inPos = inBuf;
+   stream->inEnd = inBuf + static_cast<uint32_t>(input.size());
+   stream->outPos = virt_cast<uint8_t *>(allocateTestMemory(outputSize, 4));
+   stream->maxReadSize = maxReadSize;
+   return stream;
+}
+
+struct EncoderMode
+{
+   const char *name;
+   int32_t algo;
+   int32_t btMode;
+   int32_t numHashBytes;
+   int32_t lc;
+   int32_t lp;
+   int32_t pb;
+};
+
+static const EncoderMode
+EncoderModes[] = {
+   { "hc4, fast", 0, 0, 4, 3, 0, 2 },
+   { "bt2, normal", 1, 1, 2, 3, 0, 2 },
+   { "bt3, normal", 1, 1, 3, 3, 0, 2 },
+   { "bt4, normal", 1, 1, 4, 3, 0, 2 },
+   { "bt4, lc 0 lp 2 pb 0", 1, 1, 4, 0, 2, 0 },
+};
+
+static virt_ptr<CLzmaEncProps>
+createEncoderProps(const EncoderMode &mode,
+                   uint32_t dictSize)
+{
+   auto props = virt_cast<CLzmaEncProps *>(allocateTestMemory(sizeof(CLzmaEncProps), 4));
+   LzmaEncProps_Init(props);
+   props->dictSize = dictSize;
+   props->algo = mode.algo;
+   props->btMode = mode.btMode;
+   props->numHashBytes = mode.numHashBytes;
+   props->lc = mode.lc;
+   props->lp = mode.lp;
+   props->pb = mode.pb;
+   return props;
+}
+
+//! Encode with LzmaEncode and return it as a .lzma file.
+static std::vector<uint8_t>
+encodeLzmaFile(const std::vector<uint8_t> &input,
+               virt_ptr<const CLzmaEncProps> props,
+               int32_t writeEndMark,
+               virt_ptr<ISzAlloc> alloc)
+{
+   auto inputSize = static_cast<uint32_t>(input.size());
+   auto src = copyToGuest(input.data(), inputSize);
+   auto dest = virt_cast<uint8_t *>(allocateTestMemory(inputSize + inputSize / 2, 4));
+   auto destLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto propsEncoded = virt_cast<uint8_t *>(allocateTestMemory(LZMA_PROPS_SIZE, 4));
+   auto propsSize = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+
+   *destLen = inputSize + inputSize / 2;
+   *propsSize = LZMA_PROPS_SIZE;
+   REQUIRE(LzmaEncode(dest, destLen, src, inputSize, props, propsEncoded,
+                      propsSize, writeEndMark, nullptr, alloc, alloc) == SZ_OK);
+   REQUIRE(*propsSize == LZMA_PROPS_SIZE);
+
+   auto file = std::vector<uint8_t> { propsEncoded.get(), propsEncoded.get() + LZMA_PROPS_SIZE };
+   for (auto i = 0u; i < 8; ++i) {
+      file.push_back(static_cast<uint8_t>(static_cast<uint64_t>(inputSize) >> (8 * i)));
+   }
+
+   file.insert(file.end(), dest.get(), dest.get() + *destLen);
+   return file;
+}
+
+//! Decode a .lzma file with the host LzmaDecode.
+static std::vector<uint8_t>
+decodeLzmaFile(const std::vector<uint8_t> &file,
+               uint32_t outputSize,
+               virt_ptr<ISzAlloc> alloc)
+{
+   auto src = copyToGuest(file.data(), static_cast<uint32_t>(file.size()));
+   auto dest = virt_cast<uint8_t *>(allocateTestMemory(outputSize, 4));
+   auto destLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto srcLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto status = virt_cast<int32_t *>(allocateTestMemory(4, 4));
+
+   *destLen = outputSize;
+   *srcLen = static_cast<uint32_t>(file.size() - LzmaHeaderSize);
+   REQUIRE(LzmaDecode(dest, destLen, src + LzmaHeaderSize, srcLen, src,
+                      LZMA_PROPS_SIZE, LZMA_FINISH_END, status, alloc) == SZ_OK);
+   REQUIRE(*srcLen == file.size() - LzmaHeaderSize);
+   return { dest.get(), dest.get() + *destLen };
+}
+
+//! Decode a .lzma file with GuestLzmaDecoder.
+static std::vector<uint8_t>
+guestDecodeLzmaFile(virt_ptr<uint32_t> decoder,
+                    const std::vector<uint8_t> &file,
+                    uint32_t outputSize)
+{
+   using GuestDecodeFn = uint32_t(virt_ptr<uint8_t>, uint32_t, virt_ptr<const uint8_t>, virt_ptr<uint16_t>);
+   auto decode = virt_func_cast<GuestDecodeFn>(virt_cast<virt_addr>(decoder));
+   auto src = copyToGuest(file.data(), static_cast<uint32_t>(file.size()));
+   auto dest = virt_cast<uint8_t *>(allocateTestMemory(outputSize, 4));
+   auto lcLp = file[0] % 9 + (file[0] / 9) % 5;
+   auto probs = virt_cast<uint16_t *>(allocateTestMemory((1846 + (0x300u << lcLp)) * 2, 4));
+   auto size = cafe::invoke(cpu::this_core::state(), decode, dest, outputSize,
+                            virt_cast<const uint8_t *>(src), probs);
+   return { dest.get(), dest.get() + size };
+}
+
+TEST_CASE("lzma920 LzmaDecode decodes a whole buffer")
+{
+   auto expected = makePlaintext();
+   auto stream = readStream("lzma920/streams/text.lzma");
+   auto testAlloc = createTestAlloc(64 * 1024);
+   auto src = copyToGuest(stream.data(), static_cast<uint32_t>(stream.size()));
+   auto dest = virt_cast<uint8_t *>(allocateTestMemory(PlaintextSize, 4));
+   auto destLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto srcLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto status = virt_cast<int32_t *>(allocateTestMemory(4, 4));
+
+   *destLen = PlaintextSize;
+   *srcLen = static_cast<uint32_t>(stream.size() - LzmaHeaderSize);
+   REQUIRE(LzmaDecode(dest, destLen, src + LzmaHeaderSize, srcLen, src,
+                      LZMA_PROPS_SIZE, LZMA_FINISH_END, status,
+                      virt_addrof(testAlloc->alloc)) == SZ_OK);
+   REQUIRE(*status == LZMA_STATUS_FINISHED_WITH_MARK);
+   REQUIRE(*srcLen == stream.size() - LzmaHeaderSize);
+   REQUIRE(*destLen == PlaintextSize);
+   REQUIRE(std::equal(expected.begin(), expected.end(), dest.get()));
+   REQUIRE(testAlloc->outstanding == 0);
+   resetTestMemory();
+}
+
+TEST_CASE("lzma920 LzmaDec_DecodeToBuf decodes a byte at a time")
+{
+   auto expected = makePlaintext();
+   auto stream = readStream("lzma920/streams/text.lzma");
+   auto testAlloc = createTestAlloc(64 * 1024);
+   auto src = copyToGuest(stream.data(), static_cast<uint32_t>(stream.size()));
+   auto dec = virt_cast<CLzmaDec *>(allocateTestMemory(sizeof(CLzmaDec), 4));
+   auto dest = virt_cast<uint8_t *>(allocateTestMemory(4, 4));
+   auto destLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto srcLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto status = virt_cast<int32_t *>(allocateTestMemory(4, 4));
+   auto alloc = virt_addrof(testAlloc->alloc);
+
+   REQUIRE(LzmaDec_Allocate(dec, src, LZMA_PROPS_SIZE, alloc) == SZ_OK);
+   REQUIRE(dec->dicBufSize < PlaintextSize);
+   LzmaDec_Init(dec);
+
+   // One byte in and one byte out per call, so every piece of decoder state
+   // has to survive a round trip through the guest struct
+   auto output = std::vector<uint8_t> { };
+   auto inPos = LzmaHeaderSize;
+   *status = LZMA_STATUS_NOT_SPECIFIED;
+
+   while (*status != LZMA_STATUS_FINISHED_WITH_MARK) {
+      *srcLen = inPos < stream.size() ? 1u : 0u;
+      *destLen = 1u;
+      REQUIRE(LzmaDec_DecodeToBuf(dec, dest, destLen, src + inPos, srcLen,
+                                  LZMA_FINISH_ANY, status) == SZ_OK);
+      REQUIRE(*srcLen + *destLen > 0);
+      inPos += *srcLen;
+      output.insert(output.end(), dest.get(), dest.get() + *destLen);
+   }
+
+   REQUIRE(inPos == stream.size());
+   REQUIRE(output == expected);
+
+   LzmaDec_Free(dec, alloc);
+   REQUIRE(testAlloc->outstanding == 0);
+   resetTestMemory();
+}
+
+TEST_CASE("lzma920 LzmaDec_DecodeToDic wraps the dictionary")
+{
+   auto expected = makePlaintext();
+   auto stream = readStream("lzma920/streams/text.lzma");
+   auto testAlloc = createTestAlloc(64 * 1024);
+   auto src = copyToGuest(stream.data(), static_cast<uint32_t>(stream.size()));
+   auto dec = virt_cast<CLzmaDec *>(allocateTestMemory(sizeof(CLzmaDec), 4));
+   auto srcLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto status = virt_cast<int32_t *>(allocateTestMemory(4, 4));
+   auto alloc = virt_addrof(testAlloc->alloc);
+
+   REQUIRE(LzmaDec_Allocate(dec, src, LZMA_PROPS_SIZE, alloc) == SZ_OK);
+   LzmaDec_Init(dec);
+
+   // Decode with random input and output limits, going back to the start of
+   // the dictionary whenever it fills like the SDK's own LzmaDec users do
+   auto rng = std::mt19937 { 0x5EED };
+   auto output = std::vector<uint8_t> { };
+   auto inPos = LzmaHeaderSize;
+   auto numWraps = 0u;
+   *status = LZMA_STATUS_NOT_SPECIFIED;
+
+   while (*status != LZMA_STATUS_FINISHED_WITH_MARK) {
+      if (dec->dicPos == dec->dicBufSize) {
+         dec->dicPos = 0u;
+         numWraps++;
+      }
+
+      auto dicPos = static_cast<uint32_t>(dec->dicPos);
+      auto dicLimit = std::min<uint32_t>(dec->dicBufSize, dicPos + 1 + rng() % 1500);
+      *srcLen = std::min<uint32_t>(static_cast<uint32_t>(stream.size()) - inPos, 1 + rng() % 700);
+      REQUIRE(LzmaDec_DecodeToDic(dec, dicLimit, src + inPos, srcLen,
+                                  LZMA_FINISH_ANY, status) == SZ_OK);
+      REQUIRE(*srcLen + (dec->dicPos - dicPos) > 0);
+      inPos += *srcLen;
+      output.insert(output.end(), dec->dic.get() + dicPos, dec->dic.get() + dec->dicPos);
+   }
+
+   REQUIRE(numWraps >= PlaintextSize / dec->dicBufSize - 1);
+   REQUIRE(output == expected);
+
+   LzmaDec_Free(dec, alloc);
+   REQUIRE(testAlloc->outstanding == 0);
+   resetTestMemory();
+}
+
+TEST_CASE("lzma920 Lzma2Decode decodes a whole buffer")
+{
+   auto expected = makePlaintext();
+   auto stream = readStream("lzma920/streams/text.lzma2");
+   auto testAlloc = createTestAlloc(64 * 1024);
+   auto src = copyToGuest(stream.data(), static_cast<uint32_t>(stream.size()));
+   auto dest = virt_cast<uint8_t *>(allocateTestMemory(PlaintextSize, 4));
+   auto destLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto srcLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto status = virt_cast<int32_t *>(allocateTestMemory(4, 4));
+
+   *destLen = PlaintextSize;
+   *srcLen = static_cast<uint32_t>(stream.size());
+   REQUIRE(Lzma2Decode(dest, destLen, src, srcLen, 0, LZMA_FINISH_END, status,
+                       virt_addrof(testAlloc->alloc)) == SZ_OK);
+   REQUIRE(*status == LZMA_STATUS_FINISHED_WITH_MARK);
+   REQUIRE(*srcLen == stream.size());
+   REQUIRE(*destLen == PlaintextSize);
+   REQUIRE(std::equal(expected.begin(), expected.end(), dest.get()));
+   REQUIRE(testAlloc->outstanding == 0);
+   resetTestMemory();
+}
+
+TEST_CASE("lzma920 Lzma2Dec_DecodeToBuf decodes a byte at a time")
+{
+   auto expected = makePlaintext();
+   auto stream = readStream("lzma920/streams/text.lzma2");
+   auto testAlloc = createTestAlloc(64 * 1024);
+   auto src = copyToGuest(stream.data(), static_cast<uint32_t>(stream.size()));
+   auto dec = virt_cast<CLzma2Dec *>(allocateTestMemory(sizeof(CLzma2Dec), 4));
+   auto dest = virt_cast<uint8_t *>(allocateTestMemory(4, 4));
+   auto destLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto srcLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto status = virt_cast<int32_t *>(allocateTestMemory(4, 4));
+   auto alloc = virt_addrof(testAlloc->alloc);
+
+   REQUIRE(Lzma2Dec_Allocate(dec, 0, alloc) == SZ_OK);
+   REQUIRE(dec->decoder.dicBufSize < PlaintextSize);
+   Lzma2Dec_Init(dec);
+
+   auto output = std::vector<uint8_t> { };
+   auto inPos = 0u;
+   *status = LZMA_STATUS_NOT_SPECIFIED;
+
+   while (*status != LZMA_STATUS_FINISHED_WITH_MARK) {
+      *srcLen = inPos < stream.size() ? 1u : 0u;
+      *destLen = 1u;
+      REQUIRE(Lzma2Dec_DecodeToBuf(dec, dest, destLen, src + inPos, srcLen,
+                                   LZMA_FINISH_ANY, status) == SZ_OK);
+      REQUIRE(*srcLen + *destLen > 0);
+      inPos += *srcLen;
+      output.insert(output.end(), dest.get(), dest.get() + *destLen);
+   }
+
+   REQUIRE(inPos == stream.size());
+   REQUIRE(output == expected);
+
+   LzmaDec_Free(virt_addrof(dec->decoder), alloc);
+   REQUIRE(testAlloc->outstanding == 0);
+   resetTestMemory();
+}
+
+TEST_CASE("lzma920 LzmaEncode round trips through LzmaDecode")
+{
+   auto mode = GENERATE(from_range(std::begin(EncoderModes), std::end(EncoderModes)));
+   auto writeEndMark = GENERATE(0, 1);
+   CAPTURE(mode.name, writeEndMark);
+
+   auto expected = makePlaintext();
+   auto testAlloc = createTestAlloc(8 * 1024 * 1024);
+   auto alloc = virt_addrof(testAlloc->alloc);
+   auto props = createEncoderProps(mode, 64 * 1024);
+   auto file = encodeLzmaFile(expected, props, writeEndMark, alloc);
+   REQUIRE(testAlloc->outstanding == 0);
+
+   // The random half does not compress but the words do
+   REQUIRE(file.size() < PlaintextSize * 3 / 4);
+   REQUIRE(file[0] == (mode.pb * 5 + mode.lp) * 9 + mode.lc);
+
+   auto output = decodeLzmaFile(file, PlaintextSize, alloc);
+   REQUIRE(output == expected);
+   REQUIRE(testAlloc->outstanding == 0);
+   resetTestMemory();
+}
+
+TEST_CASE("lzma920 LzmaEnc_Encode matches LzmaEnc_MemEncode")
+{
+   // Enough input that the match finder has to move its window
+   auto plaintext = makePlaintext();
+   auto input = std::vector<uint8_t> { };
+   for (auto i = 0; i < 4; ++i) {
+      input.insert(input.end(), plaintext.begin(), plaintext.end());
+   }
+
+   auto inputSize = static_cast<uint32_t>(input.size());
+   auto testAlloc = createTestAlloc(16 * 1024 * 1024);
+   auto alloc = virt_addrof(testAlloc->alloc);
+   auto props = createEncoderProps(EncoderModes[3], 64 * 1024);
+   auto stream = createTestStream(input, inputSize, 3000);
+   auto outStart = virt_cast<uint8_t *>(stream->outPos);
+
+   auto enc = LzmaEnc_Create(alloc);
+   REQUIRE(enc);
+   REQUIRE(LzmaEnc_SetProps(enc, props) == SZ_OK);
+   REQUIRE(LzmaEnc_Encode(enc, virt_addrof(stream->out), virt_addrof(stream->in),
+                          virt_addrof(stream->progress), alloc, alloc) == SZ_OK);
+   REQUIRE(stream->inPos == stream->inEnd);
+   REQUIRE(stream->progressCount >= inputSize / (64 * 1024));
+   REQUIRE(stream->progressInSize <= inputSize);
+
+   auto streamed = std::vector<uint8_t> {
+      outStart.get(), virt_cast<uint8_t *>(stream->outPos).get()
+   };
+
+   auto src = copyToGuest(input.data(), inputSize);
+   auto dest = virt_cast<uint8_t *>(allocateTestMemory(inputSize, 4));
+   auto destLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   *destLen = inputSize;
+   REQUIRE(LzmaEnc_MemEncode(enc, dest, destLen, src, inputSize, 0, nullptr,
+                             alloc, alloc) == SZ_OK);
+   REQUIRE(streamed == std::vector<uint8_t> { dest.get(), dest.get() + *destLen });
+
+   // Too small an output buffer is reported rather than overrun
+   *destLen = 1000u;
+   REQUIRE(LzmaEnc_MemEncode(enc, dest, destLen, src, inputSize, 0, nullptr,
+                             alloc, alloc) == SZ_ERROR_OUTPUT_EOF);
+   REQUIRE(*destLen == 1000u);
+
+   LzmaEnc_Destroy(enc, alloc, alloc);
+   REQUIRE(testAlloc->outstanding == 0);
+   resetTestMemory();
+}
+
+TEST_CASE("lzma920 Lzma2Enc_Encode round trips through Lzma2Decode")
+{
+   auto numBlockThreads = GENERATE(1, 2);
+   CAPTURE(numBlockThreads);
+
+   auto expected = makePlaintext();
+   auto testAlloc = createTestAlloc(16 * 1024 * 1024);
+   auto alloc = virt_addrof(testAlloc->alloc);
+   auto stream = createTestStream(expected, PlaintextSize, 5000);
+   auto outStart = virt_cast<uint8_t *>(stream->outPos);
+
+   auto props = virt_cast<CLzma2EncProps *>(allocateTestMemory(sizeof(CLzma2EncProps), 4));
+   Lzma2EncProps_Init(props);
+   props->lzmaProps.dictSize = 64u * 1024;
+   props->numBlockThreads = numBlockThreads;
+   props->blockSize = 64u * 1024;
+
+   auto enc = Lzma2Enc_Create(alloc, alloc);
+   REQUIRE(enc);
+   REQUIRE(Lzma2Enc_SetProps(enc, props) == SZ_OK);
+   auto prop = Lzma2Enc_WriteProperties(enc);
+   REQUIRE(prop == 8);
+   REQUIRE(Lzma2Enc_Encode(enc, virt_addrof(stream->out), virt_addrof(stream->in),
+                           virt_addrof(stream->progress)) == SZ_OK);
+   REQUIRE(stream->inPos == stream->inEnd);
+   REQUIRE(stream->progressCount > 0);
+
+   // The random bytes at the start have to go in uncompressed chunks
+   auto encoded = outStart.get();
+   auto encodedSize = static_cast<uint32_t>(virt_cast<uint8_t *>(stream->outPos) - outStart);
+   REQUIRE(encoded[0] == 1);
+   REQUIRE(encodedSize < PlaintextSize * 3 / 4);
+   REQUIRE(encoded[encodedSize - 1] == 0);
+
+   Lzma2Enc_Destroy(enc);
+   REQUIRE(testAlloc->outstanding == 0);
+
+   auto dest = virt_cast<uint8_t *>(allocateTestMemory(PlaintextSize, 4));
+   auto destLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto srcLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto status = virt_cast<int32_t *>(allocateTestMemory(4, 4));
+   *destLen = PlaintextSize;
+   *srcLen = encodedSize;
+   REQUIRE(Lzma2Decode(dest, destLen, outStart, srcLen, prop, LZMA_FINISH_END,
+                       status, alloc) == SZ_OK);
+   REQUIRE(*status == LZMA_STATUS_FINISHED_WITH_MARK);
+   REQUIRE(*srcLen == encodedSize);
+   REQUIRE(*destLen == PlaintextSize);
+   REQUIRE(std::equal(expected.begin(), expected.end(), dest.get()));
+   resetTestMemory();
+}
+
+TEST_CASE("lzma920 guest reference decoder agrees with the host")
+{
+   auto expected = makePlaintext();
+   auto decoder = copyCodeToGuest(GuestLzmaDecoder);
+   auto testAlloc = createTestAlloc(8 * 1024 * 1024);
+   auto alloc = virt_addrof(testAlloc->alloc);
+
+   // A stream from the reference encoder
+   REQUIRE(guestDecodeLzmaFile(decoder, readStream("lzma920/streams/text.lzma"),
+                               PlaintextSize) == expected);
+
+   // And one from the host encoder
+   auto props = createEncoderProps(EncoderModes[4], 64 * 1024);
+   auto file = encodeLzmaFile(expected, props, 1, alloc);
+   REQUIRE(guestDecodeLzmaFile(decoder, file, PlaintextSize) == expected);
+   resetTestMemory();
+}
+
+TEST_CASE("lzma920 decode throughput", "[!benchmark]")
+{
+   auto lzmaStream = readStream("lzma920/streams/text.lzma");
+   auto lzma2Stream = readStream("lzma920/streams/text.lzma2");
+   auto testAlloc = createTestAlloc(64 * 1024);
+   auto alloc = virt_addrof(testAlloc->alloc);
+   auto lzmaSrc = copyToGuest(lzmaStream.data(), static_cast<uint32_t>(lzmaStream.size()));
+   auto lzma2Src = copyToGuest(lzma2Stream.data(), static_cast<uint32_t>(lzma2Stream.size()));
+   auto dest = virt_cast<uint8_t *>(allocateTestMemory(PlaintextSize, 4));
+   auto destLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto srcLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+   auto status = virt_cast<int32_t *>(allocateTestMemory(4, 4));
+
+   // The probabilities are allocated once so the arena does not run out,
+   // each run decodes the whole 192 KiB plaintext straight into dest
+   auto lzmaDec = virt_cast<CLzmaDec *>(allocateTestMemory(sizeof(CLzmaDec), 4));
+   REQUIRE(LzmaDec_AllocateProbs(lzmaDec, lzmaSrc, LZMA_PROPS_SIZE, alloc) == SZ_OK);
+
+   auto lzma2Dec = virt_cast<CLzma2Dec *>(allocateTestMemory(sizeof(CLzma2Dec), 4));
+   REQUIRE(Lzma2Dec_AllocateProbs(lzma2Dec, 0, alloc) == SZ_OK);
+
+   BENCHMARK("LzmaDec_DecodeToDic, whole buffer")
+   {
+      lzmaDec->dic = dest;
+      lzmaDec->dicBufSize = PlaintextSize;
+      LzmaDec_Init(lzmaDec);
+      *srcLen = static_cast<uint32_t>(lzmaStream.size() - LzmaHeaderSize);
+      LzmaDec_DecodeToDic(lzmaDec, PlaintextSize, lzmaSrc + LzmaHeaderSize,
+                          srcLen, LZMA_FINISH_END, status);
+      return static_cast<uint32_t>(lzmaDec->dicPos);
+   };
+
+   BENCHMARK("Lzma2Dec_DecodeToDic, whole buffer")
+   {
+      lzma2Dec->decoder.dic = dest;
+      lzma2Dec->decoder.dicBufSize = PlaintextSize;
+      Lzma2Dec_Init(lzma2Dec);
+      *srcLen = static_cast<uint32_t>(lzma2Stream.size());
+      Lzma2Dec_DecodeToDic(lzma2Dec, PlaintextSize, lzma2Src, srcLen,
+                           LZMA_FINISH_END, status);
+      return static_cast<uint32_t>(lzma2Dec->decoder.dicPos);
+   };
+
+   BENCHMARK("LzmaDec_DecodeToDic, 4 KiB input at a time")
+   {
+      lzmaDec->dic = dest;
+      lzmaDec->dicBufSize = PlaintextSize;
+      LzmaDec_Init(lzmaDec);
+
+      for (auto inPos = LzmaHeaderSize; inPos < lzmaStream.size(); inPos += *srcLen) {
+         *srcLen = std::min<uint32_t>(static_cast<uint32_t>(lzmaStream.size()) - inPos, 4096u);
+         LzmaDec_DecodeToDic(lzmaDec, PlaintextSize, lzmaSrc + inPos, srcLen,
+                             LZMA_FINISH_ANY, status);
+
+         // Once dest is full the end marker is left unread
+         if (*status != LZMA_STATUS_NEEDS_MORE_INPUT) {
+            break;
+         }
+      }
+
+      return static_cast<uint32_t>(lzmaDec->dicPos);
+   };
+
+   // The same decode as guest code, this is what titles got before
+   // lzma920 was implemented on the host
+   using GuestDecodeFn = uint32_t(virt_ptr<uint8_t>, uint32_t, virt_ptr<const uint8_t>, virt_ptr<uint16_t>);
+   auto guestDecode = virt_func_cast<GuestDecodeFn>(
+      virt_cast<virt_addr>(copyCodeToGuest(GuestLzmaDecoder)));
+   auto guestProbs = virt_cast<uint16_t *>(allocateTestMemory((1846 + (0x300 << 3)) * 2, 4));
+
+   BENCHMARK("guest reference decoder, whole buffer")
+   {
+      return cafe::invoke(cpu::this_core::state(), guestDecode, dest, PlaintextSize,
+                          virt_cast<const uint8_t *>(lzmaSrc), guestProbs);
+   };
+
+   LzmaDec_FreeProbs(lzmaDec, alloc);
+   LzmaDec_FreeProbs(virt_addrof(lzma2Dec->decoder), alloc);
+   resetTestMemory();
+}
+
+TEST_CASE("lzma920 encode throughput", "[!benchmark]")
+{
+   auto plaintext = makePlaintext();
+   auto testAlloc = createTestAlloc(16 * 1024 * 1024);
+   auto alloc = virt_addrof(testAlloc->alloc);
+   auto src = copyToGuest(plaintext.data(), PlaintextSize);
+   auto dest = virt_cast<uint8_t *>(allocateTestMemory(PlaintextSize * 2, 4));
+   auto destLen = virt_cast<uint32_t *>(allocateTestMemory(4, 4));
+
+   // The encoders are created once, encoding again with the same props
+   // reuses everything they allocated
+   auto fastEnc = LzmaEnc_Create(alloc);
+   REQUIRE(LzmaEnc_SetProps(fastEnc, createEncoderProps(EncoderModes[0], 64 * 1024)) == SZ_OK);
+
+   auto normalEnc = LzmaEnc_Create(alloc);
+   REQUIRE(LzmaEnc_SetProps(normalEnc, createEncoderProps(EncoderModes[3], 64 * 1024)) == SZ_OK);
+
+   auto stream = createTestStream({ }, PlaintextSize * 2, 0x10000);
+   auto lzma2Props = virt_cast<CLzma2EncProps *>(allocateTestMemory(sizeof(CLzma2EncProps), 4));
+   Lzma2EncProps_Init(lzma2Props);
+   lzma2Props->lzmaProps.dictSize = 64u * 1024;
+
+   auto lzma2Enc = Lzma2Enc_Create(alloc, alloc);
+   REQUIRE(Lzma2Enc_SetProps(lzma2Enc, lzma2Props) == SZ_OK);
+
+   BENCHMARK("LzmaEnc_MemEncode, hc4 fast")
+   {
+      *destLen = PlaintextSize * 2;
+      LzmaEnc_MemEncode(fastEnc, dest, destLen, src, PlaintextSize, 0, nullptr, alloc, alloc);
+      return static_cast<uint32_t>(*destLen);
+   };
+
+   BENCHMARK("LzmaEnc_MemEncode, bt4 normal")
+   {
+      *destLen = PlaintextSize * 2;
+      LzmaEnc_MemEncode(normalEnc, dest, destLen, src, PlaintextSize, 0, nullptr, alloc, alloc);
+      return static_cast<uint32_t>(*destLen);
+   };
+
+   BENCHMARK("Lzma2Enc_Encode, guest streams")
+   {
+      stream->inPos = src;
+      stream->inEnd = src + PlaintextSize;
+      stream->outPos = dest;
+      Lzma2Enc_Encode(lzma2Enc, virt_addrof(stream->out), virt_addrof(stream->in), nullptr);
+      return static_cast<uint32_t>(virt_cast<uint8_t *>(stream->outPos) - dest);
+   };
+
+   LzmaEnc_Destroy(fastEnc, alloc, alloc);
+   LzmaEnc_Destroy(normalEnc, alloc, alloc);
+   Lzma2Enc_Destroy(lzma2Enc);
+   resetTestMemory();
+}
@@ -0,0 +1,92 @@
+#define CATCH_CONFIG_RUNNER
+#include <catch.hpp>
+
+#include "test_memory.h"
+
+#include "cafe/libraries/cafe_hle.h"
+#include "cafe/libraries/coreinit/coreinit_scheduler.h"
+#include "cafe/libraries/coreinit/coreinit_thread.h"
+
+#include <common/align.h>
+#include <common/log.h>
+#include <libcpu/cpu.h>
+#include <libcpu/cpu_config.h>
+#include <libcpu/mmu.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/null_sink.h>
+
+uint32_t sTestMemoryBase = 0x02000000u;
+uint32_t sTestMemorySize = 0x04000000u;
+
+static constexpr auto
+TestPhysicalAddress = 0x50000000u;
+
+static constexpr auto
+StackSize = 0x100000u;
+
+/**
+ * Relocate coreinit's static data into guest memory so HLE functions which
+ * use it can be called directly from tests.
+ */
+static void
+relocateCoreinitData()
+{
+   auto library = cafe::hle::getLibrary(cafe::hle::LibraryId::coreinit);
+   auto dataSize = 0u;
+
+   for (auto &[name, symbol] : library->getSymbolMap()) {
+      if (symbol->type == cafe::hle::LibrarySymbol::Data) {
+         auto data = static_cast<cafe::hle::LibraryData *>(symbol.get());
+         dataSize = std::max(dataSize, data->offset + data->size);
+      }
+   }
+
+   auto dataBase = allocateTestMemory(dataSize, 0x1000);
+   library->relocate(virt_addr { 0u }, virt_cast<virt_addr>(dataBase));
+}
+
+int main(int argc, char *argv[])
+{
+   gLog = std::make_shared<spdlog::logger>("logger", std::make_shared<spdlog::sinks::null_sink_st>());
+
+   cpu::setConfig(cpu::Settings { });
+   cpu::initialise();
+
+   auto virtualAddress = cpu::VirtualAddress { sTestMemoryBase };
+   auto physicalAddress = cpu::PhysicalAddress { TestPhysicalAddress };
+   cpu::allocateVirtualAddress(virtualAddress, sTestMemorySize);
+   cpu::mapMemory(virtualAddress, physicalAddress, sTestMemorySize, cpu::MapPermission::ReadWrite);
+
+   // Keep the top of test memory for the guest stack
+   sTestMemorySize -= StackSize;
+
+   cafe::hle::initialiseLibraries();
+   relocateCoreinitData();
+
+   // Spin locks need a running thread to belong to
+   auto thread = virt_cast<cafe::coreinit::OSThread *>(
+      allocateTestMemory(sizeof(cafe::coreinit::OSThread), 8));
+   cafe::coreinit::internal::setCoreRunningThread(1, thread);
+
+   // Everything allocated so far must outlive the tests
+   auto reservedSize = align_up(static_cast<uint32_t>(
+      virt_cast<virt_addr>(allocateTestMemory(0u))) - sTestMemoryBase, 0x1000);
+   sTestMemoryBase += reservedSize;
+   sTestMemorySize -= reservedSize;
+   resetTestMemory();
+
+   static int result = 0;
+   cpu::setCoreEntrypointHandler(
+      [argc, argv](cpu::Core *core) {
+         if (cpu::this_core::id() != 1) {
+            return;
+         }
+
+         core->gpr[1] = sTestMemoryBase + sTestMemorySize + StackSize - 0x10;
+         result = Catch::Session().run(argc, argv);
+      });
+
+   cpu::start();
+   cpu::join();
+   return result;
+}
@@ -0,0 +1,197 @@
+#include <catch.hpp>
+
+#include "decaf_pm4replay.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using decaf::pm4::CaptureMemoryLoad;
+using decaf::pm4::CapturePacket;
+using decaf::pm4::CaptureReader;
+
+/*
+The captures in pm4/captures were built by hand. The version 2 captures all
+hold the same packets:
+
+   Frame         timestamp 100
+   MemoryBlock   command buffer contents, stored uncompressed
+   CommandBuffer timestamp 101, refers to the command buffer block
+   MemoryBlock   memory load contents, zlib compressed
+   MemoryLoad    timestamp 102, Surface at 0x1000, refers to the load block
+   Frame         timestamp 200
+   CommandBuffer timestamp 201, refers to the command buffer block again
+
+- indexed.dpm ends with a valid index.
+- unindexed_truncated.dpm has no index and ends with half a packet header.
+- bad_index.dpm has an index whose frame count runs far past the end of the
+  file.
+- bad_block.dpm has a command buffer MemoryBlock packet too small to hold a
+  block header, and an index entry for the load block pointing past the end
+  of the file.
+- version1.dpm is a version 1 capture of the same command buffer and memory
+  load with their contents stored inline.
+*/
+
+static std::vector<uint8_t>
+commandBufferData()
+{
+   auto data = std::vector<uint8_t>(64);
+   for (auto i = 0u; i < data.size(); ++i) {
+      data[i] = static_cast<uint8_t>(i);
+   }
+
+   return data;
+}
+
+static std::vector<uint8_t>
+memoryLoadData()
+{
+   auto data = std::vector<uint8_t>(4096);
+   for (auto i = 0u; i < data.size(); ++i) {
+      data[i] = static_cast<uint8_t>(i * 7);
+   }
+
+   return data;
+}
+
+static void
+requireCommandBuffer(const CaptureReader::Packet &packet,
+                     uint64_t timestamp)
+{
+   REQUIRE(packet.type == CapturePacket::CommandBuffer);
+   REQUIRE(packet.timestamp == timestamp);
+   REQUIRE(std::vector<uint8_t>(packet.data, packet.data + packet.size) == commandBufferData());
+}
+
+static void
+requireMemoryLoad(const CaptureReader::Packet &packet,
+                  uint64_t timestamp)
+{
+   REQUIRE(packet.type == CapturePacket::MemoryLoad);
+   REQUIRE(packet.timestamp == timestamp);
+   REQUIRE(packet.memoryLoad.type == CaptureMemoryLoad::Surface);
+   REQUIRE(packet.memoryLoad.address == phys_addr { 0x1000 });
+   REQUIRE(std::vector<uint8_t>(packet.data, packet.data + packet.size) == memoryLoadData());
+}
+
+static void
+requireFrame(const CaptureReader::Packet &packet,
+             uint64_t timestamp)
+{
+   REQUIRE(packet.type == CapturePacket::Frame);
+   REQUIRE(packet.timestamp == timestamp);
+}
+
+//! Read the packets every version 2 test capture starts with.
+static void
+requireVersion2Packets(CaptureReader &reader)
+{
+   auto packet = CaptureReader::Packet { };
+   REQUIRE(reader.next(packet));
+   requireFrame(packet, 100);
+   REQUIRE(reader.next(packet));
+   requireCommandBuffer(packet, 101);
+   REQUIRE(reader.next(packet));
+   requireMemoryLoad(packet, 102);
+   REQUIRE(reader.next(packet));
+   requireFrame(packet, 200);
+   REQUIRE(reader.next(packet));
+   requireCommandBuffer(packet, 201);
+}
+
+TEST_CASE("pm4 capture reader reads an indexed capture")
+{
+   auto reader = CaptureReader { };
+   REQUIRE(reader.open("pm4/captures/indexed.dpm"));
+   REQUIRE(reader.version() == 2);
+   REQUIRE(reader.frames().size() == 2);
+
+   requireVersion2Packets(reader);
+   auto packet = CaptureReader::Packet { };
+   REQUIRE(!reader.next(packet));
+
+   // Frames can be jumped to directly, blocks are resolved from the index
+   reader.seek(reader.frames()[1].offset);
+   REQUIRE(reader.next(packet));
+   requireFrame(packet, 200);
+   REQUIRE(reader.next(packet));
+   requireCommandBuffer(packet, 201);
+
+   reader.rewind();
+   requireVersion2Packets(reader);
+}
+
+TEST_CASE("pm4 capture reader rebuilds a missing index")
+{
+   auto reader = CaptureReader { };
+   REQUIRE(reader.open("pm4/captures/unindexed_truncated.dpm"));
+   REQUIRE(reader.version() == 2);
+   REQUIRE(reader.frames().size() == 2);
+   REQUIRE(reader.frames()[0].timestamp == 100);
+   REQUIRE(reader.frames()[1].timestamp == 200);
+
+   // The partially written packet at the end is ignored
+   requireVersion2Packets(reader);
+   auto packet = CaptureReader::Packet { };
+   REQUIRE(!reader.next(packet));
+}
+
+TEST_CASE("pm4 capture reader ignores an index which does not fit")
+{
+   auto reader = CaptureReader { };
+   REQUIRE(reader.open("pm4/captures/bad_index.dpm"));
+   REQUIRE(reader.frames().size() == 2);
+   requireVersion2Packets(reader);
+}
+
+TEST_CASE("pm4 capture reader rejects bad blocks")
+{
+   auto reader = CaptureReader { };
+   REQUIRE(reader.open("pm4/captures/bad_block.dpm"));
+
+   auto packet = CaptureReader::Packet { };
+   REQUIRE(reader.next(packet));
+   requireFrame(packet, 100);
+
+   // The block packet is smaller than a block header
+   REQUIRE(!reader.next(packet));
+
+   // The load block's index entry points past the end of the file
+   REQUIRE(!reader.next(packet));
+}
+
+TEST_CASE("pm4 capture reader reads a version 1 capture")
+{
+   auto reader = CaptureReader { };
+   REQUIRE(reader.open("pm4/captures/version1.dpm"));
+   REQUIRE(reader.version() == 1);
+   REQUIRE(reader.frames().empty());
+
+   auto packet = CaptureReader::Packet { };
+   REQUIRE(reader.next(packet));
+   requireCommandBuffer(packet, 101);
+   REQUIRE(reader.next(packet));
+   requireMemoryLoad(packet, 102);
+   REQUIRE(!reader.next(packet));
+}
+
+TEST_CASE("pm4 capture reader handles out of range seeks")
+{
+   auto reader = CaptureReader { };
+   REQUIRE(reader.open("pm4/captures/indexed.dpm"));
+
+   auto packet = CaptureReader::Packet { };
+   reader.seek(std::numeric_limits<size_t>::max() - 4);
+   REQUIRE(!reader.next(packet));
+
+   reader.seek(size_t { 1 } << 40);
+   REQUIRE(!reader.next(packet));
+
+   // Landing in the middle of a packet must not read past the end either
+   for (auto offset = size_t { 0 }; offset < 1024; ++offset) {
+      reader.seek(offset);
+      while (reader.next(packet)) {
+      }
+   }
+}
@@ -0,0 +1,128 @@
+#include <catch.hpp>
+
+#include "cafe/libraries/sndcore2/sndcore2_mix.h"
+#include "cafe/libraries/sndcore2/sndcore2_voice.h"
+
+#include <common/fixed.h>
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <vector>
+
+using namespace cafe::sndcore2;
+
+static constexpr uint16_t
+EdgeVolumes[] = { 0x0000, 0x0001, 0x4000, 0x7FFF, 0x8000, 0x8001, 0xFFFF };
+
+static constexpr int16_t
+EdgeSamples[] = { -32768, -32767, -16384, -1, 0, 1, 16384, 32767 };
+
+//! The Q30 product truncated towards zero then wrapped to 16 bits.
+static int16_t
+referenceMix(int16_t acc,
+             int16_t in,
+             uint16_t volume)
+{
+   auto sum = int64_t { acc } * 0x8000 + int64_t { in } * volume;
+   return static_cast<int16_t>(static_cast<uint16_t>(sum / 0x8000));
+}
+
+static std::vector<int16_t>
+randomSamples(std::mt19937 &rng,
+              size_t count)
+{
+   auto samples = std::vector<int16_t>(count);
+   for (auto i = 0u; i < count; ++i) {
+      // Mix in the extremes as they are where rounding and wrapping differ
+      if (rng() % 8 == 0) {
+         samples[i] = EdgeSamples[rng() % std::size(EdgeSamples)];
+      } else {
+         samples[i] = static_cast<int16_t>(rng());
+      }
+   }
+
+   return samples;
+}
+
+static std::vector<uint16_t>
+testVolumes(std::mt19937 &rng)
+{
+   auto volumes = std::vector<uint16_t> { std::begin(EdgeVolumes), std::end(EdgeVolumes) };
+   for (auto i = 0; i < 64; ++i) {
+      volumes.push_back(static_cast<uint16_t>(rng()));
+   }
+
+   return volumes;
+}
+
+TEST_CASE("sndcore2 mixSamples matches the fixed point mix")
+{
+   auto rng = std::mt19937 { 0x5EED };
+
+   for (auto volume : testVolumes(rng)) {
+      // Odd lengths and offsets exercise the unaligned loads and scalar tails
+      for (auto numSamples : { 0u, 1u, 7u, 8u, 15u, 16u, 31u, 144u, 1001u }) {
+         auto offset = rng() % 8;
+         auto in = randomSamples(rng, numSamples + offset);
+         auto out = randomSamples(rng, numSamples + offset);
+         auto expected = out;
+
+         auto fixedVolume = fixed_from_data<ufixed_1_15_t>(volume);
+         for (auto i = offset; i < offset + numSamples; ++i) {
+            auto fixedOut = fixed_from_data<Pcm16Sample>(expected[i]);
+            fixedOut += fixed_from_data<Pcm16Sample>(in[i]) * fixedVolume;
+            REQUIRE(fixed_to_data(fixedOut) == referenceMix(expected[i], in[i], volume));
+            expected[i] = fixed_to_data(fixedOut);
+         }
+
+         internal::mixSamples(out.data() + offset, in.data() + offset, volume, numSamples);
+         REQUIRE(out == expected);
+      }
+   }
+}
+
+TEST_CASE("sndcore2 scaleSamples matches the fixed point scale")
+{
+   auto rng = std::mt19937 { 0x5EED };
+
+   for (auto volume : testVolumes(rng)) {
+      for (auto numSamples : { 0u, 1u, 7u, 8u, 15u, 16u, 31u, 144u, 1001u }) {
+         auto offset = rng() % 8;
+         auto samples = randomSamples(rng, numSamples + offset);
+         auto expected = samples;
+
+         auto fixedVolume = fixed_from_data<ufixed_1_15_t>(volume);
+         for (auto i = offset; i < offset + numSamples; ++i) {
+            auto fixedSample = fixed_from_data<Pcm16Sample>(expected[i]);
+            fixedSample = fixedSample * fixedVolume;
+            REQUIRE(fixed_to_data(fixedSample) == referenceMix(0, expected[i], volume));
+            expected[i] = fixed_to_data(fixedSample);
+         }
+
+         internal::scaleSamples(samples.data() + offset, volume, numSamples);
+         REQUIRE(samples == expected);
+      }
+   }
+}
+
+TEST_CASE("sndcore2 mix throughput", "[!benchmark]")
+{
+   auto rng = std::mt19937 { 0x5EED };
+   auto in = randomSamples(rng, 144 * 64);
+   auto out = randomSamples(rng, 144 * 64);
+
+   BENCHMARK("mixSamples")
+   {
+      internal::mixSamples(out.data(), in.data(), 0x6000, static_cast<uint32_t>(in.size()));
+      return out[0];
+   };
+
+   BENCHMARK("scalar mix")
+   {
+      for (auto i = 0u; i < in.size(); ++i) {
+         out[i] = referenceMix(out[i], in[i], 0x6000);
+      }
+
+      return out[0];
+   };
+}
@@ -0,0 +1,30 @@
+#include "test_memory.h"
+
+#include <common/align.h>
+#include <common/decaf_assert.h>
+#include <cstring>
+
+extern uint32_t sTestMemoryBase;
+extern uint32_t sTestMemorySize;
+
+static uint32_t
+sTestMemoryUsed = 0u;
+
+virt_ptr<void>
+allocateTestMemory(uint32_t size,
+                   uint32_t alignment)
+{
+   auto addr = align_up(sTestMemoryBase + sTestMemoryUsed, alignment);
+   decaf_check(addr + size <= sTestMemoryBase + sTestMemorySize);
+   sTestMemoryUsed = addr + size - sTestMemoryBase;
+
+   auto ptr = virt_cast<void *>(virt_addr { addr });
+   std::memset(ptr.get(), 0, size);
+   return ptr;
+}
+
+void
+resetTestMemory()
+{
+   sTestMemoryUsed = 0u;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <libcpu/be2_struct.h>
+
+/**
+ * Guest memory for tests which run HLE library code directly.
+ *
+ * Tests run on a guest core with coreinit's data relocated into guest memory
+ * and a dummy thread set as the running thread, which is enough for the
+ * parts of coreinit that do not need the scheduler.
+ */
+
+//! Allocate guest memory which lives until resetTestMemory is called.
+virt_ptr<void>
+allocateTestMemory(uint32_t size,
+                   uint32_t alignment = 4);
+
+//! Release every allocation made with allocateTestMemory.
+void
+resetTestMemory();
@@ -0,0 +1,134 @@
+#include <catch.hpp>
+#include <common/platform.h>
+
+#ifdef PLATFORM_POSIX
+#include "vfs/vfs_host_mappedfilehandle.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using vfs::FileHandle;
+using vfs::HostMappedFileHandle;
+
+static std::vector<uint8_t>
+makeContents(size_t size,
+             uint8_t seed)
+{
+   auto data = std::vector<uint8_t>(size);
+   for (auto i = 0u; i < size; ++i) {
+      data[i] = static_cast<uint8_t>(i * 13 + seed);
+   }
+
+   return data;
+}
+
+static void
+writeHostFile(const std::filesystem::path &path,
+              const std::vector<uint8_t> &data)
+{
+   auto file = std::ofstream { path, std::ofstream::binary | std::ofstream::trunc };
+   file.write(reinterpret_cast<const char *>(data.data()), data.size());
+}
+
+//! Map a host file the same way HostDevice does for read-only content.
+static std::unique_ptr<HostMappedFileHandle>
+openMappedFile(const std::filesystem::path &path)
+{
+   auto fd = ::open(path.string().c_str(), O_RDONLY);
+   REQUIRE(fd >= 0);
+
+   struct stat st;
+   REQUIRE(fstat(fd, &st) == 0);
+
+   auto data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                    MAP_SHARED, fd, 0);
+   REQUIRE(data != MAP_FAILED);
+   return std::make_unique<HostMappedFileHandle>(
+      fd, reinterpret_cast<uint8_t *>(data), static_cast<int64_t>(st.st_size));
+}
+
+struct TemporaryHostFile
+{
+   TemporaryHostFile() :
+      path(std::filesystem::temp_directory_path() /
+           ("decaf-mapped-" + std::to_string(getpid()) + ".bin"))
+   {
+   }
+
+   ~TemporaryHostFile()
+   {
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+   }
+
+   std::filesystem::path path;
+};
+
+TEST_CASE("vfs mapped file reads like fread")
+{
+   auto file = TemporaryHostFile { };
+   auto contents = makeContents(100000, 1);
+   writeHostFile(file.path, contents);
+
+   auto handle = openMappedFile(file.path);
+   REQUIRE(*handle->size() == 100000);
+
+   // Enough sequential reads to start the read ahead window
+   auto buffer = std::vector<uint8_t>(4096);
+   auto position = size_t { 0 };
+   while (position + buffer.size() <= contents.size()) {
+      REQUIRE(*handle->read(buffer.data(), 1, buffer.size()) == buffer.size());
+      REQUIRE(std::equal(buffer.begin(), buffer.end(), contents.begin() + position));
+      position += buffer.size();
+   }
+
+   // A partial element at the end is consumed but not counted
+   auto remaining = contents.size() - position;
+   REQUIRE(*handle->read(buffer.data(), remaining + 1, 1) == 0);
+   REQUIRE(std::equal(buffer.begin(), buffer.begin() + remaining, contents.begin() + position));
+   REQUIRE(*handle->eof());
+   REQUIRE(*handle->tell() == 100000);
+
+   REQUIRE(handle->seek(FileHandle::SeekEnd, -10) == vfs::Error::Success);
+   REQUIRE(!*handle->eof());
+   REQUIRE(*handle->read(buffer.data(), 2, 5) == 5);
+   REQUIRE(std::equal(buffer.begin(), buffer.begin() + 10, contents.end() - 10));
+}
+
+TEST_CASE("vfs mapped file picks up host size changes at the end of the file")
+{
+   auto file = TemporaryHostFile { };
+   auto contents = makeContents(8192, 2);
+   writeHostFile(file.path, contents);
+
+   auto handle = openMappedFile(file.path);
+   auto buffer = std::vector<uint8_t>(contents.size() * 4);
+
+   // Growing the file is only noticed once a read reaches the old end
+   auto grown = makeContents(contents.size() * 3, 2);
+   writeHostFile(file.path, grown);
+   REQUIRE(*handle->size() == 8192);
+
+   REQUIRE(*handle->read(buffer.data(), 1, buffer.size()) == grown.size());
+   REQUIRE(std::equal(grown.begin(), grown.end(), buffer.begin()));
+   REQUIRE(*handle->size() == static_cast<int64_t>(grown.size()));
+
+   // Shrinking stops reads at the new end rather than faulting past it
+   std::filesystem::resize_file(file.path, 1000);
+   REQUIRE(handle->seek(FileHandle::SeekStart, 500) == vfs::Error::Success);
+   REQUIRE(*handle->read(buffer.data(), 1, buffer.size()) == 500);
+   REQUIRE(std::equal(grown.begin() + 500, grown.begin() + 1000, buffer.begin()));
+   REQUIRE(*handle->size() == 1000);
+   REQUIRE(*handle->eof());
+}
+
+#endif // ifdef PLATFORM_POSIX
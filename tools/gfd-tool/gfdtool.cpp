@@ -1,13 +1,20 @@
 #include <libgfd/gfd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <common/teenyheap.h>
 #include <excmd.h>
+#include <filesystem>
 #include <fmt/core.h>
 #include <fstream>
 #include <gsl/gsl-lite.hpp>
 #include <iostream>
 #include <iterator>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
 #include <libcpu/cpu.h>
 #include <libgfd/gfd.h>
 #include <libgpu/gpu7_tiling_cpu.h>
@@ -890,10 +897,25 @@ getFileBasename(const std::string &filename)
    }
 }
 
+//! Buffers reused between textures to avoid reallocating them every time.
+struct ConvertScratch
+{
+   std::vector<uint8_t> untiled;
+   std::vector<uint8_t> imageData;
+   std::vector<uint8_t> mipMapData;
+};
+
+struct ConvertResult
+{
+   size_t numTextures = 0;
+   size_t inputBytes = 0;
+};
+
 static bool
-convertTexture(const std::string &path)
+convertTexture(const std::string &path,
+               ConvertScratch &scratch,
+               ConvertResult &result)
 {
-   OutputState out;
    gfd::GFDFile file;
 
    try {
@@ -901,7 +923,7 @@ convertTexture(const std::string &path)
          return false;
       }
    } catch (gfd::GFDReadException ex) {
-      std::cerr << fmt::format("Error reading gfd: {}", ex.what()) << std::endl;
+      std::cerr << fmt::format("Error reading gfd {}: {}", path, ex.what()) << std::endl;
       return false;
    }
 
@@ -937,12 +959,13 @@ convertTexture(const std::string &path)
       surface.pipeSwizzle = (tex.surface.swizzle >> 8) & 1;
       surface.bankSwizzle = (tex.surface.swizzle >> 9) & 3;
 
-      std::vector<uint8_t> untiled;
-      std::vector<uint8_t> imageData;
-      std::vector<uint8_t> mipMapData;
+      auto &untiled = scratch.untiled;
+      auto &imageData = scratch.imageData;
+      auto &mipMapData = scratch.mipMapData;
 
-      // Untile image
-      untiled.resize(tex.surface.image.size());
+      // Untile image, the scratch buffers are cleared so any bytes the
+      // untiling does not write are zero just as with new buffers
+      untiled.assign(tex.surface.image.size(), 0);
 
       auto surfaceInfo = gpu7::tiling::computeSurfaceInfo(surface, 0);
       auto retileInfo = gpu7::tiling::computeRetileInfo(surfaceInfo);
@@ -951,12 +974,12 @@ convertTexture(const std::string &path)
                                 0, surface.numSlices);
 
       // Unpitch image
-      imageData.resize(gpu7::tiling::computeUnpitchedImageSize(surface));
+      imageData.assign(gpu7::tiling::computeUnpitchedImageSize(surface), 0);
       gpu7::tiling::unpitchImage(surface, untiled.data(), imageData.data());
 
       // Untile mipmaps
       auto mipOffset = 0u;
-      untiled.resize(tex.surface.mipmap.size());
+      untiled.assign(tex.surface.mipmap.size(), 0);
 
       for (auto i = 1u; i < surface.numLevels; ++i) {
          auto mipSurfaceInfo = gpu7::tiling::computeSurfaceInfo(surface, i);
@@ -969,7 +992,7 @@ convertTexture(const std::string &path)
       }
 
       // Unpitch mipmaps
-      mipMapData.resize(gpu7::tiling::computeUnpitchedMipMapSize(surface));
+      mipMapData.assign(gpu7::tiling::computeUnpitchedMipMapSize(surface), 0);
       gpu7::tiling::unpitchMipMap(surface, untiled.data(), mipMapData.data());
 
       // Save to DDS file
@@ -988,11 +1011,172 @@ convertTexture(const std::string &path)
       gx2surface.mipLevels = tex.surface.mipLevels;
       gx2surface.mipmapSize = static_cast<uint32_t>(mipMapData.size());
       cafe::gx2::debug::saveDDS(outname, &gx2surface, imageData.data(), mipMapData.data());
+
+      result.numTextures++;
+      result.inputBytes += tex.surface.image.size() + tex.surface.mipmap.size();
    }
 
    return true;
 }
 
+static bool
+convertTexture(const std::string &path)
+{
+   auto scratch = ConvertScratch { };
+   auto result = ConvertResult { };
+   return convertTexture(path, scratch, result);
+}
+
+static bool
+getBatchFiles(const std::string &src,
+              std::vector<std::string> &files)
+{
+   auto error = std::error_code { };
+
+   if (std::filesystem::is_directory(src, error)) {
+      // Convert every .gtx file found under the directory
+      for (auto &entry : std::filesystem::recursive_directory_iterator { src, error }) {
+         if (entry.is_regular_file(error) && entry.path().extension() == ".gtx") {
+            files.push_back(entry.path().string());
+         }
+      }
+
+      std::sort(files.begin(), files.end());
+      return !error;
+   }
+
+   // Otherwise src is a text file listing one file per line
+   auto list = std::ifstream { src };
+   if (!list.is_open()) {
+      return false;
+   }
+
+   for (auto line = std::string { }; std::getline(list, line); ) {
+      if (!line.empty() && line.back() == '\r') {
+         line.pop_back();
+      }
+
+      if (!line.empty()) {
+         files.push_back(line);
+      }
+   }
+
+   return true;
+}
+
+/**
+ * Removes files which appear more than once, keeping the first of each. Two
+ * workers converting the same file would write the same outputs at the same
+ * time, so paths are compared after resolving them.
+ */
+static void
+removeDuplicateFiles(std::vector<std::string> &files)
+{
+   auto seen = std::unordered_set<std::string> { };
+   auto unique = std::vector<std::string> { };
+
+   for (auto &path : files) {
+      auto error = std::error_code { };
+      auto resolved = std::filesystem::weakly_canonical(path, error);
+      auto key = error ? path : resolved.string();
+
+      if (seen.insert(key).second) {
+         unique.push_back(path);
+      }
+   }
+
+   files.swap(unique);
+}
+
+static double
+getThroughput(size_t bytes,
+              std::chrono::duration<double> elapsed)
+{
+   if (elapsed.count() <= 0.0) {
+      return 0.0;
+   }
+
+   return bytes / (1024.0 * 1024.0) / elapsed.count();
+}
+
+/**
+ * Converts many files at once, each worker thread takes the next file from
+ * the list and converts it with its own scratch buffers. The output of each
+ * file is exactly what convert would write for it on its own.
+ */
+static bool
+convertTextureBatch(const std::string &src,
+                    unsigned numThreads)
+{
+   auto files = std::vector<std::string> { };
+   if (!getBatchFiles(src, files)) {
+      std::cerr << fmt::format("Could not read batch source {}", src) << std::endl;
+      return false;
+   }
+
+   removeDuplicateFiles(files);
+
+   if (numThreads == 0) {
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+   }
+
+   numThreads = std::min(numThreads, static_cast<unsigned>(std::max<size_t>(files.size(), 1)));
+
+   auto nextFile = std::atomic<size_t> { 0 };
+   auto numFailed = std::atomic<size_t> { 0 };
+   auto totalBytes = std::atomic<size_t> { 0 };
+   auto totalTextures = std::atomic<size_t> { 0 };
+   auto outputMutex = std::mutex { };
+   auto startTime = std::chrono::steady_clock::now();
+
+   auto worker = [&]() {
+      auto scratch = ConvertScratch { };
+
+      for (auto i = nextFile++; i < files.size(); i = nextFile++) {
+         auto &path = files[i];
+         auto result = ConvertResult { };
+         auto fileStart = std::chrono::steady_clock::now();
+         auto success = convertTexture(path, scratch, result);
+         auto elapsed = std::chrono::duration<double> { std::chrono::steady_clock::now() - fileStart };
+
+         std::unique_lock<std::mutex> lock { outputMutex };
+         if (!success) {
+            std::cout << fmt::format("{}: failed", path) << std::endl;
+            numFailed++;
+            continue;
+         }
+
+         std::cout << fmt::format("{}: {} textures, {} bytes in {:.2f} ms, {:.2f} MB/s",
+                                  path, result.numTextures, result.inputBytes,
+                                  elapsed.count() * 1000.0,
+                                  getThroughput(result.inputBytes, elapsed))
+                   << std::endl;
+         totalBytes += result.inputBytes;
+         totalTextures += result.numTextures;
+      }
+   };
+
+   auto threads = std::vector<std::thread> { };
+   for (auto i = 1u; i < numThreads; ++i) {
+      threads.emplace_back(worker);
+   }
+
+   worker();
+
+   for (auto &thread : threads) {
+      thread.join();
+   }
+
+   auto elapsed = std::chrono::duration<double> { std::chrono::steady_clock::now() - startTime };
+   std::cout << fmt::format("Converted {} of {} files, {} textures, {} bytes in {:.2f} s on {} threads, {:.2f} MB/s",
+                            files.size() - numFailed, files.size(),
+                            totalTextures.load(), totalBytes.load(),
+                            elapsed.count(), numThreads,
+                            getThroughput(totalBytes, elapsed))
+             << std::endl;
+   return numFailed == 0;
+}
+
 static bool
 disassembleShaderBinary(const std::string &path)
 {
@@ -1032,6 +1216,12 @@ int main(int argc, char **argv)
    parser.add_command("convert")
       .add_argument("src", excmd::value<std::string> { });
 
+   parser.add_command("convert-batch")
+      .add_option("threads",
+                  excmd::description { "Number of threads to convert with, 0 uses one per core." },
+                  excmd::default_value<int> { 0 })
+      .add_argument("src", excmd::value<std::string> { });
+
    parser.add_command("disassemble")
       .add_argument("shader", excmd::value<std::string> { });
 
@@ -1060,6 +1250,10 @@ int main(int argc, char **argv)
    } else if (options.has("convert")) {
       auto src = options.get<std::string>("src");
       result = convertTexture(src) ? 0 : -1;
+   } else if (options.has("convert-batch")) {
+      auto src = options.get<std::string>("src");
+      auto threads = std::max(0, options.get<int>("threads"));
+      result = convertTextureBatch(src, static_cast<unsigned>(threads)) ? 0 : -1;
    } else if (options.has("disassemble")) {
       auto src = options.get<std::string>("shader");
       result = disassembleShaderBinary(src) ? 0 : -1;
@@ -11,17 +11,9 @@ ReplayParserPM4::Create(gpu::GraphicsDriver *driver,
                         phys_ptr<cafe::TinyHeapPhysical> heap,
                         const std::string &path)
 {
-   // Try open file
-   std::ifstream file;
-   file.open(path, std::ifstream::binary);
-   if (!file.is_open()) {
-      return {};
-   }
-
-   // Check magic header
-   std::array<char, 4> magic;
-   file.read(magic.data(), 4);
-   if (magic != decaf::pm4::CaptureMagic) {
+   // Try open file, this also checks the magic header
+   auto self = std::unique_ptr<ReplayParserPM4> { new ReplayParserPM4 { } };
+   if (!self->mReader.open(path)) {
       return {};
    }
 
@@ -32,49 +24,36 @@ ReplayParserPM4::Create(gpu::GraphicsDriver *driver,
       return { };
    }
 
-   auto self = new ReplayParserPM4 { };
    self->mGraphicsDriver = driver;
    self->mRingBuffer = ringBuffer;
    self->mHeap = heap;
    self->mRegisterStorage = phys_cast<uint32_t *>(allocPtr);
-   self->mFile = std::move(file);
-
-   return std::unique_ptr<ReplayParser> { self };
+   return std::unique_ptr<ReplayParser> { self.release() };
 }
 
 bool
 ReplayParserPM4::runUntilTimestamp(uint64_t timestamp)
 {
-   std::vector<char> buffer;
    bool reachedTimestamp = false;
-   mFile.clear();
-   mFile.seekg(4, std::fstream::beg);
+   mReader.rewind();
 
    while (true) {
-      decaf::pm4::CapturePacket packet;
-      mFile.read(reinterpret_cast<char *>(&packet), sizeof(decaf::pm4::CapturePacket));
-      if (!mFile) {
+      decaf::pm4::CaptureReader::Packet packet;
+      if (!mReader.next(packet)) {
          return false;
       }
 
       switch (packet.type) {
       case decaf::pm4::CapturePacket::CommandBuffer:
       {
-         buffer.resize(packet.size);
-         mFile.read(buffer.data(), buffer.size());
-
-         if (!mFile) {
-            return false;
-         }
-
-         handleCommandBuffer(buffer.data(), packet.size);
+         handleCommandBuffer(packet.data, packet.size);
          break;
       }
       case decaf::pm4::CapturePacket::RegisterSnapshot:
       {
          decaf_check((packet.size % 4) == 0);
          auto numRegisters = packet.size / 4;
-         mFile.read(reinterpret_cast<char *>(mRegisterStorage.getRawPointer()), packet.size);
+         std::memcpy(mRegisterStorage.getRawPointer(), packet.data, packet.size);
 
          // Swap it into big endian, so we can write LOAD_ commands
          for (auto i = 0u; i < numRegisters; ++i) {
@@ -87,34 +66,23 @@ ReplayParserPM4::runUntilTimestamp(uint64_t timestamp)
       }
       case decaf::pm4::CapturePacket::SetBuffer:
       {
-         decaf::pm4::CaptureSetBuffer setBuffer;
-         mFile.read(reinterpret_cast<char *>(&setBuffer), sizeof(decaf::pm4::CaptureSetBuffer));
+         if (packet.size < sizeof(decaf::pm4::CaptureSetBuffer)) {
+            return false;
+         }
 
+         auto setBuffer = decaf::pm4::CaptureSetBuffer { };
+         std::memcpy(&setBuffer, packet.data, sizeof(setBuffer));
          handleSetBuffer(setBuffer);
          mRingBuffer->waitTimestamp(mRingBuffer->flushCommandBuffer());
          break;
       }
       case decaf::pm4::CapturePacket::MemoryLoad:
       {
-         decaf::pm4::CaptureMemoryLoad load;
-         mFile.read(reinterpret_cast<char *>(&load), sizeof(decaf::pm4::CaptureMemoryLoad));
-
-         if (!mFile) {
-            return false;
-         }
-
-         buffer.resize(packet.size - sizeof(decaf::pm4::CaptureMemoryLoad));
-         mFile.read(buffer.data(), buffer.size());
-
-         if (!mFile) {
-            return false;
-         }
-
-         handleMemoryLoad(load, buffer);
+         handleMemoryLoad(packet.memoryLoad, packet.data, packet.size);
          break;
       }
       default:
-         mFile.seekg(packet.size, std::ifstream::cur);
+         break;
       }
 
       if (packet.timestamp >= timestamp) {
@@ -129,7 +97,7 @@ ReplayParserPM4::runUntilTimestamp(uint64_t timestamp)
 }
 
 bool
-ReplayParserPM4::handleCommandBuffer(void *buffer, uint32_t sizeBytes)
+ReplayParserPM4::handleCommandBuffer(const void *buffer, uint32_t sizeBytes)
 {
    auto numWords = sizeBytes / 4;
    mRingBuffer->writeBuffer(buffer, numWords);
@@ -137,7 +105,7 @@ ReplayParserPM4::handleCommandBuffer(void *buffer, uint32_t sizeBytes)
 }
 
 void
-ReplayParserPM4::handleSetBuffer(decaf::pm4::CaptureSetBuffer &setBuffer)
+ReplayParserPM4::handleSetBuffer(const decaf::pm4::CaptureSetBuffer &setBuffer)
 {
    auto isTv = (setBuffer.type == decaf::pm4::CaptureSetBuffer::TvBuffer) ? 1u : 0u;
 
@@ -239,14 +207,12 @@ ReplayParserPM4::handleRegisterSnapshot(phys_ptr<uint32_t> registers, uint32_t c
 }
 
 void
-ReplayParserPM4::handleMemoryLoad(decaf::pm4::CaptureMemoryLoad &load,
-                                  std::vector<char> &data)
+ReplayParserPM4::handleMemoryLoad(const decaf::pm4::CaptureMemoryLoad &load,
+                                  const uint8_t *data,
+                                  uint32_t size)
 {
-   std::memcpy(phys_cast<void *>(load.address).getRawPointer(),
-               data.data(), data.size());
-
-   mGraphicsDriver->notifyCpuFlush(load.address,
-                                    static_cast<uint32_t>(data.size()));
+   std::memcpy(phys_cast<void *>(load.address).getRawPointer(), data, size);
+   mGraphicsDriver->notifyCpuFlush(load.address, size);
 }
 
 bool
@@ -274,9 +240,9 @@ ReplayParserPM4::scanType3(HeaderType3 header,
 }
 
 bool
-ReplayParserPM4::scanCommandBuffer(void *words, uint32_t numWords)
+ReplayParserPM4::scanCommandBuffer(const void *words, uint32_t numWords)
 {
-   auto buffer = reinterpret_cast<be2_val<uint32_t> *>(words);
+   auto buffer = reinterpret_cast<be2_val<uint32_t> *>(const_cast<void *>(words));
    auto foundSwap = false;
 
    for (auto pos = size_t { 0u }; pos < numWords; ) {
@@ -9,7 +9,6 @@
 #include <libgpu/latte/latte_pm4.h>
 
 #include <cstdint>
-#include <fstream>
 #include <memory>
 #include <string>
 
@@ -33,18 +32,18 @@ public:
           const std::string &path);
 
 private:
-   bool handleCommandBuffer(void *buffer, uint32_t sizeBytes);
-   void handleSetBuffer(decaf::pm4::CaptureSetBuffer &setBuffer);
+   bool handleCommandBuffer(const void *buffer, uint32_t sizeBytes);
+   void handleSetBuffer(const decaf::pm4::CaptureSetBuffer &setBuffer);
    void handleRegisterSnapshot(phys_ptr<uint32_t> registers, uint32_t count);
-   void handleMemoryLoad(decaf::pm4::CaptureMemoryLoad &load, std::vector<char> &data);
+   void handleMemoryLoad(const decaf::pm4::CaptureMemoryLoad &load, const uint8_t *data, uint32_t size);
    bool scanType0(latte::pm4::HeaderType0 header, const gsl::span<be2_val<uint32_t>> &data);
    bool scanType3(latte::pm4::HeaderType3 header, const gsl::span<be2_val<uint32_t>> &data);
-   bool scanCommandBuffer(void *words, uint32_t numWords);
+   bool scanCommandBuffer(const void *words, uint32_t numWords);
 
 private:
    gpu::GraphicsDriver *mGraphicsDriver = nullptr;
    RingBuffer *mRingBuffer = nullptr;
-   std::ifstream mFile;
+   decaf::pm4::CaptureReader mReader;
 
    phys_ptr<cafe::TinyHeapPhysical> mHeap = nullptr;
    phys_ptr<uint32_t> mRegisterStorage = nullptr;